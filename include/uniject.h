@@ -8,7 +8,10 @@
 #pragma once
 
 #include "uniject/preconfig.h"
-#include <windows.h>
+
+#ifdef _WIN32
+#	include <windows.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,7 +50,13 @@ typedef __int8 _Bool;
 #endif
 
 #ifndef CDECL
-#	define CDECL __cdecl
+#	if defined(UNIJ_CC_MSVC) || defined(_WIN32)
+#		define CDECL __cdecl
+#	elif defined(UNIJ_ARCH_X86)
+#		define CDECL __attribute__(( cdecl ))
+#	else
+#		define CDECL 
+#	endif
 #endif
 
 #ifndef UNIJ_EXTERN
@@ -127,14 +136,32 @@ typedef __int8 _Bool;
  * @brief DLL import macro.
  * TODO: figure out what to use in clang and mingw
  */
-#define UNIJ_DLLIMP __declspec(dllimport)
+#if defined(_WIN32)
+#	define UNIJ_DLLIMP __declspec(dllimport)
+#else
+#	define UNIJ_DLLIMP 
+#endif
 
 /**
  * @def UNIJ_DLLEXP
  * @brief DLL export macro.
  * TODO: figure out what to use in clang and mingw
  */
-#define UNIJ_DLLEXP __declspec(dllexport)
+#if defined(_WIN32)
+#	define UNIJ_DLLEXP __declspec(dllexport)
+#else
+#	define UNIJ_DLLEXP __attribute__(( visibility("default") ))
+#endif
+
+/**
+ * @def UNIJ_FUNCTION
+ * @brief Name of the enclosing function, as a narrow string. (use %hs)
+ */
+#if defined(UNIJ_CC_MSVC) && (_MSC_VER < 1900)
+#	define UNIJ_FUNCTION __FUNCTION__
+#else
+#	define UNIJ_FUNCTION __func__
+#endif
 
 typedef struct unij_wstr unij_wstr_t;
 typedef struct unij_cstr unij_cstr_t;
@@ -181,6 +208,7 @@ static UNIJ_INLINE bool _unij_is_empty(const unij_wstr_t* value)
 }
 #endif
 
+#include "uniject/platform.h"
 #include "uniject/crt.h"
 
 #endif /* _UNIJECT_H_ */
@@ -0,0 +1,101 @@
+/**
+ * @file uniject/arena.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Bump-pointer arena allocator
+ *
+ * Allocations are carved out of large blocks in order, and are only given back all at once through
+ * \a unij_arena_reset or \a unij_arena_destroy. Freeing or resizing the most recent allocation is the one exception,
+ * which keeps growable packers from wasting space as their buffer grows.
+ *
+ * Memory handed out by an arena is always zeroed and aligned to twice the size of a pointer.
+ *
+ * Arenas are not thread-safe. When installing one as the library-wide allocator with \a unij_set_handlers, make sure
+ * no other thread is calling into the library.
+ */
+#ifndef _UNIJECT_ARENA_H_
+#define _UNIJECT_ARENA_H_
+#pragma once
+
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/packing.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Arena forward declaration
+ */
+typedef struct unij_arena unij_arena_t;
+
+/**
+ * @brief Creates an empty arena. No blocks are allocated until the first allocation.
+ * @param[in] block_size Minimum size of each block. (0 for the default) Larger allocations get a block of their own.
+ * @return NULL on failure
+ */
+unij_arena_t* unij_arena_create(size_t block_size);
+
+/**
+ * @brief Releases every block, along with the arena itself.
+ * @param A
+ */
+void unij_arena_destroy(unij_arena_t* A);
+
+/**
+ * @brief Invalidates every allocation made so far. The most recent block is kept around for reuse.
+ * @param A
+ */
+void unij_arena_reset(unij_arena_t* A);
+
+/**
+ * @brief
+ * @param A
+ * @param size
+ * @return Zeroed memory or NULL on failure.
+ */
+void* unij_arena_alloc(unij_arena_t* A, size_t size);
+
+/**
+ * @brief Resizes an allocation. Only the most recent allocation can grow in place - anything else is copied.
+ * @param A
+ * @param ptr Allocation to resize. NULL is the same as calling \a unij_arena_alloc.
+ * @param size
+ * @return The resized allocation or NULL on failure. \a ptr is left untouched on failure.
+ */
+void* unij_arena_realloc(unij_arena_t* A, void* ptr, size_t size);
+
+/**
+ * @brief Only reclaims space when \a ptr is the most recent allocation. Everything else waits for the next reset.
+ * @param A
+ * @param ptr
+ */
+void unij_arena_free(unij_arena_t* A, void* ptr);
+
+/**
+ * @brief Total bytes handed out since the arena was created or last reset. (alignment padding included)
+ * @param A
+ * @return
+ */
+size_t unij_arena_used(unij_arena_t* A);
+
+/**
+ * @brief Fills in \a procs so packers allocate their buffers from \a A.
+ * @param A
+ * @param procs
+ */
+void unij_arena_memprocs(unij_arena_t* A, unij_memprocs_t* procs);
+
+/**
+ * @brief Fills in the allocation fields of \a handlers so \a unij_set_handlers routes \a unij_alloc and \a unij_free
+ * through \a A. \a error_fn is left untouched.
+ * @param A
+ * @param handlers
+ */
+void unij_arena_handlers(unij_arena_t* A, unij_handlers_t* handlers);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _UNIJECT_ARENA_H_ */
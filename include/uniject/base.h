@@ -18,10 +18,14 @@ extern "C" {
 bool unij_init(void);
 
 typedef struct uniject uniject_t;
+typedef struct unij_arena unij_arena_t;
+typedef struct unij_handlers unij_handlers_t;
 
 uniject_t* unij_loader_open(void);
 uniject_t* unij_injector_open(uint32_t pid);
+#ifdef _WIN32
 uniject_t* unij_injector_assign(HANDLE process_handle);
+#endif
 uniject_t* unij_injector_open_params(const unij_params_t* params);
 
 // Injector REQUIRES a call to \a unij_set_assembly_path before calling \a unij_inject
@@ -29,6 +33,59 @@ void unij_set_assembly_path(uniject_t* ctx, unij_wstr_t* path);
 
 bool unij_inject(uniject_t* ctx);
 
+typedef struct unij_operation unij_operation_t;
+
+/**
+ * @brief Where an operation started by \a unij_inject_async stands.
+ */
+enum unij_operation_state
+{
+	UNIJ_OPERATION_PENDING = 0,
+	UNIJ_OPERATION_SUCCEEDED,
+	UNIJ_OPERATION_FAILED,
+	UNIJ_OPERATION_TIMED_OUT,
+	UNIJ_OPERATION_CANCELLED
+};
+
+typedef enum unij_operation_state unij_operation_state_t;
+
+/**
+ * @brief Called once per operation, as soon as it's found to no longer be pending.
+ * @param[in] op
+ * @param[in] state
+ * @param[in] status What the loader reported. \a UNIJ_ERROR_OPERATION when it never did.
+ * @param[in] user Passed through from \a unij_inject_async.
+ */
+typedef void(CDECL* unij_operation_fn)(unij_operation_t* op, unij_operation_state_t state, unij_error_t status,
+                                       void* user);
+
+// Same as \a unij_inject, but returns as soon as the loader is on its way, and the loader reports back through the
+// returned operation instead. Nothing waits on it in the background: an operation only moves on when it's polled,
+// waited on or cancelled, and \a callback gets called right there. A single thread can drive any number of them that
+// way. \a timeout is in milliseconds, or INFINITE.
+//
+// NOTE: \a ctx has to stay open until the operation is closed, and can only have one operation at a time. Timing out
+//       or cancelling only stops the waiting - the loader keeps going in the target regardless.
+unij_operation_t* unij_inject_async(uniject_t* ctx, unij_operation_fn callback, void* user, uint32_t timeout);
+
+// Checks on \a op without waiting.
+unij_operation_state_t unij_operation_poll(unij_operation_t* op);
+
+// Waits up to \a timeout milliseconds for \a op to finish, or for its own timeout to run out.
+unij_operation_state_t unij_operation_wait(unij_operation_t* op, uint32_t timeout);
+
+// Returns false when \a op had already finished.
+bool unij_operation_cancel(unij_operation_t* op);
+
+unij_error_t unij_operation_status(unij_operation_t* op);
+
+// Cancels \a op first, if it's still pending.
+void unij_operation_close(unij_operation_t* op);
+
+// Loader only: reports \a status to an injector waiting on the injection through \a unij_inject_async. Does nothing
+// for anybody else.
+void unij_loader_complete(uniject_t* ctx, unij_error_t status);
+
 // Returns a pointer to the actual params struct. Quicker than the individual unij_set_* calls, but you give up
 // the minimal safety checks in those functions.
 //
@@ -39,9 +96,13 @@ unij_params_t* unij_get_params(uniject_t* ctx);
 uint32_t unij_get_pid(uniject_t* ctx);
 uint32_t unij_get_tid(uniject_t* ctx);
 bool unij_get_debugging(uniject_t* ctx);
+bool unij_get_resident(uniject_t* ctx);
 
 // wstr params return pointers to the actual param field. It's assumed that the user won't be dumb and free or
 // modify them unnecessarily
+//
+// NOTE: On the loader side, assembly_path arrives as UTF-8, and class_name/method_name arrive combined into a method
+//       descriptor. Both are only available through the utf8 member of \a unij_get_params.
 unij_wstr_t* unij_get_mono_path(uniject_t* ctx);
 unij_wstr_t* unij_get_assembly_path(uniject_t* ctx);
 unij_wstr_t* unij_get_class_name(uniject_t* ctx);
@@ -50,16 +111,41 @@ unij_wstr_t* unij_get_log_path(uniject_t* ctx);
 
 void unij_set_tid(uniject_t* ctx, uint32_t tid);
 void unij_set_debugging(uniject_t* ctx, bool enabled);
+
+// Resident mode: the first \a unij_inject loads the loader as usual, but leaves it running a service thread in the
+// target. Later calls to \a unij_inject for the same process - from this context or a new one - are sent to that
+// thread over a channel instead of injecting the loader again.
+void unij_set_resident(uniject_t* ctx, bool enabled);
 //void unij_set_mono_path(uniject_t* ctx, unij_wstr_t* path);
 void unij_set_class_name(uniject_t* ctx, unij_wstr_t* path);
+void unij_set_method_name(uniject_t* ctx, unij_wstr_t* path);
 void unij_set_log_path(uniject_t* ctx, unij_wstr_t* path);
 void unij_set_loader_path(uniject_t* ctx, unij_wstr_t* path);
 
+/**
+ * @brief Hands ownership of \a arena to \a ctx. Strings stored in the context's params are moved into the arena, as
+ * are any set afterwards, and \a unij_close releases all of them at once by destroying the arena. Only those strings
+ * live in it: the context itself, its IPC object names and its scratch buffers are still allocated with \a unij_alloc.
+ * @param ctx 
+ * @param arena 
+ * @return 
+ */
+bool unij_set_arena(uniject_t* ctx, unij_arena_t* arena);
+
 void unij_close(uniject_t* ctx);
 
 /**
- * @brief Future site of the user-overridable handlers declaration.
- * TODO: Allow overriding various handlers in one go.
+ * @brief Installs application handlers for the whole library. Passing NULL restores the defaults.
+ * 
+ * Allocators must be swapped while nothing allocated with the previous ones is still alive, since \a unij_free
+ * always goes through whichever \a free_fn is current.
+ * @param handlers Copied - doesn't need to outlive the call. \a alloc_fn and \a free_fn must be set together.
+ * @return 
+ */
+bool unij_set_handlers(const unij_handlers_t* handlers);
+
+/**
+ * @brief User-overridable handlers. See \a unij_set_handlers.
  */
 struct unij_handlers
 {
@@ -69,7 +155,8 @@ struct unij_handlers
 	void* context;
 	
 	/**
-	 * @brief Should point to an application callback for handling memory allocations.
+	 * @brief Should point to an application callback for handling memory allocations. The returned memory doesn't
+	 * need to be zeroed - \a unij_alloc takes care of that.
 	 * @param[in] context Context context - read from the field above.
 	 * @param[in] size The requested size of the allocation. (byte count)
 	 * @return A newly allocated buffer or NULL in the case of failure.
@@ -85,7 +172,7 @@ struct unij_handlers
 	void(CDECL* free_fn)(void* context, void* ptr);
 	
 	/**
-	 * @brief Should point to an application callback for handling errors.
+	 * @brief Optional. Called with every fatal error, right before the abort handler.
 	 * @param[in] context Context context - read from the field above.
 	 * @param[in] code Relevant error code
 	 * @param[in] message Relevant error message
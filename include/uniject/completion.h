@@ -0,0 +1,66 @@
+/**
+ * @file uniject/completion.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief How a loader reports back to an injector that isn't blocked on it
+ *
+ * The injector creates a small mapping and an event, both named after the injection's pid and nonce, and flags the
+ * handoff block so the loader knows to look for them. Once the loader is done, however that went, it writes its
+ * status into the mapping and sets the event. Checking on an injection is a single load from the mapping, so one
+ * thread can keep track of any number of them, and only has to sleep on the event when it wants to wait for one.
+ */
+#ifndef _UNIJECT_COMPLETION_H_
+#define _UNIJECT_COMPLETION_H_
+#pragma once
+
+#include <uniject.h>
+#include <uniject/error.h>
+#include <uniject/handoff.h>
+#include <uniject/platform.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct unij_completion unij_completion_t;
+
+/**
+ * @brief Injector only: creates the completion objects for the injection \a handoff describes, and flags the block.
+ * Has to happen before the block is written into the target.
+ * @param[in,out] handoff
+ * @return
+ */
+unij_completion_t* unij_completion_create(unij_handoff_t* handoff);
+
+/**
+ * @brief Checks whether the loader has reported back yet, without waiting.
+ * @param[in] completion
+ * @param[out] pstatus The loader's status, once it has reported.
+ * @return
+ */
+bool unij_completion_check(unij_completion_t* completion, unij_error_t* pstatus);
+
+/**
+ * @brief Waits for the loader to report back.
+ * @param[in] completion
+ * @param[in] timeout Milliseconds, or INFINITE.
+ * @param[out] pstatus The loader's status, once it has reported.
+ * @return
+ */
+unij_wait_t unij_completion_wait(unij_completion_t* completion, uint32_t timeout, unij_error_t* pstatus);
+
+void unij_completion_close(unij_completion_t* completion);
+
+/**
+ * @brief Loader only: reports \a status to the injector behind \a handoff. Does nothing for injections that weren't
+ * flagged with \a UNIJ_HANDOFF_COMPLETION, so it's safe to call for every one of them.
+ * @param[in] handoff
+ * @param[in] status
+ * @return false if the injector was waiting, but couldn't be told.
+ */
+bool unij_completion_signal(const unij_handoff_t* handoff, unij_error_t status);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _UNIJECT_COMPLETION_H_ */
@@ -15,6 +15,8 @@
 extern "C" {
 #endif
 
+#ifdef _WIN32
+
 #ifdef RtlFillMemory
 #	pragma push_macro("RtlFillMemory")
 #	undef RtlFillMemory
@@ -59,6 +61,17 @@ UNIJ_DLLIMP void WINAPI RtlCopyMemory(PVOID, const VOID*, SIZE_T);
 #define RtlCopyMemory RtlMoveMemory 
 #endif
 
+#else
+
+// Nothing to avoid elsewhere, so these just go to the C library.
+#define RtlFillMemory(DEST,SIZE,FILL) memset((DEST), (FILL), (SIZE))
+#define RtlZeroMemory(DEST,SIZE) memset((DEST), 0, (SIZE))
+#define RtlMoveMemory(DEST,SRC,SIZE) memmove((DEST), (SRC), (SIZE))
+#define RtlCopyMemory(DEST,SRC,SIZE) memcpy((DEST), (SRC), (SIZE))
+#define RtlEqualMemory(A,B,SIZE) (memcmp((A), (B), (SIZE)) == 0)
+
+#endif /* _WIN32 */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,105 @@
+/**
+ * @file uniject/elffile.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Dynamic symbol lookups straight from ELF shared objects on disk
+ *
+ * The ELF counterpart of uniject/pefile.h. Lookups go through the same tables the dynamic linker uses - found through
+ * PT_DYNAMIC, so stripped section headers don't matter - preferring .gnu.hash and falling back to .hash. Nothing is
+ * ever loaded, so symbols can be resolved for a library that only the target has mapped, and adding the result to
+ * the start of the library's mapping in the target's /proc/pid/maps gives the remote address without running any code
+ * there. Both classes are handled regardless of our own, but only little-endian files.
+ */
+#ifndef _UNIJECT_ELFFILE_H_
+#define _UNIJECT_ELFFILE_H_
+#pragma once
+
+#include <uniject.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct unij_elffile unij_elffile_t;
+
+/**
+ * @brief Which hash table lookups go through.
+ */
+enum unij_elfhash
+{
+	// No usable hash table, so nothing can be looked up.
+	UNIJ_ELF_HASH_NONE = 0,
+	UNIJ_ELF_HASH_SYSV,
+	UNIJ_ELF_HASH_GNU
+};
+
+typedef enum unij_elfhash unij_elfhash_t;
+
+/**
+ * @brief Maps the file at \a path and validates its headers and dynamic section.
+ * @param path
+ * @return NULL if the file can't be opened or isn't a little-endian ELF file with a dynamic section.
+ */
+unij_elffile_t* unij_elffile_open(const wchar_t* path);
+
+/**
+ * @brief Same as \a unij_elffile_open, for a file that's already in memory. \a data needs to outlive the returned
+ * handle.
+ * @param data
+ * @param size
+ * @return
+ */
+unij_elffile_t* unij_elffile_open_memory(const void* data, size_t size);
+
+/**
+ * @brief Unmaps the file, if it was mapped by \a unij_elffile_open, and frees the handle.
+ * @param elf
+ */
+void unij_elffile_close(unij_elffile_t* elf);
+
+/**
+ * @brief 32 for ELFCLASS32 files and 64 for ELFCLASS64.
+ * @param elf
+ * @return
+ */
+int unij_elffile_bits(const unij_elffile_t* elf);
+
+/**
+ * @brief EM_* value from the file header.
+ * @param elf
+ * @return
+ */
+uint16_t unij_elffile_machine(const unij_elffile_t* elf);
+
+/**
+ * @brief Which hash table the file's lookups go through.
+ * @param elf
+ * @return
+ */
+unij_elfhash_t unij_elffile_hash(const unij_elffile_t* elf);
+
+/**
+ * @brief Translates a virtual address, as the file's own tables use them, to a pointer into the file.
+ * @param elf
+ * @param vaddr
+ * @param size Bytes that need to be readable from the returned pointer.
+ * @return NULL if any of the range isn't backed by the file.
+ */
+const void* unij_elffile_vaddr_to_data(const unij_elffile_t* elf, uint64_t vaddr, size_t size);
+
+/**
+ * @brief Looks up the defined function or object named \a name. Where a name has several versions, the default one
+ * wins, the same as it would for dlsym.
+ * @param elf
+ * @param name
+ * @param[out] poffset Offset of the symbol from where the start of the file gets mapped. For an indirect function,
+ * that's its resolver.
+ * @param[out] pvaddr Optional. The symbol's value, for use with \a unij_elffile_vaddr_to_data.
+ * @return false if there's no such symbol.
+ */
+bool unij_elffile_symbol(const unij_elffile_t* elf, const char* name, uint64_t* poffset, uint64_t* pvaddr);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _UNIJECT_ELFFILE_H_ */
@@ -97,7 +97,7 @@ enum unij_error
 	/**
 	 * @brief Win32 System Error
 	 * Indicates that a Win32 API call failed, and that the system
-	 * error code can be retrieved with a call to GetLastError.
+	 * error code can be retrieved with a call to GetLastError. (errno elsewhere, see unij_last_error)
 	 */
 	UNIJ_ERROR_LASTERROR = -1
 };
@@ -163,7 +163,7 @@ void unij_show_message(unij_level_t level, const wchar_t* format, ...);
  * @param[in] ... Var args for \a format 
  */
 #define unij_show_error_message(format,...) \
-	unij_show_message(UNIJ_LEVEL_ERROR, UNIJ_TRACE_PREFIX(format), __VA_ARGS__ )
+	unij_show_message(UNIJ_LEVEL_ERROR, UNIJ_TRACE_PREFIX(format), ##__VA_ARGS__ )
 
 /**
  * @brief Fatal error message
@@ -189,7 +189,7 @@ static UNIJ_INLINE void unij_abort(unij_error_t code)
 {
 	uint32_t win32_error = ERROR_SUCCESS;
 	if(code == UNIJ_ERROR_LASTERROR)
-		win32_error = GetLastError();
+		win32_error = unij_last_error();
 	unij_abort_impl(code, win32_error);
 }
 
@@ -201,11 +201,11 @@ static UNIJ_INLINE void unij_abort(unij_error_t code)
 #define unij_fatal_call(FUNC) \
 	unij_fatal_error( \
 		UNIJ_ERROR_LASTERROR, \
-		L"%s: Failed call at %s:%s:%s", \
+		L"%ls: Failed call at %ls:%ls:%hs", \
 		UNIJ_WSTRINGIFY(FUNC), \
 		UNIJ_WIDEN(__FILE__), \
 		UNIJ_WSTRINGIFY(__LINE__), \
-		__FUNCTIONW__ \
+		UNIJ_FUNCTION \
 	)
 
 #ifdef __cplusplus
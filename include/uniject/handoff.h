@@ -0,0 +1,77 @@
+/**
+ * @file uniject/handoff.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Per-injection object names and the block that hands them to the loader
+ * 
+ * Every injection picks a fresh nonce, and the objects it creates for the loader are named after the target pid plus
+ * that nonce. Injections never share a name that way, so any number of them can be in flight at once, into the same
+ * process or different ones. The loader can't derive the nonce on its own, so the injector writes a handoff block
+ * into the target alongside the code that loads it, and the loader reads its names from there.
+ * 
+ * A nonce of 0 names the objects that are only ever created once per target, like the command channel.
+ * 
+ * Where the platform allows it, the params mapping skips naming altogether: the injector creates it unnamed, and the
+ * block says which process holds it and under what id, so the loader can pull it straight out of the injector.
+ */
+#ifndef _UNIJECT_HANDOFF_H_
+#define _UNIJECT_HANDOFF_H_
+#pragma once
+
+#include <uniject.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UNIJ_HANDOFF_MAGIC 0x4F484E55 /* UNHO */
+
+// The injector is waiting on a completion object for this injection. (see uniject/completion.h)
+#define UNIJ_HANDOFF_COMPLETION 0x00000001
+
+typedef struct unij_handoff unij_handoff_t;
+
+/**
+ * @brief Handoff block. Only fixed-size fields, so it reads the same from 32-bit and 64-bit processes.
+ */
+struct unij_handoff
+{
+	uint32_t magic;
+	uint32_t size;
+	uint32_t pid;
+	uint32_t nonce;
+	
+	// Process holding the params mapping and what it exported it as. (see unij_reserve_unnamed_mmap) An owner of 0
+	// means the mapping has a name instead.
+	uint32_t owner;
+	uint32_t mapping;
+	
+	// UNIJ_HANDOFF_* flags.
+	uint32_t flags;
+};
+
+/**
+ * @brief Generates a nonce for a new injection. Never returns 0, and never returns the same value twice within a
+ * process. Nonces from different processes are only very unlikely to collide, so object creation still has to check.
+ * @return
+ */
+uint32_t unij_object_nonce(void);
+
+/**
+ * @brief Fills in a handoff block for a new injection into \a pid.
+ * @param[out] handoff
+ * @param[in] pid
+ */
+void unij_handoff_init(unij_handoff_t* handoff, uint32_t pid);
+
+/**
+ * @brief Validates a handoff block read from memory the loader doesn't otherwise trust.
+ * @param[in] handoff
+ * @return
+ */
+bool unij_handoff_valid(const unij_handoff_t* handoff);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _UNIJECT_HANDOFF_H_ */
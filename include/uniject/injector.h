@@ -9,6 +9,7 @@
 
 #include <uniject.h>
 #include <uniject/error.h>
+#include <uniject/handoff.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,13 +18,61 @@ extern "C" {
 typedef struct unij_process unij_process_t;
 typedef void(CDECL* unij_hijack_fn)(void* param);
 
+#ifdef _WIN32
 bool unij_hijack_thread(HANDLE thread, unij_hijack_fn fn, void* param);
 bool unij_hijack_thread_id(uint32_t tid, unij_hijack_fn fn, void* param);
-bool unij_inject_loader_ex(unij_process_t* process, unij_wstr_t* loader);
+#endif
+
+/**
+ * @brief Injects the loader into \a process.
+ * @param process
+ * @param loader Loader dll path. Resolved next to the executable when empty.
+ * @param handoff Written into the target right in front of the injected code. When NULL, the loader falls back to
+ * the per-process object names.
+ * @return
+ */
+bool unij_inject_loader_ex(unij_process_t* process, unij_wstr_t* loader, const unij_handoff_t* handoff);
+
+/**
+ * @brief Injection started by \a unij_inject_loader_start. On Windows, the remote thread runs all of DllMain, so it can
+ * keep going long after the start returns. On Linux, the stub has already returned by then.
+ */
+typedef struct unij_injection unij_injection_t;
+
+/**
+ * @brief Same as \a unij_inject_loader_ex, but returns as soon as the injected code is running.
+ * @param process Has to outlive the injection.
+ * @param loader
+ * @param handoff
+ * @return
+ */
+unij_injection_t* unij_inject_loader_start(unij_process_t* process, unij_wstr_t* loader, const unij_handoff_t* handoff);
+
+/**
+ * @brief Waits for the injected code to finish.
+ * @param injection
+ * @param timeout Milliseconds, or INFINITE. 0 only checks.
+ * @param[out] presult Whether the loader got loaded, once finished.
+ * @return
+ */
+unij_wait_t unij_injection_wait(unij_injection_t* injection, uint32_t timeout, bool* presult);
+
+/**
+ * @brief Releases \a injection. Code that's still running in the target stays allocated there.
+ * @param injection
+ */
+void unij_injection_close(unij_injection_t* injection);
+
+/**
+ * @brief Loader only: reads the handoff block the injector left in front of the current thread's entrypoint.
+ * @param[out] handoff
+ * @return false when the current thread wasn't started by \a unij_inject_loader_ex.
+ */
+bool unij_loader_handoff(unij_handoff_t* handoff);
 
 static UNIJ_INLINE bool unij_inject_loader(unij_process_t* process)
 {
-	return unij_inject_loader_ex(process, NULL);
+	return unij_inject_loader_ex(process, NULL, NULL);
 }
 
 #ifdef __cplusplus
@@ -3,6 +3,11 @@
  * @author Charles Grunwald <ch@rles.rocks>
  * @brief Interprocess communication layer
  * 
+ * By default, an IPC context is a one-shot mailbox: the writer packs once into a fresh mapping and the reader
+ * unpacks once. Calling \a unij_ipc_channel_open instead turns it into a persistent channel, where packed messages
+ * flow through a pair of ring buffers in the mapping (commands from the writer, replies from the reader) for as long
+ * as both sides keep it open.
+ * 
  * TODO: Possibly have the reader wait on an event that signals the writer's completion.
  */
 #ifndef _UNIJECT_IPC_H_
@@ -10,6 +15,7 @@
 #pragma once
 
 #include <uniject.h>
+#include <uniject/handoff.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,6 +30,7 @@ typedef struct unij_ipc unij_ipc_t;
 typedef struct uniject uniject_t;
 typedef struct unij_packer unij_packer_t;
 typedef struct unij_unpacker unij_unpacker_t;
+typedef enum unij_layout unij_layout_t;
 
 typedef void (CDECL *unij_reserve_fn)(unij_packer_t* P, const void* data);
 typedef bool (CDECL *unij_pack_fn)(unij_packer_t* P, const void* data);
@@ -36,6 +43,19 @@ bool unij_ipc_open(uniject_t* ctx);
 unij_ipc_t* unij_ipc_writer_open(uint32_t pid, const wchar_t* key);
 unij_ipc_t* unij_ipc_reader_open(const wchar_t* key);
 
+/**
+ * @brief Custom IPC openers that go through a handoff block, like standard contexts do. The writer's mapping gets
+ * handed to the reader through the block where possible (see unij_reserve_unnamed_mmap), and is named after the
+ * block's pid and nonce otherwise. Either way, the writer fills the block in and it needs to outlive the context.
+ * The reader has to be the process the block was made for.
+ */
+unij_ipc_t* unij_ipc_handoff_writer_open(unij_handoff_t* handoff, const wchar_t* key);
+unij_ipc_t* unij_ipc_handoff_reader_open(const unij_handoff_t* handoff, const wchar_t* key);
+
+// Standard channel openers: the request channel between an injector and a resident loader. (already in channel mode)
+unij_ipc_t* unij_ipc_channel_writer_open(uint32_t pid);
+unij_ipc_t* unij_ipc_channel_reader_open(void);
+
 /**
  * @brief Destroy IPC context. (works for both standard and custom variations) 
  * @param ctx 
@@ -43,14 +63,24 @@ unij_ipc_t* unij_ipc_reader_open(const wchar_t* key);
 void unij_ipc_close(unij_ipc_t* ipc);
 
 /* For overriding default params struct */
+/* Custom payloads can generate matching handlers from a field list with uniject/schema.h */
 
 /**
- * @brief Writer only: override the default data reserve handler
+ * @brief Writer only: set a data reserve handler. Writers pack in a single pass by default - setting a reserve
+ * handler switches \a unij_ipc_pack back to the reserve/commit/pack protocol.
  * @param ipc 
  * @param fn 
  */
 void unij_ipc_set_reserve_fn(unij_ipc_t* ipc, unij_reserve_fn fn);
 
+/**
+ * @brief Writer only: set the layout of the packed data. Readers detect it on their own. Indexed layouts are always
+ * packed in a single pass, so any reserve handler is ignored.
+ * @param ipc 
+ * @param layout 
+ */
+void unij_ipc_set_layout(unij_ipc_t* ipc, unij_layout_t layout);
+
 /**
  * @brief Writer only: override the default data packing handler
  * @param ipc 
@@ -66,7 +96,7 @@ void unij_ipc_set_pack_fn(unij_ipc_t* ipc, unij_pack_fn fn);
 void unij_ipc_set_unpack_fn(unij_ipc_t* ipc, unij_unpack_fn fn);
 
 /**
- * @brief Writer only: will use the set reverse/pack functions or fallback to those declared in params.h
+ * @brief Writer only: will use the set reserve/pack functions or fallback to those declared in params.h
  * @param ipc 
  * @param data 
  * @return 
@@ -74,13 +104,77 @@ void unij_ipc_set_unpack_fn(unij_ipc_t* ipc, unij_unpack_fn fn);
 bool unij_ipc_pack(unij_ipc_t* ipc, const void* data);
 
 /**
- * @brief Reader only: will use the set unpack function or fallback to the one declared in params.h
+ * @brief Reader only: will use the set unpack function or fallback to \a unij_unpack_params, which copies the strings
+ * out of the mapping. Whatever a borrowing handler like \a unij_unpack_params_view points into the mapping stays
+ * valid until the context is closed. (\a unij_loader_open uses that one)
  * @param ipc 
  * @param data 
  * @return 
  */
 bool unij_ipc_unpack(unij_ipc_t* ipc, void* dest);
 
+/* Persistent channel */
+
+/**
+ * @brief Switches the context over to channel mode. The writer creates the channel's mapping, so it has to open its
+ * side first. Can't be mixed with \a unij_ipc_pack / \a unij_ipc_unpack on the same context.
+ * 
+ * If a reader is still holding the channel open from an earlier writer, a new writer picks up where the last one left
+ * off. Only one writer can have the channel open at a time. Another one is refused, unless the process holding it
+ * is gone.
+ * @param ipc 
+ * @return 
+ */
+bool unij_ipc_channel_open(unij_ipc_t* ipc);
+
+/**
+ * @brief Reader only: advertises whether this process is currently serving requests on the channel.
+ * @param ipc 
+ * @param listening 
+ */
+void unij_ipc_set_listening(unij_ipc_t* ipc, bool listening);
+
+/**
+ * @brief Process id of the reader serving requests on the channel, or 0 when nothing is listening.
+ * @param ipc 
+ * @return 
+ */
+uint32_t unij_ipc_listener(unij_ipc_t* ipc);
+
+/**
+ * @brief Packs a message and queues it for the other side. Writers send commands and readers send replies.
+ * @param ipc 
+ * @param fn Pack handler for the message. NULL uses the writer's pack handler. (see \a unij_ipc_set_pack_fn)
+ * @param data 
+ * @return false on failure, or when the channel is full. Nothing is sent in either case.
+ */
+bool unij_ipc_send(unij_ipc_t* ipc, unij_pack_fn fn, const void* data);
+
+/**
+ * @brief Checks whether a message from the other side is waiting to be received.
+ * @param ipc 
+ * @return 
+ */
+bool unij_ipc_pending(unij_ipc_t* ipc);
+
+/**
+ * @brief Waits until a message from the other side is pending.
+ * @param ipc 
+ * @param timeout In milliseconds. (INFINITE to wait forever)
+ * @return false on failure, or when \a timeout elapses first.
+ */
+bool unij_ipc_wait(unij_ipc_t* ipc, uint32_t timeout);
+
+/**
+ * @brief Unpacks the oldest message from the other side and removes it from the channel.
+ * Its memory is handed back to the sender right afterwards, so \a fn has to copy anything it keeps. (no views)
+ * @param ipc 
+ * @param fn Unpack handler for the message. NULL uses the reader's unpack handler. (see \a unij_ipc_set_unpack_fn)
+ * @param dest 
+ * @return false on failure, or when no message is pending.
+ */
+bool unij_ipc_receive(unij_ipc_t* ipc, unij_unpack_fn fn, void* dest);
+
 #ifdef __cplusplus
 };
 #endif
@@ -0,0 +1,116 @@
+/**
+ * @file uniject/modcache.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Process-wide cache of module export lookups
+ *
+ * Maps a (module path, symbol) key to whatever the lookup produced, usually an RVA, with 0 for symbols that aren't
+ * there. Every entry remembers the identity of the file it was computed from, so a module that has been replaced
+ * since just misses. The cache starts out in memory, and can be moved into a file so later runs start out warm.
+ *
+ * Entries are written with plain stores, without locks or atomics. The checksum is the only protection against torn
+ * entries: a reader that catches one halfway through an update sees it fail its checksum and treats it as a miss, so
+ * the worst a race can do is cost a lookup.
+ */
+#ifndef _UNIJECT_MODCACHE_H_
+#define _UNIJECT_MODCACHE_H_
+#pragma once
+
+#include <uniject.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct unij_file_identity unij_file_identity_t;
+
+/**
+ * @brief What a cached entry gets validated against.
+ */
+struct unij_file_identity
+{
+	uint64_t size;
+	uint64_t mtime;
+	// File index/inode where the platform has one that's cheap to get, 0 otherwise.
+	uint64_t file_id;
+};
+
+#ifdef _WIN32
+
+/**
+ * @brief Fills in \a identity for the file at \a path without opening it.
+ * @param path
+ * @param[out] identity
+ * @return
+ */
+bool unij_file_identity(const wchar_t* path, unij_file_identity_t* identity);
+
+#else
+
+/**
+ * @brief Fills in \a identity for an open file.
+ * @param fd
+ * @param[out] identity
+ * @return
+ */
+bool unij_file_identity_fd(int fd, unij_file_identity_t* identity);
+
+#endif
+
+/**
+ * @brief Builds the key for a lookup of \a symbol in the module at \a path. Never 0.
+ * @param path Path in whatever encoding the platform uses.
+ * @param size Size of \a path in bytes.
+ * @param symbol
+ * @return
+ */
+uint64_t unij_modcache_key(const void* path, size_t size, const char* symbol);
+
+/**
+ * @brief \a unij_modcache_key for lookups whose result also depends on the bitness of the target, like the loader entry
+ * point of a system library. Injections resolve that for every target, so it's only parsed out of each build of the
+ * library once.
+ * @param bits
+ * @param path
+ * @param size
+ * @param symbol
+ * @return
+ */
+uint64_t unij_modcache_key_bits(int bits, const void* path, size_t size, const char* symbol);
+
+/**
+ * @brief Looks up \a key.
+ * @param key
+ * @param identity Identity of the file as it is now.
+ * @param[out] pvalue
+ * @return false on a miss, including when the entry was computed from a different file.
+ */
+bool unij_modcache_get(uint64_t key, const unij_file_identity_t* identity, uint64_t* pvalue);
+
+/**
+ * @brief Stores the result of a lookup, evicting an older entry if there's no room.
+ * @param key
+ * @param identity
+ * @param value
+ */
+void unij_modcache_put(uint64_t key, const unij_file_identity_t* identity, uint64_t value);
+
+/**
+ * @brief Moves the cache into the file at \a path, which is created if needed. Entries already in the file are kept
+ * and the ones in memory are added to them. Meant to be called once, before anything is looked up from another thread.
+ * @param path
+ * @return false if the file can't be used, in which case the cache stays in memory.
+ */
+bool unij_modcache_persist(const wchar_t* path);
+
+/**
+ * @brief Lookup counts since the process started, for reporting.
+ * @param[out] phits
+ * @param[out] pmisses
+ */
+void unij_modcache_stats(uint32_t* phits, uint32_t* pmisses);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _UNIJECT_MODCACHE_H_ */
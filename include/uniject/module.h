@@ -62,6 +62,15 @@ bool unij_system_module_path(wchar_t* buffer, uint32_t* psize, const wchar_t* mo
  */
 uint32_t unij_get_proc_rva(const wchar_t* module, const char* proc);
 
+/**
+ * @brief \a unij_get_proc_rva, going through the module cache. (see uniject/modcache.h) Missing exports are cached
+ * too, since most modules that get probed don't have the export being looked for.
+ * @param module 
+ * @param proc 
+ * @return 
+ */
+uint32_t unij_get_proc_rva_cached(const wchar_t* module, const char* proc);
+
 #ifdef __cplusplus
 };
 #endif
@@ -9,11 +9,21 @@
  * Data is packed into the buffer with no concern for alignment. Numeric types occupy the full size of their
  * type, (ex: 32-bit integer will always be 4 bytes) using the system's native byte order. Strings/bytes are prefixed
  * with a 16-bit unsigned integer containing their lengths. None of the data I'm working with should ever come anywhere
- * close to overflowing that, so that's what we'll go with for now.
+ * close to overflowing that, so that's what we'll go with for now. Non-empty strings are followed by a terminating
+ * null character, which isn't counted in their length.
  * 
  * Data is unpacked in the same order that it was packed. Numeric types are copied from the buffer. The structs used
- * in unpacking strings/bytes point directly to the string in the buffer, so the calling code should immediately copy
- * the data into its own storage. Unpacked strings will not contain a trailing zero, s
+ * in unpacking strings/bytes point directly to the string in the buffer, so they're only valid for as long as the
+ * buffer is. Since the terminator is packed along with them, these borrowed strings can be handed straight to APIs
+ * that expect null-terminated strings. Use \a unij_unpack_wstrdup when the data has to outlive the buffer.
+ * 
+ * Growable packers can opt into \a UNIJ_LAYOUT_INDEXED instead. Every pack call becomes a field that starts on an
+ * 8-byte boundary, and an offset table is appended when the packer is finished. The unpacker picks the layout up from
+ * the buffer's header, so the same unpacking code works for both, and \a unij_unpacker_field can jump straight to any
+ * field of an indexed buffer.
+ * 
+ * The top 16 bits of the leading size word hold the layout. Indexed buffers follow it with two 32-bit integers: the
+ * offset of the table and its entry count.
  */
 #ifndef _UNIJECT_PACKING_H_
 #define _UNIJECT_PACKING_H_
@@ -37,6 +47,7 @@ extern "C" {
 // TODO: Make the buffer mechanic a bit more consistent across the two different context types
 
 typedef void*(CDECL* unij_alloc_fn)(void* parameter, size_t size);
+typedef void*(CDECL* unij_realloc_fn)(void* parameter, void* ptr, size_t size);
 typedef void(CDECL* unij_free_fn)(void* parameter, void* ptr);
 
 /**
@@ -64,6 +75,16 @@ struct unij_memprocs
 	 * @param[in] size The size of our allocation
 	 */
 	unij_free_fn free_fn;
+	
+	/**
+	 * @brief Optional. Used by growable packers to resize their buffer. When NULL, growing falls back to
+	 * \a alloc_fn + copy + \a free_fn.
+	 * @param[in] parameter Context parameter - read from the field above.
+	 * @param[in] ptr The buffer previously returned by \a alloc_fn or \a realloc_fn.
+	 * @param[in] size The new size of the buffer. (byte count) Always larger than the current size.
+	 * @return The resized buffer (may be moved) or NULL in the case of failure. On failure, \a ptr is still valid.
+	 */
+	unij_realloc_fn realloc_fn;
 };
 
 /**
@@ -78,6 +99,20 @@ typedef struct unij_unpacker unij_unpacker_t;
 
 typedef struct unij_memprocs unij_memprocs_t;
 
+/**
+ * @brief Packed buffer layouts.
+ */
+enum unij_layout
+{
+	/// Fields packed back to back. Only readable in order.
+	UNIJ_LAYOUT_SEQUENTIAL = 0,
+	
+	/// Aligned fields followed by an offset table. Readable in order or by field index.
+	UNIJ_LAYOUT_INDEXED
+};
+
+typedef enum unij_layout unij_layout_t;
+
 /**
  * @brief 
  * @param[in] procs
@@ -85,6 +120,24 @@ typedef struct unij_memprocs unij_memprocs_t;
  */
 unij_packer_t* unij_packer_create(unij_memprocs_t* procs);
 
+/**
+ * @brief Creates a single-pass packer. Data is packed immediately with no reservation step, and the buffer grows
+ * geometrically as needed. Call \a unij_packer_finish once all data has been packed.
+ * @param[in] procs Memory routines used for the packed buffer. \a realloc_fn is used for growing when set.
+ * @param[in] hint Expected payload size in bytes. (0 if unknown) Sizing this right avoids any regrowth.
+ * @return NULL on failure
+ */
+unij_packer_t* unij_packer_create_growable(unij_memprocs_t* procs, size_t hint);
+
+/**
+ * @brief Growable packers only: selects the layout of the packed buffer. Must be called before any data is packed.
+ * The layout survives a call to \a unij_packer_reset.
+ * @param P 
+ * @param layout 
+ * @return 
+ */
+bool unij_packer_set_layout(unij_packer_t* P, unij_layout_t layout);
+
 /**
  * @brief 
  * @param P 
@@ -111,6 +164,22 @@ size_t unij_packer_get_size(unij_packer_t* P);
  */
 const void* unij_packer_get_buffer(unij_packer_t* P);
 
+/**
+ * @brief Growable packers only: writes the size header and locks the buffer against further packing.
+ * @param P 
+ * @return 
+ */
+bool unij_packer_finish(unij_packer_t* P);
+
+/**
+ * @brief Hands ownership of the packed buffer to the caller. The packer no longer frees it on reset/destroy, so
+ * the caller is responsible for releasing it through the same \a unij_memprocs_t it was allocated with.
+ * @param[in] P Packer in packing mode. (committed or finished)
+ * @param[out] psize Optional - receives the size of the packed data.
+ * @return The packed buffer or NULL on failure.
+ */
+void* unij_packer_release(unij_packer_t* P, size_t* psize);
+
 // "Reservation" mode functions
 
 /**
@@ -127,6 +196,20 @@ void unij_reserve(unij_packer_t* P, size_t size);
  */
 void unij_reserve_wstr(unij_packer_t* P, const unij_wstr_t* data);
 
+/**
+ * @brief 
+ * @param P 
+ * @param data 
+ */
+void unij_reserve_cstr(unij_packer_t* P, const unij_cstr_t* data);
+
+/**
+ * @brief Reserves space for a wstr packed with \a unij_pack_wstr_utf8.
+ * @param P 
+ * @param data 
+ */
+void unij_reserve_wstr_utf8(unij_packer_t* P, const unij_wstr_t* data);
+
 /**
  * @brief 
  * @param P 
@@ -134,7 +217,7 @@ void unij_reserve_wstr(unij_packer_t* P, const unij_wstr_t* data);
  */
 bool unij_packer_commit(unij_packer_t* P);
 
-// "Packing Mode" functions
+// "Packing Mode" functions - also used directly on growable packers.
 
 /**
  * @brief 
@@ -153,6 +236,38 @@ bool unij_pack(unij_packer_t* P, const void* data, size_t size);
  */
 bool unij_pack_wstr(unij_packer_t* P, const unij_wstr_t* data);
 
+/**
+ * @brief Packs a UTF-8 string. Same wire format as \a unij_pack_wstr, with the length counted in bytes.
+ * @param P 
+ * @param data 
+ * @return 
+ */
+bool unij_pack_cstr(unij_packer_t* P, const unij_cstr_t* data);
+
+/**
+ * @brief Packs a wide string as UTF-8, transcoding straight into the packer's buffer. Unpack with
+ * \a unij_unpack_cstr.
+ * @param P 
+ * @param data 
+ * @return 
+ */
+bool unij_pack_wstr_utf8(unij_packer_t* P, const unij_wstr_t* data);
+
+/**
+ * @brief Number of bytes \a unij_pack_wstr_utf8 will pack for the characters of \a data. (terminator included,
+ * length prefix excluded)
+ * @param data 
+ * @return 
+ */
+size_t unij_wstr_utf8_size(const unij_wstr_t* data);
+
+/**
+ * @brief Size of a packed buffer, as recorded in its header. (header included)
+ * @param buffer 
+ * @return 
+ */
+size_t unij_packed_size(const void* buffer);
+
 /**
  * @brief 
  * @param buffer 
@@ -166,6 +281,22 @@ unij_unpacker_t* unij_unpacker_create(const void* buffer);
  */
 void unij_unpacker_destroy(unij_unpacker_t* U);
 
+/**
+ * @brief Number of fields in an indexed buffer. Always 0 for sequential buffers.
+ * @param U 
+ * @return 
+ */
+size_t unij_unpacker_field_count(unij_unpacker_t* U);
+
+/**
+ * @brief Indexed buffers only: positions the unpacker at the start of a field, so the next unpack call reads it.
+ * Fields are numbered in the order they were packed, starting from 0.
+ * @param U 
+ * @param index 
+ * @return 
+ */
+bool unij_unpacker_field(unij_unpacker_t* U, size_t index);
+
 /**
  * @brief 
  * @param U 
@@ -198,6 +329,22 @@ bool unij_unpack(unij_unpacker_t* U, void* dest, size_t size);
  */
 bool unij_unpack_wstr(unij_unpacker_t* U, unij_wstr_t* dest);
 
+/**
+ * @brief 
+ * @param U 
+ * @param dest 
+ * @return 
+ */
+bool unij_unpack_cstr(unij_unpacker_t* U, unij_cstr_t* dest);
+
+/**
+ * @brief Same as \a unij_unpack_cstr, but allocates a copy of the string with a terminating null character.
+ * @param U 
+ * @param dest 
+ * @return 
+ */
+bool unij_unpack_cstrdup(unij_unpacker_t* U, unij_cstr_t* dest);
+
 /**
  * @brief Same as \a unij_unpack_wstr, but allocates a copy of the string with a terminating null character.
  * @param U 
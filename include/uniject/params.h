@@ -22,25 +22,78 @@ struct unij_params
 	uint32_t pid;
 	uint32_t tid;
 	
+	// Set by the injector on each request to a resident loader, which echoes it back in its status reply.
+	uint32_t request;
+	
 	// Flags
 	bool debugging : 1;
 	
+	// Keep the loader resident after the first injection, so later injections are just requests over a channel.
+	bool resident : 1;
+	
 	// Strings
 	unij_wstr_t mono_path;
 	unij_wstr_t assembly_path;
 	unij_wstr_t class_name;
 	unij_wstr_t method_name;
 	unij_wstr_t log_path;
+	
+	/**
+	 * UTF-8 strings handed to mono. The injector packs them straight from the wide fields above, so they're only
+	 * filled in on the loader side, where their wide counterparts are left empty.
+	 * 
+	 * method_desc is the null-terminated "Class:Method" descriptor for mono_method_desc_new, with the defaults for
+	 * class_name and method_name already applied.
+	 */
+	struct
+	{
+		unij_cstr_t assembly_path;
+		unij_cstr_t method_desc;
+	} utf8;
 };
 
 // Forward declaration
 typedef struct unij_packer unij_packer_t;
 typedef struct unij_unpacker unij_unpacker_t;
 
+/**
+ * @brief Computes the packed size of \a data in the sequential layout. (header excluded)
+ */
+size_t unij_measure_params(const unij_params_t* data);
+
 void unij_reserve_params(unij_packer_t* P, const unij_params_t* data);
 bool unij_pack_params(unij_packer_t* P, const unij_params_t* data);
 bool unij_unpack_params(unij_unpacker_t* U, unij_params_t* dest);
 
+/**
+ * @brief Same as \a unij_unpack_params, but the string fields point into the packed buffer instead of being copied.
+ * The buffer has to stay mapped for as long as \a dest is in use, and the strings must not be freed.
+ */
+bool unij_unpack_params_view(unij_unpacker_t* U, unij_params_t* dest);
+
+/**
+ * @brief Frees the strings of a \a unij_params_t filled in by \a unij_unpack_params, then zeroes it.
+ */
+void unij_free_params(unij_params_t* params);
+
+typedef struct unij_status unij_status_t;
+
+/**
+ * @brief Status reply sent back by a resident loader for each request.
+ */
+struct unij_status
+{
+	// unij_params_t::request of the request being answered, so replies to requests the injector gave up on can't be
+	// taken for the answer to a later one.
+	uint32_t request;
+	
+	// unij_error_t value
+	uint32_t status;
+};
+
+bool unij_pack_status(unij_packer_t* P, const unij_status_t* status);
+bool unij_unpack_status(unij_unpacker_t* U, unij_status_t* dest);
+
 #ifdef __cplusplus
 }
 #endif
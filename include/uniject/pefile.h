@@ -0,0 +1,131 @@
+/**
+ * @file uniject/pefile.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Export lookups straight from PE32/PE32+ files on disk
+ *
+ * The file is mapped read-only and never loaded, so the only pages that get read are the headers, the section table
+ * and whatever part of the export directory a lookup touches. Every offset and count in the file is checked against
+ * the size of the mapping before it's used, so a truncated or corrupt file just fails to open or misses. Nothing here
+ * depends on the platform beyond the mapping itself, so the same code can be tested against sample files anywhere.
+ */
+#ifndef _UNIJECT_PEFILE_H_
+#define _UNIJECT_PEFILE_H_
+#pragma once
+
+#include <uniject.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct unij_pefile unij_pefile_t;
+typedef struct unij_export_index unij_export_index_t;
+typedef struct unij_export_binding unij_export_binding_t;
+
+/**
+ * @brief One symbol in a batch lookup. (see \a unij_export_index_bind)
+ */
+struct unij_export_binding
+{
+	const char* name;
+	// Filled in by the lookup. 0 if the export is missing or forwarded.
+	uint32_t rva;
+};
+
+/**
+ * @brief Maps the file at \a path and validates its headers.
+ * @param path
+ * @return NULL if the file can't be opened or isn't a PE32/PE32+ image.
+ */
+unij_pefile_t* unij_pefile_open(const wchar_t* path);
+
+/**
+ * @brief Validates the headers of an image that's already in memory, laid out as it would be on disk. \a data needs
+ * to outlive the returned handle.
+ * @param data
+ * @param size
+ * @return NULL if \a data isn't a PE32/PE32+ image.
+ */
+unij_pefile_t* unij_pefile_open_memory(const void* data, size_t size);
+
+/**
+ * @brief Unmaps the file, if it was mapped by \a unij_pefile_open, and frees the handle.
+ * @param pe
+ */
+void unij_pefile_close(unij_pefile_t* pe);
+
+/**
+ * @brief 32 for PE32 images and 64 for PE32+.
+ * @param pe
+ * @return
+ */
+int unij_pefile_bits(const unij_pefile_t* pe);
+
+/**
+ * @brief IMAGE_FILE_MACHINE_* value from the file header.
+ * @param pe
+ * @return
+ */
+uint16_t unij_pefile_machine(const unij_pefile_t* pe);
+
+/**
+ * @brief Translates \a rva to a pointer into the file, through the section table.
+ * @param pe
+ * @param rva
+ * @param size Bytes that need to be readable from the returned pointer.
+ * @return NULL if any of the range falls outside the file's raw data.
+ */
+const void* unij_pefile_rva_to_data(const unij_pefile_t* pe, uint32_t rva, size_t size);
+
+/**
+ * @brief Looks up the export named \a name.
+ * @param pe
+ * @param name
+ * @return The export's RVA, or 0 if there's no such export or it's forwarded to another module.
+ */
+uint32_t unij_pefile_export_rva(const unij_pefile_t* pe, const char* name);
+
+/**
+ * @brief Hashes every exported name of \a pe in a single pass over its name table, so any number of lookups after that
+ * cost a hash and a string compare each. Worth it as soon as more than a handful of symbols are needed from the same
+ * module. The index points into \a pe, so it needs to be freed before \a pe is closed.
+ * @param pe
+ * @return NULL on allocation failure. A module without exports gets an empty index.
+ */
+unij_export_index_t* unij_export_index_build(const unij_pefile_t* pe);
+
+/**
+ * @brief Frees an index built by \a unij_export_index_build.
+ * @param index
+ */
+void unij_export_index_free(unij_export_index_t* index);
+
+/**
+ * @brief Number of names in the index, forwarders not included.
+ * @param index
+ * @return
+ */
+uint32_t unij_export_index_count(const unij_export_index_t* index);
+
+/**
+ * @brief Same as \a unij_pefile_export_rva, through the index.
+ * @param index
+ * @param name
+ * @return
+ */
+uint32_t unij_export_index_find(const unij_export_index_t* index, const char* name);
+
+/**
+ * @brief Looks up every binding in \a bindings.
+ * @param index
+ * @param bindings
+ * @param count
+ * @return How many of them were found.
+ */
+size_t unij_export_index_bind(const unij_export_index_t* index, unij_export_binding_t* bindings, size_t count);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _UNIJECT_PEFILE_H_ */
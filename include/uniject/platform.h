@@ -0,0 +1,389 @@
+/**
+ * @file uniject/platform.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief What the shared code needs from the OS
+ *
+ * Heap, named mappings and events, one-time initialization, and the few string, time and error primitives that used
+ * to be straight Win32 calls. win32.c implements it on Windows and posix.c everywhere else. Trivial wrappers are
+ * inlined here instead.
+ *
+ * Outside of Windows, this also defines the handful of Win32 names that are part of our own interfaces - HANDLE, BOOL
+ * and the ERROR_* codes that \a unij_error_t is built on - so the headers read the same on every platform.
+ */
+#ifndef _UNIJECT_PLATFORM_H_
+#define _UNIJECT_PLATFORM_H_
+#pragma once
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <errno.h>
+#	include <sched.h>
+#	include <stdint.h>
+#	include <stdio.h>
+#	include <stdarg.h>
+#	include <string.h>
+#	include <time.h>
+#	include <unistd.h>
+#	include <wchar.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _WIN32
+
+typedef void* HANDLE;
+typedef int BOOL;
+
+#	define TRUE 1
+#	define FALSE 0
+#	define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#	define INFINITE 0xFFFFFFFF
+
+// Values behind unij_error_t. Only ever compared against each other, so they keep their Win32 values.
+#	define ERROR_SUCCESS 0
+#	define ERROR_FILE_NOT_FOUND 2
+#	define ERROR_PATH_NOT_FOUND 3
+#	define ERROR_INVALID_DATA 13
+#	define ERROR_OUTOFMEMORY 14
+#	define ERROR_INVALID_PARAMETER 87
+#	define ERROR_MOD_NOT_FOUND 126
+#	define ERROR_PROC_NOT_FOUND 127
+#	define ERROR_BAD_PATHNAME 161
+#	define ERROR_BAD_EXE_FORMAT 193
+#	define ERROR_INVALID_ADDRESS 487
+#	define ERROR_INTERNAL_ERROR 1359
+#	define ERROR_INVALID_OPERATION 4317
+
+#endif
+
+/**
+ * @internal
+ * Errors
+ */
+
+/**
+ * @def UNIJ_LAST_ERROR_EXISTS
+ * @brief What \a unij_last_error returns after creating an object that turned out to exist already.
+ */
+#ifdef _WIN32
+#	define UNIJ_LAST_ERROR_EXISTS ERROR_ALREADY_EXISTS
+#else
+#	define UNIJ_LAST_ERROR_EXISTS EEXIST
+#endif
+
+/**
+ * @brief GetLastError, or errno outside of Windows.
+ * @return
+ */
+static UNIJ_INLINE uint32_t unij_last_error(void)
+{
+#ifdef _WIN32
+	return (uint32_t)GetLastError();
+#else
+	return (uint32_t)errno;
+#endif
+}
+
+static UNIJ_INLINE void unij_set_last_error(uint32_t error)
+{
+#ifdef _WIN32
+	SetLastError((DWORD)error);
+#else
+	errno = (int)error;
+#endif
+}
+
+/**
+ * @brief Describes a system error code, as returned by \a unij_last_error.
+ * @param[in] error
+ * @return NULL when there's no description. Otherwise, pass it to \a unij_system_error_free when done with it.
+ */
+const wchar_t* unij_system_error_text(uint32_t error);
+
+void unij_system_error_free(const wchar_t* text);
+
+/**
+ * @internal
+ * Strings
+ */
+
+static UNIJ_INLINE size_t unij_wcslen(const wchar_t* str)
+{
+#ifdef _WIN32
+	return (size_t)lstrlenW(str);
+#else
+	return wcslen(str);
+#endif
+}
+
+/**
+ * @brief Number of characters \a format expands to, not counting the trailing zero.
+ * @param[in] format
+ * @param[in] args
+ * @return -1 on a bad format string.
+ */
+#ifdef _WIN32
+#	define unij_vscwprintf(format,args) _vscwprintf(format, args)
+#	define unij_vscprintf(format,args) _vscprintf(format, args)
+#	define unij_vsnwprintf(buffer,count,format,args) _vsnwprintf(buffer, count, format, args)
+#	define unij_vsnprintf(buffer,count,format,args) _vsnprintf(buffer, count, format, args)
+#else
+int unij_vscwprintf(const wchar_t* format, va_list args);
+#	define unij_vscprintf(format,args) vsnprintf(NULL, 0, format, args)
+#	define unij_vsnwprintf(buffer,count,format,args) vswprintf(buffer, count, format, args)
+#	define unij_vsnprintf(buffer,count,format,args) vsnprintf(buffer, count, format, args)
+#endif
+
+/**
+ * @brief Encodes the first \a length characters of \a str as UTF-8. Nothing gets terminated.
+ * @param[out] buffer NULL to only work out the size.
+ * @param[in] size Size of \a buffer in bytes.
+ * @param[in] str
+ * @param[in] length
+ * @return Bytes written, or needed when \a buffer is NULL. 0 if \a buffer is too small or \a str can't be encoded.
+ */
+size_t unij_wcstoutf8(char* buffer, size_t size, const wchar_t* str, size_t length);
+
+/**
+ * @internal
+ * Processes & time
+ */
+
+static UNIJ_INLINE uint32_t unij_current_pid(void)
+{
+#ifdef _WIN32
+	return (uint32_t)GetCurrentProcessId();
+#else
+	return (uint32_t)getpid();
+#endif
+}
+
+/**
+ * @brief Whether a process with id \a pid is still running. Processes we aren't allowed to query count as running.
+ * @param[in] pid
+ * @return
+ */
+bool unij_process_exists(uint32_t pid);
+
+/**
+ * @brief Milliseconds since some arbitrary point. Wraps around, so only differences mean anything.
+ * @return
+ */
+static UNIJ_INLINE uint32_t unij_tick_count(void)
+{
+#ifdef _WIN32
+	return (uint32_t)GetTickCount();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000);
+#endif
+}
+
+/**
+ * @brief Spin-wait hint.
+ */
+static UNIJ_INLINE void unij_yield_processor(void)
+{
+#if defined(_WIN32)
+	YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#else
+	sched_yield();
+#endif
+}
+
+/**
+ * @internal
+ * One-time initialization
+ */
+
+/**
+ * @brief One-time initialization structure.
+ * Since `InitOnceExecuteOnce` wasn't added until Windows Vista, we use our own implementation for
+ * Windows XP compatibility. It's a single state word, so a finished one costs one load to get past and nothing ever
+ * creates a kernel object for it.
+ */
+struct unij_once
+{
+	uint32_t state;
+};
+
+typedef struct unij_once unij_once_t;
+
+/**
+ * Run once callback declaration
+ * @typedef PRUN_ONCE_FN
+ * @param[in]
+ */
+typedef BOOL(CDECL *unij_once_fn)(void* parameter);
+
+/**
+ * @def unij_once_init
+ * Static initializer for one-time initialization structure.
+ */
+#define UNIJ_ONCE_INIT {0}
+
+/**
+ * Essentially InitOnceExecuteOnce for pre-Vista Windows without the context it. Callers that lose the race sleep
+ * until the winner's callback returns. A failed callback isn't retried.
+ * @param[in,out] once Pointer to the one-time initialiation structure.
+ * @param[in] oncefn Application-defined one-time callback.
+ * @param[in,out] parameter Application-defined data passed into the callback
+ * @return Success of the callback.
+ */
+bool unij_once(unij_once_t* once, unij_once_fn oncefn, void* parameter);
+
+/**
+ * @brief Sleeps while the 32-bit word at \a address still holds \a expected. Only for words in this process. Can
+ * return early, so callers have to check the word again. Where the OS can't wait on an address, this only yields.
+ * @param[in] address
+ * @param[in] expected
+ */
+void unij_wait_on_address(const volatile void* address, uint32_t expected);
+
+/**
+ * @brief Wakes everything sleeping in \a unij_wait_on_address on \a address.
+ * @param[in] address
+ */
+void unij_wake_by_address(const volatile void* address);
+
+/**
+ * @internal
+ * Named objects
+ */
+
+/**
+ * @brief Object type (either mapping or evenT)
+ */
+enum unij_object
+{
+	UNIJ_OBJECT_MAPPING = 0,
+	UNIJ_OBJECT_EVENT
+};
+
+typedef enum unij_object unij_object_t;
+
+/**
+ * @brief Result of \a unij_wait_event
+ */
+enum unij_wait
+{
+	UNIJ_WAIT_SIGNALED = 0,
+	UNIJ_WAIT_TIMEOUT,
+	UNIJ_WAIT_FAILED
+};
+
+typedef enum unij_wait unij_wait_t;
+
+/**
+ * @brief Creates an object name based on \a UNIJ_OBJECT_FORMAT
+ * @param[in] key
+ * @param[in] type
+ * @param[in] pid Target process.
+ * @param[in] nonce Injection the object belongs to, or 0 for per-process objects. (see uniject/handoff.h)
+ * @return
+ */
+const wchar_t* unij_object_name(const wchar_t* key, unij_object_t type, uint32_t pid, uint32_t nonce);
+
+/**
+ * @brief Creates a named mapping of \a size bytes, or opens the existing one, in which case \a unij_last_error
+ * returns \a UNIJ_LAST_ERROR_EXISTS.
+ * @param[in] name
+ * @param[in] size
+ * @return
+ */
+HANDLE unij_create_mmap(const wchar_t* name, size_t size);
+
+/**
+ * @brief Creates a named mapping that only reserves \a max_size bytes. Pages must be committed with
+ * \a unij_commit_mmap before use, which lets a mapped view grow in place.
+ * @param[in] name
+ * @param[in] max_size
+ * @return
+ */
+HANDLE unij_reserve_mmap(const wchar_t* name, size_t max_size);
+
+/**
+ * @brief Commits the first \a size bytes of a view mapped from a \a unij_reserve_mmap section.
+ * @param[in] view
+ * @param[in] size
+ * @return
+ */
+bool unij_commit_mmap(void* view, size_t size);
+
+/**
+ * @brief
+ * @param[in] name
+ * @param[in] readonly
+ * @return
+ */
+HANDLE unij_open_mmap(const wchar_t* name, bool readonly);
+
+/**
+ * @brief Reserves a mapping like \a unij_reserve_mmap, but without a name. Other processes can only get at it through
+ * \a unij_import_mmap, so nothing about it is left lying around. Its size is sealed, so an importer can map all of it
+ * without having to trust the owner to leave it that way.
+ * @param[in] max_size
+ * @param[out] pexported What \a unij_import_mmap needs besides our pid.
+ * @return NULL where that isn't possible, without raising an error. Windows never can - fall back to a named mapping.
+ */
+HANDLE unij_reserve_unnamed_mmap(size_t max_size, uint32_t* pexported);
+
+/**
+ * @brief Opens a mapping that process \a owner created with \a unij_reserve_unnamed_mmap, while the owner still has
+ * it open.
+ * @param[in] owner
+ * @param[in] exported
+ * @param[in] readonly
+ * @return
+ */
+HANDLE unij_import_mmap(uint32_t owner, uint32_t exported, bool readonly);
+
+/**
+ * @brief Maps a view of a named mapping.
+ * @param[in] mapping
+ * @param[in,out] psize Bytes to map, or 0 for all of it. Gets the size that \a unij_unmap_view needs back.
+ * @param[in] readonly
+ * @return
+ */
+void* unij_map_view(HANDLE mapping, size_t* psize, bool readonly);
+
+void unij_unmap_view(const void* view, size_t size);
+
+void unij_flush_view(const void* view, size_t size);
+
+/**
+ * @brief Creates a named, manual-reset event, or opens the existing one.
+ * @param[in] name
+ * @return
+ */
+HANDLE unij_create_event(const wchar_t* name);
+
+void unij_set_event(HANDLE event);
+
+void unij_reset_event(HANDLE event);
+
+/**
+ * @brief Waits for \a event to be set.
+ * @param[in] event
+ * @param[in] timeout Milliseconds, or INFINITE.
+ * @return
+ */
+unij_wait_t unij_wait_event(HANDLE event, uint32_t timeout);
+
+/**
+ * @brief Closes a mapping or event. Outside of Windows, the last handle to an object also takes its name with it.
+ * @param[in] object
+ */
+void unij_close_handle(HANDLE object);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UNIJECT_PLATFORM_H_ */
@@ -57,12 +57,49 @@ typedef struct unij_process unij_process_t;
 typedef bool(CDECL* unij_monoinfo_fn)(unij_monoinfo_t* info, void* parameter);
 
 /**
- * @brief 
+ * @brief Flags for \a unij_enum_options_t
+ */
+enum unij_enumflags
+{
+	UNIJ_ENUM_DEFAULT = 0,
+	
+	// Hold results back until every process has been inspected, then deliver them from the calling thread in
+	// ascending pid order. Without it, the callback runs on the worker threads as soon as each result comes in.
+	UNIJ_ENUM_ORDERED = 1 << 0
+};
+
+typedef enum unij_enumflags unij_enumflags_t;
+typedef struct unij_enum_options unij_enum_options_t;
+
+/**
+ * @brief Options for \a unij_enum_mono_processes_ex
+ */
+struct unij_enum_options
+{
+	// Worker threads, the calling thread included. 0 picks one per core, and 1 inspects everything on the calling thread.
+	uint32_t threads;
+	uint32_t flags;
+};
+
+/**
+ * @brief Calls \a fn for every process that has Mono loaded, one process at a time, until it returns true.
  * @param fn 
  * @param parameter 
  */
 void unij_enum_mono_processes(unij_monoinfo_fn fn, void* parameter);
 
+/**
+ * @brief Parallel version of \a unij_enum_mono_processes. Processes are spread across a pool of worker threads that
+ * steal from each other once they run out.
+ * 
+ * Without \a UNIJ_ENUM_ORDERED, \a fn gets called from several threads at once, and returning true stops the
+ * enumeration as soon as the workers notice. With it, \a fn only ever runs on the calling thread.
+ * @param fn 
+ * @param parameter 
+ * @param options NULL for the same behavior as \a unij_enum_mono_processes.
+ */
+void unij_enum_mono_processes_ex(unij_monoinfo_fn fn, void* parameter, const unij_enum_options_t* options);
+
 /**
  * @brief Opens a process for use with our injection functionality.
  * @param[in] pid Required process id
@@ -76,7 +113,9 @@ unij_process_t* unij_process_open(uint32_t pid);
  * @param[in] process Required process handle
  * @return NULL on failure
  */
+#ifdef _WIN32
 unij_process_t* unij_process_assign(HANDLE process);
+#endif
 
 /**
  * @brief Closes a process previously opened by \a unij_process_open/unij_process_assign.
@@ -88,7 +127,9 @@ void unij_process_close(unij_process_t* process);
 
 uint32_t unij_process_get_pid(unij_process_t* process);
 
+#ifdef _WIN32
 HANDLE unij_process_get_handle(unij_process_t* process);
+#endif
 
 unij_wstr_t* unij_process_get_mono_path(unij_process_t* process);
 
@@ -0,0 +1,55 @@
+/**
+ * @file uniject/ptrace.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Linux injection backend
+ * 
+ * The Linux counterpart to \a unij_inject_loader_ex: instead of a remote thread calling LoadLibraryW, one of the
+ * target's own threads is briefly taken over with ptrace to dlopen the loader. Since nothing like DllMain's thread
+ * start address exists to find the handoff block from, the loader exports an entrypoint that gets handed the block
+ * directly once dlopen returns.
+ */
+#ifndef _UNIJECT_PTRACE_H_
+#define _UNIJECT_PTRACE_H_
+#pragma once
+
+#include <uniject.h>
+#include <uniject/handoff.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @def UNIJ_LOADER_ENTRY "unij_loader_entry"
+ * @brief Name of the entrypoint a Linux loader exports. (see \a unij_loader_entry_fn)
+ */
+#define UNIJ_LOADER_ENTRY "unij_loader_entry"
+
+/**
+ * @brief Called on the hijacked thread right after the loader is loaded. The handoff block only lives until the call
+ * returns, and the thread it's called on belongs to the target, so anything slow belongs on a thread of its own.
+ * @return Non-zero on success.
+ */
+typedef int(*unij_loader_entry_fn)(const unij_handoff_t* handoff);
+
+/**
+ * @brief Called by the loader's entrypoint, before \a unij_loader_open, so it finds the block it was handed. Only a
+ * copy is kept, since the block itself goes away when the entrypoint returns.
+ * @param handoff
+ */
+void unij_loader_set_handoff(const unij_handoff_t* handoff);
+
+/**
+ * @brief Injects \a loader into \a pid. x86-64 only.
+ * @param pid
+ * @param loader Absolute path of the shared object.
+ * @param handoff Handed to the loader's \a UNIJ_LOADER_ENTRY export. May be NULL.
+ * @return
+ */
+bool unij_ptrace_inject(uint32_t pid, const char* loader, const unij_handoff_t* handoff);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _UNIJECT_PTRACE_H_ */
@@ -0,0 +1,115 @@
+/**
+ * @file uniject/remote.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Reading and writing another process's memory on Linux
+ *
+ * The Linux counterpart to READ_PROC_MEM/WRITE_PROC_MEM. Transfers are described as lists of spans, so writing a stub
+ * or reading a handful of remote headers costs one syscall instead of one per word. Three methods are tried in order:
+ * process_vm_readv/writev, then pread/pwrite on /proc/pid/mem (which also gets past read-only pages, unlike
+ * process_vm_writev), then PTRACE_PEEKDATA/POKEDATA as a last resort. Once a method fails for reasons that won't go
+ * away, the handle stops trying it.
+ */
+#ifndef _UNIJECT_REMOTE_H_
+#define _UNIJECT_REMOTE_H_
+#pragma once
+
+#include <uniject.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Remote memory handle forward declaration
+ */
+typedef struct unij_remote unij_remote_t;
+
+typedef enum unij_remote_method
+{
+	UNIJ_REMOTE_AUTO = 0,
+	UNIJ_REMOTE_VM,
+	UNIJ_REMOTE_PROCMEM,
+	UNIJ_REMOTE_PTRACE,
+	UNIJ_REMOTE_METHODS
+} unij_remote_method_t;
+
+/**
+ * @brief One contiguous piece of a transfer.
+ */
+typedef struct unij_remote_span
+{
+	uintptr_t address;
+	void* data;
+	size_t size;
+} unij_remote_span_t;
+
+/**
+ * @brief Opens a handle for transfers with \a pid. Nothing is opened in the target until it's first needed.
+ * @param pid
+ * @return NULL on failure.
+ */
+unij_remote_t* unij_remote_open(uint32_t pid);
+
+/**
+ * @brief Closes the handle, along with /proc/pid/mem if it was opened.
+ * @param R
+ */
+void unij_remote_close(unij_remote_t* R);
+
+/**
+ * @brief Restricts the handle to a single method, or lets it pick again with \a UNIJ_REMOTE_AUTO.
+ * @param R
+ * @param method \a UNIJ_REMOTE_PTRACE only works while the caller has the target attached and stopped.
+ */
+void unij_remote_set_method(unij_remote_t* R, unij_remote_method_t method);
+
+/**
+ * @brief Name of a method, for reporting.
+ * @param method
+ * @return
+ */
+const wchar_t* unij_remote_method_name(unij_remote_method_t method);
+
+/**
+ * @brief Reads every span from the target, in a single call where the method allows it.
+ * @param R
+ * @param spans
+ * @param count
+ * @return false unless every span was read in full.
+ */
+bool unij_remote_readv(unij_remote_t* R, const unij_remote_span_t* spans, size_t count);
+
+/**
+ * @brief Writes every span to the target, in a single call where the method allows it.
+ * @param R
+ * @param spans
+ * @param count
+ * @return false unless every span was written in full.
+ */
+bool unij_remote_writev(unij_remote_t* R, const unij_remote_span_t* spans, size_t count);
+
+/**
+ * @brief Single span version of \a unij_remote_readv.
+ * @param R
+ * @param address
+ * @param[out] buffer
+ * @param size
+ * @return
+ */
+bool unij_remote_read(unij_remote_t* R, uintptr_t address, void* buffer, size_t size);
+
+/**
+ * @brief Single span version of \a unij_remote_writev.
+ * @param R
+ * @param address
+ * @param data
+ * @param size
+ * @return
+ */
+bool unij_remote_write(unij_remote_t* R, uintptr_t address, const void* data, size_t size);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _UNIJECT_REMOTE_H_ */
@@ -0,0 +1,117 @@
+/**
+ * @file uniject/ring.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Single-producer/single-consumer ring buffer of messages
+ *
+ * The ring lives entirely in caller-supplied memory, which is meant to be a shared mapping: one process creates the
+ * ring, the other attaches to it, and each side gets its own handle. Only the producer handle may reserve/push, and
+ * only the consumer handle may peek/release. Neither call blocks - a full or empty ring is reported back to the caller.
+ *
+ * Messages are stored whole, so a peeked message is always contiguous and can be handed straight to an unpacker. The
+ * shared header only holds 32-bit values, so 32-bit and 64-bit processes can share a ring.
+ */
+#ifndef _UNIJECT_RING_H_
+#define _UNIJECT_RING_H_
+#pragma once
+
+#include <uniject.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Ring handle forward declaration
+ */
+typedef struct unij_ring unij_ring_t;
+
+/**
+ * @brief Bytes of shared memory needed for a ring holding \a capacity bytes of messages. (header included)
+ * @param capacity Rounded up to a power of two.
+ * @return 0 when \a capacity is too large.
+ */
+size_t unij_ring_footprint(size_t capacity);
+
+/**
+ * @brief Initializes a new, empty ring over \a memory, discarding whatever was there.
+ * @param memory At least 8-byte aligned.
+ * @param size Size of \a memory. The ring's capacity is the largest power of two that fits after the header.
+ * @return Handle for this side of the ring or NULL on failure.
+ */
+unij_ring_t* unij_ring_create(void* memory, size_t size);
+
+/**
+ * @brief Attaches to a ring that was initialized by \a unij_ring_create, most likely in another process.
+ * @param memory
+ * @param size Size of the mapping, used to validate the ring's header.
+ * @return Handle for this side of the ring or NULL on failure.
+ */
+unij_ring_t* unij_ring_attach(void* memory, size_t size);
+
+/**
+ * @brief Releases the handle. The shared memory is left untouched.
+ * @param R
+ */
+void unij_ring_destroy(unij_ring_t* R);
+
+/**
+ * @brief Largest message that can be pushed into the ring.
+ * @param R
+ * @return
+ */
+size_t unij_ring_max_message(unij_ring_t* R);
+
+/**
+ * @brief Producer only: reserves space for a message of \a size bytes, which stays invisible to the consumer until
+ * \a unij_ring_publish is called.
+ * @param R
+ * @param size
+ * @return Pointer to write the message to, or NULL if the ring is currently too full. (not an error)
+ */
+void* unij_ring_reserve(unij_ring_t* R, size_t size);
+
+/**
+ * @brief Producer only: makes the reserved message visible to the consumer.
+ * @param R
+ * @param size Actual size of the message, which can be smaller than the size reserved.
+ * @return
+ */
+bool unij_ring_publish(unij_ring_t* R, size_t size);
+
+/**
+ * @brief Producer only: copies a message into the ring.
+ * @param R
+ * @param data
+ * @param size
+ * @return false if the ring is currently too full or \a size is larger than \a unij_ring_max_message.
+ */
+bool unij_ring_push(unij_ring_t* R, const void* data, size_t size);
+
+/**
+ * @brief Consumer only: looks at the oldest message without removing it. Peeking again before
+ * \a unij_ring_release returns the same message.
+ * @param R
+ * @param[out] psize Size of the message.
+ * @return NULL when the ring is empty.
+ */
+const void* unij_ring_peek(unij_ring_t* R, size_t* psize);
+
+/**
+ * @brief Consumer only: removes the peeked message, handing its space back to the producer. Pointers returned by
+ * \a unij_ring_peek are invalid afterwards.
+ * @param R
+ */
+void unij_ring_release(unij_ring_t* R);
+
+/**
+ * @brief Checks whether every published message has been released. Safe to call from either side.
+ * @param R
+ * @return
+ */
+bool unij_ring_empty(unij_ring_t* R);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _UNIJECT_RING_H_ */
@@ -0,0 +1,264 @@
+/**
+ * @file uniject/schema.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Generates the packing code for a struct from a single X-macro field list.
+ *
+ * Included once per payload, after defining:
+ *
+ * - UNIJ_SCHEMA_NAME   - Payload name. Generates unij_measure_NAME, unij_reserve_NAME, unij_pack_NAME and
+ *                        unij_unpack_NAME, plus the unij_NAME_fixed_size constant and the unij_NAME_field_* indices.
+ * - UNIJ_SCHEMA_TYPE   - The struct type being packed.
+ * - UNIJ_SCHEMA_FIELDS - Quoted filename of the field list. (must be reachable from the include path)
+ *
+ * Optional:
+ *
+ * - UNIJ_SCHEMA_STORAGE     - Storage class for the generated functions. (ex: static) Defaults to nothing.
+ * - UNIJ_SCHEMA_UNPACK_WSTR - Function used to unpack WSTR fields. Defaults to \a unij_unpack_wstr.
+ * - UNIJ_SCHEMA_UNPACK_CSTR - Function used to unpack UTF8 fields. Defaults to \a unij_unpack_cstr.
+ * - UNIJ_SCHEMA_VIEW        - When defined, also generates unij_unpack_NAME_view. It unpacks WSTR and UTF8 fields
+ *                             with \a unij_unpack_wstr and \a unij_unpack_cstr, leaving them pointing into the
+ *                             packed buffer.
+ * - UNIJ_SCHEMA_REVISION    - Wire format revision. When defined, it's packed ahead of the fields as a uint16_t, and
+ *                             unpacking fails if the revision doesn't match. Bump it whenever the field list changes.
+ *
+ * The field list is a series of `UNIJ_FIELD(KIND, TYPE, NAME)` entries, in wire order. It's expected to #undef
+ * UNIJ_FIELD at the end, the same way mono_api.inl does with MONO_API. Kinds:
+ *
+ * - VAL   - Fixed-size numeric field of type TYPE.
+ * - FLAGS - TYPE-sized bitset holding every FLAG field. NAME is unused.
+ * - FLAG  - bool field, packed as the bit value TYPE of the FLAGS word. Takes no space of its own.
+ * - WSTR  - \a unij_wstr_t field.
+ * - UTF8  - \a unij_wstr_t field NAME, packed as UTF-8. Unpacks into the \a unij_cstr_t member named by TYPE, (ex:
+ *           utf8.NAME) so the reading side never has to convert it.
+ * - CUSTOM - Field computed by hand-written hooks. TYPE is the prefix of the three hooks:
+ *            - `size_t TYPE_measure(const T* data)` - Packed size, length prefixes included.
+ *            - `bool TYPE_pack(unij_packer_t* P, const T* data)` - Must pack exactly one field.
+ *            - `bool TYPE_unpack(unij_unpacker_t* U, T* dest, bool view)` - \a view is true when called from
+ *              unij_unpack_NAME_view, in which case the result should borrow from the packed buffer.
+ *
+ * Every kind except FLAG (plus the revision, when present) takes up one field of a \a UNIJ_LAYOUT_INDEXED buffer. Their indices are generated as
+ * unij_NAME_field_FIELD, (followed by unij_NAME_field_count) for use with \a unij_unpacker_field.
+ * 
+ * The generated functions match the \a unij_reserve_fn / \a unij_pack_fn / \a unij_unpack_fn signatures (modulo the
+ * data pointer type), so custom IPC payloads can be hooked up with \a unij_ipc_set_pack_fn and friends.
+ *
+ * Every UNIJ_SCHEMA_* macro is undefined at the end of this file.
+ */
+#if !defined(UNIJ_SCHEMA_NAME) || !defined(UNIJ_SCHEMA_TYPE) || !defined(UNIJ_SCHEMA_FIELDS)
+#	error UNIJ_SCHEMA_NAME, UNIJ_SCHEMA_TYPE and UNIJ_SCHEMA_FIELDS must be defined prior to including uniject/schema.h!
+#endif
+
+#include <uniject/error.h>
+#include <uniject/packing.h>
+
+#ifndef _UNIJECT_SCHEMA_H_
+#define _UNIJECT_SCHEMA_H_
+
+// Generated names
+#define _UNIJ_SCHEMA_FN(VERB) \
+	UNIJ_PASTE(UNIJ_PASTE(unij_, VERB), UNIJ_PASTE(_, UNIJ_SCHEMA_NAME))
+
+#define _UNIJ_SCHEMA_FIXED \
+	UNIJ_PASTE(UNIJ_PASTE(unij_, UNIJ_SCHEMA_NAME), _fixed_size)
+
+#define _UNIJ_SCHEMA_FIELD(NAME) \
+	UNIJ_PASTE(UNIJ_PASTE(unij_, UNIJ_SCHEMA_NAME), UNIJ_PASTE(_field_, NAME))
+
+// Field indices of each kind
+#define _UNIJ_INDEX_VAL(TYPE,NAME)   _UNIJ_SCHEMA_FIELD(NAME),
+#define _UNIJ_INDEX_FLAGS(TYPE,NAME) _UNIJ_SCHEMA_FIELD(NAME),
+#define _UNIJ_INDEX_FLAG(TYPE,NAME)
+#define _UNIJ_INDEX_WSTR(TYPE,NAME)  _UNIJ_SCHEMA_FIELD(NAME),
+#define _UNIJ_INDEX_UTF8(TYPE,NAME)  _UNIJ_SCHEMA_FIELD(NAME),
+#define _UNIJ_INDEX_CUSTOM(TYPE,NAME) _UNIJ_SCHEMA_FIELD(NAME),
+
+// Fixed-size portion of each kind
+#define _UNIJ_FIXED_VAL(TYPE,NAME)   + sizeof(TYPE)
+#define _UNIJ_FIXED_FLAGS(TYPE,NAME) + sizeof(TYPE)
+#define _UNIJ_FIXED_FLAG(TYPE,NAME)
+#define _UNIJ_FIXED_WSTR(TYPE,NAME)  + sizeof(uint16_t)
+#define _UNIJ_FIXED_UTF8(TYPE,NAME)  + sizeof(uint16_t)
+#define _UNIJ_FIXED_CUSTOM(TYPE,NAME)
+
+// Variable-size portion of each kind
+#define _UNIJ_MEASURE_VAL(TYPE,NAME)
+#define _UNIJ_MEASURE_FLAGS(TYPE,NAME)
+#define _UNIJ_MEASURE_FLAG(TYPE,NAME)
+#define _UNIJ_MEASURE_WSTR(TYPE,NAME) \
+	if(data->NAME.length > 0) size += ((size_t)data->NAME.length + 1) * sizeof(wchar_t);
+#define _UNIJ_MEASURE_UTF8(TYPE,NAME) \
+	size += unij_wstr_utf8_size(&(data->NAME));
+#define _UNIJ_MEASURE_CUSTOM(TYPE,NAME) \
+	size += UNIJ_PASTE(TYPE,_measure)(data);
+
+// Collecting/distributing FLAG bits
+#define _UNIJ_BITS_IN_VAL(TYPE,NAME)
+#define _UNIJ_BITS_IN_FLAGS(TYPE,NAME)
+#define _UNIJ_BITS_IN_FLAG(TYPE,NAME) \
+	if(data->NAME) flags |= (uint64_t)(TYPE);
+#define _UNIJ_BITS_IN_WSTR(TYPE,NAME)
+#define _UNIJ_BITS_IN_UTF8(TYPE,NAME)
+#define _UNIJ_BITS_IN_CUSTOM(TYPE,NAME)
+
+#define _UNIJ_BITS_OUT_VAL(TYPE,NAME)
+#define _UNIJ_BITS_OUT_FLAGS(TYPE,NAME)
+#define _UNIJ_BITS_OUT_FLAG(TYPE,NAME) \
+	dest->NAME = (flags & (uint64_t)(TYPE)) ? 1 : 0;
+#define _UNIJ_BITS_OUT_WSTR(TYPE,NAME)
+#define _UNIJ_BITS_OUT_UTF8(TYPE,NAME)
+#define _UNIJ_BITS_OUT_CUSTOM(TYPE,NAME)
+
+// Packing
+#define _UNIJ_PACK_VAL(TYPE,NAME) \
+	if(!unij_pack_val(P, data->NAME)) return false;
+#define _UNIJ_PACK_FLAGS(TYPE,NAME) \
+	{ TYPE value = (TYPE)flags; if(!unij_pack_val(P, value)) return false; }
+#define _UNIJ_PACK_FLAG(TYPE,NAME)
+#define _UNIJ_PACK_WSTR(TYPE,NAME) \
+	if(!unij_pack_wstr(P, &(data->NAME))) return false;
+#define _UNIJ_PACK_UTF8(TYPE,NAME) \
+	if(!unij_pack_wstr_utf8(P, &(data->NAME))) return false;
+#define _UNIJ_PACK_CUSTOM(TYPE,NAME) \
+	if(!UNIJ_PASTE(TYPE,_pack)(P, data)) return false;
+
+// Unpacking
+#define _UNIJ_UNPACK_VAL(TYPE,NAME) \
+	if(!unij_unpack_val(U, &(dest->NAME))) return false;
+#define _UNIJ_UNPACK_FLAGS(TYPE,NAME) \
+	{ TYPE value = 0; if(!unij_unpack_val(U, &value)) return false; flags = (uint64_t)value; }
+#define _UNIJ_UNPACK_FLAG(TYPE,NAME)
+#define _UNIJ_UNPACK_WSTR(TYPE,NAME) \
+	if(!UNIJ_SCHEMA_UNPACK_WSTR(U, &(dest->NAME))) return false;
+#define _UNIJ_UNPACK_UTF8(TYPE,NAME) \
+	if(!UNIJ_SCHEMA_UNPACK_CSTR(U, &(dest->TYPE))) return false;
+#define _UNIJ_UNPACK_CUSTOM(TYPE,NAME) \
+	if(!UNIJ_PASTE(TYPE,_unpack)(U, dest, _UNIJ_SCHEMA_BORROW)) return false;
+
+// Revision word
+#define _UNIJ_PACK_REVISION(REVISION) \
+	{ uint16_t revision = (REVISION); if(!unij_pack_val(P, revision)) return false; }
+#define _UNIJ_UNPACK_REVISION(REVISION) \
+	{ \
+		uint16_t revision = 0; \
+		if(!unij_unpack_val(U, &revision)) return false; \
+		if(revision != (REVISION)) { \
+			unij_fatal_error( \
+				UNIJ_ERROR_OPERATION, \
+				L"Packed %ls data is revision %hu, but revision %hu was expected. Make sure the injector and loader " \
+				L"come from the same build.", \
+				UNIJ_WSTRINGIFY(UNIJ_SCHEMA_NAME), revision, (uint16_t)(REVISION) \
+			); \
+			return false; \
+		} \
+	}
+
+#endif /* _UNIJECT_SCHEMA_H_ */
+
+#ifndef UNIJ_SCHEMA_STORAGE
+#	define UNIJ_SCHEMA_STORAGE
+#endif
+
+#ifndef UNIJ_SCHEMA_UNPACK_WSTR
+#	define UNIJ_SCHEMA_UNPACK_WSTR unij_unpack_wstr
+#endif
+
+#ifndef UNIJ_SCHEMA_UNPACK_CSTR
+#	define UNIJ_SCHEMA_UNPACK_CSTR unij_unpack_cstr
+#endif
+
+#define _UNIJ_SCHEMA_BORROW false
+
+/** Fixed-size prefix of the payload - everything except string contents. */
+enum
+{
+	_UNIJ_SCHEMA_FIXED = 0
+#	ifdef UNIJ_SCHEMA_REVISION
+	+ sizeof(uint16_t)
+#	endif
+#	define UNIJ_FIELD(KIND,TYPE,NAME) _UNIJ_FIXED_##KIND(TYPE,NAME)
+#	include UNIJ_SCHEMA_FIELDS
+};
+
+/** Field indices for UNIJ_LAYOUT_INDEXED buffers. */
+enum
+{
+#	ifdef UNIJ_SCHEMA_REVISION
+	_UNIJ_SCHEMA_FIELD(revision),
+#	endif
+#	define UNIJ_FIELD(KIND,TYPE,NAME) _UNIJ_INDEX_##KIND(TYPE,NAME)
+#	include UNIJ_SCHEMA_FIELDS
+	_UNIJ_SCHEMA_FIELD(count)
+};
+
+UNIJ_SCHEMA_STORAGE size_t _UNIJ_SCHEMA_FN(measure)(const UNIJ_SCHEMA_TYPE* data)
+{
+	size_t size = (size_t)_UNIJ_SCHEMA_FIXED;
+#	define UNIJ_FIELD(KIND,TYPE,NAME) _UNIJ_MEASURE_##KIND(TYPE,NAME)
+#	include UNIJ_SCHEMA_FIELDS
+	return size;
+}
+
+UNIJ_SCHEMA_STORAGE void _UNIJ_SCHEMA_FN(reserve)(unij_packer_t* P, const UNIJ_SCHEMA_TYPE* data)
+{
+	unij_reserve(P, _UNIJ_SCHEMA_FN(measure)(data));
+}
+
+UNIJ_SCHEMA_STORAGE bool _UNIJ_SCHEMA_FN(pack)(unij_packer_t* P, const UNIJ_SCHEMA_TYPE* data)
+{
+	uint64_t flags = 0;
+#	ifdef UNIJ_SCHEMA_REVISION
+	_UNIJ_PACK_REVISION(UNIJ_SCHEMA_REVISION)
+#	endif
+#	define UNIJ_FIELD(KIND,TYPE,NAME) _UNIJ_BITS_IN_##KIND(TYPE,NAME)
+#	include UNIJ_SCHEMA_FIELDS
+#	define UNIJ_FIELD(KIND,TYPE,NAME) _UNIJ_PACK_##KIND(TYPE,NAME)
+#	include UNIJ_SCHEMA_FIELDS
+	UNIJ_SUPPRESS_UNUSED(flags);
+	return true;
+}
+
+UNIJ_SCHEMA_STORAGE bool _UNIJ_SCHEMA_FN(unpack)(unij_unpacker_t* U, UNIJ_SCHEMA_TYPE* dest)
+{
+	uint64_t flags = 0;
+#	ifdef UNIJ_SCHEMA_REVISION
+	_UNIJ_UNPACK_REVISION(UNIJ_SCHEMA_REVISION)
+#	endif
+#	define UNIJ_FIELD(KIND,TYPE,NAME) _UNIJ_UNPACK_##KIND(TYPE,NAME)
+#	include UNIJ_SCHEMA_FIELDS
+#	define UNIJ_FIELD(KIND,TYPE,NAME) _UNIJ_BITS_OUT_##KIND(TYPE,NAME)
+#	include UNIJ_SCHEMA_FIELDS
+	UNIJ_SUPPRESS_UNUSED(flags);
+	return true;
+}
+
+#ifdef UNIJ_SCHEMA_VIEW
+#	undef UNIJ_SCHEMA_UNPACK_WSTR
+#	define UNIJ_SCHEMA_UNPACK_WSTR unij_unpack_wstr
+#	undef UNIJ_SCHEMA_UNPACK_CSTR
+#	define UNIJ_SCHEMA_UNPACK_CSTR unij_unpack_cstr
+#	undef _UNIJ_SCHEMA_BORROW
+#	define _UNIJ_SCHEMA_BORROW true
+UNIJ_SCHEMA_STORAGE bool UNIJ_PASTE(_UNIJ_SCHEMA_FN(unpack), _view)(unij_unpacker_t* U, UNIJ_SCHEMA_TYPE* dest)
+{
+	uint64_t flags = 0;
+#	ifdef UNIJ_SCHEMA_REVISION
+	_UNIJ_UNPACK_REVISION(UNIJ_SCHEMA_REVISION)
+#	endif
+#	define UNIJ_FIELD(KIND,TYPE,NAME) _UNIJ_UNPACK_##KIND(TYPE,NAME)
+#	include UNIJ_SCHEMA_FIELDS
+#	define UNIJ_FIELD(KIND,TYPE,NAME) _UNIJ_BITS_OUT_##KIND(TYPE,NAME)
+#	include UNIJ_SCHEMA_FIELDS
+	UNIJ_SUPPRESS_UNUSED(flags);
+	return true;
+}
+#endif
+
+#undef UNIJ_SCHEMA_NAME
+#undef UNIJ_SCHEMA_TYPE
+#undef UNIJ_SCHEMA_FIELDS
+#undef UNIJ_SCHEMA_STORAGE
+#undef UNIJ_SCHEMA_UNPACK_WSTR
+#undef UNIJ_SCHEMA_UNPACK_CSTR
+#undef UNIJ_SCHEMA_VIEW
+#undef UNIJ_SCHEMA_REVISION
+#undef _UNIJ_SCHEMA_BORROW
@@ -21,11 +21,13 @@ static struct parg_option const cli_options[] =
 	{L"help",     PARG_NOARG,       NULL, L'h'},
 	{L"list",     PARG_NOARG,       NULL, L'l'},
 	{L"debug",    PARG_NOARG,       NULL, L'g'},
+	{L"resident", PARG_NOARG,       NULL, L'r'},
 	{L"pid",      PARG_REQARG,      NULL, L'p'},
 	{L"tid",      PARG_REQARG,      NULL, L't'},
 	{L"class",    PARG_REQARG,      NULL, L'c'},
 	{L"method",   PARG_REQARG,      NULL, L'm'},
 	{L"mono",     PARG_REQARG,      NULL, L'M'},
+	{L"cache",    PARG_REQARG,      NULL, L'C'},
 	{NULL,       0,                 NULL, 0}
 };
 
@@ -181,7 +183,7 @@ static void parse_nonopts(unij_cliargs_t* argsobj, int argc, wchar_t** argv)
 
 void parse_args(unij_cliargs_t *argsobj, int argc, wchar_t* argv[])
 {
-	static const wchar_t optstring[] = L"hlgp:t:c:m:M:";
+	static const wchar_t optstring[] = L"hlgrp:t:c:m:M:C:";
 	int c, optend, errflag = PARSE_ERROR_SUCCESS, optind = 0;
 	struct parg_state ps = {NULL};
 	
@@ -208,6 +210,9 @@ void parse_args(unij_cliargs_t *argsobj, int argc, wchar_t* argv[])
 			case L'g':
 				argsobj->params.debugging = true;
 				break;
+			case L'r':
+				argsobj->params.resident = true;
+				break;
 			case L'p':
 				argsobj->params.pid = parse_uint32(&errflag, ps.optarg);
 				break;
@@ -223,6 +228,9 @@ void parse_args(unij_cliargs_t *argsobj, int argc, wchar_t* argv[])
 			case L'M':
 				parse_wstr(&argsobj->params.mono_path, &errflag, ps.optarg);
 				break;
+			case L'C':
+				parse_wstr(&argsobj->cache_path, &errflag, ps.optarg);
+				break;
 			default:
 				static const wchar_t null_text[] = L"(null)";
 				wprintf(L"error: unhandled option -%c\n", (wchar_t)c);
@@ -278,11 +286,13 @@ L"\n"
 L"  -h, --help                     display this help and exit\n"
 L"  -V, --version                  output version information and exit\n"
 L"  -l, --list                     list active unity processes\n"
+L"  -C, --cache                    keep module scan results in this file between runs\n"
 L"\n"
 L"Injection parameters:\n"
 L"   ASSEMBLY                      filepath of the injected assembly\n"
 L"  -p, --pid                      required process id\n"
 L"  -g, --debug                    enable release-mode debugging\n"
+L"  -r, --resident                 keep the loader resident, so later injections skip reloading it\n"
 L"  -t, --tid                      optional thread id\n"
 L"  -c, --class                    targeted class name (default: Loader)\n"
 L"  -m, --method                   targeted method name (default: Initialize)\n"
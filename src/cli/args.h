@@ -21,6 +21,7 @@ struct unij_cliargs
 {
 	bool help : 1;
 	bool list : 1;
+	unij_wstr_t cache_path;
 	unij_params_t params;
 };
 
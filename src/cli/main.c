@@ -5,6 +5,7 @@
 #include "pch.h"
 #include "args.h"
 #include <uniject/injector.h>
+#include <uniject/modcache.h>
 #include <uniject/process.h>
 
 // TODO: Atomics compatibility macros
@@ -74,8 +75,10 @@ static UNIJ_NOINLINE bool CDECL cmd_list_monoinfo_fn(unij_monoinfo_t* info, void
 
 static int  cmd_list(void)
 {
+	// Inspect on every core, but keep the listing in pid order.
+	unij_enum_options_t options = { 0, UNIJ_ENUM_ORDERED };
 	wprintf(L"Currently running Unity processes:\n");
-	unij_enum_mono_processes(cmd_list_monoinfo_fn, NULL);
+	unij_enum_mono_processes_ex(cmd_list_monoinfo_fn, NULL, &options);
 	return 0;
 }
 
@@ -83,6 +86,11 @@ int wmain(int argc, wchar_t* argv[])
 {
 	unij_cliargs_t cliargs = {false};
 	parse_args(&cliargs, argc, argv);
+	
+	// Not being able to use the cache file only makes scanning slower, so carry on regardless.
+	if(!unij_is_empty(&cliargs.cache_path))
+		unij_modcache_persist(cliargs.cache_path.value);
+	
 	if(cliargs.list) {
 		return cmd_list();
 	} else {
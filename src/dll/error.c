@@ -6,6 +6,8 @@
 #include "pch.h"
 #include "error.h"
 
+#ifdef _WIN32
+
 #include <uniject/module.h>
 
 // TODO: Atomics compatibility macros
@@ -140,3 +142,61 @@ void unij_abort_impl(unij_error_t code, uint32_t win32_error)
 	}
 }
 
+#else
+
+// Persistent uniject-specific error information for the first fatal error encountered.
+static UNIJ_CACHE_ALIGN uint64_t first_fatal_error = 0;
+
+// Nothing to load up front. Messages go to the target's stderr.
+void unij_error_init(void)
+{
+}
+
+void unij_error_shutdown(void)
+{
+}
+
+void unij_set_fatal_error(unij_errors_t codes)
+{
+	uint64_t expected = 0;
+	uint64_t error = (uint64_t)codes.unij_code | ((uint64_t)codes.win32_code << 32);
+	__atomic_compare_exchange_n(&first_fatal_error, &expected, error, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+unij_errors_t unij_get_fatal_error(void)
+{
+	uint64_t error = __atomic_load_n(&first_fatal_error, __ATOMIC_ACQUIRE);
+	return (unij_errors_t) {
+		(unij_error_t)(uint32_t)error, (uint32_t)(error >> 32)
+	};
+}
+
+// Implementation for uniject library's usage. Written as UTF-8, since the host may never have made stderr wide.
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	char* text;
+	size_t length = unij_wcslen(message);
+	size_t size = unij_wcstoutf8(NULL, 0, message, length);
+#   ifdef _NDEBUG
+	if(level != UNIJ_LEVEL_FATAL)
+		return;
+#   endif
+
+	text = (char*)unij_alloc(size + 1);
+	if(text == NULL)
+		return;
+	unij_wcstoutf8(text, size + 1, message, length);
+	fprintf(stderr, "Uniject %ls: %s\n", unij_level_name(level)->value, text);
+	unij_free((void*)text);
+}
+
+// The entry point runs on one of the target's threads, which isn't ours to exit, and the loader's own thread unwinds
+// through the error returns anyway. So this only records the error.
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	unij_errors_t errors = { code, win32_error };
+	unij_set_fatal_error(errors);
+	unij_show_message(UNIJ_LEVEL_ERROR, L"unij_abort called with codes %u:%u", code, win32_error);
+}
+
+#endif
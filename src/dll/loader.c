@@ -7,38 +7,20 @@
 #include "pch.h"
 #include "error.h"
 #include "mono_api.h"
+#include "service.h"
 
+#include <uniject/completion.h>
 #include <uniject/injector.h>
 
-typedef struct hijack_data hijack_data_t;
-
-struct hijack_data
-{
-	HANDLE event;
-	unij_error_t status;
-	const uniject_t* ctx;
-};
-
-DEFINE_STATIC_WSTR(DEFAULT_CLASSNAME, L"Loader");
-DEFINE_STATIC_WSTR(DEFAULT_METHOD, L"Initialize");
+#ifndef _WIN32
+#	include <pthread.h>
+#endif
 
-static UNIJ_INLINE char* build_method_desc(unij_cstr_t* cls, unij_cstr_t* method)
-{
-	char* descstr = (char*)unij_alloc((size_t)(cls->length + method->length) + 2);
-	assert(descstr != NULL);
-	lstrcpyA(descstr, cls->value);
-	lstrcatA(descstr, ":");
-	lstrcatA(descstr, method->value);
-	return descstr;
-}
-
-static UNIJ_INLINE unij_wstr_t* default_to(unij_wstr_t* pvalue, unij_wstr_t* pdefault)
-{
-	return unij_is_empty(pvalue) ? pdefault : pvalue;
-}
+// Only used when the loader stays resident after its first load.
+static loader_service_t loader_service;
 
 // At this point in the process, the root appdomain has been acquired with the working thread attached to it.
-static unij_error_t mono_main(const uniject_t* ctx, MonoDomain *domain)
+static unij_error_t mono_main(const unij_params_t* params, MonoDomain *domain)
 {
 	unij_error_t result = UNIJ_ERROR_SUCCESS;
 	
@@ -46,33 +28,12 @@ static unij_error_t mono_main(const uniject_t* ctx, MonoDomain *domain)
 	MonoMethod* method;
 	MonoAssembly* assembly;
 	MonoMethodDesc* desc = NULL;
-	char* descstr = NULL;
-	unij_cstr_t aname, cname, mname;
-	unij_wstr_t *pcname, *pmname;
-	unij_params_t* params = unij_get_params((uniject_t*)ctx);
-	
-	pcname = default_to(&params->class_name, &DEFAULT_CLASSNAME);
-	pmname = default_to(&params->method_name, &DEFAULT_METHOD);
-	
-	aname = unij_wstrtocstr(&params->assembly_path);
-	if(unij_is_empty(&aname)) {
-		return unij_get_fatal_error().unij_code;
-	}
-	
-	cname = unij_wstrtocstr(pcname);
-	if(unij_is_empty(&cname)) {
-		return unij_get_fatal_error().unij_code;
-	}
-	
-	mname = unij_wstrtocstr(pmname);
-	if(unij_is_empty(&mname)) {
-		return unij_get_fatal_error().unij_code;
-	}
 	
 	if(params->debugging)
 		mono_enable_debugging();
 	
-	assembly = mono_domain_assembly_open(domain, aname.value);
+	// The injector already encoded these as UTF-8 and resolved the method descriptor, so they go straight to mono.
+	assembly = mono_domain_assembly_open(domain, params->utf8.assembly_path.value);
 	if(!assembly) {
 		result = UNIJ_ERROR_MONO;
 		unij_show_error_message(L"Failed call to mono_domain_assembly_open!");
@@ -86,14 +47,7 @@ static unij_error_t mono_main(const uniject_t* ctx, MonoDomain *domain)
 		goto cleanup;
 	}
 	
-	descstr = build_method_desc(&cname, &mname);
-	if(!descstr) {
-		result = UNIJ_ERROR_INTERNAL;
-		unij_show_error_message(L"Failed to build mono desc string!");
-		goto cleanup;
-	}
-	
-	desc = mono_method_desc_new(descstr, true);
+	desc = mono_method_desc_new(params->utf8.method_desc.value, true);
 	if(!desc) {
 		result = UNIJ_ERROR_MONO;
 		unij_show_error_message(L"Failed call to mono_method_desc_new!");
@@ -108,29 +62,20 @@ static unij_error_t mono_main(const uniject_t* ctx, MonoDomain *domain)
 	}
 	
 	mono_runtime_invoke(method, 0, 0, 0);
-	
+
 cleanup:
-	
+
 	if(desc != NULL) {
 		mono_method_desc_free(desc);
 		desc = NULL;
 	}
 	
-	if(descstr != NULL) {
-		unij_free((void*)descstr);
-		descstr = NULL;
-	}
-	
-	unij_cstrfree(&aname);
-	unij_cstrfree(&cname);
-	unij_cstrfree(&mname);
-	
 	return result;
 }
 
-static unij_error_t remote_thread_setup(const uniject_t* ctx)
+static unij_error_t remote_thread_setup(const unij_params_t* params)
 {
-	bool result;
+	unij_error_t result;
 	MonoThread* thread;
 	MonoDomain *domain = mono_get_root_domain();
 	if(domain == NULL) {
@@ -144,12 +89,23 @@ static unij_error_t remote_thread_setup(const uniject_t* ctx)
 		return UNIJ_ERROR_MONO;
 	}
 	
-	result = mono_main(ctx, domain);
+	result = mono_main(params, domain);
 	mono_thread_detach(thread);
 	
 	return result;
 }
 
+#ifdef _WIN32
+
+typedef struct hijack_data hijack_data_t;
+
+struct hijack_data
+{
+	HANDLE event;
+	unij_error_t status;
+	const unij_params_t* params;
+};
+
 static void hijack_complete(hijack_data_t* data, unij_error_t status)
 {
 	HANDLE event = data->event;
@@ -185,15 +141,15 @@ static void CDECL hijacked_entrypoint(hijack_data_t* data)
 		return;
 	}
 	
-	hijack_complete(data, mono_main(data->ctx, domain));
+	hijack_complete(data, mono_main(data->params, domain));
 }
 
-static unij_error_t hijacked_thread_setup(const uniject_t* ctx, uint32_t tid)
+static unij_error_t hijacked_thread_setup(const unij_params_t* params, uint32_t tid)
 {
 	unij_error_t result;
 	HANDLE process, duplicate;
 	HANDLE wait_handles[] = { NULL, NULL };
-	hijack_data_t data = { NULL, UNIJ_ERROR_SUCCESS, ctx, };
+	hijack_data_t data = { NULL, UNIJ_ERROR_SUCCESS, params, };
 	
 	// First we need to ensure that we can open the target thread
 	wait_handles[0] = OpenThread(THREAD_ALL_ACCESS, FALSE, (DWORD)tid);
@@ -216,7 +172,7 @@ static unij_error_t hijacked_thread_setup(const uniject_t* ctx, uint32_t tid)
 		result = UNIJ_ERROR_LASTERROR;
 		unij_fatal_call(DuplicateHandle);
 		goto cleanup;
-		
+	
 	}
 	
 	// do the actual hijacking
@@ -229,45 +185,192 @@ static unij_error_t hijacked_thread_setup(const uniject_t* ctx, uint32_t tid)
 		WaitForMultipleObjects(2, wait_handles, FALSE, INFINITE);
 		result = data.status; // TODO: Verify the thread still exists to ensure data.status being correct
 	}
-	
+
 cleanup:
 	CloseHandle(wait_handles[0]);
 	CloseHandle(wait_handles[1]);
 	return result;
 }
 
-unij_error_t loader_main(void)
+#else
+
+// Nothing comparable to unij_hijack_thread exists outside of Windows yet.
+static unij_error_t hijacked_thread_setup(const unij_params_t* params, uint32_t tid)
+{
+	UNIJ_SUPPRESS_UNUSED(params);
+	unij_fatal_error(UNIJ_ERROR_OPERATION, L"Can't run on thread %u: thread hijacking is Windows-only.", tid);
+	return UNIJ_ERROR_OPERATION;
+}
+
+#endif
+
+// Requests after the first one. The service thread is already attached to the root appdomain, so requests without a
+// thread id run right here.
+static unij_error_t CDECL service_request(MonoDomain* domain, const unij_params_t* params)
+{
+	if(params->tid == 0) {
+		return mono_main(params, domain);
+	} else {
+		return hijacked_thread_setup(params, params->tid);
+	}
+}
+
+static unij_error_t service_main(void)
+{
+	MonoThread* thread;
+	MonoDomain *domain = mono_get_root_domain();
+	if(domain == NULL) {
+		unij_show_error_message(L"Loader service failed to acquire the root appdomain!");
+		loader_service_close(&loader_service);
+		return UNIJ_ERROR_MONO;
+	}
+	
+	thread = mono_thread_attach(domain);
+	if(thread == NULL) {
+		unij_show_error_message(L"Loader service failed to attach to the root appdomain!");
+		loader_service_close(&loader_service);
+		return UNIJ_ERROR_MONO;
+	}
+	
+	loader_service.context = (void*)domain;
+	loader_service_run(&loader_service);
+	mono_thread_detach(thread);
+	loader_service_close(&loader_service);
+	return UNIJ_ERROR_SUCCESS;
+}
+
+#ifdef _WIN32
+
+static DWORD WINAPI service_thread(LPVOID parameter)
+{
+	UNIJ_SUPPRESS_UNUSED(parameter);
+	return (DWORD)service_main();
+}
+
+static bool service_thread_start(void)
+{
+	HANDLE thread = CreateThread(NULL, 0, service_thread, NULL, 0, NULL);
+	if(thread == NULL) {
+		unij_fatal_call(CreateThread);
+		return false;
+	}
+	CloseHandle(thread);
+	return true;
+}
+
+#else
+
+// Kept so loader_stop can wait for the thread before the library goes away.
+static pthread_t service_thread_id;
+static bool service_thread_started = false;
+
+static void* service_thread(void* parameter)
+{
+	UNIJ_SUPPRESS_UNUSED(parameter);
+	service_main();
+	return NULL;
+}
+
+static bool service_thread_start(void)
+{
+	int error = pthread_create(&service_thread_id, NULL, service_thread, NULL);
+	if(error != 0) {
+		unij_set_last_error((uint32_t)error);
+		unij_fatal_call(pthread_create);
+		return false;
+	}
+	service_thread_started = true;
+	return true;
+}
+
+#endif
+
+// Called on the loader's way in, so the channel gets opened right away and requests queue up until the thread gets
+// going.
+static void loader_start_service(void)
+{
+	if(!loader_service_open(&loader_service, (loader_request_fn)service_request, NULL)) {
+		unij_show_message(UNIJ_LEVEL_WARNING, L"Couldn't open the request channel. The loader won't stay resident.");
+		return;
+	}
+	
+	if(!service_thread_start())
+		loader_service_close(&loader_service);
+}
+
+void loader_stop(void)
+{
+	loader_service_stop(&loader_service);
+#ifndef _WIN32
+	// Our destructor is the last thing that runs before the library gets unmapped, so the thread has to be out of it.
+	// When the service thread itself is the one exiting the process, there's nothing left to wait for.
+	if(service_thread_started && !pthread_equal(service_thread_id, pthread_self()))
+		pthread_join(service_thread_id, NULL);
+	service_thread_started = false;
+#endif
+}
+
+uniject_t* loader_open(void)
 {
 	uniject_t* ctx;
 	const unij_params_t* params;
-	unij_error_t result = UNIJ_ERROR_SUCCESS;
 	ctx = unij_loader_open();
 	if(ctx == NULL) {
 		unij_show_message(UNIJ_LEVEL_INFO, L"ctx = NULL");
-		return UNIJ_ERROR_INTERNAL;
+		return NULL;
 	}
 	
 	params = unij_get_params(ctx);
 	if(params == NULL) {
 		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"Params = NULL!");
-		return UNIJ_ERROR_INTERNAL;
-	} else if(unij_is_empty(&params->assembly_path)) {
-		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"params->assembly_path == NULL!");
+		return NULL;
+	} else if(unij_is_empty(&params->utf8.assembly_path)) {
+		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"params->utf8.assembly_path == NULL!");
 		unij_close(ctx);
-		return UNIJ_ERROR_INTERNAL;
-	}
-	
-	if(!mono_api_init(&params->mono_path)) {
+		return NULL;
+	} else if(unij_is_empty(&params->utf8.method_desc)) {
+		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"params->utf8.method_desc == NULL!");
 		unij_close(ctx);
-		return UNIJ_ERROR_INTERNAL;
+		return NULL;
 	}
-	
-	if(params->tid == 0) {
-		result = remote_thread_setup(ctx);
-	} else {
-		result = hijacked_thread_setup(ctx, params->tid);
+	return ctx;
+}
+
+unij_error_t loader_run(uniject_t* ctx)
+{
+	unij_error_t result = UNIJ_ERROR_INTERNAL;
+	const unij_params_t* params = unij_get_params(ctx);
+	if(mono_api_init(&params->mono_path)) {
+		if(params->tid == 0) {
+			result = remote_thread_setup(params);
+		} else {
+			result = hijacked_thread_setup(params, params->tid);
+		}
+		
+		if(result == UNIJ_ERROR_SUCCESS && params->resident)
+			loader_start_service();
 	}
 	
+	unij_loader_complete(ctx, result);
 	unij_close(ctx);
 	return result;
 }
+
+// The injector can't tell a loader that failed to open from one that's still running, unless it gets told.
+void loader_fail(void)
+{
+	unij_handoff_t handoff;
+	unij_error_t status = unij_get_fatal_error().unij_code;
+	if(unij_loader_handoff(&handoff))
+		unij_completion_signal(&handoff, status != UNIJ_ERROR_SUCCESS ? status : UNIJ_ERROR_INTERNAL);
+}
+
+unij_error_t loader_main(void)
+{
+	uniject_t* ctx = loader_open();
+	if(ctx == NULL) {
+		loader_fail();
+		return UNIJ_ERROR_INTERNAL;
+	}
+	return loader_run(ctx);
+}
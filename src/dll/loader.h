@@ -8,6 +8,7 @@
 #pragma once
 
 #include <uniject.h>
+#include <uniject/base.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -17,6 +18,19 @@ typedef enum unij_error unij_error_t;
 
 unij_error_t loader_main(void);
 
+// First half of loader_main: opens the context and checks the params the injector sent.
+uniject_t* loader_open(void);
+
+// Second half of loader_main: loads the assembly, reports back to the injector, then closes \a ctx.
+unij_error_t loader_run(uniject_t* ctx);
+
+// Reports the last fatal error to an injector waiting on a loader that never got as far as loader_run.
+void loader_fail(void);
+
+// Asks a resident loader's service thread to stop after its current request. Outside of Windows, also waits for it to
+// exit.
+void loader_stop(void);
+
 #ifdef __cplusplus
 };
 #endif
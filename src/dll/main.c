@@ -1,11 +1,23 @@
 /**
  * @file main.c
  * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * On Windows, everything happens in DllMain, on the remote thread the injector started. On Linux, the constructor
+ * and destructor stand in for the attach/detach halves of DllMain, and the injection stub calls
+ * \a UNIJ_LOADER_ENTRY on one of the target's own threads. That thread only stays long enough to read the params out
+ * of the injector's mapping, before the injector closes it, and the rest runs on a thread of our own.
  */
 #include "pch.h"
 #include "error.h"
 #include "loader.h"
 
+#ifndef _WIN32
+#	include <pthread.h>
+#	include <uniject/ptrace.h>
+#endif
+
+#ifdef _WIN32
+
 // Used to determine if the currently executing code is running within a hijacked thread or the original injected
 // thread.
 static uint32_t tls_landmark = 0;
@@ -34,6 +46,7 @@ static UNIJ_INLINE bool loader_init(void* instance)
 
 static UNIJ_INLINE void loader_shutdown()
 {
+	loader_stop();
 	TlsFree(tls_landmark);
 	unij_error_shutdown();
 }
@@ -65,3 +78,76 @@ BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved)
 	}
 	return result;
 }
+
+#else
+
+// Same as the Windows landmark, but set on the thread loader_thread_main runs on.
+static pthread_key_t tls_landmark;
+static bool tls_landmark_created = false;
+
+bool unij_loader_thread(void)
+{
+	return !tls_landmark_created || pthread_getspecific(tls_landmark) == NULL;
+}
+
+static void* loader_thread_main(void* parameter)
+{
+	unij_error_t status;
+	pthread_setspecific(tls_landmark, (void*)&tls_landmark);
+	status = loader_run((uniject_t*)parameter);
+	if(status != UNIJ_ERROR_SUCCESS)
+		unij_show_message(UNIJ_LEVEL_ERROR, L"Loader failed with status %u!", (unsigned int)status);
+	return NULL;
+}
+
+__attribute__((constructor))
+static void loader_attach(void)
+{
+	if(pthread_key_create(&tls_landmark, NULL) != 0) {
+		unij_show_message(UNIJ_LEVEL_ERROR, L"Loader failed during initialization logic!");
+		return;
+	}
+	tls_landmark_created = true;
+	unij_error_init();
+}
+
+__attribute__((destructor))
+static void loader_detach(void)
+{
+	loader_stop();
+	if(tls_landmark_created) {
+		pthread_key_delete(tls_landmark);
+		tls_landmark_created = false;
+	}
+	unij_error_shutdown();
+}
+
+UNIJ_DLLEXP int unij_loader_entry(const unij_handoff_t* handoff)
+{
+	int error;
+	pthread_t thread;
+	uniject_t* ctx;
+	unij_show_message(UNIJ_LEVEL_INFO, L"Loader entry point hit!");
+	if(!tls_landmark_created)
+		return 0;
+	
+	unij_loader_set_handoff(handoff);
+	ctx = loader_open();
+	if(ctx == NULL) {
+		loader_fail();
+		return 0;
+	}
+	
+	error = pthread_create(&thread, NULL, loader_thread_main, (void*)ctx);
+	if(error != 0) {
+		unij_set_last_error((uint32_t)error);
+		unij_fatal_call(pthread_create);
+		loader_fail();
+		unij_close(ctx);
+		return 0;
+	}
+	pthread_detach(thread);
+	return 1;
+}
+
+#endif
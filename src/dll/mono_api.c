@@ -1,11 +1,22 @@
 /**
  * @file mono_api.c
+ *
+ * Binds the MONO_API pointers to the runtime that's already loaded in the target. On Windows, names are looked up in
+ * one pass over the DLL's export table. On Linux, they're all dlsym'd from the library the injector found mapped.
  */
+#include "pch.h"
 #include <uniject.h>
 #include <uniject/error.h>
-#include <uniject/module.h>
 #include <uniject/utility.h>
-#include <uniject/win32.h>
+
+#ifdef _WIN32
+#	include <uniject/module.h>
+#	include <uniject/pefile.h>
+#	include <uniject/win32.h>
+#else
+#	include <dlfcn.h>
+typedef void(*FARPROC)(void);
+#endif
 
 #include "mono_api.h"
 
@@ -21,37 +32,135 @@ static unij_once_t mono_api_initialized = UNIJ_ONCE_INIT;
 // Used in \a mono_enable_debugging 
 static const char mono_debug_argv[] = "--debugger-agent=transport=dt_socket,embedding=1,server=y,address=0.0.0.0:56000,defer=y"; 
 
+// set_vprintf_func name changes across mono versions, so both names get looked up ahead of everything else.
+#define VPRINTF_BINDINGS 2
+
+static const char* const mono_api_names[] = {
+	"mono_unity_set_vprintf_func",
+	"set_vprintf_func",
+#	define MONO_API(RET, NAME, ...) \
+	#NAME,
+#	include "mono_api.inl"
+};
+
+// Same order as mono_api_names, past the vprintf entries.
+static FARPROC* const mono_api_slots[] = {
+#	define MONO_API(RET, NAME, ...) \
+	(FARPROC*)&NAME,
+#	include "mono_api.inl"
+};
+
+#ifdef _WIN32
+
+// Looks up every name in one pass over mono's export table, instead of a GetProcAddress search per name.
+static void bind_from_file(const wchar_t* path, unij_export_binding_t* bindings, size_t count)
+{
+	unij_pefile_t* pe;
+	unij_export_index_t* index;
+	pe = unij_pefile_open(path);
+	if(pe == NULL)
+		return;
+	
+	index = unij_export_index_build(pe);
+	if(index != NULL) {
+		unij_export_index_bind(index, bindings, count);
+		unij_export_index_free(index);
+	}
+	unij_pefile_close(pe);
+}
+
+// Forwarded exports, and everything if the file couldn't be read, still need the loader to find them.
+static FARPROC resolve_binding(HMODULE module, const unij_export_binding_t* binding)
+{
+	if(binding->rva != 0)
+		return (FARPROC)((uint8_t*)module + binding->rva);
+	return GetProcAddress(module, binding->name);
+}
+
 static UNIJ_NOINLINE
 BOOL CDECL mono_api_init_once(const unij_wstr_t* mono_path)
 {
+	size_t i;
+	unij_export_binding_t bindings[ARRAYLEN(mono_api_names)];
 	HMODULE mono_module = unij_noref_module(mono_path->value);
 	if(mono_module == NULL) {
 		unij_fatal_error(UNIJ_ERROR_MONO, L"Failed to load mono DLL from: %s", mono_path->value);
 		return FALSE;
 	}
 	
-	// set_vprintf_func name changes across mono versions.
-	*((FARPROC*)&mono_unity_set_vprintf_func) = GetProcAddress(mono_module, "mono_unity_set_vprintf_func" );
+	for(i = 0; i < ARRAYLEN(bindings); i++) {
+		bindings[i].name = mono_api_names[i];
+		bindings[i].rva = 0;
+	}
+	bind_from_file(mono_path->value, bindings, ARRAYLEN(bindings));
+	
+	*((FARPROC*)&mono_unity_set_vprintf_func) = resolve_binding(mono_module, &bindings[0]);
 	if(mono_unity_set_vprintf_func == NULL) {
-		*((FARPROC*)&mono_unity_set_vprintf_func) = GetProcAddress(mono_module, "set_vprintf_func" );
+		*((FARPROC*)&mono_unity_set_vprintf_func) = resolve_binding(mono_module, &bindings[1]);
 	}
 	if(mono_unity_set_vprintf_func == NULL) {
 		unij_fatal_error(UNIJ_ERROR_METHOD, L"Failed to locate required proc: mono.mono_unity_set_vprintf_func");
 		return FALSE;
 	}
 	
-#	define MONO_API(RET, NAME, ...) \
-	UNIJ_MESSAGE("Creating import code for mono." #NAME ": " #RET "(*)(" UNIJ_STRINGIFY(__VA_ARGS__)")" ); \
-	*((FARPROC*)&NAME) = GetProcAddress(mono_module, #NAME ); \
-	if(NAME == NULL) { \
-		unij_fatal_error(UNIJ_ERROR_METHOD, L"Failed to locate required proc: mono.%s", UNIJ_WSTRINGIFY(NAME)); \
-		return FALSE; \
+	for(i = VPRINTF_BINDINGS; i < ARRAYLEN(bindings); i++) {
+		FARPROC* slot = mono_api_slots[i - VPRINTF_BINDINGS];
+		*slot = resolve_binding(mono_module, &bindings[i]);
+		if(*slot == NULL) {
+			unij_fatal_error(UNIJ_ERROR_METHOD, L"Failed to locate required proc: mono.%S", bindings[i].name);
+			return FALSE;
+		}
 	}
+	return TRUE;
+}
+
+#else
+
+static UNIJ_NOINLINE
+BOOL CDECL mono_api_init_once(const unij_wstr_t* mono_path)
+{
+	size_t i;
+	void* mono_module;
+	unij_cstr_t path = unij_wstrtocstr(mono_path);
+	if(path.value == NULL)
+		return FALSE;
 	
-#	include "mono_api.inl"
+	// Only ever finds a runtime that's already loaded, like unij_noref_module.
+	mono_module = dlopen(path.value, RTLD_NOW | RTLD_NOLOAD);
+	unij_cstrfree(&path);
+	if(mono_module == NULL) {
+		unij_fatal_error(UNIJ_ERROR_MONO, L"Failed to find the loaded mono library %ls: %hs", mono_path->value,
+		                 dlerror());
+		return FALSE;
+	}
+	
+	*((void**)&mono_unity_set_vprintf_func) = dlsym(mono_module, mono_api_names[0]);
+	if(mono_unity_set_vprintf_func == NULL) {
+		*((void**)&mono_unity_set_vprintf_func) = dlsym(mono_module, mono_api_names[1]);
+	}
+	if(mono_unity_set_vprintf_func == NULL) {
+		unij_fatal_error(UNIJ_ERROR_METHOD, L"Failed to locate required proc: mono.mono_unity_set_vprintf_func");
+		dlclose(mono_module);
+		return FALSE;
+	}
+	
+	for(i = VPRINTF_BINDINGS; i < ARRAYLEN(mono_api_names); i++) {
+		FARPROC* slot = mono_api_slots[i - VPRINTF_BINDINGS];
+		*((void**)slot) = dlsym(mono_module, mono_api_names[i]);
+		if(*slot == NULL) {
+			unij_fatal_error(UNIJ_ERROR_METHOD, L"Failed to locate required proc: mono.%hs", mono_api_names[i]);
+			dlclose(mono_module);
+			return FALSE;
+		}
+	}
+	
+	// The runtime's host keeps it loaded, so the reference dlopen just took isn't needed.
+	dlclose(mono_module);
 	return TRUE;
 }
 
+#endif
+
 bool mono_api_init(const unij_wstr_t* mono_path)
 {
 	return unij_once(&mono_api_initialized, (unij_once_fn)mono_api_init_once, (void*)mono_path);
@@ -17,7 +17,7 @@ bool mono_api_init(const unij_wstr_t* mono_path);
 void mono_enable_debugging(void);
 
 #define MONO_API(RET, NAME, ...) \
-RET ( * NAME )( __VA_ARGS__ );
+extern RET ( * NAME )( __VA_ARGS__ );
 #include "mono_api.inl"
 
 #ifdef __cplusplus
@@ -13,7 +13,9 @@
 #include <uniject/base.h>
 #include <uniject/error.h>
 #include <uniject/utility.h>
-#include <uniject/win32.h>
+#ifdef _WIN32
+#	include <uniject/win32.h>
+#endif
 
 // length stuff
 #define ARRAYLEN(ARRAY) \
@@ -0,0 +1,69 @@
+/**
+ * @file service.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ */
+#include "pch.h"
+#include "service.h"
+
+// How long the loop sleeps on the channel before checking whether it's been asked to stop.
+#define SERVICE_POLL_INTERVAL 1000
+
+bool loader_service_open(loader_service_t* service, loader_request_fn request_fn, void* context)
+{
+	RtlZeroMemory((void*)service, sizeof(*service));
+	service->request_fn = request_fn;
+	service->context = context;
+	
+	service->channel = unij_ipc_channel_reader_open();
+	if(service->channel == NULL)
+		return false;
+	
+	unij_ipc_set_listening(service->channel, true);
+	return true;
+}
+
+bool loader_service_poll(loader_service_t* service, uint32_t timeout)
+{
+	unij_status_t reply;
+	unij_params_t params;
+	if(!unij_ipc_wait(service->channel, timeout))
+		return false;
+	
+	// Requests are copied out of the channel, since their space goes back to the injector once received. If one can't
+	// be read, its reply may go out with a request id of 0, which the injector never uses and so ignores.
+	RtlZeroMemory((void*)&params, sizeof(params));
+	if(!unij_ipc_receive(service->channel, (unij_unpack_fn)unij_unpack_params, (void*)&params)) {
+		reply.status = UNIJ_ERROR_OPERATION;
+	} else if(unij_is_empty(&params.utf8.assembly_path) || unij_is_empty(&params.utf8.method_desc)) {
+		reply.status = UNIJ_ERROR_PARAM;
+	} else {
+		reply.status = (uint32_t)service->request_fn(service->context, &params);
+	}
+	reply.request = params.request;
+	unij_free_params(&params);
+	
+	// The injector is blocked on this, so a full reply ring means it's long gone.
+	if(!unij_ipc_send(service->channel, (unij_pack_fn)unij_pack_status, (const void*)&reply))
+		unij_show_message(UNIJ_LEVEL_WARNING, L"Couldn't reply to a load request: status=%u", reply.status);
+	return true;
+}
+
+void loader_service_run(loader_service_t* service)
+{
+	while(unij_atomic_load_acquire(&service->stopping) == 0)
+		loader_service_poll(service, SERVICE_POLL_INTERVAL);
+}
+
+void loader_service_stop(loader_service_t* service)
+{
+	unij_atomic_store_release(&service->stopping, 1);
+}
+
+void loader_service_close(loader_service_t* service)
+{
+	if(service->channel != NULL) {
+		unij_ipc_set_listening(service->channel, false);
+		unij_ipc_close(service->channel);
+		service->channel = NULL;
+	}
+}
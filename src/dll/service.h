@@ -0,0 +1,68 @@
+/**
+ * @file service.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Request loop for a resident loader.
+ * 
+ * Only talks to the channel through uniject/ipc.h and hands each request to a handler, so the loop itself doesn't
+ * care which platform or mono it's running against.
+ */
+#ifndef _LOADER_SERVICE_H_
+#define _LOADER_SERVICE_H_
+#pragma once
+
+#include <uniject.h>
+#include <uniject/error.h>
+#include <uniject/ipc.h>
+#include <uniject/params.h>
+#include "atomics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct loader_service loader_service_t;
+
+/**
+ * @brief Handles a single load request. The params are only valid for the duration of the call.
+ */
+typedef unij_error_t(CDECL* loader_request_fn)(void* context, const unij_params_t* params);
+
+struct loader_service
+{
+	unij_ipc_t* channel;
+	loader_request_fn request_fn;
+	void* context;
+	
+	// Checked between requests. Set by loader_service_stop, possibly from another thread.
+	unij_atomic_u32 stopping;
+};
+
+/**
+ * @brief Attaches to the injector's request channel and starts advertising the service as listening. Requests sent
+ * from then on queue up until \a loader_service_run gets to them.
+ */
+bool loader_service_open(loader_service_t* service, loader_request_fn request_fn, void* context);
+
+/**
+ * @brief Waits up to \a timeout milliseconds for a request, then handles it and replies with its status.
+ * @return false when no request arrived or the request couldn't be received.
+ */
+bool loader_service_poll(loader_service_t* service, uint32_t timeout);
+
+/**
+ * @brief Handles requests until \a loader_service_stop is called.
+ */
+void loader_service_run(loader_service_t* service);
+
+void loader_service_stop(loader_service_t* service);
+
+/**
+ * @brief Stops advertising the service and detaches from the channel.
+ */
+void loader_service_close(loader_service_t* service);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _LOADER_SERVICE_H_ */
@@ -0,0 +1,242 @@
+/**
+ * @file arena.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Blocks come straight from the library heap so an arena can be installed as the allocator behind \a unij_alloc
+ * without recursing into itself.
+ */
+#include "pch.h"
+#include <uniject/arena.h>
+
+#define TOPTR(X) ((size_t)(X))
+
+#define ARENA_ALIGN (2 * sizeof(void*))
+#define ARENA_ALIGN_UP(X) \
+	( ((X) + (ARENA_ALIGN - 1)) & ~((size_t)(ARENA_ALIGN - 1)) )
+
+// Every allocation is preceded by its size, so it can be copied when resized.
+#define ARENA_PREFIX_SIZE ARENA_ALIGN
+
+typedef struct arena_block arena_block_t;
+
+struct arena_block
+{
+	arena_block_t* next;
+	size_t capacity;
+	size_t used;
+};
+
+#define BLOCK_HEADER_SIZE ARENA_ALIGN_UP(sizeof(arena_block_t))
+
+#define BLOCK_DATA(B) \
+	( (uint8_t*)(TOPTR(B) + BLOCK_HEADER_SIZE) )
+
+#define ALLOC_SIZE(PTR) \
+	( *((size_t*)(TOPTR(PTR) - ARENA_PREFIX_SIZE)) )
+
+struct unij_arena
+{
+	size_t block_size;
+	
+	// Most recently allocated block. Older blocks are chained through next.
+	arena_block_t* head;
+	
+	// Most recent allocation, which can still be resized in place or given back.
+	void* last;
+};
+
+#define ENSURE_ARENA(A) \
+	( !unij_fatal_null3(A, UNIJ_FUNCTION, L"arena") )
+
+static arena_block_t* arena_add_block(unij_arena_t* A, size_t required)
+{
+	arena_block_t* block;
+	size_t capacity = A->block_size > required ? A->block_size : required;
+	if(capacity > SIZE_MAX - BLOCK_HEADER_SIZE) {
+		unij_fatal_error(UNIJ_ERROR_OUTOFMEMORY, L"Arena allocation of %zu bytes is too large!", required);
+		return NULL;
+	}
+	
+	// unij_heap_alloc hands back zeroed memory, which is what keeps every allocation zeroed.
+	block = (arena_block_t*)unij_heap_alloc(BLOCK_HEADER_SIZE + capacity);
+	if(block == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	block->capacity = capacity;
+	block->next = A->head;
+	A->head = block;
+	return block;
+}
+
+static UNIJ_INLINE bool arena_owns_last(unij_arena_t* A, void* ptr)
+{
+	return A != NULL && ptr != NULL && ptr == A->last;
+}
+
+unij_arena_t* unij_arena_create(size_t block_size)
+{
+	unij_arena_t* A = (unij_arena_t*)unij_heap_alloc(sizeof(*A));
+	if(A == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	A->block_size = ARENA_ALIGN_UP(block_size == 0 ? UNIJ_ARENA_BLOCK_SIZE : block_size);
+	return A;
+}
+
+void unij_arena_destroy(unij_arena_t* A)
+{
+	if(A != NULL) {
+		arena_block_t* block = A->head;
+		while(block != NULL) {
+			arena_block_t* next = block->next;
+			unij_heap_free((void*)block);
+			block = next;
+		}
+		unij_heap_free((void*)A);
+	}
+}
+
+void unij_arena_reset(unij_arena_t* A)
+{
+	arena_block_t* block;
+	if(!ENSURE_ARENA(A) || A->head == NULL)
+		return;
+	
+	// Hold onto the newest block, since it's likely to be the largest.
+	block = A->head->next;
+	while(block != NULL) {
+		arena_block_t* next = block->next;
+		unij_heap_free((void*)block);
+		block = next;
+	}
+	
+	RtlZeroMemory((void*)BLOCK_DATA(A->head), A->head->used);
+	A->head->next = NULL;
+	A->head->used = 0;
+	A->last = NULL;
+}
+
+void* unij_arena_alloc(unij_arena_t* A, size_t size)
+{
+	uint8_t* ptr;
+	size_t total;
+	arena_block_t* block;
+	if(!ENSURE_ARENA(A))
+		return NULL;
+	
+	if(size > SIZE_MAX - (ARENA_PREFIX_SIZE + ARENA_ALIGN)) {
+		unij_fatal_error(UNIJ_ERROR_OUTOFMEMORY, L"Arena allocation of %zu bytes is too large!", size);
+		return NULL;
+	}
+	
+	total = ARENA_PREFIX_SIZE + ARENA_ALIGN_UP(size);
+	block = A->head;
+	if(block == NULL || block->capacity - block->used < total) {
+		block = arena_add_block(A, total);
+		if(block == NULL)
+			return NULL;
+	}
+	
+	ptr = BLOCK_DATA(block) + block->used + ARENA_PREFIX_SIZE;
+	block->used += total;
+	ALLOC_SIZE(ptr) = size;
+	A->last = (void*)ptr;
+	return (void*)ptr;
+}
+
+void* unij_arena_realloc(unij_arena_t* A, void* ptr, size_t size)
+{
+	void* result;
+	size_t old_size;
+	if(ptr == NULL)
+		return unij_arena_alloc(A, size);
+	else if(!ENSURE_ARENA(A))
+		return NULL;
+	
+	old_size = ALLOC_SIZE(ptr);
+	if(size <= old_size)
+		return ptr;
+	
+	// The most recent allocation just claims more of its block, if there's room.
+	if(arena_owns_last(A, ptr)) {
+		size_t growth = ARENA_ALIGN_UP(size) - ARENA_ALIGN_UP(old_size);
+		arena_block_t* block = A->head;
+		if(block->capacity - block->used >= growth) {
+			block->used += growth;
+			ALLOC_SIZE(ptr) = size;
+			return ptr;
+		}
+	}
+	
+	result = unij_arena_alloc(A, size);
+	if(result != NULL)
+		RtlCopyMemory(result, (const void*)ptr, old_size);
+	return result;
+}
+
+void unij_arena_free(unij_arena_t* A, void* ptr)
+{
+	size_t total;
+	arena_block_t* block;
+	if(!arena_owns_last(A, ptr))
+		return;
+	
+	// Hand the space back to the block, zeroed for the next allocation.
+	block = A->head;
+	total = ARENA_PREFIX_SIZE + ARENA_ALIGN_UP(ALLOC_SIZE(ptr));
+	block->used -= total;
+	RtlZeroMemory((void*)(BLOCK_DATA(block) + block->used), total);
+	A->last = NULL;
+}
+
+size_t unij_arena_used(unij_arena_t* A)
+{
+	size_t used = 0;
+	arena_block_t* block;
+	if(!ENSURE_ARENA(A))
+		return 0;
+	
+	for(block = A->head; block != NULL; block = block->next)
+		used += block->used;
+	return used;
+}
+
+static void* CDECL arena_alloc_handler(unij_arena_t* A, size_t size)
+{
+	return unij_arena_alloc(A, size);
+}
+
+static void* CDECL arena_realloc_handler(unij_arena_t* A, void* ptr, size_t size)
+{
+	return unij_arena_realloc(A, ptr, size);
+}
+
+static void CDECL arena_free_handler(unij_arena_t* A, void* ptr)
+{
+	unij_arena_free(A, ptr);
+}
+
+void unij_arena_memprocs(unij_arena_t* A, unij_memprocs_t* procs)
+{
+	if(!ENSURE_ARENA(A) || unij_fatal_null(procs))
+		return;
+	
+	procs->parameter = (void*)A;
+	procs->alloc_fn = (unij_alloc_fn)arena_alloc_handler;
+	procs->realloc_fn = (unij_realloc_fn)arena_realloc_handler;
+	procs->free_fn = (unij_free_fn)arena_free_handler;
+}
+
+void unij_arena_handlers(unij_arena_t* A, unij_handlers_t* handlers)
+{
+	if(!ENSURE_ARENA(A) || unij_fatal_null(handlers))
+		return;
+	
+	handlers->context = (void*)A;
+	handlers->alloc_fn = (void*(CDECL*)(void*, size_t))arena_alloc_handler;
+	handlers->free_fn = (void(CDECL*)(void*, void*))arena_free_handler;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file atomics.h
+ *
+ * Minimal set of 32-bit atomics for data shared between processes. C11 atomics are used wherever the compiler has
+ * them. Older MSVC versions fall back to volatile accesses fenced by compiler barriers, which is enough on x86/x64
+ * where aligned 32-bit loads and stores are atomic and already ordered the way acquire/release needs.
+ *
+ * Only 32-bit values are used, so the layout and lock-freedom of anything shared stays the same between 32-bit and
+ * 64-bit processes.
+ */
+#ifndef _UNIJECT_ATOMICS_H_
+#define _UNIJECT_ATOMICS_H_
+#pragma once
+
+#if defined(UNIJ_CC_MSVC) && !defined(__clang__) && \
+    (!defined(__STDC_VERSION__) || (__STDC_VERSION__ < 201112L) || defined(__STDC_NO_ATOMICS__))
+#	define UNIJ_ATOMICS_MSVC 1
+#	include <intrin.h>
+#else
+#	include <stdatomic.h>
+#endif
+
+#ifdef UNIJ_ATOMICS_MSVC
+
+typedef volatile uint32_t unij_atomic_u32;
+
+#	if defined(_M_IX86) || defined(_M_X64)
+#		define UNIJ_ATOMIC_FENCE() _ReadWriteBarrier()
+#	else
+#		define UNIJ_ATOMIC_FENCE() MemoryBarrier()
+#	endif
+
+static UNIJ_INLINE uint32_t unij_atomic_load_relaxed(const unij_atomic_u32* ptr)
+{
+	return *ptr;
+}
+
+static UNIJ_INLINE uint32_t unij_atomic_load_acquire(const unij_atomic_u32* ptr)
+{
+	uint32_t value = *ptr;
+	UNIJ_ATOMIC_FENCE();
+	return value;
+}
+
+static UNIJ_INLINE void unij_atomic_store_relaxed(unij_atomic_u32* ptr, uint32_t value)
+{
+	*ptr = value;
+}
+
+static UNIJ_INLINE void unij_atomic_store_release(unij_atomic_u32* ptr, uint32_t value)
+{
+	UNIJ_ATOMIC_FENCE();
+	*ptr = value;
+}
+
+static UNIJ_INLINE uint32_t unij_atomic_fetch_add(unij_atomic_u32* ptr, uint32_t value)
+{
+	return (uint32_t)_InterlockedExchangeAdd((volatile long*)ptr, (long)value);
+}
+
+static UNIJ_INLINE uint32_t unij_atomic_exchange(unij_atomic_u32* ptr, uint32_t value)
+{
+	return (uint32_t)_InterlockedExchange((volatile long*)ptr, (long)value);
+}
+
+static UNIJ_INLINE bool unij_atomic_compare_exchange(unij_atomic_u32* ptr, uint32_t* pexpected, uint32_t desired)
+{
+	uint32_t expected = *pexpected;
+	*pexpected = (uint32_t)_InterlockedCompareExchange((volatile long*)ptr, (long)desired, (long)expected);
+	return *pexpected == expected;
+}
+
+#else
+
+typedef _Atomic uint32_t unij_atomic_u32;
+
+static UNIJ_INLINE uint32_t unij_atomic_load_relaxed(const unij_atomic_u32* ptr)
+{
+	return atomic_load_explicit((unij_atomic_u32*)ptr, memory_order_relaxed);
+}
+
+static UNIJ_INLINE uint32_t unij_atomic_load_acquire(const unij_atomic_u32* ptr)
+{
+	return atomic_load_explicit((unij_atomic_u32*)ptr, memory_order_acquire);
+}
+
+static UNIJ_INLINE void unij_atomic_store_relaxed(unij_atomic_u32* ptr, uint32_t value)
+{
+	atomic_store_explicit(ptr, value, memory_order_relaxed);
+}
+
+static UNIJ_INLINE void unij_atomic_store_release(unij_atomic_u32* ptr, uint32_t value)
+{
+	atomic_store_explicit(ptr, value, memory_order_release);
+}
+
+static UNIJ_INLINE uint32_t unij_atomic_fetch_add(unij_atomic_u32* ptr, uint32_t value)
+{
+	return atomic_fetch_add_explicit(ptr, value, memory_order_relaxed);
+}
+
+static UNIJ_INLINE uint32_t unij_atomic_exchange(unij_atomic_u32* ptr, uint32_t value)
+{
+	return atomic_exchange_explicit(ptr, value, memory_order_acq_rel);
+}
+
+// Acquire/release on success. On failure, \a pexpected gets the current value.
+static UNIJ_INLINE bool unij_atomic_compare_exchange(unij_atomic_u32* ptr, uint32_t* pexpected, uint32_t desired)
+{
+	return atomic_compare_exchange_strong_explicit(ptr, pexpected, desired, memory_order_acq_rel, memory_order_acquire);
+}
+
+#endif
+
+#endif /* _UNIJECT_ATOMICS_H_ */
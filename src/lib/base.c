@@ -6,20 +6,23 @@
 #include "base_private.h"
 #include "process_private.h"
 #include "error_private.h"
+#include <uniject/arena.h>
+#include <uniject/completion.h>
 #include <uniject/injector.h>
+#include <uniject/logger.h>
 #include <uniject/utility.h>
 
 #define ENSURE_CTX(CTX) \
 	(!unij_fatal_null(CTX))
 
 #define ENSURE_LOADER(CTX) \
-	( (uniject_t*)ctx_ensure_role((void*)(CTX), ROLE_LOADER, true, __FUNCTIONW__) )
+	( (uniject_t*)ctx_ensure_role((void*)(CTX), ROLE_LOADER, true, UNIJ_FUNCTION) )
 
 #define ENSURE_INJECTOR(CTX) \
-	( (unijector_t*)ctx_ensure_role((void*)(CTX), ROLE_INJECTOR, true, __FUNCTIONW__) )
+	( (unijector_t*)ctx_ensure_role((void*)(CTX), ROLE_INJECTOR, true, UNIJ_FUNCTION) )
 
 #define UNIJECTOR(CTX) \
-	( (unijector_t*)ctx_ensure_role((void*)(CTX), ROLE_INJECTOR, false, __FUNCTIONW__) )
+	( (unijector_t*)ctx_ensure_role((void*)(CTX), ROLE_INJECTOR, false, UNIJ_FUNCTION) )
 
 static UNIJ_INLINE const wchar_t* ctx_role_text(unij_role_t role)
 {
@@ -34,7 +37,7 @@ static UNIJ_INLINE const wchar_t* ctx_role_text(unij_role_t role)
 	}
 }
 
-static void* ctx_ensure_role(uniject_t* ctx, unij_role_t role, bool error, const wchar_t* caller)
+static void* ctx_ensure_role(uniject_t* ctx, unij_role_t role, bool error, const char* caller)
 {
 	uniject_t* result = NULL;
 	if(!unij_fatal_null2(ctx, caller)) {
@@ -43,8 +46,8 @@ static void* ctx_ensure_role(uniject_t* ctx, unij_role_t role, bool error, const
 		} else if(error) {
 			unij_fatal_error(
 				UNIJ_ERROR_OPERATION,
-				L"%s requires a uniject context with a '%s' role assigned!",
-				ctx_role_text(role)
+				L"%hs requires a uniject context with a '%ls' role assigned!",
+				caller, ctx_role_text(role)
 			);
 		}
 	}
@@ -62,7 +65,7 @@ static uniject_t* ctx_alloc(unij_process_t* process, size_t size, bool resolve_m
 	unij_wstr_t* mono_path = NULL;
 	if(!unij_init())
 		return ctx;
-		
+	
 	if(resolve_mono && process != NULL) {
 		mono_path = unij_process_get_mono_path(process);
 		if(mono_path == NULL) {
@@ -78,13 +81,21 @@ static uniject_t* ctx_alloc(unij_process_t* process, size_t size, bool resolve_m
 	
 	if(process == NULL) {
 		ctx->role = ROLE_LOADER;
-		ctx->params.pid = (uint32_t)GetCurrentProcessId();
+		ctx->params.pid = unij_current_pid();
+		
+		// Loaders started by an older injector don't get a handoff block, so they fall back to the per-process names.
+		if(!unij_loader_handoff(&ctx->handoff)) {
+			LogWarning(L"No handoff block was found. Falling back to the per-process object names.");
+			ctx->handoff.pid = ctx->params.pid;
+			ctx->handoff.nonce = 0;
+		}
 	} else {
 		unijector_t* ext = (unijector_t*)ctx;
 		assert(size == sizeof(unijector_t));
 		ext->process = process;
 		ctx->role = ROLE_INJECTOR;
 		ctx->params.pid = process->pid;
+		unij_handoff_init(&ctx->handoff, process->pid);
 		if(resolve_mono) {
 			ctx->params.mono_path = unij_wstrdup(mono_path);
 		}
@@ -118,6 +129,7 @@ uniject_t* unij_injector_open(uint32_t pid)
 	return result;
 }
 
+#ifdef _WIN32
 uniject_t* unij_injector_assign(HANDLE process_handle)
 {
 	uniject_t* result = NULL;
@@ -137,6 +149,7 @@ uniject_t* unij_injector_assign(HANDLE process_handle)
 	
 	return result;
 }
+#endif
 
 uniject_t* unij_injector_open_params(const unij_params_t* params)
 {
@@ -169,6 +182,7 @@ uniject_t* unij_injector_open_params(const unij_params_t* params)
 	// Copy over the params.
 	result->params.tid = params->tid;
 	result->params.debugging = params->debugging;
+	result->params.resident = params->resident;
 	result->params.log_path = unij_wstrdup(&params->log_path);
 	result->params.class_name = unij_wstrdup(&params->class_name);
 	result->params.method_name = unij_wstrdup(&params->method_name);
@@ -183,51 +197,485 @@ uniject_t* unij_loader_open(void)
 {
 	// Allocate our ctx struct and initialize IPC context
 	uniject_t* ctx = ctx_alloc(NULL, sizeof(uniject_t), false);
-	if(ctx != NULL && !unij_ipc_unpack(&ctx->ipc, (void*)&(ctx->params))) {
+	if(ctx == NULL)
+		return ctx;
+	
+	// Keep allocations in the target process to a minimum by borrowing the strings straight from the mapping. It
+	// stays open until unij_close.
+	ctx->borrowed = true;
+	unij_ipc_set_unpack_fn(&ctx->ipc, (unij_unpack_fn)unij_unpack_params_view);
+	if(!unij_ipc_unpack(&ctx->ipc, (void*)&(ctx->params))) {
 		unij_close(ctx);
 		ctx = NULL;
 	}
 	return ctx;
 }
 
+// Copies a string into the context's arena when it has one.
+static unij_wstr_t ctx_wstrdup(uniject_t* ctx, const unij_wstr_t* value)
+{
+	wchar_t* copy;
+	unij_wstr_t result = { 0, NULL };
+	uint16_t length = unij_wstrlen(value);
+	if(ctx->arena == NULL)
+		return unij_wstrdup(value);
+	else if(length == 0)
+		return result;
+	
+	copy = (wchar_t*)unij_arena_alloc(ctx->arena, WSIZE((size_t)length + 1));
+	if(copy != NULL) {
+		RtlCopyMemory((void*)copy, (const void*)value->value, WSIZE(length));
+		result.length = length;
+		result.value = (const wchar_t*)copy;
+	}
+	return result;
+}
+
+// Arena-owned strings are left for unij_close.
+static void ctx_wstrfree(uniject_t* ctx, unij_wstr_t* str)
+{
+	if(ctx->arena == NULL) {
+		unij_wstrfree(str);
+	} else {
+		RtlZeroMemory((void*)str, sizeof(*str));
+	}
+}
+
+// Most strings unij_set_arena has to move: every param plus the injector's loader path.
+#define CTX_ADOPTIONS_MAX 8
+
+typedef struct ctx_adoption ctx_adoption_t;
+
+// A string allocated with unij_alloc, on its way into the arena.
+struct ctx_adoption
+{
+	const void** pvalue;
+	size_t length;
+	size_t width;
+	void* copy;
+};
+
+#define ADOPTION(STR) \
+	{ (const void**)&((STR).value), (size_t)(STR).length, sizeof(*((STR).value)), NULL }
+
+// Copies every string before swapping any of them, so a failure leaves the context's own strings in place.
+static bool ctx_adopt_strings(unij_arena_t* arena, ctx_adoption_t* adoptions, size_t count)
+{
+	size_t i;
+	for(i = 0; i < count; i++) {
+		ctx_adoption_t* adoption = &adoptions[i];
+		if(*adoption->pvalue == NULL || adoption->length == 0)
+			continue;
+		
+		// Copies made so far stay in the arena until it's reset.
+		adoption->copy = unij_arena_alloc(arena, (adoption->length + 1) * adoption->width);
+		if(adoption->copy == NULL)
+			return false;
+		RtlCopyMemory(adoption->copy, *adoption->pvalue, adoption->length * adoption->width);
+	}
+	
+	for(i = 0; i < count; i++) {
+		if(adoptions[i].copy != NULL) {
+			unij_free((void*)*adoptions[i].pvalue);
+			*adoptions[i].pvalue = (const void*)adoptions[i].copy;
+		}
+	}
+	return true;
+}
+
+bool unij_set_arena(uniject_t* ctx, unij_arena_t* arena)
+{
+	unij_params_t* params;
+	unijector_t* injector;
+	if(!ENSURE_CTX(ctx) || unij_fatal_null(arena)) {
+		return false;
+	} else if(ctx->arena != NULL) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"unij_set_arena can only be called once per context!");
+		return false;
+	}
+	
+	// Borrowed strings belong to the IPC mapping, so there's nothing to move.
+	params = &ctx->params;
+	injector = UNIJECTOR(ctx);
+	if(!ctx->borrowed) {
+		ctx_adoption_t adoptions[CTX_ADOPTIONS_MAX] = {
+			ADOPTION(params->mono_path),
+			ADOPTION(params->assembly_path),
+			ADOPTION(params->class_name),
+			ADOPTION(params->method_name),
+			ADOPTION(params->log_path),
+			ADOPTION(params->utf8.assembly_path),
+			ADOPTION(params->utf8.method_desc)
+		};
+		size_t count = CTX_ADOPTIONS_MAX - 1;
+		if(injector != NULL) {
+			ctx_adoption_t loader = ADOPTION(injector->loader);
+			adoptions[count++] = loader;
+		}
+		if(!ctx_adopt_strings(arena, adoptions, count))
+			return false;
+	}
+	
+	ctx->arena = arena;
+	return true;
+}
+
 static void ctx_free_params(uniject_t* ctx)
 {
 	unij_params_t* params = &ctx->params;
 	unijector_t* injector = UNIJECTOR(ctx);
-	unij_wstrfree(&params->assembly_path);
-	unij_wstrfree(&params->class_name);
-	unij_wstrfree(&params->method_name);
-	unij_wstrfree(&params->log_path);
-	unij_wstrfree(&params->mono_path);
-	if(injector != NULL) {
-		unij_wstrfree(&injector->loader);
+	if(ctx->borrowed || ctx->arena != NULL) {
+		// Nothing to free individually. Arena strings go away along with the arena in unij_close.
 		RtlZeroMemory((void*)params, sizeof(unij_params_t));
+		if(injector != NULL)
+			RtlZeroMemory((void*)&injector->loader, sizeof(injector->loader));
+		return;
 	}
+	
+	unij_free_params(params);
+	if(injector != NULL)
+		unij_wstrfree(&injector->loader);
 }
 
 void unij_close(uniject_t* ctx)
 {
 	if(ctx != NULL) {
 		unijector_t* injector = UNIJECTOR(ctx);
-		if(injector != NULL)
+		if(injector != NULL) {
 			unij_process_close(injector->process);
+			unij_ipc_close(injector->channel);
+		}
 		
 		if(ctx->ipc.name != NULL)
 			unij_ipc_close(&ctx->ipc);
 		
 		ctx_free_params(ctx);
+		unij_arena_destroy(ctx->arena);
 		unij_free((void*)ctx);
 	}
 }
 
+// The channel has to exist before the loader is injected, since a resident loader attaches to it on startup.
+static bool ctx_open_channel(unijector_t* injector)
+{
+	uniject_t* ctx = &injector->u;
+	if(injector->channel != NULL)
+		return true;
+	
+	injector->channel = unij_ipc_channel_writer_open(ctx->params.pid);
+	return injector->channel != NULL;
+}
+
+// Hands the params to a loader that's already resident in the target. *psent says whether there was one, in which
+// case reply is waiting on the answer.
+static bool ctx_send_request(unijector_t* injector, unij_reply_t* reply, bool* psent)
+{
+	uniject_t* ctx = &injector->u;
+	*psent = false;
+	if(!ctx->params.resident)
+		return true;
+	else if(!ctx_open_channel(injector))
+		return false;
+	
+	// Skip the whole injection when the loader is already resident in the target.
+	if(unij_ipc_listener(injector->channel) != ctx->params.pid)
+		return true;
+	
+	// Unique within this process, and mixed with our pid, so an earlier writer's requests won't share it either.
+	ctx->params.request = unij_object_nonce();
+	if(!unij_ipc_send(injector->channel, NULL, (const void*)&ctx->params)) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"The resident loader isn't keeping up with load requests!");
+		return false;
+	}
+	
+	RtlZeroMemory((void*)reply, sizeof(*reply));
+	reply->request = ctx->params.request;
+	reply->next = injector->replies;
+	injector->replies = reply;
+	*psent = true;
+	return true;
+}
+
+// Stops waiting on a reply. If it still comes in, it gets dropped along with any other stale one.
+static void ctx_forget_reply(unijector_t* injector, unij_reply_t* reply)
+{
+	unij_reply_t** link;
+	for(link = &injector->replies; *link != NULL; link = &(*link)->next) {
+		if(*link == reply) {
+			*link = reply->next;
+			reply->next = NULL;
+			break;
+		}
+	}
+}
+
+// Hands every reply that's come in to the request it answers.
+static bool ctx_receive_replies(unijector_t* injector)
+{
+	unij_reply_t* reply;
+	unij_status_t status;
+	while(unij_ipc_pending(injector->channel)) {
+		if(!unij_ipc_receive(injector->channel, (unij_unpack_fn)unij_unpack_status, (void*)&status))
+			return false;
+		
+		reply = injector->replies;
+		while(reply != NULL && reply->request != status.request)
+			reply = reply->next;
+		
+		if(reply == NULL) {
+			LogWarning(L"Dropped a reply to request 0x%08X, which nothing is waiting on.", status.request);
+			continue;
+		}
+		
+		reply->received = true;
+		reply->status = status.status;
+		ctx_forget_reply(injector, reply);
+	}
+	return true;
+}
+
+// Waits for the resident loader to report back on the request ctx_send_request sent.
+static bool ctx_request_load(unijector_t* injector, unij_reply_t* reply)
+{
+	uniject_t* ctx = &injector->u;
+	uint32_t elapsed, start = unij_tick_count();
+	while(!reply->received) {
+		elapsed = unij_tick_count() - start;
+		if(elapsed >= UNIJ_SERVICE_TIMEOUT || !unij_ipc_wait(injector->channel, UNIJ_SERVICE_TIMEOUT - elapsed)) {
+			ctx_forget_reply(injector, reply);
+			unij_fatal_error(UNIJ_ERROR_OPERATION, L"Timed out waiting on the resident loader in process %u.",
+			                 ctx->params.pid);
+			return false;
+		} else if(!ctx_receive_replies(injector)) {
+			ctx_forget_reply(injector, reply);
+			return false;
+		}
+	}
+	
+	if(reply->status != UNIJ_ERROR_SUCCESS) {
+		unij_fatal_error((unij_error_t)reply->status, L"The resident loader failed to load the assembly!");
+		return false;
+	}
+	return true;
+}
+
 bool unij_inject(uniject_t* ctx)
 {
+	bool sent;
+	unij_reply_t reply;
 	unijector_t* injector = ENSURE_INJECTOR(ctx);
-	if(injector == NULL) return false;
+	if(injector == NULL || !ctx_send_request(injector, &reply, &sent))
+		return false;
+	else if(sent)
+		return ctx_request_load(injector, &reply);
+	
 	if(!unij_ipc_pack(&ctx->ipc, (const void*)&ctx->params)) {
 		return false;
 	}
-	return unij_inject_loader_ex(injector->process, &injector->loader);
+	
+	// Left over from an earlier unij_inject_async, whose completion objects are gone by now.
+	ctx->handoff.flags &= ~UNIJ_HANDOFF_COMPLETION;
+	return unij_inject_loader_ex(injector->process, &injector->loader, &ctx->handoff);
+}
+
+/**
+ * @internal
+ * Asynchronous injection
+ */
+
+// How often an operation checks on the injected code while it sleeps, until that code has loaded the loader.
+#define OPERATION_CHECK_INTERVAL 100
+
+struct unij_operation
+{
+	unijector_t* injector;
+	unij_operation_fn callback;
+	void* user;
+	uint32_t started;
+	uint32_t timeout;
+	unij_operation_state_t state;
+	unij_error_t status;
+	
+	// Both NULL for requests to a resident loader, which get their reply over the channel instead.
+	unij_completion_t* completion;
+	unij_injection_t* injection;
+	unij_reply_t reply;
+};
+
+static void operation_free(unij_operation_t* op)
+{
+	unij_injection_close(op->injection);
+	unij_completion_close(op->completion);
+	unij_free((void*)op);
+}
+
+static void operation_finish(unij_operation_t* op, unij_operation_state_t state, unij_error_t status)
+{
+	if(op->completion == NULL)
+		ctx_forget_reply(op->injector, &op->reply);
+	op->state = state;
+	op->status = status;
+	if(op->callback != NULL)
+		op->callback(op, state, status, op->user);
+}
+
+// Milliseconds left before the operation times out.
+static uint32_t operation_remaining(const unij_operation_t* op)
+{
+	uint32_t elapsed = unij_tick_count() - op->started;
+	if(op->timeout == INFINITE)
+		return INFINITE;
+	return elapsed < op->timeout ? op->timeout - elapsed : 0;
+}
+
+// Whether the loader has reported back, without waiting on it.
+static bool operation_check(unij_operation_t* op, unij_error_t* pstatus)
+{
+	bool loaded;
+	if(op->completion == NULL) {
+		// Replies can come in for other operations on the same context, so they get sorted out first.
+		if(!ctx_receive_replies(op->injector)) {
+			*pstatus = UNIJ_ERROR_OPERATION;
+			return true;
+		}
+		
+		*pstatus = (unij_error_t)op->reply.status;
+		return op->reply.received;
+	}
+	
+	if(unij_completion_check(op->completion, pstatus))
+		return true;
+	
+	// Code that finished without loading the loader leaves nothing behind that could still report back.
+	if(unij_injection_wait(op->injection, 0, &loaded) == UNIJ_WAIT_SIGNALED && !loaded) {
+		*pstatus = UNIJ_ERROR_LOADERS;
+		return true;
+	}
+	return false;
+}
+
+// Sleeps until the loader might have reported back, for at most timeout milliseconds.
+static bool operation_sleep(unij_operation_t* op, uint32_t timeout)
+{
+	bool loaded;
+	unij_error_t status;
+	if(op->completion == NULL) {
+		unij_ipc_wait(op->injector->channel, timeout);
+		return true;
+	}
+	
+	// The loader can't report a failure to load itself, so that has to be checked for separately.
+	if(unij_injection_wait(op->injection, 0, &loaded) != UNIJ_WAIT_SIGNALED && timeout > OPERATION_CHECK_INTERVAL)
+		timeout = OPERATION_CHECK_INTERVAL;
+	return unij_completion_wait(op->completion, timeout, &status) != UNIJ_WAIT_FAILED;
+}
+
+/**
+ * @endinternal
+ */
+
+unij_operation_t* unij_inject_async(uniject_t* ctx, unij_operation_fn callback, void* user, uint32_t timeout)
+{
+	bool sent;
+	unij_operation_t* op;
+	unijector_t* injector = ENSURE_INJECTOR(ctx);
+	if(injector == NULL)
+		return NULL;
+	
+	op = (unij_operation_t*)unij_alloc(sizeof(unij_operation_t));
+	if(op == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	op->injector = injector;
+	op->callback = callback;
+	op->user = user;
+	op->timeout = timeout;
+	op->state = UNIJ_OPERATION_PENDING;
+	op->status = UNIJ_ERROR_SUCCESS;
+	op->started = unij_tick_count();
+	if(!ctx_send_request(injector, &op->reply, &sent)) {
+		operation_free(op);
+		return NULL;
+	} else if(sent) {
+		return op;
+	}
+	
+	// Packing can still pick a new nonce, and the completion objects are named after the final one.
+	ctx->handoff.flags &= ~UNIJ_HANDOFF_COMPLETION;
+	if(!unij_ipc_pack(&ctx->ipc, (const void*)&ctx->params) ||
+	   (op->completion = unij_completion_create(&ctx->handoff)) == NULL ||
+	   (op->injection = unij_inject_loader_start(injector->process, &injector->loader, &ctx->handoff)) == NULL) {
+		operation_free(op);
+		return NULL;
+	}
+	return op;
+}
+
+unij_operation_state_t unij_operation_poll(unij_operation_t* op)
+{
+	unij_error_t status = UNIJ_ERROR_SUCCESS;
+	if(unij_fatal_null(op))
+		return UNIJ_OPERATION_FAILED;
+	else if(op->state != UNIJ_OPERATION_PENDING)
+		return op->state;
+	
+	if(operation_check(op, &status)) {
+		operation_finish(op, status == UNIJ_ERROR_SUCCESS ? UNIJ_OPERATION_SUCCEEDED : UNIJ_OPERATION_FAILED, status);
+	} else if(operation_remaining(op) == 0) {
+		operation_finish(op, UNIJ_OPERATION_TIMED_OUT, UNIJ_ERROR_OPERATION);
+	}
+	return op->state;
+}
+
+unij_operation_state_t unij_operation_wait(unij_operation_t* op, uint32_t timeout)
+{
+	uint32_t slice, elapsed, start = unij_tick_count();
+	while(unij_operation_poll(op) == UNIJ_OPERATION_PENDING) {
+		elapsed = unij_tick_count() - start;
+		if(timeout != INFINITE && elapsed >= timeout)
+			break;
+		
+		// Whichever runs out first: the caller's timeout or the operation's.
+		slice = operation_remaining(op);
+		if(timeout != INFINITE && timeout - elapsed < slice)
+			slice = timeout - elapsed;
+		
+		if(!operation_sleep(op, slice)) {
+			operation_finish(op, UNIJ_OPERATION_FAILED, UNIJ_ERROR_OPERATION);
+			break;
+		}
+	}
+	return op != NULL ? op->state : UNIJ_OPERATION_FAILED;
+}
+
+bool unij_operation_cancel(unij_operation_t* op)
+{
+	if(unij_fatal_null(op) || op->state != UNIJ_OPERATION_PENDING)
+		return false;
+	
+	operation_finish(op, UNIJ_OPERATION_CANCELLED, UNIJ_ERROR_OPERATION);
+	return true;
+}
+
+unij_error_t unij_operation_status(unij_operation_t* op)
+{
+	return !unij_fatal_null(op) ? op->status : UNIJ_ERROR_PARAM;
+}
+
+void unij_operation_close(unij_operation_t* op)
+{
+	if(op != NULL) {
+		unij_operation_cancel(op);
+		operation_free(op);
+	}
+}
+
+void unij_loader_complete(uniject_t* ctx, unij_error_t status)
+{
+	if(ENSURE_LOADER(ctx) != NULL && !unij_completion_signal(&ctx->handoff, status))
+		LogWarning(L"Couldn't report back to the injector.");
 }
 
 unij_params_t* unij_get_params(uniject_t* ctx)
@@ -259,14 +707,15 @@ unij_params_t* unij_get_params(uniject_t* ctx)
 	{ \
 		if( !ENSURE_INJECTOR(ctx) ) return; \
 		if(!unij_is_empty(&ctx->params. PARAM )) { \
-			unij_wstrfree(&ctx->params . PARAM); \
+			ctx_wstrfree(ctx, &ctx->params . PARAM); \
 		} \
-		ctx->params. PARAM = unij_wstrdup(value); \
+		ctx->params. PARAM = ctx_wstrdup(ctx, value); \
 	}
 
 IMPL_PARAM_GETTER(uint32_t, pid);
 IMPL_PARAM_GETTER(uint32_t, tid);
 IMPL_PARAM_GETTER(bool, debugging);
+IMPL_PARAM_GETTER(bool, resident);
 
 IMPL_WSTR_PARAM_GETTER(mono_path);
 IMPL_WSTR_PARAM_GETTER(assembly_path);
@@ -276,6 +725,7 @@ IMPL_WSTR_PARAM_GETTER(log_path);
 
 IMPL_PARAM_SETTER(uint32_t, tid);
 IMPL_PARAM_SETTER(bool, debugging);
+IMPL_PARAM_SETTER(bool, resident);
 
 IMPL_WSTR_PARAM_SETTER(assembly_path);
 IMPL_WSTR_PARAM_SETTER(class_name);
@@ -285,6 +735,7 @@ IMPL_WSTR_PARAM_SETTER(log_path);
 void unij_set_loader_path(uniject_t* ctx, unij_wstr_t* value)
 {
 	unijector_t* injector = ENSURE_INJECTOR(ctx);
-	if(ctx == NULL) return;
-	injector->loader = unij_wstrdup(value);
+	if(injector == NULL) return;
+	ctx_wstrfree(ctx, &injector->loader);
+	injector->loader = ctx_wstrdup(ctx, value);
 }
@@ -8,9 +8,11 @@
 #pragma once
 
 #include <uniject/base.h>
+#include <uniject/handoff.h>
 #include <uniject/ipc.h>
 #include <uniject/packing.h>
 #include <uniject/process.h>
+#include <uniject/ring.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,11 +35,36 @@ typedef struct unijector unijector_t;
 struct unij_ipc
 {
 	bool custom;
+	
+	// Only needed again when a writer has to pick a new name, which only standard contexts (static keys) ever do.
+	const wchar_t* key;
 	const wchar_t* name;
+	uint32_t pid;
+	uint32_t nonce;
+	
+	// Where the mapping gets handed over instead of by name, when possible. NULL for contexts opened by key alone.
+	unij_handoff_t* handoff;
 	HANDLE file_handle;
 	void* mapped_view;
+	
+	// What mapped_view was mapped with, which is what unmapping it takes outside of Windows.
+	size_t mapped_size;
+	size_t committed;
+	unij_layout_t layout;
 	unij_memprocs_t memprocs;
 	unij_reserve_fn reserve_fn;
+	
+	// Persistent channel mode: outgoing/incoming rings and the scratch buffer messages get packed into.
+	unij_ring_t* outgoing;
+	unij_ring_t* incoming;
+	HANDLE outgoing_event;
+	HANDLE incoming_event;
+	
+	// Set while this writer holds the channel, which it has to give up on close.
+	bool claimed;
+	unij_memprocs_t scratch_procs;
+	void* scratch;
+	size_t scratch_size;
 	union
 	{
 		unij_pack_fn pack_fn;
@@ -51,15 +78,41 @@ struct unij_ipc
 struct uniject
 {
 	unij_role_t role;
+	
+	// Set when the params strings are borrowed from the IPC mapping rather than owned by us.
+	bool borrowed;
+	
+	// When set, owns every params string and gets destroyed by unij_close.
+	unij_arena_t* arena;
+	
+	// Names this context's objects. The injector picks the nonce, and the loader reads it back out of the target.
+	unij_handoff_t handoff;
 	unij_ipc_t ipc;
 	unij_params_t params;
 };
 
+typedef struct unij_reply unij_reply_t;
+
+// A request sent to a resident loader, until its reply comes in or the injector gives up on it.
+struct unij_reply
+{
+	unij_reply_t* next;
+	uint32_t request;
+	bool received;
+	uint32_t status;
+};
+
 struct unijector
 {
 	uniject_t u;
 	unij_wstr_t loader;
 	unij_process_t* process;
+	
+	// Request channel to a resident loader. Only opened in resident mode.
+	unij_ipc_t* channel;
+	
+	// Requests on the channel still waiting on their reply, in no particular order.
+	unij_reply_t* replies;
 };
 
 // Function prototypes
@@ -31,7 +31,7 @@
 /**
  * @def UNIJ_OBJECT_PREFIX "uniject"
  * Prefix for all object names that we create. Resulting names will be:
- * ```SCOPE "\\" PREFIX "." TYPE ":" KEY "@" PID```
+ * ```SCOPE "\\" PREFIX "." KEY ":" TYPE "@" PID "." NONCE```
  */
 #define UNIJ_OBJECT_PREFIX "uniject"
 
@@ -49,6 +49,50 @@
  */
 #define UNIJ_LOADER_BASENAME "uniject-loader"
 
+/**
+ * @def UNIJ_IPC_RESERVE_SIZE 0x100000
+ * @brief Address space reserved for the params mapping. Only the pages actually packed get committed, so this is
+ * just the upper bound on how large a single-pass packed payload can grow.
+ */
+#define UNIJ_IPC_RESERVE_SIZE 0x100000
+
+/**
+ * @def UNIJ_CHANNEL_KEY "channel"
+ * @brief The "key" part of the object name for the persistent command channel. See uniject/ipc.h for more details.
+ */
+#define UNIJ_CHANNEL_KEY "channel"
+
+/**
+ * @def UNIJ_IPC_CHANNEL_CAPACITY 0x10000
+ * @brief Bytes of packed messages each direction of a command channel can hold before the sender has to wait for
+ * the other side to catch up. No single message can be larger than half of this.
+ */
+#define UNIJ_IPC_CHANNEL_CAPACITY 0x10000
+
+/**
+ * @def UNIJ_SERVICE_TIMEOUT 30000
+ * @brief Milliseconds the injector waits for a resident loader to reply to a load request.
+ */
+#define UNIJ_SERVICE_TIMEOUT 30000
+
+/**
+ * @def UNIJ_ARENA_BLOCK_SIZE 0x10000
+ * @brief Default size of the blocks an arena carves its allocations from.
+ */
+#define UNIJ_ARENA_BLOCK_SIZE 0x10000
+
+/**
+ * @def UNIJ_DEFAULT_CLASS "Loader"
+ * @brief Class name used in the mono method descriptor when the user doesn't specify one.
+ */
+#define UNIJ_DEFAULT_CLASS "Loader"
+
+/**
+ * @def UNIJ_DEFAULT_METHOD "Initialize"
+ * @brief Method name used in the mono method descriptor when the user doesn't specify one.
+ */
+#define UNIJ_DEFAULT_METHOD "Initialize"
+
 /**
  * UNIJ_LOADER_READONLY true
  * @brief Determines whether an unij_ipc_ctx created with a reader role is given read-only access to the shared memory.
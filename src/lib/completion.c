@@ -0,0 +1,168 @@
+/**
+ * @file completion.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Nothing in here is specific to win32, so the POSIX builds share it.
+ */
+#include "pch.h"
+#include "atomics.h"
+#include <uniject/completion.h>
+#include <uniject/utility.h>
+
+#define COMPLETION_KEY L"completion"
+
+// "DONE", stored by the loader once the status is in.
+#define COMPLETION_DONE 0x454E4F44
+
+typedef struct completion_block completion_block_t;
+
+// All there is to the mapping.
+struct completion_block
+{
+	unij_atomic_u32 state;
+	uint32_t status;
+};
+
+struct unij_completion
+{
+	HANDLE mapping;
+	HANDLE event;
+	completion_block_t* block;
+	size_t mapped_size;
+};
+
+static void completion_free(unij_completion_t* completion)
+{
+	if(completion->block != NULL)
+		unij_unmap_view((const void*)completion->block, completion->mapped_size);
+	if(completion->mapping != NULL)
+		unij_close_handle(completion->mapping);
+	if(completion->event != NULL)
+		unij_close_handle(completion->event);
+	unij_free((void*)completion);
+}
+
+// Only the injector creates the mapping. A loader that doesn't find it has nobody left to report to.
+static HANDLE completion_object(const unij_handoff_t* handoff, unij_object_t type, bool create)
+{
+	HANDLE object;
+	const wchar_t* name = unij_object_name(COMPLETION_KEY, type, handoff->pid, handoff->nonce);
+	if(name == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	if(type == UNIJ_OBJECT_EVENT) {
+		object = unij_create_event(name);
+	} else if(create) {
+		object = unij_create_mmap(name, sizeof(completion_block_t));
+	} else {
+		object = unij_open_mmap(name, false);
+	}
+	
+	// A fresh nonce shouldn't find anything under its names, so these belong to some other injection.
+	if(IS_VALID_HANDLE(object) && create && unij_last_error() == UNIJ_LAST_ERROR_EXISTS) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"%ls is already in use!", name);
+		unij_close_handle(object);
+		object = NULL;
+	}
+	
+	unij_free((void*)name);
+	return IS_VALID_HANDLE(object) ? object : NULL;
+}
+
+unij_completion_t* unij_completion_create(unij_handoff_t* handoff)
+{
+	unij_completion_t* completion;
+	if(unij_fatal_null(handoff))
+		return NULL;
+	
+	completion = (unij_completion_t*)unij_alloc(sizeof(unij_completion_t));
+	if(completion == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	completion->mapping = completion_object(handoff, UNIJ_OBJECT_MAPPING, true);
+	if(completion->mapping != NULL)
+		completion->event = completion_object(handoff, UNIJ_OBJECT_EVENT, true);
+	if(completion->event != NULL) {
+		completion->mapped_size = sizeof(completion_block_t);
+		completion->block = (completion_block_t*)unij_map_view(completion->mapping, &completion->mapped_size, false);
+	}
+	
+	if(completion->block == NULL) {
+		completion_free(completion);
+		return NULL;
+	}
+	
+	// New mappings start out zeroed, which already reads as pending.
+	handoff->flags |= UNIJ_HANDOFF_COMPLETION;
+	return completion;
+}
+
+bool unij_completion_check(unij_completion_t* completion, unij_error_t* pstatus)
+{
+	if(unij_fatal_null(completion) || unij_atomic_load_acquire(&completion->block->state) != COMPLETION_DONE)
+		return false;
+	
+	if(pstatus != NULL)
+		*pstatus = (unij_error_t)completion->block->status;
+	return true;
+}
+
+unij_wait_t unij_completion_wait(unij_completion_t* completion, uint32_t timeout, unij_error_t* pstatus)
+{
+	unij_wait_t result;
+	if(unij_fatal_null(completion))
+		return UNIJ_WAIT_FAILED;
+	else if(unij_completion_check(completion, pstatus))
+		return UNIJ_WAIT_SIGNALED;
+	
+	// The loader only sets the event after storing its status, and nothing ever resets it.
+	result = unij_wait_event(completion->event, timeout);
+	if(result == UNIJ_WAIT_FAILED) {
+		unij_fatal_call(unij_wait_event);
+	} else if(result == UNIJ_WAIT_SIGNALED && !unij_completion_check(completion, pstatus)) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"Completion event was set without a status!");
+		result = UNIJ_WAIT_FAILED;
+	}
+	return result;
+}
+
+void unij_completion_close(unij_completion_t* completion)
+{
+	if(completion != NULL)
+		completion_free(completion);
+}
+
+bool unij_completion_signal(const unij_handoff_t* handoff, unij_error_t status)
+{
+	HANDLE mapping, event;
+	completion_block_t* block;
+	size_t size = sizeof(completion_block_t);
+	if(!unij_handoff_valid(handoff) || (handoff->flags & UNIJ_HANDOFF_COMPLETION) == 0)
+		return true;
+	
+	mapping = completion_object(handoff, UNIJ_OBJECT_MAPPING, false);
+	if(mapping == NULL)
+		return false;
+	
+	block = (completion_block_t*)unij_map_view(mapping, &size, false);
+	if(block != NULL) {
+		block->status = (uint32_t)status;
+		unij_atomic_store_release(&block->state, COMPLETION_DONE);
+		unij_unmap_view((const void*)block, size);
+	}
+	unij_close_handle(mapping);
+	if(block == NULL)
+		return false;
+	
+	event = completion_object(handoff, UNIJ_OBJECT_EVENT, false);
+	if(event == NULL)
+		return false;
+	
+	unij_set_event(event);
+	unij_close_handle(event);
+	return true;
+}
@@ -0,0 +1,511 @@
+/**
+ * @file elffile.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Same approach as pefile.c: fields are read at their documented offsets rather than through <elf.h>, which is what
+ * lets one build handle both classes. Offsets are relative to the start of the structure they belong to, and come in
+ * pairs where the classes differ. Every address from the file is bounds-checked on its way to becoming a pointer, so
+ * a corrupt file can't send a lookup outside the mapping, and hash chains can't loop forever.
+ */
+#include "pch.h"
+#include "filemap.h"
+#include <uniject/elffile.h>
+#include <uniject/utility.h>
+
+#define ELF_IDENT_CLASS 4
+#define ELF_IDENT_DATA 5
+#define ELF_CLASS32 1
+#define ELF_CLASS64 2
+#define ELF_DATA_LSB 1
+
+#define ELF_HEADER_SIZE(B) ((B) == 64 ? 64 : 52)
+#define ELF_HEADER_MACHINE 18
+#define ELF_HEADER_PHOFF(B) ((B) == 64 ? 32 : 28)
+#define ELF_HEADER_PHENTSIZE(B) ((B) == 64 ? 54 : 42)
+#define ELF_HEADER_PHNUM(B) ((B) == 64 ? 56 : 44)
+
+#define ELF_PHDR_SIZE(B) ((B) == 64 ? 56 : 32)
+#define ELF_PHDR_TYPE 0
+#define ELF_PHDR_OFFSET(B) ((B) == 64 ? 8 : 4)
+#define ELF_PHDR_VADDR(B) ((B) == 64 ? 16 : 8)
+#define ELF_PHDR_FILESZ(B) ((B) == 64 ? 32 : 16)
+#define ELF_PT_LOAD 1
+#define ELF_PT_DYNAMIC 2
+
+#define ELF_DYN_SIZE(B) ((B) == 64 ? 16 : 8)
+#define ELF_DYN_VALUE(B) ((B) == 64 ? 8 : 4)
+#define ELF_DT_NULL 0
+#define ELF_DT_HASH 4
+#define ELF_DT_STRTAB 5
+#define ELF_DT_SYMTAB 6
+#define ELF_DT_STRSZ 10
+#define ELF_DT_SYMENT 11
+#define ELF_DT_GNU_HASH 0x6FFFFEF5
+#define ELF_DT_VERSYM 0x6FFFFFF0
+
+#define ELF_SYM_SIZE(B) ((B) == 64 ? 24 : 16)
+#define ELF_SYM_NAME 0
+#define ELF_SYM_INFO(B) ((B) == 64 ? 4 : 12)
+#define ELF_SYM_SHNDX(B) ((B) == 64 ? 6 : 14)
+#define ELF_SYM_VALUE(B) ((B) == 64 ? 8 : 4)
+#define ELF_SHN_UNDEF 0
+
+#define ELF_STT_OBJECT 1
+#define ELF_STT_FUNC 2
+#define ELF_STT_GNU_IFUNC 10
+#define ELF_STB_GLOBAL 1
+#define ELF_STB_WEAK 2
+#define ELF_STB_GNU_UNIQUE 10
+
+// Set in a .gnu.version entry for versions other than the default.
+#define ELF_VERSYM_HIDDEN 0x8000
+#define ELF_VERSYM_LOCAL 0
+
+#define GNU_HASH_HEADER 16
+
+struct unij_elffile
+{
+	const uint8_t* data;
+	size_t size;
+	bool mapped;
+	
+	int bits;
+	uint16_t machine;
+	const uint8_t* phdrs;
+	uint32_t phnum;
+	uint32_t phentsize;
+	// Address the start of the file gets mapped at, before relocation.
+	uint64_t base;
+	
+	unij_elfhash_t hash;
+	uint64_t hash_table;
+	uint64_t symtab;
+	uint64_t syment;
+	uint64_t strtab;
+	uint64_t strsz;
+	uint64_t versym;
+};
+
+typedef struct elf_symbol
+{
+	uint32_t name;
+	uint8_t info;
+	uint16_t shndx;
+	uint64_t value;
+} elf_symbol_t;
+
+static UNIJ_INLINE uint16_t read_u16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static UNIJ_INLINE uint32_t read_u32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static UNIJ_INLINE uint64_t read_u64(const uint8_t* p)
+{
+	return (uint64_t)read_u32(p) | ((uint64_t)read_u32(p + 4) << 32);
+}
+
+// Addresses, offsets and sizes are words of the file's class.
+static UNIJ_INLINE uint64_t read_word(const unij_elffile_t* elf, const uint8_t* p)
+{
+	return elf->bits == 64 ? read_u64(p) : (uint64_t)read_u32(p);
+}
+
+static UNIJ_INLINE bool in_file(const unij_elffile_t* elf, uint64_t offset, uint64_t size)
+{
+	return offset <= (uint64_t)elf->size && size <= (uint64_t)elf->size - offset;
+}
+
+static const uint8_t* vaddr_to_span(const unij_elffile_t* elf, uint64_t vaddr, size_t* pavailable)
+{
+	uint32_t i;
+	for(i = 0; i < elf->phnum; i++) {
+		const uint8_t* phdr = elf->phdrs + (size_t)i * elf->phentsize;
+		uint64_t address, offset, filesz, available;
+		if(read_u32(phdr + ELF_PHDR_TYPE) != ELF_PT_LOAD)
+			continue;
+		
+		address = read_word(elf, phdr + ELF_PHDR_VADDR(elf->bits));
+		filesz = read_word(elf, phdr + ELF_PHDR_FILESZ(elf->bits));
+		if(vaddr < address || vaddr - address >= filesz)
+			continue;
+		
+		offset = read_word(elf, phdr + ELF_PHDR_OFFSET(elf->bits)) + (vaddr - address);
+		if(offset >= (uint64_t)elf->size)
+			return NULL;
+		
+		available = filesz - (vaddr - address);
+		if(available > (uint64_t)elf->size - offset)
+			available = (uint64_t)elf->size - offset;
+		*pavailable = (size_t)available;
+		return elf->data + offset;
+	}
+	return NULL;
+}
+
+/**
+ * @internal
+ * Header parsing
+ */
+
+static void parse_dynamic(unij_elffile_t* elf, uint64_t offset, uint64_t size)
+{
+	uint64_t i, count = size / ELF_DYN_SIZE(elf->bits);
+	uint64_t gnu_hash = 0, sysv_hash = 0;
+	size_t available = 0;
+	for(i = 0; i < count; i++) {
+		const uint8_t* entry = elf->data + offset + i * ELF_DYN_SIZE(elf->bits);
+		uint64_t tag = read_word(elf, entry);
+		uint64_t value = read_word(elf, entry + ELF_DYN_VALUE(elf->bits));
+		if(tag == ELF_DT_NULL)
+			break;
+		
+		switch(tag) {
+			case ELF_DT_HASH: sysv_hash = value; break;
+			case ELF_DT_GNU_HASH: gnu_hash = value; break;
+			case ELF_DT_SYMTAB: elf->symtab = value; break;
+			case ELF_DT_SYMENT: elf->syment = value; break;
+			case ELF_DT_STRTAB: elf->strtab = value; break;
+			case ELF_DT_STRSZ: elf->strsz = value; break;
+			case ELF_DT_VERSYM: elf->versym = value; break;
+			default: break;
+		}
+	}
+	
+	if(elf->syment < ELF_SYM_SIZE(elf->bits))
+		elf->syment = ELF_SYM_SIZE(elf->bits);
+	if(elf->symtab == 0 || elf->strtab == 0)
+		return;
+	
+	// Only tables whose header is actually in the file count.
+	if(gnu_hash != 0 && vaddr_to_span(elf, gnu_hash, &available) != NULL && available >= GNU_HASH_HEADER) {
+		elf->hash = UNIJ_ELF_HASH_GNU;
+		elf->hash_table = gnu_hash;
+	} else if(sysv_hash != 0 && vaddr_to_span(elf, sysv_hash, &available) != NULL && available >= 8) {
+		elf->hash = UNIJ_ELF_HASH_SYSV;
+		elf->hash_table = sysv_hash;
+	}
+}
+
+static bool parse_headers(unij_elffile_t* elf)
+{
+	uint32_t i;
+	uint64_t phoff, lowest = UINT64_MAX, dynamic_offset = 0, dynamic_size = 0;
+	if(elf->size < ELF_HEADER_SIZE(32) || memcmp((const void*)elf->data, "\x7F" "ELF", 4) != 0 ||
+	   elf->data[ELF_IDENT_DATA] != ELF_DATA_LSB)
+		return false;
+	
+	if(elf->data[ELF_IDENT_CLASS] == ELF_CLASS64)
+		elf->bits = 64;
+	else if(elf->data[ELF_IDENT_CLASS] == ELF_CLASS32)
+		elf->bits = 32;
+	else
+		return false;
+	
+	if(elf->size < ELF_HEADER_SIZE(elf->bits))
+		return false;
+	
+	elf->machine = read_u16(elf->data + ELF_HEADER_MACHINE);
+	phoff = read_word(elf, elf->data + ELF_HEADER_PHOFF(elf->bits));
+	elf->phentsize = read_u16(elf->data + ELF_HEADER_PHENTSIZE(elf->bits));
+	elf->phnum = read_u16(elf->data + ELF_HEADER_PHNUM(elf->bits));
+	if(elf->phentsize < ELF_PHDR_SIZE(elf->bits) || !in_file(elf, phoff, (uint64_t)elf->phnum * elf->phentsize))
+		return false;
+	
+	elf->phdrs = elf->data + phoff;
+	for(i = 0; i < elf->phnum; i++) {
+		const uint8_t* phdr = elf->phdrs + (size_t)i * elf->phentsize;
+		uint32_t type = read_u32(phdr + ELF_PHDR_TYPE);
+		uint64_t vaddr = read_word(elf, phdr + ELF_PHDR_VADDR(elf->bits));
+		uint64_t offset = read_word(elf, phdr + ELF_PHDR_OFFSET(elf->bits));
+		if(type == ELF_PT_LOAD && vaddr < lowest) {
+			// The first segment starts at the top of the file, give or take the page offset the two share.
+			lowest = vaddr;
+			elf->base = vaddr - offset;
+		} else if(type == ELF_PT_DYNAMIC) {
+			dynamic_offset = offset;
+			dynamic_size = read_word(elf, phdr + ELF_PHDR_FILESZ(elf->bits));
+		}
+	}
+	
+	if(lowest == UINT64_MAX || dynamic_size == 0 || !in_file(elf, dynamic_offset, dynamic_size))
+		return false;
+	
+	parse_dynamic(elf, dynamic_offset, dynamic_size);
+	return true;
+}
+
+/**
+ * @internal
+ * Symbol lookup
+ */
+
+static bool read_symbol(const unij_elffile_t* elf, uint32_t index, elf_symbol_t* symbol)
+{
+	size_t available = 0;
+	const uint8_t* entry = vaddr_to_span(elf, elf->symtab + (uint64_t)index * elf->syment, &available);
+	if(entry == NULL || available < ELF_SYM_SIZE(elf->bits))
+		return false;
+	
+	symbol->name = read_u32(entry + ELF_SYM_NAME);
+	symbol->info = entry[ELF_SYM_INFO(elf->bits)];
+	symbol->shndx = read_u16(entry + ELF_SYM_SHNDX(elf->bits));
+	symbol->value = read_word(elf, entry + ELF_SYM_VALUE(elf->bits));
+	return true;
+}
+
+// strcmp against a name in the string table, without running off the end of it.
+static bool name_matches(const unij_elffile_t* elf, uint32_t offset, const char* name)
+{
+	size_t i, available = 0;
+	const uint8_t* candidate;
+	if(elf->strsz != 0 && offset >= elf->strsz)
+		return false;
+	
+	candidate = vaddr_to_span(elf, elf->strtab + offset, &available);
+	if(candidate == NULL)
+		return false;
+	if(elf->strsz != 0 && available > elf->strsz - offset)
+		available = (size_t)(elf->strsz - offset);
+	
+	for(i = 0; i < available; i++) {
+		if((uint8_t)name[i] != candidate[i])
+			return false;
+		if(name[i] == '\0')
+			return true;
+	}
+	return false;
+}
+
+typedef struct elf_match
+{
+	bool found;
+	bool hidden;
+	uint64_t value;
+} elf_match_t;
+
+// Checks the symbol at \a index against \a name. Returns true once there's no point looking any further.
+static bool check_symbol(const unij_elffile_t* elf, uint32_t index, const char* name, elf_match_t* match)
+{
+	uint8_t type, binding;
+	size_t available = 0;
+	bool hidden = false;
+	elf_symbol_t symbol;
+	if(!read_symbol(elf, index, &symbol) || symbol.shndx == ELF_SHN_UNDEF)
+		return false;
+	
+	type = symbol.info & 0xF;
+	binding = symbol.info >> 4;
+	if((type != ELF_STT_FUNC && type != ELF_STT_OBJECT && type != ELF_STT_GNU_IFUNC) ||
+	   (binding != ELF_STB_GLOBAL && binding != ELF_STB_WEAK && binding != ELF_STB_GNU_UNIQUE) ||
+	   !name_matches(elf, symbol.name, name))
+		return false;
+	
+	if(elf->versym != 0) {
+		const uint8_t* version = vaddr_to_span(elf, elf->versym + (uint64_t)index * sizeof(uint16_t), &available);
+		if(version != NULL && available >= sizeof(uint16_t)) {
+			uint16_t value = read_u16(version);
+			if(value == ELF_VERSYM_LOCAL)
+				return false;
+			hidden = (value & ELF_VERSYM_HIDDEN) != 0;
+		}
+	}
+	
+	// Older versions only get used if the default never turns up.
+	if(!match->found || (match->hidden && !hidden)) {
+		match->found = true;
+		match->hidden = hidden;
+		match->value = symbol.value;
+	}
+	return !hidden;
+}
+
+static UNIJ_INLINE uint32_t gnu_hash(const char* name)
+{
+	uint32_t hash = 5381;
+	for(; *name != '\0'; name++)
+		hash = hash * 33 + (uint8_t)*name;
+	return hash;
+}
+
+static UNIJ_INLINE uint32_t sysv_hash(const char* name)
+{
+	uint32_t hash = 0, high;
+	for(; *name != '\0'; name++) {
+		hash = (hash << 4) + (uint8_t)*name;
+		high = hash & 0xF0000000;
+		if(high != 0)
+			hash ^= high >> 24;
+		hash &= ~high;
+	}
+	return hash;
+}
+
+// Reads a u32 at \a index in the array at \a vaddr.
+static bool read_table(const unij_elffile_t* elf, uint64_t vaddr, uint64_t index, uint32_t* pvalue)
+{
+	size_t available = 0;
+	const uint8_t* entry = vaddr_to_span(elf, vaddr + index * sizeof(uint32_t), &available);
+	if(entry == NULL || available < sizeof(uint32_t))
+		return false;
+	*pvalue = read_u32(entry);
+	return true;
+}
+
+static void lookup_gnu(const unij_elffile_t* elf, const char* name, elf_match_t* match)
+{
+	size_t available = 0;
+	const uint8_t *header, *word;
+	uint32_t buckets, offset, bloom_size, shift, index, chain, hash = gnu_hash(name);
+	uint64_t bloom, bits, bloom_word, buckets_vaddr, chain_vaddr, word_size = (uint64_t)elf->bits / 8;
+	header = vaddr_to_span(elf, elf->hash_table, &available);
+	buckets = read_u32(header);
+	offset = read_u32(header + 4);
+	bloom_size = read_u32(header + 8);
+	shift = read_u32(header + 12);
+	if(buckets == 0 || bloom_size == 0)
+		return;
+	
+	// The bloom filter rules out most missing names without touching the symbol table.
+	bits = (uint64_t)elf->bits;
+	bloom = elf->hash_table + GNU_HASH_HEADER;
+	word = vaddr_to_span(elf, bloom + ((hash / bits) % bloom_size) * word_size, &available);
+	if(word == NULL || available < word_size)
+		return;
+	
+	bloom_word = read_word(elf, word);
+	if(((bloom_word >> (hash % bits)) & (bloom_word >> ((hash >> (shift % 32)) % bits)) & 1) == 0)
+		return;
+	
+	buckets_vaddr = bloom + (uint64_t)bloom_size * word_size;
+	chain_vaddr = buckets_vaddr + (uint64_t)buckets * sizeof(uint32_t);
+	if(!read_table(elf, buckets_vaddr, hash % buckets, &index) || index < offset)
+		return;
+	
+	// Each step reads a new chain entry, and the walk ends at the first entry that's out of the file, so it can't loop.
+	for(; read_table(elf, chain_vaddr, (uint64_t)(index - offset), &chain); index++) {
+		if((chain | 1) == (hash | 1) && check_symbol(elf, index, name, match))
+			return;
+		if((chain & 1) || index == UINT32_MAX)
+			return;
+	}
+}
+
+static void lookup_sysv(const unij_elffile_t* elf, const char* name, elf_match_t* match)
+{
+	uint32_t buckets, chains, index, steps, hash = sysv_hash(name);
+	if(!read_table(elf, elf->hash_table, 0, &buckets) || !read_table(elf, elf->hash_table, 1, &chains) ||
+	   buckets == 0 || !read_table(elf, elf->hash_table, 2 + hash % buckets, &index))
+		return;
+	
+	// A chain can't be longer than the table, so a longer one has a loop in it.
+	for(steps = 0; index != 0 && index < chains && steps < chains; steps++) {
+		if(check_symbol(elf, index, name, match))
+			return;
+		if(!read_table(elf, elf->hash_table, 2 + (uint64_t)buckets + index, &index))
+			return;
+	}
+}
+
+/**
+ * @internal
+ * Public API
+ */
+
+unij_elffile_t* unij_elffile_open_memory(const void* data, size_t size)
+{
+	unij_elffile_t* elf;
+	if(unij_fatal_null(data))
+		return NULL;
+	
+	elf = (unij_elffile_t*)unij_alloc(sizeof(*elf));
+	if(elf == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	elf->data = (const uint8_t*)data;
+	elf->size = size;
+	if(!parse_headers(elf)) {
+		unij_free((void*)elf);
+		return NULL;
+	}
+	return elf;
+}
+
+unij_elffile_t* unij_elffile_open(const wchar_t* path)
+{
+	size_t size = 0;
+	const uint8_t* data;
+	unij_elffile_t* elf;
+	if(unij_fatal_null(path))
+		return NULL;
+	
+	data = filemap_open(path, &size);
+	if(data == NULL)
+		return NULL;
+	
+	elf = unij_elffile_open_memory((const void*)data, size);
+	if(elf == NULL) {
+		filemap_close(data, size);
+		return NULL;
+	}
+	
+	elf->mapped = true;
+	return elf;
+}
+
+void unij_elffile_close(unij_elffile_t* elf)
+{
+	if(elf == NULL)
+		return;
+	if(elf->mapped)
+		filemap_close(elf->data, elf->size);
+	unij_free((void*)elf);
+}
+
+int unij_elffile_bits(const unij_elffile_t* elf)
+{
+	return elf->bits;
+}
+
+uint16_t unij_elffile_machine(const unij_elffile_t* elf)
+{
+	return elf->machine;
+}
+
+unij_elfhash_t unij_elffile_hash(const unij_elffile_t* elf)
+{
+	return elf->hash;
+}
+
+const void* unij_elffile_vaddr_to_data(const unij_elffile_t* elf, uint64_t vaddr, size_t size)
+{
+	size_t available = 0;
+	const uint8_t* data = vaddr_to_span(elf, vaddr, &available);
+	return data != NULL && size <= available ? (const void*)data : NULL;
+}
+
+bool unij_elffile_symbol(const unij_elffile_t* elf, const char* name, uint64_t* poffset, uint64_t* pvaddr)
+{
+	elf_match_t match = { false, false, 0 };
+	if(unij_fatal_null(elf) || unij_fatal_null(name) || unij_fatal_null(poffset))
+		return false;
+	
+	if(elf->hash == UNIJ_ELF_HASH_GNU)
+		lookup_gnu(elf, name, &match);
+	else if(elf->hash == UNIJ_ELF_HASH_SYSV)
+		lookup_sysv(elf, name, &match);
+	
+	if(!match.found)
+		return false;
+	
+	*poffset = match.value - elf->base;
+	if(pvaddr != NULL)
+		*pvaddr = match.value;
+	return true;
+}
@@ -4,24 +4,33 @@
  */
 #include "pch.h"
 #include "error_private.h"
+#include "uniject/base.h"
 #include "uniject/logger.h"
 #include "uniject/utility.h"
 
-static UNIJ_INLINE const wchar_t* get_last_error_description(uint32_t last_error)
+// Our own codes are Win32 error codes, which only mean something to FormatMessage.
+static UNIJ_INLINE uint32_t system_error_code(unij_error_t code)
 {
-	const wchar_t* message = NULL;
-	FormatMessageW(
-		FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM |FORMAT_MESSAGE_IGNORE_INSERTS,
-		NULL, last_error,
-		MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-		(wchar_t*)&message, 0, NULL
-	);
-	return message;
+#ifdef _WIN32
+	return (uint32_t)code;
+#else
+	switch(code)
+	{
+		case UNIJ_ERROR_ADDRESS:
+			return EFAULT;
+		case UNIJ_ERROR_OUTOFMEMORY:
+			return ENOMEM;
+		case UNIJ_ERROR_PATHNAME:
+			return ENOENT;
+		default:
+			return 0;
+	}
+#endif
 }
 
 const wchar_t* unij_get_error_text(unij_error_t code)
 {
-	uint32_t last_error = GetLastError();
+	uint32_t last_error = unij_last_error();
 	
 	switch(code)
 	{
@@ -47,9 +56,9 @@ const wchar_t* unij_get_error_text(unij_error_t code)
 		case UNIJ_ERROR_ADDRESS:
 		case UNIJ_ERROR_OUTOFMEMORY:
 		case UNIJ_ERROR_PATHNAME:
-			last_error = (uint32_t)code;
+			last_error = system_error_code(code);
 		case UNIJ_ERROR_LASTERROR:
-			return get_last_error_description(last_error);
+			return unij_system_error_text(last_error);
 	}
 	
 	return L"Unknown Error";
@@ -64,23 +73,36 @@ void unij_free_error_text(unij_error_t code, const wchar_t* message)
 		case UNIJ_ERROR_OUTOFMEMORY:
 		case UNIJ_ERROR_PATHNAME:
 		case UNIJ_ERROR_LASTERROR:
-			LocalFree((HLOCAL)message);
+			unij_system_error_free(message);
 			break;
 		default:
 			break;
 	}
 }
 
-static UNIJ_INLINE void vshow_message(unij_level_t level, const wchar_t* format, va_list args)
+static UNIJ_INLINE void show_formatted(unij_level_t level, const wchar_t* message)
 {
-	const wchar_t* message = unij_vsawprintf(format, args);
 	unij_show_message_impl(level, message);
 	if(level >= UNIJ_LEVEL_ERROR) {
 		LogError(message);
 	}
+}
+
+static UNIJ_INLINE void vshow_message(unij_level_t level, const wchar_t* format, va_list args)
+{
+	const wchar_t* message = unij_vsawprintf(format, args);
+	show_formatted(level, message);
 	unij_free((void*)message);
 }
 
+static UNIJ_INLINE void notify_error(unij_error_t code, const wchar_t* message)
+{
+	const unij_handlers_t* handlers = unij_get_handlers();
+	if(handlers->error_fn != NULL) {
+		handlers->error_fn(handlers->context, code, message);
+	}
+}
+
 void unij_show_message(unij_level_t level, const wchar_t* format, ...)
 {
 	va_list vargs;
@@ -95,23 +117,29 @@ void unij_fatal_error(unij_error_t code, const wchar_t* format, ...)
 	const wchar_t* desc = NULL;
 	
 	// Store last error for potential future use.
-	uint32_t last_error = GetLastError();
+	uint32_t last_error = unij_last_error();
 	desc = unij_get_error_text(code);
 	
 	// Determine what to do with format
 	if(IS_INVALID_STRING(format)) {
 		unij_show_message_impl(UNIJ_LEVEL_FATAL, desc);
+		notify_error(code, desc);
 	} else {
 		// Build new format string
-		const wchar_t* new_format = unij_sawprintf(L"%s - %s", desc, format);
+		const wchar_t* message;
+		const wchar_t* new_format = unij_sawprintf(L"%ls - %ls", desc, format);
 		ASSERT_VALID_STRING(new_format);
 		
 		// Apply new format string.
 		va_start(vargs, format);
-		vshow_message(UNIJ_LEVEL_FATAL, new_format, vargs);
+		message = unij_vsawprintf(new_format, vargs);
 		va_end(vargs);
 		
+		show_formatted(UNIJ_LEVEL_FATAL, message);
+		notify_error(code, message);
+		
 		// Cleanup
+		unij_free((void*)message);
 		unij_free((void*)new_format);
 	}
 	
@@ -119,7 +147,7 @@ void unij_fatal_error(unij_error_t code, const wchar_t* format, ...)
 	unij_free_error_text(code, desc);
 	
 	// Restore LastError
-	SetLastError(last_error);
+	unij_set_last_error(last_error);
 	
 	// Trigger the abort handler.
 	unij_abort(code);
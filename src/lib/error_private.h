@@ -14,29 +14,29 @@ extern "C" {
 #endif
 
 // Stupidly long names since I'm going to be wrapping these in macros.
-static UNIJ_INLINE bool unij_is_required_param_null(void* param, const wchar_t* caller, const wchar_t* name)
+static UNIJ_INLINE bool unij_is_required_param_null(void* param, const char* caller, const wchar_t* name)
 {
 	bool result = param == NULL;
 	if(result) {
-		unij_fatal_error(UNIJ_ERROR_ADDRESS, L"Fatal call made to %s: param %s cannot be NULL!", caller, name);
+		unij_fatal_error(UNIJ_ERROR_ADDRESS, L"Fatal call made to %hs: param %ls cannot be NULL!", caller, name);
 	}
 	return result;
 }
 
-static UNIJ_INLINE bool unij_is_required_string_invalid(const wchar_t* param, const wchar_t* caller, const wchar_t* name)
+static UNIJ_INLINE bool unij_is_required_string_invalid(const wchar_t* param, const char* caller, const wchar_t* name)
 {
 	bool result = (param == NULL) || (*param == L'\0');
 	if(result) {
-		unij_fatal_error(UNIJ_ERROR_ADDRESS, L"Fatal call made to %s: param %s cannot be NULL or empty!", caller, name);
+		unij_fatal_error(UNIJ_ERROR_ADDRESS, L"Fatal call made to %hs: param %ls cannot be NULL or empty!", caller, name);
 	}
 	return result;
 }
 
-static UNIJ_INLINE bool unij_is_required_handle_invalid(HANDLE param, const wchar_t* caller, const wchar_t* name)
+static UNIJ_INLINE bool unij_is_required_handle_invalid(HANDLE param, const char* caller, const wchar_t* name)
 {
 	bool result = IS_INVALID_HANDLE(param);
 	if(result) {
-		unij_fatal_error(UNIJ_ERROR_ADDRESS, L"Fatal call made to %s: param %s must be a valid handle!", caller, name);
+		unij_fatal_error(UNIJ_ERROR_ADDRESS, L"Fatal call made to %hs: param %ls must be a valid handle!", caller, name);
 	}
 	return result;
 }
@@ -48,10 +48,10 @@ static UNIJ_INLINE bool unij_is_required_handle_invalid(HANDLE param, const wcha
 #define unij_fatal_alloc() \
 	unij_fatal_error( \
 		UNIJ_ERROR_OUTOFMEMORY, \
-		L"Failed allocation at %s:%s:%s", \
+		L"Failed allocation at %ls:%ls:%hs", \
 		UNIJ_WIDEN(__FILE__), \
 		UNIJ_WSTRINGIFY(__LINE__), \
-		__FUNCTIONW__ \
+		UNIJ_FUNCTION \
 	)
 
 /**
@@ -63,7 +63,7 @@ static UNIJ_INLINE bool unij_is_required_handle_invalid(HANDLE param, const wcha
 #define unij_fatal_null(PARAM) \
 	(unij_is_required_param_null( \
 		(void*)(PARAM), \
-		__FUNCTIONW__, \
+		UNIJ_FUNCTION, \
 		UNIJ_WSTRINGIFY(PARAM) \
 	))
 
@@ -105,7 +105,7 @@ static UNIJ_INLINE bool unij_is_required_handle_invalid(HANDLE param, const wcha
 #define unij_fatal_string(PARAM) \
 	(unij_is_required_string_invalid( \
 		(PARAM), \
-		__FUNCTIONW__, \
+		UNIJ_FUNCTION, \
 		UNIJ_WSTRINGIFY(PARAM) \
 	))
 
@@ -118,7 +118,7 @@ static UNIJ_INLINE bool unij_is_required_handle_invalid(HANDLE param, const wcha
 #define unij_fatal_handle(PARAM) \
 	(unij_is_required_handle_invalid( \
 		(PARAM), \
-		__FUNCTIONW__, \
+		UNIJ_FUNCTION, \
 		UNIJ_WSTRINGIFY(PARAM) \
 	))
 
@@ -0,0 +1,90 @@
+/**
+ * @file filemap.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ */
+#include "pch.h"
+#include "filemap.h"
+#include <uniject/utility.h>
+
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+const uint8_t* filemap_open(const wchar_t* path, size_t* psize)
+{
+	void* view;
+	HANDLE file, mapping;
+	LARGE_INTEGER size;
+	file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+	                   FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+		return NULL;
+	
+	if(!GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart > (uint64_t)SIZE_MAX) {
+		CloseHandle(file);
+		return NULL;
+	}
+	
+	mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if(mapping == NULL)
+		return NULL;
+	
+	view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	*psize = (size_t)size.QuadPart;
+	return (const uint8_t*)view;
+}
+
+void filemap_close(const uint8_t* data, size_t size)
+{
+	UNIJ_SUPPRESS_UNUSED(size);
+	UnmapViewOfFile((LPCVOID)data);
+}
+
+#else
+
+const uint8_t* filemap_open(const wchar_t* path, size_t* psize)
+{
+	int fd;
+	void* view;
+	struct stat st;
+	unij_wstr_t wpath;
+	unij_cstr_t cpath;
+	
+	wpath.value = path;
+	wpath.length = 0;
+	cpath = unij_wstrtocstr(&wpath);
+	if(cpath.value == NULL)
+		return NULL;
+	
+	fd = open(cpath.value, O_RDONLY | O_CLOEXEC);
+	unij_cstrfree(&cpath);
+	if(fd < 0)
+		return NULL;
+	
+	if(fstat(fd, &st) != 0 || (uint64_t)st.st_size > (uint64_t)SIZE_MAX) {
+		close(fd);
+		return NULL;
+	}
+	
+	view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(view == MAP_FAILED)
+		return NULL;
+	
+	*psize = (size_t)st.st_size;
+	return (const uint8_t*)view;
+}
+
+void filemap_close(const uint8_t* data, size_t size)
+{
+	munmap((void*)data, size);
+}
+
+#endif
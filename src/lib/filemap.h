@@ -0,0 +1,36 @@
+/**
+ * @file filemap.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Read-only file mappings for the on-disk image parsers (pefile.c, elffile.c)
+ */
+#ifndef _FILEMAP_H_
+#define _FILEMAP_H_
+#pragma once
+
+#include <uniject.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maps the whole file at \a path for reading. Pages only get read in as they're touched.
+ * @param path
+ * @param[out] psize
+ * @return NULL if the file can't be opened or is empty. Failures aren't reported, since probing files that turn out
+ * not to be there is normal.
+ */
+const uint8_t* filemap_open(const wchar_t* path, size_t* psize);
+
+/**
+ * @brief Unmaps a file mapped by \a filemap_open.
+ * @param data
+ * @param size
+ */
+void filemap_close(const uint8_t* data, size_t size);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _FILEMAP_H_ */
@@ -0,0 +1,99 @@
+/**
+ * @file handoff.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ * 
+ * Nothing in here is specific to win32, so the POSIX builds share it.
+ */
+#include "pch.h"
+#include "atomics.h"
+#include <uniject/handoff.h>
+#include <uniject/platform.h>
+#include <uniject/utility.h>
+
+// Incremented for every nonce, which is what keeps them unique within a process.
+static unij_atomic_u32 nonce_counter;
+
+// Murmur3's finalizer. A bijection, so distinct inputs can't collide.
+static UNIJ_INLINE uint32_t nonce_mix(uint32_t value)
+{
+	value ^= value >> 16;
+	value *= 0x85EBCA6B;
+	value ^= value >> 13;
+	value *= 0xC2B2AE35;
+	value ^= value >> 16;
+	return value;
+}
+
+static UNIJ_INLINE uint32_t nonce_seed(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (uint32_t)counter.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)ts.tv_nsec ^ (uint32_t)ts.tv_sec;
+#endif
+}
+
+uint32_t unij_object_nonce(void)
+{
+	static unij_atomic_u32 shared_seed;
+	uint32_t nonce, seed = unij_atomic_load_relaxed(&shared_seed);
+	
+	// Racing threads might each pick a seed, which only costs us the uniqueness the name checks catch anyways.
+	if(seed == 0) {
+		seed = nonce_seed() | 1;
+		unij_atomic_store_relaxed(&shared_seed, seed);
+	}
+	
+	// The pid is mixed in on every call rather than into the seed, since a forked child inherits the seed and the
+	// counter along with everything else.
+	seed ^= nonce_mix(unij_current_pid());
+	do {
+		nonce = nonce_mix(seed + unij_atomic_fetch_add(&nonce_counter, 1) * 0x9E3779B9);
+	} while(nonce == 0);
+	return nonce;
+}
+
+void unij_handoff_init(unij_handoff_t* handoff, uint32_t pid)
+{
+	if(unij_fatal_null(handoff))
+		return;
+	
+	handoff->magic = UNIJ_HANDOFF_MAGIC;
+	handoff->size = (uint32_t)sizeof(*handoff);
+	handoff->pid = pid;
+	handoff->nonce = unij_object_nonce();
+	handoff->owner = 0;
+	handoff->mapping = 0;
+	handoff->flags = 0;
+}
+
+bool unij_handoff_valid(const unij_handoff_t* handoff)
+{
+	return handoff != NULL && handoff->magic == UNIJ_HANDOFF_MAGIC &&
+	       handoff->size == (uint32_t)sizeof(*handoff) && handoff->pid != 0;
+}
+
+static UNIJ_INLINE const wchar_t* unij_object_type_text(unij_object_t type)
+{
+	switch(type)
+	{
+		case UNIJ_OBJECT_MAPPING:
+			return L"mem";
+		case UNIJ_OBJECT_EVENT:
+			return L"ev";
+		default:
+			return L"unknown";
+	}
+}
+
+const wchar_t* unij_object_name(const wchar_t* key, unij_object_t type, uint32_t pid, uint32_t nonce)
+{
+	const wchar_t* stype = unij_object_type_text(type);
+	ASSERT_NOT_ZERO(pid);
+	ASSERT_VALID_STRING(key);
+	return unij_sawprintf(UNIJ_OBJECT_FORMAT, key, stype, pid, nonce);
+}
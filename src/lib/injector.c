@@ -13,8 +13,8 @@
 #include "pch.h"
 #include "process_private.h"
 
-#include <conio.h>
 #include <uniject/injector.h>
+#include <uniject/modcache.h>
 #include <uniject/module.h>
 #include <uniject/utility.h>
 
@@ -22,6 +22,13 @@
 #define FILE_ATTRIBUTE_NOTFILE \
 	(FILE_ATTRIBUTE_DEVICE | FILE_ATTRIBUTE_DIRECTORY)
 
+// Injected code is laid out as: handoff block, template code, loader path. The block sits right in front of the
+// entrypoint, so the loader can find it from the start address of the thread it's being loaded on.
+#define HANDOFF_SIZE sizeof(unij_handoff_t)
+
+// NtQueryInformationThread's ThreadQuerySetWin32StartAddress
+#define THREAD_START_ADDRESS_CLASS 9
+
 typedef struct inject_params inject_params_t;
 typedef struct hijack_params hijack_params_t;
 typedef struct callback_data callback_data_t;
@@ -38,6 +45,7 @@ struct template_code
 
 struct inject_params
 {
+	const unij_handoff_t* handoff;
 	unij_wstr_t* loader;
 	unij_process_t* process;
 	uint32_t loadlib_rva;
@@ -223,16 +231,30 @@ static const template_code_t HIJACK_CODE = {
 	HIJACK_TEMPLATE
 };
 
-static UNIJ_INLINE uint32_t get_loadlib_rva(int bits)
+static uint32_t get_loadlib_rva(int bits)
 {
-	uint32_t bufsize = MAX_PATH;
+	uint32_t rva, bufsize = MAX_PATH;
+	uint64_t key, value;
+	unij_file_identity_t identity;
 	wchar_t buffer[MAX_PATH+1] = EMPTY_STRINGW;
 	if(!unij_system_module_path(buffer, &bufsize, L"kernel32.dll", bits)) {
 		unij_fatal_call(unij_system_module_path);
 		return 0;
 	}
 	
-	return unij_get_proc_rva((const wchar_t*)buffer, "LoadLibraryW");
+	// Batch injections would otherwise parse kernel32's exports once per target.
+	if(!unij_file_identity((const wchar_t*)buffer, &identity))
+		return unij_get_proc_rva((const wchar_t*)buffer, "LoadLibraryW");
+	
+	key = unij_modcache_key_bits(bits, (const void*)buffer, WSIZE(bufsize), "LoadLibraryW");
+	if(unij_modcache_get(key, &identity, &value) && value != 0)
+		return (uint32_t)value;
+	
+	// Failures aren't kept, since the next attempt reports them again.
+	rva = unij_get_proc_rva((const wchar_t*)buffer, "LoadLibraryW");
+	if(rva != 0)
+		unij_modcache_put(key, &identity, (uint64_t)rva);
+	return rva;
 }
 
 static bool get_loader_path(unij_wstr_t* path_buffer, unij_procflags_t flags)
@@ -245,7 +267,7 @@ static bool get_loader_path(unij_wstr_t* path_buffer, unij_procflags_t flags)
 		unij_fatal_call(GetModuleFileNameW);
 		return false;
 	}
-	 
+	
 	// Erase the executable filename, leaving only the parent folder.
 	while(buffer[--len] != L'\\' && len)
 		buffer[len] = L'\0';
@@ -284,7 +306,7 @@ static void* render_inject_code(inject_params_t* params)
 	unij_wstr_t* loader = params->loader;
 	unij_process_t* process = params->process;
 	const template_code_t* code = params->code;
-	size_t code_size = code->template_size + AS_UPTR(WSIZE(loader->length + 1));
+	size_t code_size = HANDOFF_SIZE + code->template_size + AS_UPTR(WSIZE(loader->length + 1));
 	
 	// First try allocating the memory we intend to inject in the target process.
 	procmem = VirtualAllocEx(process->process, NULL, code_size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
@@ -301,13 +323,17 @@ static void* render_inject_code(inject_params_t* params)
 		return NULL;
 	}
 	
+	// Handoff block first. (left zeroed without one, which the loader won't mistake for a valid block)
+	if(params->handoff != NULL)
+		RtlCopyMemory((void*)buffer, (const void*)params->handoff, HANDOFF_SIZE);
+	
 	// Fill in our buffer with the shellcode template, then fill in the LoadLibraryW RVA
-	RtlCopyMemory((void*)buffer, (const void*)code->template, code->template_size);
-	prva = MAKE_PTR(uint32_t, buffer, code->param_off);
+	RtlCopyMemory((void*)(buffer + HANDOFF_SIZE), (const void*)code->template, code->template_size);
+	prva = MAKE_PTR(uint32_t, buffer, HANDOFF_SIZE + code->param_off);
 	*prva = params->loadlib_rva;
 	
 	// Fill in the loader dll path after the template code.
-	ppath = MAKE_PTR(wchar_t, buffer, code->template_size);
+	ppath = MAKE_PTR(wchar_t, buffer, HANDOFF_SIZE + code->template_size);
 	RtlCopyMemory((void*)ppath, (const void*)loader->value, AS_UPTR(WSIZE(loader->length)));
 	
 	// Finally, write the assembled code to our target process
@@ -378,75 +404,68 @@ static void* render_hijack_code(hijack_params_t* params)
 #	define HEXPTR_FORMAT L"%016" UNIJ_WIDEN(PRIX64)
 #endif
 
-static bool execute_injection(inject_params_t* params, void* pmem)
+struct unij_injection
+{
+	HANDLE thread;
+	HANDLE process;
+	void* procmem;
+	size_t code_size;
+	DWORD tid;
+	bool finished;
+	bool result;
+};
+
+static bool execute_injection(inject_params_t* params, void* pmem, unij_injection_t* injection)
 {
-	bool result = true;
-	DWORD tid = 0, thread_exit = 0;
 	void* entrypoint, *thparam;
 	const template_code_t* code = params->code;
-	HANDLE remote_thread, process = params->process->process;
+	HANDLE process = params->process->process;
 	
 	// Resolve the remote address of the loader dll
-	thparam = MAKE_PTR(void, pmem, code->template_size);
+	thparam = MAKE_PTR(void, pmem, HANDOFF_SIZE + code->template_size);
 	
 	// Resolve the remote address of the injection code's entrypoint
-	entrypoint = MAKE_PTR(void, pmem, code->entrypoint_off);
+	entrypoint = MAKE_PTR(void, pmem, HANDOFF_SIZE + code->entrypoint_off);
 	
 	// Create the remote thread & verify
-	remote_thread = CreateRemoteThread(
+	injection->thread = CreateRemoteThread(
 		process,
 		NULL, 0,
 		(LPTHREAD_START_ROUTINE)entrypoint,
 		thparam,
-		CREATE_SUSPENDED, &tid
+		CREATE_SUSPENDED, &injection->tid
 	);
-	if(IS_INVALID_HANDLE(remote_thread)) {
+	if(IS_INVALID_HANDLE(injection->thread)) {
+		injection->thread = NULL;
 		unij_fatal_call(CreateRemotethread);
 		return false;
 	}
 	
-	
-	unij_show_message(UNIJ_LEVEL_INFO, L"Created suspended thread: %lu [%08X]", tid, tid);
+	unij_show_message(UNIJ_LEVEL_INFO, L"Created suspended thread: %lu [%08X]", injection->tid, injection->tid);
 	unij_show_message(UNIJ_LEVEL_INFO, L"  Entrypoint = " HEXPTR_FORMAT , entrypoint);
 	unij_show_message(UNIJ_LEVEL_INFO, L"  Parameter = " HEXPTR_FORMAT , thparam);
-	unij_show_message(UNIJ_LEVEL_INFO, L"Press any key to resume thread..");
-	_getch();
-	ResumeThread(remote_thread);
-	
-	// TODO: Possible non-blocking implementation
-	WaitForSingleObject(remote_thread, INFINITE);
-	if(!GetExitCodeThread(remote_thread, &thread_exit)) {
-		result = false;
-		unij_show_message(UNIJ_LEVEL_ERROR, L"Call to GetExitCodeThread failed!");
-		unij_abort(UNIJ_ERROR_LASTERROR);
-	} else if(thread_exit == 0) {
-		result = false;
-		unij_show_message(UNIJ_LEVEL_ERROR, L"Injected thread %lu exited with code 0!", tid);
-		unij_abort(UNIJ_ERROR_INTERNAL);
-	}
-	CloseHandle(remote_thread);
-	return result;
+	ResumeThread(injection->thread);
+	return true;
 }
 
-bool unij_inject_loader_ex(unij_process_t* process, unij_wstr_t* loader)
+unij_injection_t* unij_inject_loader_start(unij_process_t* process, unij_wstr_t* loader, const unij_handoff_t* handoff)
 {
 	int bits;
-	bool result;
 	uint32_t fileattrs;
-	void* procmem = NULL;
+	unij_injection_t* injection;
 	inject_params_t params = {NULL};
 	const wchar_t fallback_buffer[MAX_PATH+1] = EMPTY_STRINGW;
 	unij_wstr_t fallback = { MAX_PATH, fallback_buffer };
 	
 	// Verify the process
 	if(unij_fatal_null(process))
-		return false;
+		return NULL;
 	
 	// Verify the loader path as a string
 	if(!unij_wstring(loader)) {
 		// If not set, use the default loader path for this process type.
 		if(!get_loader_path(&fallback, process->flags))
-			return false;
+			return NULL;
 		loader = &fallback;
 	}
 	
@@ -454,13 +473,14 @@ bool unij_inject_loader_ex(unij_process_t* process, unij_wstr_t* loader)
 	fileattrs = GetFileAttributesW(loader->value);
 	if((fileattrs == INVALID_FILE_ATTRIBUTES) || (fileattrs & FILE_ATTRIBUTE_NOTFILE)) {
 		unij_fatal_error(UNIJ_ERROR_LOADERS, L"%s does not point to a valid filepath!", loader->value);
-		return false;
+		return NULL;
 	}
 	
 	// Extract process architecture
 	bits = unij_process_bits(process);
 	
 	// Initial params setup.
+	params.handoff = handoff;
 	params.loader = loader;
 	params.process = process;
 	
@@ -473,29 +493,139 @@ bool unij_inject_loader_ex(unij_process_t* process, unij_wstr_t* loader)
 #	endif
 	} else {
 		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"Unsupported architecture detected! Process bits=%d", bits);
-		return false;
+		return NULL;
 	}
 	
 	// Lookup LoadLibraryW RVA
 	params.loadlib_rva = get_loadlib_rva(bits);
 	if(params.loadlib_rva == 0) {
 		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"Failed to locate LoadLibraryW export!");
-		return false;
+		return NULL;
+	}
+	
+	injection = (unij_injection_t*)unij_alloc(sizeof(unij_injection_t));
+	if(injection == NULL) {
+		unij_fatal_alloc();
+		return NULL;
 	}
 	
 	// Render injection code
-	procmem = render_inject_code(&params);
-	if(procmem == NULL) {
-		return false;
+	injection->process = process->process;
+	injection->procmem = render_inject_code(&params);
+	if(injection->procmem == NULL) {
+		unij_free((void*)injection);
+		return NULL;
 	}
+	injection->code_size = params.code_size;
 	
 	// Inject our remote thread
 	unij_show_message(UNIJ_LEVEL_INFO, L"Attempting to inject loader DLL: %s", loader->value);
-	result = execute_injection(&params, procmem);
-	VirtualFreeEx(process->process, procmem, params.code_size, MEM_RELEASE);
+	if(!execute_injection(&params, injection->procmem, injection)) {
+		VirtualFreeEx(injection->process, injection->procmem, injection->code_size, MEM_RELEASE);
+		unij_free((void*)injection);
+		return NULL;
+	}
+	return injection;
+}
+
+unij_wait_t unij_injection_wait(unij_injection_t* injection, uint32_t timeout, bool* presult)
+{
+	DWORD thread_exit = 0;
+	if(unij_fatal_null(injection))
+		return UNIJ_WAIT_FAILED;
+	
+	if(!injection->finished) {
+		switch(WaitForSingleObject(injection->thread, (DWORD)timeout))
+		{
+			case WAIT_OBJECT_0:
+				break;
+			case WAIT_TIMEOUT:
+				return UNIJ_WAIT_TIMEOUT;
+			default:
+				unij_fatal_call(WaitForSingleObject);
+				return UNIJ_WAIT_FAILED;
+		}
+		
+		injection->finished = true;
+		if(!GetExitCodeThread(injection->thread, &thread_exit)) {
+			unij_show_message(UNIJ_LEVEL_ERROR, L"Call to GetExitCodeThread failed!");
+			unij_abort(UNIJ_ERROR_LASTERROR);
+		} else if(thread_exit == 0) {
+			unij_show_message(UNIJ_LEVEL_ERROR, L"Injected thread %lu exited with code 0!", injection->tid);
+			unij_abort(UNIJ_ERROR_INTERNAL);
+		} else {
+			injection->result = true;
+		}
+	}
+	
+	if(presult != NULL)
+		*presult = injection->result;
+	return UNIJ_WAIT_SIGNALED;
+}
+
+void unij_injection_close(unij_injection_t* injection)
+{
+	if(injection != NULL) {
+		// Freeing the code out from under a thread that's still running it would take the target down with it.
+		if(injection->finished)
+			VirtualFreeEx(injection->process, injection->procmem, injection->code_size, MEM_RELEASE);
+		CloseHandle(injection->thread);
+		unij_free((void*)injection);
+	}
+}
+
+bool unij_inject_loader_ex(unij_process_t* process, unij_wstr_t* loader, const unij_handoff_t* handoff)
+{
+	bool result = false;
+	unij_injection_t* injection = unij_inject_loader_start(process, loader, handoff);
+	if(injection == NULL)
+		return false;
+	
+	if(unij_injection_wait(injection, INFINITE, &result) != UNIJ_WAIT_SIGNALED)
+		result = false;
+	unij_injection_close(injection);
 	return result;
 }
 
+static void* current_thread_start(void)
+{
+	void* start = NULL;
+	static LONG(NTAPI* fnNtQueryInformationThread)(HANDLE, ULONG, PVOID, ULONG, PULONG) = NULL;
+	if(fnNtQueryInformationThread == NULL) {
+		HMODULE ntdll = unij_noref_module(L"ntdll");
+		ASSERT_NOT_NULL(ntdll);
+		*(FARPROC*)(&fnNtQueryInformationThread) = GetProcAddress(ntdll, "NtQueryInformationThread");
+		if(fnNtQueryInformationThread == NULL) {
+			unij_fatal_call(GetProcAddress);
+			return NULL;
+		}
+	}
+	
+	if(fnNtQueryInformationThread(GetCurrentThread(), THREAD_START_ADDRESS_CLASS, &start, sizeof(start), NULL) < 0)
+		return NULL;
+	return start;
+}
+
+bool unij_loader_handoff(unij_handoff_t* handoff)
+{
+	uint8_t* start;
+	MEMORY_BASIC_INFORMATION info;
+	if(unij_fatal_null(handoff))
+		return false;
+	
+	start = (uint8_t*)current_thread_start();
+	if(start == NULL)
+		return false;
+	
+	// The injected code is its own allocation with the block at the very start. Anything else is some other thread.
+	if(VirtualQuery((const void*)start, &info, sizeof(info)) == 0 ||
+	   (uint8_t*)info.AllocationBase != start - HANDOFF_SIZE)
+		return false;
+	
+	RtlCopyMemory((void*)handoff, (const void*)(start - HANDOFF_SIZE), HANDOFF_SIZE);
+	return unij_handoff_valid(handoff) && handoff->pid == (uint32_t)GetCurrentProcessId();
+}
+
 #define SUSPEND_FAILURE ((DWORD)-1)
 
 bool unij_hijack_thread(HANDLE thread, unij_hijack_fn fn, void* param)
@@ -545,7 +675,7 @@ bool unij_hijack_thread(HANDLE thread, unij_hijack_fn fn, void* param)
 		VirtualFreeEx(process, procmem, params.code_size, MEM_RELEASE);
 		unij_fatal_call(SetThreadContext);
 	}
-	
+
 hijack_complete:
 	// Whether successful or not, if we suspended the thread, we need to resume it.
 	ResumeThread(thread);
@@ -54,11 +54,16 @@
 #	define MAKEULONGLONG(LOWDWORD, HIGHDWORD) (((uint64_t)(HIGHDWORD) << 32) | ((LOWDWORD) & 0xFFFFFFFF))
 #endif
 
-#define STATIC_ASSERT2(COND,MSG) \
-	static int UNIJ_PASTE(STATIC_ASSERTION_,MSG)[(COND)?1:-1]
-
-#define STATIC_ASSERT(COND) \
-	STATIC_ASSERT2(COND,__COUNTER__)
+// C11 gets the real thing. Everything else falls back to a typedef, which (unlike a variable) never warns when unused.
+#if !defined(_MSC_VER) && defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#	define STATIC_ASSERT(COND) \
+		_Static_assert(COND, #COND)
+#else
+#	define STATIC_ASSERT2(COND,MSG) \
+		typedef char UNIJ_PASTE(STATIC_ASSERTION_,MSG)[(COND)?1:-1]
+#	define STATIC_ASSERT(COND) \
+		STATIC_ASSERT2(COND,__COUNTER__)
+#endif
 
 // Numeric validation
 #define ASSERT_NOT_ZERO(VAL) \
@@ -105,19 +110,34 @@
 
 // Resulting format string for object names based on the values of 
 // UNIJ_OBJECT_SCOPE and UNIJ_OBJECT_PREFIX.
-// TODO: pid is coming up as 0 in the loader dll call. Need to find out why
-#define UNIJ_OBJECT_FORMAT \
-	UNIJ_WIDEN(UNIJ_OBJECT_SCOPE) L"\\" UNIJ_WIDEN(UNIJ_OBJECT_PREFIX) L".%s:%s"
-//	UNIJ_WIDEN(UNIJ_OBJECT_SCOPE) L"\\" UNIJ_WIDEN(UNIJ_OBJECT_PREFIX) L".%s:%s@%08X"
+#ifdef _WIN32
+#	define UNIJ_OBJECT_FORMAT \
+		UNIJ_WIDEN(UNIJ_OBJECT_SCOPE) L"\\" UNIJ_WIDEN(UNIJ_OBJECT_PREFIX) L".%ls:%ls@%08X.%08X"
+#else
+// POSIX names have no scope, and can't hold a slash past the leading one. shm_open takes them once encoded as UTF-8.
+#	define UNIJ_OBJECT_FORMAT \
+		L"/" UNIJ_WIDEN(UNIJ_OBJECT_PREFIX) L".%ls:%ls@%08X.%08X"
+#endif
 
 // Wide stringify the params key
 #define UNIJ_PARAMS_KEYW \
 	UNIJ_WIDEN(UNIJ_PARAMS_KEY)
 
+// Wide stringify the channel key
+#define UNIJ_CHANNEL_KEYW \
+	UNIJ_WIDEN(UNIJ_CHANNEL_KEY)
+
 // Wide stringify the loader basename
 #define UNIJ_LOADER_BASENAMEW \
 	UNIJ_WIDEN(UNIJ_LOADER_BASENAME)
 
+// Wide stringify the default class/method names
+#define UNIJ_DEFAULT_CLASSW \
+	UNIJ_WIDEN(UNIJ_DEFAULT_CLASS)
+
+#define UNIJ_DEFAULT_METHODW \
+	UNIJ_WIDEN(UNIJ_DEFAULT_METHOD)
+
 // Wide stringify the loader basename
 #define UNIJ_LOADER32_NAME \
 	UNIJ_LOADER_BASENAMEW L"-32.dll"
@@ -126,6 +146,10 @@
 #define UNIJ_LOADER64_NAME \
 	UNIJ_LOADER_BASENAMEW L"-64.dll"
 
+// Linux loader filename
+#define UNIJ_LOADER_SO_NAME \
+	UNIJ_LOADER_BASENAME "-" UNIJ_STRINGIFY(UNIJ_BITS) ".so"
+
 #define MAKE_PTR(TYPE,BASE,OFFSET) \
 	( (TYPE*)(AS_UPTR(BASE) + AS_UPTR(OFFSET)) )
 
@@ -133,6 +157,21 @@
 extern "C" {
 #endif
 
+// Forward declaration
+typedef struct unij_handlers unij_handlers_t;
+
+/**
+ * @brief Allocates straight from the library's heap, bypassing any handlers installed with \a unij_set_handlers.
+ * Used by allocators that can't go through \a unij_alloc themselves. (arenas)
+ */
+void* unij_heap_alloc(size_t size);
+void unij_heap_free(void* ptr);
+
+/**
+ * @brief Currently installed application handlers. Fields are NULL when not overridden.
+ */
+const unij_handlers_t* unij_get_handlers(void);
+
 /**
  * @brief Internally used helper for normalizing the process of getting a wstring's length without doing checks.
  * @param[in] str Pointer to test 
@@ -142,7 +181,7 @@ static UNIJ_INLINE uint16_t unij_wstrlen(const unij_wstr_t* str)
 {
 	uint16_t length = 0;
 	if(str != NULL && IS_VALID_STRING(str->value)) {
-		length = str->length == 0 ? (uint16_t)lstrlenW(str->value) : str->length;
+		length = str->length == 0 ? (uint16_t)unij_wcslen(str->value) : str->length;
 	}
 	return length;
 }
@@ -6,27 +6,34 @@
  */
 #include "pch.h"
 #include "base_private.h"
+#include "atomics.h"
 
+#include <uniject/handoff.h>
 #include <uniject/ipc.h>
 #include <uniject/logger.h>
 #include <uniject/packing.h>
 #include <uniject/params.h>
 #include <uniject/process.h>
 #include <uniject/utility.h>
-#include <uniject/win32.h>
+#include <uniject/platform.h>
 
 #define IPC_MAX_SIZE 0x1000
 
+// Fresh nonces to try when a writer's object name turns out to be taken already.
+#define IPC_NAME_ATTEMPTS 4
+
 #define ROLE_READER ROLE_LOADER
 #define ROLE_WRITER ROLE_INJECTOR
 
 #define AS_UPTR(X) ((uintptr_t)(X))
 
 #define ENSURE_WRITER(IPC) \
-	( ipc_ensure_role(IPC, ROLE_WRITER, __FUNCTIONW__) )
+	( ipc_ensure_role(IPC, ROLE_WRITER, UNIJ_FUNCTION) )
 
 #define ENSURE_READER(IPC) \
-	( ipc_ensure_role(IPC, ROLE_READER, __FUNCTIONW__) )
+	( ipc_ensure_role(IPC, ROLE_READER, UNIJ_FUNCTION) )
+
+static void ipc_close_channel(unij_ipc_t* ipc);
 
 static UNIJ_INLINE unij_role_t ipc_get_role(unij_ipc_t* ipc)
 {
@@ -35,7 +42,7 @@ static UNIJ_INLINE unij_role_t ipc_get_role(unij_ipc_t* ipc)
 
 static UNIJ_INLINE uniject_t* ipc_get_ctx(unij_ipc_t* ipc)
 {
-	return ipc->custom ? NULL : (uniject_t*)(AS_UPTR(ipc->role) - FIELD_OFFSET(uniject_t, role));
+	return ipc->custom ? NULL : (uniject_t*)(AS_UPTR(ipc->role) - offsetof(uniject_t, role));
 }
 
 static UNIJ_INLINE const wchar_t* ipc_role_name(unij_role_t role)
@@ -51,7 +58,7 @@ static UNIJ_INLINE const wchar_t* ipc_role_name(unij_role_t role)
 	}
 }
 
-static bool ipc_ensure_role(unij_ipc_t* ipc, unij_role_t expected, const wchar_t* caller)
+static bool ipc_ensure_role(unij_ipc_t* ipc, unij_role_t expected, const char* caller)
 {
 	bool status = !unij_fatal_null2(ipc, caller);
 	if(status) {
@@ -61,7 +68,7 @@ static bool ipc_ensure_role(unij_ipc_t* ipc, unij_role_t expected, const wchar_t
 			status = false;
 			unij_fatal_error(
 				UNIJ_ERROR_OPERATION,
-				L"Calls to %s can only be made from an IPC context with the role: %s!",
+				L"Calls to %hs can only be made from an IPC context with the role: %ls!",
 				caller, expected_role
 			);
 		}
@@ -73,7 +80,7 @@ static UNIJ_INLINE void ipc_close_handle(unij_ipc_t* ipc)
 {
 	// We are ensured of a non-NULL ipc by all callers to this function.
 	if(IS_VALID_HANDLE(ipc->file_handle)) {
-		CloseHandle(ipc->file_handle);
+		unij_close_handle(ipc->file_handle);
 		ipc->file_handle = NULL;
 	}
 }
@@ -82,31 +89,117 @@ static void ipc_close_mmap(unij_ipc_t* ipc, bool close_handle)
 {
 	// We are ensured of a non-NULL ipc by all callers to this function.
 	if(ipc->mapped_view != NULL) {
-		UnmapViewOfFile((const void*)ipc->mapped_view);
+		unij_unmap_view((const void*)ipc->mapped_view, ipc->mapped_size);
 		ipc->mapped_view = NULL;
+		ipc->mapped_size = 0;
+		ipc->committed = 0;
 	}
 	
 	if(close_handle)
 		ipc_close_handle(ipc);
 }
 
+static bool ipc_set_name(unij_ipc_t* ipc, uint32_t nonce)
+{
+	const wchar_t* name = unij_object_name(ipc->key, UNIJ_OBJECT_MAPPING, ipc->pid, nonce);
+	if(name == NULL) {
+		unij_fatal_alloc();
+		return false;
+	}
+	
+	if(ipc->name != NULL)
+		unij_free((void*)ipc->name);
+	ipc->name = name;
+	ipc->nonce = nonce;
+	
+	// The nonce gets handed to the loader, so it has to follow along.
+	if(ipc->handoff != NULL && ipc_get_role(ipc) == ROLE_WRITER)
+		ipc->handoff->nonce = nonce;
+	return true;
+}
+
+// Another injection got to the name first, which only happens when two injectors came up with the same nonce.
+static bool ipc_name_taken(unij_ipc_t* ipc)
+{
+	if(ipc->nonce == 0 || unij_last_error() != UNIJ_LAST_ERROR_EXISTS)
+		return false;
+	
+	unij_close_handle(ipc->file_handle);
+	ipc->file_handle = NULL;
+	LogWarning(L"%ls is already in use, picking another name.", ipc->name);
+	return true;
+}
+
+// Readers that were handed an unnamed mapping take it straight from the writer.
+static UNIJ_INLINE bool ipc_handed_over(unij_ipc_t* ipc)
+{
+	return ipc->handoff != NULL && ipc->handoff->owner != 0;
+}
+
+// Writers with someone to hand the mapping to skip the name, and with it any chance of a collision.
+static bool ipc_reserve_unnamed(unij_ipc_t* ipc, size_t size)
+{
+	uint32_t exported = 0;
+	if(ipc->handoff == NULL)
+		return false;
+	
+	ipc->file_handle = unij_reserve_unnamed_mmap(size, &exported);
+	if(IS_INVALID_HANDLE(ipc->file_handle)) {
+		ipc->file_handle = NULL;
+		ipc->handoff->owner = 0;
+		return false;
+	}
+	
+	ipc->handoff->owner = unij_current_pid();
+	ipc->handoff->mapping = exported;
+	return true;
+}
+
 static UNIJ_INLINE HANDLE ipc_ensure_handle(unij_ipc_t* ipc, size_t size, bool readonly)
 {
-	if(IS_INVALID_HANDLE(ipc->file_handle))
-		ipc->file_handle = size == 0 ? unij_open_mmap(ipc->name, readonly) : unij_create_mmap(ipc->name, size);
+	int attempt;
+	size_t reserve_size = size > UNIJ_IPC_RESERVE_SIZE ? size : UNIJ_IPC_RESERVE_SIZE;
+	
+	// Writers only reserve the section, so the view can be grown in place by committing more of it.
+	if(IS_INVALID_HANDLE(ipc->file_handle)) {
+		if(size == 0 && ipc_handed_over(ipc)) {
+			ipc->file_handle = unij_import_mmap(ipc->handoff->owner, ipc->handoff->mapping, readonly);
+		} else if(size == 0) {
+			ipc->file_handle = unij_open_mmap(ipc->name, readonly);
+		} else if(!ipc_reserve_unnamed(ipc, reserve_size)) {
+			for(attempt = 0; attempt < IPC_NAME_ATTEMPTS; attempt++) {
+				ipc->file_handle = unij_reserve_mmap(ipc->name, reserve_size);
+				if(IS_INVALID_HANDLE(ipc->file_handle) || !ipc_name_taken(ipc))
+					break;
+				if(!ipc_set_name(ipc, unij_object_nonce()))
+					break;
+			}
+			if(attempt == IPC_NAME_ATTEMPTS)
+				unij_fatal_error(UNIJ_ERROR_OPERATION, L"Couldn't find an unused name for the IPC mapping!");
+		}
+	}
 	return ipc->file_handle;
 }
 
-static UNIJ_INLINE void* ipc_create_reader_mmap(unij_ipc_t* ipc, uint32_t access)
+static bool ipc_commit(unij_ipc_t* ipc, size_t size)
 {
-	size_t size;
-	size_t* pmapsize = (size_t*)MapViewOfFile(ipc->file_handle, access, 0, 0, sizeof(size_t));
-	if(pmapsize == NULL) {
-		return NULL;
+	if(size <= ipc->committed)
+		return true;
+	
+	if(size > UNIJ_IPC_RESERVE_SIZE) {
+		unij_fatal_error(
+			UNIJ_ERROR_OPERATION,
+			L"IPC payload of %zu bytes exceeds the %zu bytes reserved for it. Raise UNIJ_IPC_RESERVE_SIZE.",
+			size, (size_t)UNIJ_IPC_RESERVE_SIZE
+		);
+		return false;
 	}
-	size = *pmapsize;
-	UnmapViewOfFile((const void*)pmapsize);
-	return MapViewOfFile(ipc->file_handle, access, 0, 0, size);
+	
+	if(!unij_commit_mmap(ipc->mapped_view, size))
+		return false;
+	
+	ipc->committed = size;
+	return true;
 }
 
 static void* ipc_ensure_mmap(unij_ipc_t* ipc, size_t size)
@@ -117,18 +210,18 @@ static void* ipc_ensure_mmap(unij_ipc_t* ipc, size_t size)
 	if(IS_INVALID_HANDLE(file_handle))
 		return NULL;
 	
-	// Set mapped view
+	// Readers map the whole thing in one go, and get its size back from unij_map_view.
 	if(ipc->mapped_view == NULL) {
-		uint32_t access = readonly && size == 0 ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS;
-		ipc->mapped_view = MapViewOfFile(ipc->file_handle, access, 0, 0, 0);
-		if(ipc->mapped_view == NULL) {
-			DWORD last_error = GetLastError();
+		ipc->mapped_size = 0;
+		ipc->mapped_view = unij_map_view(ipc->file_handle, &ipc->mapped_size, readonly && size == 0);
+		if(ipc->mapped_view == NULL)
 			ipc_close_handle(ipc);
-			SetLastError(last_error);
-			unij_fatal_call(MapViewOfFile);
-		}
 	}
 	
+	// Writers need the requested range committed before touching it.
+	if(ipc->mapped_view != NULL && size > 0 && !ipc_commit(ipc, size))
+		return NULL;
+	
 	return ipc->mapped_view;
 }
 
@@ -147,6 +240,20 @@ static UNIJ_NOINLINE void* CDECL ipc_packer_alloc_handler(unij_ipc_t* ipc, size_
 	return ipc_ensure_mmap(ipc, size);
 }
 
+// Used internally for the writer context. Growing commits more of the reserved section, so the view never moves.
+static UNIJ_NOINLINE void* CDECL ipc_packer_realloc_handler(unij_ipc_t* ipc, void* ptr, size_t size)
+{
+	if(!ENSURE_WRITER(ipc)) {
+		return NULL;
+	} else if(ptr != ipc->mapped_view) {
+		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"ipc_packer_realloc_handler called with a pointer that didn't "
+		                                      L"match ipc->mapped_view. This should not happen.");
+		return NULL;
+	}
+	
+	return ipc_commit(ipc, size) ? ptr : NULL;
+}
+
 // Used internally for the writer context.
 //
 // IMPORTANT: We are intentionally not closing the file handle. This is to make sure the shared memory doesn't get
@@ -158,33 +265,39 @@ static UNIJ_NOINLINE void CDECL ipc_packer_free_handler(unij_ipc_t* ipc, void* p
 		LogWarning(L"ipc_packer_free_handler called with a pointer that didn't match ipc->mapped_view. Should not happen.");
 		ipc_close_mmap(ipc, false);
 	}
-	UnmapViewOfFile((const void*)ptr);
+	
+	// Forget the view so a later ipc_close_mmap doesn't unmap it a second time.
+	if(ipc->mapped_view == ptr) {
+		ipc->mapped_view = NULL;
+		ipc->committed = 0;
+	}
+	unij_unmap_view((const void*)ptr, ipc->mapped_size);
+	ipc->mapped_size = 0;
 }
 
-static bool ipc_common_open(unij_ipc_t* ipc, uint32_t pid, const wchar_t* key)
+static bool ipc_common_open(unij_ipc_t* ipc, uint32_t pid, uint32_t nonce, const wchar_t* key, unij_handoff_t* handoff)
 {
 	unij_role_t role = ipc_get_role(ipc);
 	
 	if(role == ROLE_READER) {
 		ipc->unpack_fn = (unij_unpack_fn)unij_unpack_params;
 	} else {
+		// No reserve handler: packing is done in a single pass unless one gets set.
 		ipc->pack_fn = (unij_pack_fn)unij_pack_params;
-		ipc->reserve_fn = (unij_reserve_fn)unij_reserve_params;
+		ipc->reserve_fn = NULL;
 		ipc->memprocs.parameter = (void*)ipc;
 		ipc->memprocs.alloc_fn = (unij_alloc_fn)ipc_packer_alloc_handler;
+		ipc->memprocs.realloc_fn = (unij_realloc_fn)ipc_packer_realloc_handler;
 		ipc->memprocs.free_fn = (unij_free_fn)ipc_packer_free_handler;
 	}
 	
-	ipc->name = unij_object_name(key, UNIJ_OBJECT_MAPPING, pid);
-	if(ipc->name == NULL) {
-		unij_fatal_alloc();
-		return false;
-	}
-	
-	return true;
+	ipc->key = key;
+	ipc->pid = pid;
+	ipc->handoff = handoff;
+	return ipc_set_name(ipc, nonce);
 }
 
-static unij_ipc_t* ipc_custom_open(uint32_t pid, const wchar_t* key, unij_role_t role)
+static unij_ipc_t* ipc_custom_open(uint32_t pid, const wchar_t* key, unij_role_t role, unij_handoff_t* handoff)
 {
 	unij_ipc_t* ipc = (unij_ipc_t*)unij_alloc(sizeof(*ipc));
 	if(ipc == NULL) {
@@ -195,7 +308,7 @@ static unij_ipc_t* ipc_custom_open(uint32_t pid, const wchar_t* key, unij_role_t
 	// No use wasting an allocation when a pointer can fit any role value.
 	ipc->custom = true;
 	ipc->role = (unij_role_t*)AS_UPTR(role);
-	if(!ipc_common_open(ipc, pid, key)) {
+	if(!ipc_common_open(ipc, pid, handoff != NULL ? handoff->nonce : 0, key, handoff)) {
 		unij_free((void*)ipc);
 		ipc = NULL;
 	}
@@ -206,34 +319,55 @@ static unij_ipc_t* ipc_custom_open(uint32_t pid, const wchar_t* key, unij_role_t
 bool unij_ipc_open(uniject_t* ctx)
 {
 	unij_ipc_t* ipc = &ctx->ipc;
-	RtlZeroMemory((PVOID)ipc, sizeof(*ipc));
+	RtlZeroMemory((void*)ipc, sizeof(*ipc));
 	ctx->ipc.custom = false;
 	ctx->ipc.role = &ctx->role;
-	return ipc_common_open(ipc, unij_get_pid(ctx), UNIJ_PARAMS_KEYW);
+	return ipc_common_open(ipc, ctx->handoff.pid, ctx->handoff.nonce, UNIJ_PARAMS_KEYW, &ctx->handoff);
 }
 
 unij_ipc_t* unij_ipc_writer_open(uint32_t pid, const wchar_t* key)
 {
-	return ipc_custom_open(pid, key, ROLE_WRITER);
+	return ipc_custom_open(pid, key, ROLE_WRITER, NULL);
 }
 
 unij_ipc_t* unij_ipc_reader_open(const wchar_t* key)
 {
-	uint32_t pid = (uint32_t)GetCurrentProcessId();
-	return ipc_custom_open(pid, key, ROLE_READER);
+	uint32_t pid = unij_current_pid();
+	return ipc_custom_open(pid, key, ROLE_READER, NULL);
+}
+
+unij_ipc_t* unij_ipc_handoff_writer_open(unij_handoff_t* handoff, const wchar_t* key)
+{
+	if(!unij_handoff_valid(handoff)) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"Invalid handoff block passed to unij_ipc_handoff_writer_open");
+		return NULL;
+	}
+	return ipc_custom_open(handoff->pid, key, ROLE_WRITER, handoff);
+}
+
+unij_ipc_t* unij_ipc_handoff_reader_open(const unij_handoff_t* handoff, const wchar_t* key)
+{
+	if(!unij_handoff_valid(handoff) || handoff->pid != unij_current_pid()) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"Invalid handoff block passed to unij_ipc_handoff_reader_open");
+		return NULL;
+	}
+	
+	// Readers never write to the block.
+	return ipc_custom_open(handoff->pid, key, ROLE_READER, (unij_handoff_t*)handoff);
 }
 
 void unij_ipc_close(unij_ipc_t* ipc)
 {
 	if(ipc != NULL) {
-		
+	
 		// Free up object name
 		if(ipc->name != NULL) {
 			unij_free((void*)ipc->name);
 			ipc->name = NULL;
 		}
 		
-		// Cleanup mmap if open
+		// Cleanup the channel and mmap if open
+		ipc_close_channel(ipc);
 		ipc_close_mmap(ipc, true);
 		
 		// Either custom or standard context.
@@ -253,6 +387,13 @@ void unij_ipc_set_reserve_fn(unij_ipc_t* ipc, unij_reserve_fn fn)
 	}
 }
 
+void unij_ipc_set_layout(unij_ipc_t* ipc, unij_layout_t layout)
+{
+	if(ENSURE_WRITER(ipc)) {
+		ipc->layout = layout;
+	}
+}
+
 void unij_ipc_set_pack_fn(unij_ipc_t* ipc, unij_pack_fn fn)
 {
 	if(ENSURE_WRITER(ipc) && !unij_fatal_null(fn)) {
@@ -267,6 +408,41 @@ void unij_ipc_set_unpack_fn(unij_ipc_t* ipc, unij_unpack_fn fn)
 	}
 }
 
+// Single pass: pack straight into the shared memory, then take the finished buffer off the packer's hands.
+static bool ipc_pack_growable(unij_ipc_t* ipc, const void* data)
+{
+	size_t size = 0;
+	void* buffer;
+	unij_packer_t* P = unij_packer_create_growable(&ipc->memprocs, IPC_MAX_SIZE);
+	if(P == NULL) {
+		ipc_close_mmap(ipc, true);
+		return false;
+	}
+	
+	if(ipc->layout != UNIJ_LAYOUT_SEQUENTIAL && !unij_packer_set_layout(P, ipc->layout)) {
+		unij_packer_destroy(P);
+		ipc_close_mmap(ipc, true);
+		return false;
+	}
+	
+	if(!ipc->pack_fn(P, data) || !unij_packer_finish(P)) {
+		unij_packer_destroy(P);
+		ipc_close_mmap(ipc, true);
+		return false;
+	}
+	
+	buffer = unij_packer_release(P, &size);
+	unij_packer_destroy(P);
+	
+	// Flush our changes
+	unij_flush_view((const void*)buffer, size);
+	
+	// IMPORTANT: We are intentionally not closing the file handle. This is to make sure the shared memory doesn't get
+	// cleaned up before the loader has a chance to read it. DO NOT FORGET.
+	ipc_close_mmap(ipc, false);
+	return true;
+}
+
 bool unij_ipc_pack(unij_ipc_t* ipc, const void* data)
 {
 	bool result = false;
@@ -274,6 +450,9 @@ bool unij_ipc_pack(unij_ipc_t* ipc, const void* data)
 	if(!ENSURE_WRITER(ipc) || unij_fatal_null(data))
 		return false;
 	
+	if(ipc->reserve_fn == NULL || ipc->layout != UNIJ_LAYOUT_SEQUENTIAL)
+		return ipc_pack_growable(ipc, data);
+	
 	// Create packer
 	P = unij_packer_create(&ipc->memprocs);
 	if(P == NULL) {
@@ -289,7 +468,7 @@ bool unij_ipc_pack(unij_ipc_t* ipc, const void* data)
 	}
 	
 	// Flush our changes
-	FlushViewOfFile(unij_packer_get_buffer(P), unij_packer_get_size(P));
+	unij_flush_view(unij_packer_get_buffer(P), unij_packer_get_size(P));
 	
 	// IMPORTANT: We are intentionally not closing the file handle. This is to make sure the shared memory doesn't get
 	// cleaned up before the loader has a chance to read it. DO NOT FORGET.
@@ -331,9 +510,442 @@ bool unij_ipc_unpack(unij_ipc_t* ipc, void* dest)
 	// IMPORTANT: We are intentionally not cleaning up the mmap/file handle at this point. This is to ensure that the
 	// memory pointed to in dest (particularly any wstr_t's) doesn't become invalidated. DON'T FORGET
 	//
-	// NOTE: the standard params unpacker actually allocates a copy of the shared memory so this doesn't really apply
-	// there.
+	// NOTE: The reader default, unij_unpack_params, copies everything out of the mapping, so this doesn't really
+	// apply there. It matters for unij_unpack_params_view, which unij_loader_open switches to.
 	//ipc_close_mmap(ipc, true);
 	unij_unpacker_destroy(U);
 	return true;
 }
+
+/**
+ * @internal
+ * Persistent channel
+ */
+
+#define IPC_CHANNEL_MAGIC 0x4E414843 /* CHAN */
+
+// Lives at the start of the channel mapping. The command ring runs up to the reply ring, which runs to the end.
+typedef struct ipc_channel
+{
+	uint32_t magic;
+	uint32_t size;
+	uint32_t command_offset;
+	uint32_t reply_offset;
+	
+	// Process id of the reader while it's serving requests, otherwise 0.
+	unij_atomic_u32 listener;
+	
+	// Process id of the writer that has the channel open, otherwise 0. The command ring only takes one producer.
+	unij_atomic_u32 writer;
+} ipc_channel_t;
+
+#define IPC_CHANNEL_HEADER_SIZE 0x40
+
+// How many times to poll the incoming ring before going to sleep on its event.
+#define IPC_CHANNEL_SPIN_COUNT 0x400
+
+#define ENSURE_CHANNEL(IPC) \
+	( ipc_ensure_channel(IPC, UNIJ_FUNCTION) )
+
+static bool ipc_ensure_channel(unij_ipc_t* ipc, const char* caller)
+{
+	if(unij_fatal_null2(ipc, caller)) {
+		return false;
+	} else if(ipc->outgoing == NULL || ipc->incoming == NULL) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"Calls to %hs require an open channel. See unij_ipc_channel_open.", caller);
+		return false;
+	}
+	return true;
+}
+
+static UNIJ_INLINE ipc_channel_t* ipc_get_channel(unij_ipc_t* ipc)
+{
+	return (ipc_channel_t*)ipc->mapped_view;
+}
+
+// Messages are packed into a scratch buffer that's kept around between sends, so steady traffic doesn't allocate.
+static UNIJ_NOINLINE void* CDECL ipc_scratch_alloc_handler(unij_ipc_t* ipc, size_t size)
+{
+	if(size > ipc->scratch_size) {
+		void* scratch = unij_alloc(size);
+		if(scratch == NULL)
+			return NULL;
+		
+		unij_free(ipc->scratch);
+		ipc->scratch = scratch;
+		ipc->scratch_size = size;
+	}
+	return ipc->scratch;
+}
+
+static UNIJ_NOINLINE void* CDECL ipc_scratch_realloc_handler(unij_ipc_t* ipc, void* ptr, size_t size)
+{
+	if(ptr != ipc->scratch) {
+		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"ipc_scratch_realloc_handler called with a pointer that didn't "
+		                                      L"match ipc->scratch. This should not happen.");
+		return NULL;
+	}
+	
+	if(size > ipc->scratch_size) {
+		void* scratch = unij_alloc(size);
+		if(scratch == NULL)
+			return NULL;
+		
+		RtlCopyMemory(scratch, (const void*)ipc->scratch, ipc->scratch_size);
+		unij_free(ipc->scratch);
+		ipc->scratch = scratch;
+		ipc->scratch_size = size;
+	}
+	return ipc->scratch;
+}
+
+static UNIJ_NOINLINE void CDECL ipc_scratch_free_handler(unij_ipc_t* ipc, void* ptr)
+{
+	// Released along with the channel in ipc_close_channel.
+	UNIJ_SUPPRESS_UNUSED(ipc);
+	UNIJ_SUPPRESS_UNUSED(ptr);
+}
+
+static void ipc_close_channel(unij_ipc_t* ipc)
+{
+	// A reader that goes away stops serving requests, and a writer lets the next one in.
+	if(ipc->incoming != NULL && ipc_get_role(ipc) == ROLE_READER)
+		unij_atomic_store_release(&ipc_get_channel(ipc)->listener, 0);
+	if(ipc->claimed) {
+		unij_atomic_store_release(&ipc_get_channel(ipc)->writer, 0);
+		ipc->claimed = false;
+	}
+	
+	unij_ring_destroy(ipc->outgoing);
+	unij_ring_destroy(ipc->incoming);
+	ipc->outgoing = ipc->incoming = NULL;
+	
+	if(ipc->outgoing_event != NULL) {
+		unij_close_handle(ipc->outgoing_event);
+		ipc->outgoing_event = NULL;
+	}
+	
+	if(ipc->incoming_event != NULL) {
+		unij_close_handle(ipc->incoming_event);
+		ipc->incoming_event = NULL;
+	}
+	
+	if(ipc->scratch != NULL) {
+		unij_free(ipc->scratch);
+		ipc->scratch = NULL;
+		ipc->scratch_size = 0;
+	}
+}
+
+// Each direction gets an event that's set after every send, named after the mapping plus the direction.
+static HANDLE ipc_open_channel_event(unij_ipc_t* ipc, const wchar_t* direction)
+{
+	HANDLE event;
+	const wchar_t* name = unij_sawprintf(L"%ls.%ls", ipc->name, direction);
+	if(name == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	event = unij_create_event(name);
+	unij_free((void*)name);
+	return IS_VALID_HANDLE(event) ? event : NULL;
+}
+
+static ipc_channel_t* ipc_map_channel(unij_ipc_t* ipc)
+{
+	ipc_channel_t* channel;
+	ipc_channel_t header;
+	size_t size = 0;
+	
+	// All of it at once. The header only has to agree with the size that comes back.
+	channel = (ipc_channel_t*)unij_map_view(ipc->file_handle, &size, false);
+	if(channel == NULL)
+		return NULL;
+	
+	if(size >= sizeof(header))
+		RtlCopyMemory((void*)&header, (const void*)channel, sizeof(header));
+	if(size < sizeof(header) || header.magic != IPC_CHANNEL_MAGIC || header.command_offset < sizeof(header) ||
+	   header.reply_offset <= header.command_offset || header.size <= header.reply_offset || header.size > size) {
+		unij_unmap_view((const void*)channel, size);
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"%ls is not a command channel!", ipc->name);
+		return NULL;
+	}
+	
+	ipc->mapped_view = (void*)channel;
+	ipc->mapped_size = size;
+	ipc->committed = (size_t)header.size;
+	return channel;
+}
+
+// Writers create the channel, unless a resident reader is still holding one open from an earlier writer.
+static ipc_channel_t* ipc_create_channel_mmap(unij_ipc_t* ipc, bool* pexisting)
+{
+	ipc_channel_t* channel;
+	size_t ring_size = unij_ring_footprint(UNIJ_IPC_CHANNEL_CAPACITY);
+	size_t size = IPC_CHANNEL_HEADER_SIZE + 2 * ring_size;
+	
+	ipc->file_handle = unij_create_mmap(ipc->name, size);
+	if(IS_INVALID_HANDLE(ipc->file_handle))
+		return NULL;
+	
+	*pexisting = unij_last_error() == UNIJ_LAST_ERROR_EXISTS;
+	if(*pexisting)
+		return ipc_map_channel(ipc);
+	
+	channel = (ipc_channel_t*)unij_map_view(ipc->file_handle, &size, false);
+	if(channel == NULL)
+		return NULL;
+	
+	ipc->mapped_view = (void*)channel;
+	ipc->mapped_size = size;
+	ipc->committed = size;
+	channel->size = (uint32_t)size;
+	channel->command_offset = IPC_CHANNEL_HEADER_SIZE;
+	channel->reply_offset = (uint32_t)(IPC_CHANNEL_HEADER_SIZE + ring_size);
+	unij_atomic_store_relaxed(&channel->listener, 0);
+	unij_atomic_store_relaxed(&channel->writer, 0);
+	channel->magic = IPC_CHANNEL_MAGIC;
+	return channel;
+}
+
+// Takes the writer's side of the channel. One whose process has gone away without closing it can be taken over.
+static bool ipc_claim_channel(unij_ipc_t* ipc, ipc_channel_t* channel)
+{
+	uint32_t self = unij_current_pid();
+	uint32_t owner = 0;
+	while(!unij_atomic_compare_exchange(&channel->writer, &owner, self)) {
+		if(owner == self || unij_process_exists(owner)) {
+			unij_fatal_error(UNIJ_ERROR_OPERATION, L"%ls is already open for writing in process %u!", ipc->name,
+			                 owner);
+			return false;
+		}
+	}
+	ipc->claimed = true;
+	return true;
+}
+
+static ipc_channel_t* ipc_open_channel_mmap(unij_ipc_t* ipc)
+{
+	ipc->file_handle = unij_open_mmap(ipc->name, false);
+	if(IS_INVALID_HANDLE(ipc->file_handle))
+		return NULL;
+	
+	return ipc_map_channel(ipc);
+}
+
+/**
+ * @endinternal
+ */
+
+bool unij_ipc_channel_open(unij_ipc_t* ipc)
+{
+	uint8_t* base;
+	ipc_channel_t* channel;
+	void* command_memory, *reply_memory;
+	size_t command_size, reply_size;
+	bool existing = false;
+	unij_role_t role;
+	if(unij_fatal_null(ipc)) {
+		return false;
+	} else if(ipc->outgoing != NULL) {
+		return true;
+	} else if(ipc->mapped_view != NULL || IS_VALID_HANDLE(ipc->file_handle)) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"A channel can't share its IPC context with a one-shot mapping!");
+		return false;
+	}
+	
+	// The writer (injector) creates the channel, so it needs to be opened there first.
+	role = ipc_get_role(ipc);
+	channel = role == ROLE_WRITER ? ipc_create_channel_mmap(ipc, &existing) : ipc_open_channel_mmap(ipc);
+	if(channel == NULL || (role == ROLE_WRITER && !ipc_claim_channel(ipc, channel))) {
+		ipc_close_mmap(ipc, true);
+		return false;
+	}
+	
+	base = (uint8_t*)channel;
+	command_memory = (void*)(base + channel->command_offset);
+	command_size = (size_t)(channel->reply_offset - channel->command_offset);
+	reply_memory = (void*)(base + channel->reply_offset);
+	reply_size = (size_t)(channel->size - channel->reply_offset);
+	
+	// Commands flow from the writer to the reader, replies flow back the other way.
+	if(role == ROLE_WRITER && !existing) {
+		ipc->outgoing = unij_ring_create(command_memory, command_size);
+		ipc->incoming = unij_ring_create(reply_memory, reply_size);
+	} else if(role == ROLE_WRITER) {
+		ipc->outgoing = unij_ring_attach(command_memory, command_size);
+		ipc->incoming = unij_ring_attach(reply_memory, reply_size);
+	} else {
+		ipc->outgoing = unij_ring_attach(reply_memory, reply_size);
+		ipc->incoming = unij_ring_attach(command_memory, command_size);
+	}
+	
+	if(ipc->outgoing != NULL && ipc->incoming != NULL) {
+		ipc->outgoing_event = ipc_open_channel_event(ipc, role == ROLE_WRITER ? L"command" : L"reply");
+		ipc->incoming_event = ipc_open_channel_event(ipc, role == ROLE_WRITER ? L"reply" : L"command");
+	}
+	
+	if(ipc->outgoing_event == NULL || ipc->incoming_event == NULL) {
+		ipc_close_channel(ipc);
+		ipc_close_mmap(ipc, true);
+		return false;
+	}
+	
+	// Replies meant for an earlier writer would only get mistaken for ours.
+	if(existing) {
+		size_t size;
+		while(unij_ring_peek(ipc->incoming, &size) != NULL)
+			unij_ring_release(ipc->incoming);
+	}
+	
+	ipc->scratch_procs.parameter = (void*)ipc;
+	ipc->scratch_procs.alloc_fn = (unij_alloc_fn)ipc_scratch_alloc_handler;
+	ipc->scratch_procs.realloc_fn = (unij_realloc_fn)ipc_scratch_realloc_handler;
+	ipc->scratch_procs.free_fn = (unij_free_fn)ipc_scratch_free_handler;
+	return true;
+}
+
+static unij_ipc_t* ipc_channel_custom_open(uint32_t pid, unij_role_t role)
+{
+	unij_ipc_t* ipc = ipc_custom_open(pid, UNIJ_CHANNEL_KEYW, role, NULL);
+	if(ipc != NULL && !unij_ipc_channel_open(ipc)) {
+		unij_ipc_close(ipc);
+		ipc = NULL;
+	}
+	return ipc;
+}
+
+unij_ipc_t* unij_ipc_channel_writer_open(uint32_t pid)
+{
+	return ipc_channel_custom_open(pid, ROLE_WRITER);
+}
+
+unij_ipc_t* unij_ipc_channel_reader_open(void)
+{
+	return ipc_channel_custom_open(unij_current_pid(), ROLE_READER);
+}
+
+void unij_ipc_set_listening(unij_ipc_t* ipc, bool listening)
+{
+	if(ENSURE_READER(ipc) && ENSURE_CHANNEL(ipc)) {
+		uint32_t pid = listening ? unij_current_pid() : 0;
+		unij_atomic_store_release(&ipc_get_channel(ipc)->listener, pid);
+	}
+}
+
+uint32_t unij_ipc_listener(unij_ipc_t* ipc)
+{
+	return ENSURE_CHANNEL(ipc) ? unij_atomic_load_acquire(&ipc_get_channel(ipc)->listener) : 0;
+}
+
+bool unij_ipc_send(unij_ipc_t* ipc, unij_pack_fn fn, const void* data)
+{
+	bool result;
+	unij_packer_t* P;
+	if(!ENSURE_CHANNEL(ipc) || unij_fatal_null(data)) {
+		return false;
+	} else if(fn == NULL) {
+		if(ipc_get_role(ipc) != ROLE_WRITER) {
+			unij_fatal_error(UNIJ_ERROR_PARAM, L"Readers have no default pack handler to send with!");
+			return false;
+		}
+		fn = ipc->pack_fn;
+	}
+	
+	P = unij_packer_create_growable(&ipc->scratch_procs, 0);
+	if(P == NULL)
+		return false;
+	
+	if(ipc->layout != UNIJ_LAYOUT_SEQUENTIAL && !unij_packer_set_layout(P, ipc->layout)) {
+		unij_packer_destroy(P);
+		return false;
+	}
+	
+	// A full ring isn't an error - the caller just has to try again once the other side has caught up.
+	result = fn(P, data) && unij_packer_finish(P) &&
+	         unij_ring_push(ipc->outgoing, unij_packer_get_buffer(P), unij_packer_get_size(P));
+	unij_packer_destroy(P);
+	
+	if(result)
+		unij_set_event(ipc->outgoing_event);
+	return result;
+}
+
+bool unij_ipc_pending(unij_ipc_t* ipc)
+{
+	size_t size;
+	return ENSURE_CHANNEL(ipc) && unij_ring_peek(ipc->incoming, &size) != NULL;
+}
+
+bool unij_ipc_wait(unij_ipc_t* ipc, uint32_t timeout)
+{
+	uint32_t index, start, elapsed;
+	if(!ENSURE_CHANNEL(ipc))
+		return false;
+	
+	// Replies to a resident loader usually show up within microseconds, which is far less than a trip through the
+	// scheduler would cost.
+	for(index = 0; index < IPC_CHANNEL_SPIN_COUNT; index++) {
+		if(unij_ipc_pending(ipc))
+			return true;
+		unij_yield_processor();
+	}
+	
+	start = unij_tick_count();
+	for(;;) {
+		unij_wait_t status;
+		
+		// Reset before checking, so a send that lands in between still leaves the event set for the wait below.
+		unij_reset_event(ipc->incoming_event);
+		if(unij_ipc_pending(ipc))
+			return true;
+		
+		elapsed = unij_tick_count() - start;
+		if(timeout != INFINITE && elapsed >= timeout)
+			return false;
+		
+		status = unij_wait_event(ipc->incoming_event, timeout == INFINITE ? INFINITE : timeout - elapsed);
+		if(status == UNIJ_WAIT_FAILED) {
+			unij_fatal_call(unij_wait_event);
+			return false;
+		}
+	}
+}
+
+bool unij_ipc_receive(unij_ipc_t* ipc, unij_unpack_fn fn, void* dest)
+{
+	bool result;
+	size_t size = 0;
+	const void* message;
+	unij_unpacker_t* U;
+	if(!ENSURE_CHANNEL(ipc) || unij_fatal_null(dest)) {
+		return false;
+	} else if(fn == NULL) {
+		if(ipc_get_role(ipc) != ROLE_READER) {
+			unij_fatal_error(UNIJ_ERROR_PARAM, L"Writers have no default unpack handler to receive with!");
+			return false;
+		}
+		fn = ipc->unpack_fn;
+	}
+	
+	message = unij_ring_peek(ipc->incoming, &size);
+	if(message == NULL)
+		return false;
+	
+	// Don't let the unpacker read past the message it was handed.
+	if(size < sizeof(uint64_t) || unij_packed_size(message) > size) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"Received a corrupt message of %zu bytes!", size);
+		unij_ring_release(ipc->incoming);
+		return false;
+	}
+	
+	U = unij_unpacker_create(message);
+	result = U != NULL && fn(U, dest);
+	unij_unpacker_destroy(U);
+	
+	// The message's space goes back to the sender as soon as it's unpacked, which is why borrowing unpack handlers
+	// can't be used here.
+	unij_ring_release(ipc->incoming);
+	return result;
+}
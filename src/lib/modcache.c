@@ -0,0 +1,329 @@
+/**
+ * @file modcache.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Open-addressed table of fixed-size entries, laid out the same in memory and in the cache file, so persisting is just
+ * a matter of pointing the table at a mapping of the file. A key probes a handful of slots from its home slot, and a
+ * put with nowhere to go evicts whatever sits in the home slot.
+ */
+#include "pch.h"
+#include "atomics.h"
+#include <uniject/modcache.h>
+#include <uniject/utility.h>
+
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+#define MODCACHE_MAGIC 0x41434D55 /* UMCA */
+#define MODCACHE_VERSION 1
+
+// Both powers of two.
+#define MODCACHE_MEMORY_CAPACITY 0x400
+#define MODCACHE_FILE_CAPACITY 0x1000
+
+#define MODCACHE_PROBES 8
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+typedef struct modcache_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;
+	uint32_t entry_size;
+	uint8_t padding[48];
+} modcache_header_t;
+
+typedef struct modcache_entry
+{
+	uint64_t key;
+	uint64_t size;
+	uint64_t mtime;
+	uint64_t file_id;
+	uint64_t value;
+	// Covers every other field. 0 marks an empty slot.
+	uint64_t check;
+} modcache_entry_t;
+
+STATIC_ASSERT(sizeof(modcache_header_t) == 64);
+STATIC_ASSERT(sizeof(modcache_entry_t) == 48);
+
+#define MODCACHE_FILE_SIZE \
+	( sizeof(modcache_header_t) + MODCACHE_FILE_CAPACITY * sizeof(modcache_entry_t) )
+
+static modcache_entry_t memory_entries[MODCACHE_MEMORY_CAPACITY];
+
+static modcache_entry_t* cache_entries = memory_entries;
+static uint32_t cache_capacity = MODCACHE_MEMORY_CAPACITY;
+
+static unij_atomic_u32 cache_hits;
+static unij_atomic_u32 cache_misses;
+
+// Murmur3's 64-bit finalizer.
+static UNIJ_INLINE uint64_t modcache_mix(uint64_t value)
+{
+	value ^= value >> 33;
+	value *= 0xFF51AFD7ED558CCDULL;
+	value ^= value >> 33;
+	value *= 0xC4CEB9FE1A85EC53ULL;
+	value ^= value >> 33;
+	return value;
+}
+
+static UNIJ_INLINE uint64_t entry_check(const modcache_entry_t* entry)
+{
+	uint64_t check = modcache_mix(entry->key ^ modcache_mix(entry->size ^ modcache_mix(entry->mtime ^
+	                 modcache_mix(entry->file_id ^ modcache_mix(entry->value)))));
+	return check | 1;
+}
+
+static UNIJ_INLINE bool entry_valid(const modcache_entry_t* entry)
+{
+	return entry->check != 0 && entry->check == entry_check(entry);
+}
+
+static UNIJ_INLINE bool entry_matches(const modcache_entry_t* entry, const unij_file_identity_t* identity)
+{
+	return entry->size == identity->size && entry->mtime == identity->mtime && entry->file_id == identity->file_id;
+}
+
+static void table_put(modcache_entry_t* entries, uint32_t capacity, const modcache_entry_t* entry)
+{
+	uint32_t i, mask = capacity - 1;
+	modcache_entry_t* slot = NULL;
+	for(i = 0; i < MODCACHE_PROBES; i++) {
+		modcache_entry_t* probe = &entries[(uint32_t)(entry->key + i) & mask];
+		if(!entry_valid(probe) || probe->key == entry->key) {
+			slot = probe;
+			break;
+		}
+	}
+	
+	if(slot == NULL)
+		slot = &entries[(uint32_t)entry->key & mask];
+	
+	// Plain stores with no ordering between them: a reader racing this can see any mix of old and new fields, and
+	// the checksum is the only thing that catches such a torn entry (it then counts as a miss).
+	slot->key = entry->key;
+	slot->size = entry->size;
+	slot->mtime = entry->mtime;
+	slot->file_id = entry->file_id;
+	slot->value = entry->value;
+	slot->check = entry->check;
+}
+
+#ifdef _WIN32
+
+bool unij_file_identity(const wchar_t* path, unij_file_identity_t* identity)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if(unij_fatal_null(path) || unij_fatal_null(identity))
+		return false;
+	
+	if(!GetFileAttributesExW(path, GetFileExInfoStandard, (LPVOID)&data))
+		return false;
+	
+	identity->size = ((uint64_t)data.nFileSizeHigh << 32) | (uint64_t)data.nFileSizeLow;
+	identity->mtime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+	                  (uint64_t)data.ftLastWriteTime.dwLowDateTime;
+	identity->file_id = 0;
+	return true;
+}
+
+static void* map_cache_file(const wchar_t* path)
+{
+	void* view;
+	HANDLE file, mapping;
+	file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS,
+	                   FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE) {
+		unij_fatal_call(CreateFileW);
+		return NULL;
+	}
+	
+	// Grows the file to the full size if it's any smaller.
+	mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE, 0, (DWORD)MODCACHE_FILE_SIZE, NULL);
+	CloseHandle(file);
+	if(mapping == NULL) {
+		unij_fatal_call(CreateFileMappingW);
+		return NULL;
+	}
+	
+	view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, MODCACHE_FILE_SIZE);
+	CloseHandle(mapping);
+	if(view == NULL)
+		unij_fatal_call(MapViewOfFile);
+	return view;
+}
+
+#else
+
+bool unij_file_identity_fd(int fd, unij_file_identity_t* identity)
+{
+	struct stat st;
+	if(unij_fatal_null(identity) || fstat(fd, &st) != 0)
+		return false;
+	
+	identity->size = (uint64_t)st.st_size;
+	identity->mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + (uint64_t)st.st_mtim.tv_nsec;
+	identity->file_id = (uint64_t)st.st_ino;
+	return true;
+}
+
+static void* map_cache_file(const wchar_t* path)
+{
+	int fd;
+	void* view;
+	struct stat st;
+	unij_wstr_t wpath;
+	unij_cstr_t cpath;
+	
+	wpath.value = path;
+	wpath.length = 0;
+	cpath = unij_wstrtocstr(&wpath);
+	if(cpath.value == NULL)
+		return NULL;
+	
+	fd = open(cpath.value, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(fd < 0) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"Couldn't open %ls: %hs", path, strerror(errno));
+		unij_cstrfree(&cpath);
+		return NULL;
+	}
+	unij_cstrfree(&cpath);
+	
+	if(fstat(fd, &st) != 0 || ((size_t)st.st_size < MODCACHE_FILE_SIZE && ftruncate(fd, MODCACHE_FILE_SIZE) != 0)) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"Couldn't size %ls: %hs", path, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	
+	view = mmap(NULL, MODCACHE_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(view == MAP_FAILED) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"Couldn't map %ls: %hs", path, strerror(errno));
+		return NULL;
+	}
+	return view;
+}
+
+#endif
+
+static uint64_t modcache_hash(uint64_t hash, const void* path, size_t size, const char* symbol)
+{
+	size_t i;
+	const uint8_t* bytes = (const uint8_t*)path;
+	for(i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	
+	// Keeps "ab" + "c" apart from "a" + "bc".
+	hash = (hash ^ 0xFF) * FNV_PRIME;
+	for(bytes = (const uint8_t*)symbol; *bytes != 0; bytes++)
+		hash = (hash ^ *bytes) * FNV_PRIME;
+	
+	hash = modcache_mix(hash);
+	return hash == 0 ? 1 : hash;
+}
+
+uint64_t unij_modcache_key(const void* path, size_t size, const char* symbol)
+{
+	return modcache_hash(FNV_OFFSET, path, size, symbol);
+}
+
+uint64_t unij_modcache_key_bits(int bits, const void* path, size_t size, const char* symbol)
+{
+	// Bitness goes in ahead of the path, behind a byte no path starts with, so these never line up with plain keys.
+	uint64_t hash = (FNV_OFFSET ^ (uint8_t)bits) * FNV_PRIME;
+	return modcache_hash((hash ^ 0xFE) * FNV_PRIME, path, size, symbol);
+}
+
+bool unij_modcache_get(uint64_t key, const unij_file_identity_t* identity, uint64_t* pvalue)
+{
+	uint32_t i, mask = cache_capacity - 1;
+	modcache_entry_t entry;
+	if(unij_fatal_null(identity) || unij_fatal_null(pvalue))
+		return false;
+	
+	for(i = 0; i < MODCACHE_PROBES; i++) {
+		// Copied out first, so the checksum is verified against exactly the fields that get used.
+		entry = cache_entries[(uint32_t)(key + i) & mask];
+		if(!entry_valid(&entry) || entry.key != key)
+			continue;
+		
+		if(!entry_matches(&entry, identity))
+			break;
+		
+		unij_atomic_fetch_add(&cache_hits, 1);
+		*pvalue = entry.value;
+		return true;
+	}
+	
+	unij_atomic_fetch_add(&cache_misses, 1);
+	return false;
+}
+
+void unij_modcache_put(uint64_t key, const unij_file_identity_t* identity, uint64_t value)
+{
+	modcache_entry_t entry;
+	if(unij_fatal_null(identity))
+		return;
+	
+	entry.key = key;
+	entry.size = identity->size;
+	entry.mtime = identity->mtime;
+	entry.file_id = identity->file_id;
+	entry.value = value;
+	entry.check = entry_check(&entry);
+	table_put(cache_entries, cache_capacity, &entry);
+}
+
+bool unij_modcache_persist(const wchar_t* path)
+{
+	uint32_t i;
+	modcache_header_t* header;
+	modcache_entry_t* entries;
+	if(unij_fatal_null(path)) {
+		return false;
+	} else if(cache_entries != memory_entries) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"The module cache has already been moved into a file!");
+		return false;
+	}
+	
+	header = (modcache_header_t*)map_cache_file(path);
+	if(header == NULL)
+		return false;
+	
+	// Anything we don't recognize gets started over.
+	entries = (modcache_entry_t*)(header + 1);
+	if(header->magic != MODCACHE_MAGIC || header->version != MODCACHE_VERSION ||
+	   header->capacity != MODCACHE_FILE_CAPACITY || header->entry_size != sizeof(modcache_entry_t)) {
+		RtlZeroMemory((void*)header, MODCACHE_FILE_SIZE);
+		header->version = MODCACHE_VERSION;
+		header->capacity = MODCACHE_FILE_CAPACITY;
+		header->entry_size = sizeof(modcache_entry_t);
+		header->magic = MODCACHE_MAGIC;
+	}
+	
+	for(i = 0; i < MODCACHE_MEMORY_CAPACITY; i++) {
+		if(entry_valid(&memory_entries[i]))
+			table_put(entries, MODCACHE_FILE_CAPACITY, &memory_entries[i]);
+	}
+	
+	// Entries first: a lookup racing us with the old capacity only sees part of the new table.
+	cache_entries = entries;
+	cache_capacity = MODCACHE_FILE_CAPACITY;
+	return true;
+}
+
+void unij_modcache_stats(uint32_t* phits, uint32_t* pmisses)
+{
+	if(phits != NULL)
+		*phits = unij_atomic_load_relaxed(&cache_hits);
+	if(pmisses != NULL)
+		*pmisses = unij_atomic_load_relaxed(&cache_misses);
+}
@@ -0,0 +1,130 @@
+/**
+ * @file monoenum.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Ordered results get a slot per process, filled in by whichever worker inspected it, so delivering them in pid order
+ * afterwards is just a walk over the slots. Unordered results skip all that and go straight to the callback.
+ */
+#include "pch.h"
+#include "atomics.h"
+#include "monoenum.h"
+#include "pool.h"
+#include <uniject/utility.h>
+
+typedef struct mono_result
+{
+	uint32_t pid;
+	wchar_t* exe_path;
+	wchar_t* mono_name;
+	wchar_t* mono_path;
+} mono_result_t;
+
+struct mono_enum
+{
+	const mono_enum_platform_t* platform;
+	unij_monoinfo_fn fn;
+	void* parameter;
+	unij_atomic_u32 stop;
+	
+	// Only allocated for ordered enumerations.
+	mono_result_t* results;
+	
+	// Handed out to workers on their first item.
+	void* states[POOL_MAX_THREADS];
+};
+
+static void enum_task(void* context, size_t index, uint32_t worker)
+{
+	mono_enum_t* E = (mono_enum_t*)context;
+	const mono_enum_platform_t* platform = E->platform;
+	if(platform->state_size > 0 && E->states[worker] == NULL) {
+		E->states[worker] = unij_alloc(platform->state_size);
+		if(E->states[worker] == NULL) {
+			unij_fatal_alloc();
+			return;
+		}
+	}
+	platform->inspect(E, platform->context, E->states[worker], index);
+}
+
+void mono_enum_found(mono_enum_t* E, size_t index, const unij_monoinfo_t* info)
+{
+	mono_result_t* result;
+	if(E->results == NULL) {
+		// Any number of workers may be in here at once, which is the caller's problem. (see unij_enum_options_t)
+		if(unij_atomic_load_relaxed(&E->stop) == 0 && E->fn((unij_monoinfo_t*)info, E->parameter))
+			unij_atomic_store_relaxed(&E->stop, 1);
+		return;
+	}
+	
+	result = &E->results[index];
+	result->pid = info->pid;
+	result->exe_path = unij_wcsdup(info->exe_path);
+	result->mono_name = unij_wcsdup(info->mono_name);
+	result->mono_path = unij_wcsdup(info->mono_path);
+}
+
+static void deliver_results(mono_enum_t* E, size_t count)
+{
+	size_t i;
+	bool handled = false;
+	for(i = 0; i < count; i++) {
+		mono_result_t* result = &E->results[i];
+		if(result->pid != 0 && !handled) {
+			unij_monoinfo_t info;
+			info.pid = result->pid;
+			info.exe_path = (const wchar_t*)result->exe_path;
+			info.mono_name = (const wchar_t*)result->mono_name;
+			info.mono_path = (const wchar_t*)result->mono_path;
+			handled = E->fn(&info, E->parameter);
+		}
+		
+		unij_free((void*)result->exe_path);
+		unij_free((void*)result->mono_name);
+		unij_free((void*)result->mono_path);
+	}
+}
+
+void mono_enum_run(const mono_enum_platform_t* platform, size_t count, const unij_enum_options_t* options,
+                   unij_monoinfo_fn fn, void* parameter)
+{
+	size_t i;
+	mono_enum_t* E;
+	uint32_t threads = options == NULL ? 1 : options->threads;
+	bool ordered = options != NULL && (options->flags & UNIJ_ENUM_ORDERED);
+	if(count == 0)
+		return;
+	
+	E = (mono_enum_t*)unij_alloc(sizeof(*E));
+	if(E == NULL) {
+		unij_fatal_alloc();
+		return;
+	}
+	
+	E->platform = platform;
+	E->fn = fn;
+	E->parameter = parameter;
+	if(ordered) {
+		E->results = (mono_result_t*)unij_alloc(count * sizeof(mono_result_t));
+		if(E->results == NULL) {
+			unij_fatal_alloc();
+			unij_free((void*)E);
+			return;
+		}
+	}
+	
+	pool_run(count, threads, enum_task, (void*)E, &E->stop);
+	if(ordered) {
+		deliver_results(E, count);
+		unij_free((void*)E->results);
+	}
+	
+	for(i = 0; i < POOL_MAX_THREADS; i++) {
+		if(E->states[i] == NULL)
+			continue;
+		if(platform->cleanup != NULL)
+			platform->cleanup(E->states[i]);
+		unij_free(E->states[i]);
+	}
+	unij_free((void*)E);
+}
@@ -0,0 +1,64 @@
+/**
+ * @file monoenum.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Shared driver behind \a unij_enum_mono_processes_ex
+ *
+ * The platform lists the processes and knows how to inspect one. Everything else - spreading the work across the
+ * pool, stopping early, and collecting results for ordered delivery - lives here.
+ */
+#ifndef _MONOENUM_H_
+#define _MONOENUM_H_
+#pragma once
+
+#include <uniject/process.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mono_enum mono_enum_t;
+typedef struct mono_enum_platform mono_enum_platform_t;
+
+/**
+ * @brief Inspects the process at \a index, handing anything it finds to \a mono_enum_found.
+ * @param state Per-worker scratch space of \a mono_enum_platform::state_size bytes, zeroed when first handed out.
+ */
+typedef void(*mono_inspect_fn)(mono_enum_t* E, void* context, void* state, size_t index);
+
+/**
+ * @brief Releases anything the inspector kept in a worker's state.
+ */
+typedef void(*mono_cleanup_fn)(void* state);
+
+struct mono_enum_platform
+{
+	mono_inspect_fn inspect;
+	mono_cleanup_fn cleanup;
+	size_t state_size;
+	void* context;
+};
+
+/**
+ * @brief Inspects \a count processes, which the platform should have listed in ascending pid order.
+ * @param platform
+ * @param count
+ * @param options NULL to inspect them one at a time on the calling thread.
+ * @param fn
+ * @param parameter
+ */
+void mono_enum_run(const mono_enum_platform_t* platform, size_t count, const unij_enum_options_t* options,
+                   unij_monoinfo_fn fn, void* parameter);
+
+/**
+ * @brief Reports Mono in the process at \a index. The strings in \a info only need to live until this returns.
+ * @param E
+ * @param index
+ * @param info
+ */
+void mono_enum_found(mono_enum_t* E, size_t index, const unij_monoinfo_t* info);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _MONOENUM_H_ */
@@ -0,0 +1,50 @@
+/**
+ * @file once.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * unij_once on top of a single atomic state word. Whoever moves it out of ONCE_IDLE runs the callback, and publishes
+ * the result with a release store that the acquire load on the fast path pairs with. Callers that show up while it's
+ * running flag the word as ONCE_WAITING and sleep on it, so the winner only has to wake anybody when that flag is set.
+ */
+#include "pch.h"
+#include "atomics.h"
+#include <uniject/platform.h>
+
+// unij_once states. Everything from ONCE_FAILED up is final.
+#define ONCE_IDLE    0
+#define ONCE_RUNNING 1
+#define ONCE_WAITING 2
+#define ONCE_FAILED  3
+#define ONCE_DONE    4
+
+STATIC_ASSERT(sizeof(unij_atomic_u32) == sizeof(unij_once_t));
+
+static UNIJ_NOINLINE
+bool unij_once_slow(unij_atomic_u32* state, uint32_t current, unij_once_fn oncefn, void* parameter)
+{
+	for(;;) {
+		if(current >= ONCE_FAILED) {
+			return current == ONCE_DONE;
+		} else if(current == ONCE_IDLE) {
+			if(!unij_atomic_compare_exchange(state, &current, ONCE_RUNNING))
+				continue;
+			
+			current = oncefn(parameter) ? ONCE_DONE : ONCE_FAILED;
+			if(unij_atomic_exchange(state, current) == ONCE_WAITING)
+				unij_wake_by_address((const volatile void*)state);
+			return current == ONCE_DONE;
+		} else if(current == ONCE_RUNNING && !unij_atomic_compare_exchange(state, &current, ONCE_WAITING)) {
+			continue;
+		}
+		
+		unij_wait_on_address((const volatile void*)state, ONCE_WAITING);
+		current = unij_atomic_load_acquire(state);
+	}
+}
+
+bool unij_once(unij_once_t* once, unij_once_fn oncefn, void* parameter)
+{
+	unij_atomic_u32* state = (unij_atomic_u32*)&once->state;
+	uint32_t current = unij_atomic_load_acquire(state);
+	return current >= ONCE_FAILED ? current == ONCE_DONE : unij_once_slow(state, current, oncefn, parameter);
+}
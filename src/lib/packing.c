@@ -4,6 +4,7 @@
  */
 #include "pch.h"
 #include <uniject/packing.h>
+#include <uniject/platform.h>
 #include <uniject/utility.h>
 
 /**
@@ -15,21 +16,45 @@
 
 #define PACKER_MODE_RESERVE 0
 #define PACKER_MODE_PACK    1
+#define PACKER_MODE_GROW    2
+
+// Every packed buffer starts with its total size. The top 16 bits of the size word hold the layout.
+#define PACKER_HEADER_SIZE sizeof(uint64_t)
+#define PACKER_LAYOUT_SHIFT 48
+#define PACKER_SIZE_MASK (((uint64_t)1 << PACKER_LAYOUT_SHIFT) - 1)
+
+// Indexed layouts follow the size word with the offset table's position and entry count.
+#define PACKER_INDEX_HEADER_SIZE (PACKER_HEADER_SIZE + (2 * sizeof(uint32_t)))
+#define PACKER_FIELD_ALIGN 8
+#define PACKER_MIN_FIELDS 0x10
+
+// Smallest buffer a growable packer will allocate.
+#define PACKER_MIN_CAPACITY 0x100
 
 struct unij_packer
 {
 	uint8_t mode;
+	uint8_t layout;
+	bool growable;
 	size_t size;
 	void* position;
 	const void* buffer;
 	unij_memprocs_t* mem;
+	
+	// Field offsets for the indexed layout, written out by unij_packer_finish.
+	uint32_t* fields;
+	uint32_t field_count;
+	uint32_t field_capacity;
 };
 
 struct unij_unpacker
 {
+	uint8_t layout;
 	size_t size;
 	void* position;
 	const void* buffer;
+	uint32_t field_count;
+	const uint32_t* fields;
 };
 
 static const wchar_t SELF_UNPACKER[] = L"unpacker";
@@ -42,31 +67,41 @@ static const wchar_t BOUNDS_UPPER[] = L"upper";
 static const wchar_t BOUNDS_LOWER[] = L"lower";
 
 #define ENSURE_PACKER(P) \
-	( packing_ensure((void*)(P), SELF_PACKER, __FUNCTIONW__) )
+	( packing_ensure((void*)(P), SELF_PACKER, UNIJ_FUNCTION) )
 
 #define ENSURE_UNPACKER(U) \
-	( packing_ensure((void*)(U), SELF_UNPACKER, __FUNCTIONW__) )
+	( packing_ensure((void*)(U), SELF_UNPACKER, UNIJ_FUNCTION) )
 
 #define ENSURE_PACK_MODE(P) \
-	( packer_ensure_mode(P, PACKER_MODE_PACK, __FUNCTIONW__) )
+	( packer_ensure_mode(P, PACKER_MODE_PACK, UNIJ_FUNCTION) )
 
 #define ENSURE_RESERVE_MODE(P) \
-	( packer_ensure_mode(P, PACKER_MODE_RESERVE, __FUNCTIONW__) )
+	( packer_ensure_mode(P, PACKER_MODE_RESERVE, UNIJ_FUNCTION) )
 
-static UNIJ_INLINE bool packing_ensure(void* self, const wchar_t* param, const wchar_t* caller)
+static UNIJ_INLINE bool packing_ensure(void* self, const wchar_t* param, const char* caller)
 {
  	return !unij_fatal_null3(self, caller, param);
 }
 
-static UNIJ_INLINE bool packer_ensure_mode(unij_packer_t* P, uint8_t mode, const wchar_t* caller)
+static UNIJ_INLINE bool packer_ensure_mode(unij_packer_t* P, uint8_t mode, const char* caller)
 {
 	bool result = packing_ensure((void*)P, SELF_PACKER, caller);
-	if(result && P->mode != mode) {
+	if(result && P->mode == PACKER_MODE_GROW) {
+		// Growable packers accept packing calls, but have no reservation phase.
+		if(mode != PACKER_MODE_PACK) {
+			result = false;
+			unij_fatal_error(
+				UNIJ_ERROR_OPERATION,
+				L"Calls to %hs cannot be made on a growable packer!",
+				caller
+			);
+		}
+	} else if(result && P->mode != mode) {
 		const wchar_t* when = mode == PACKER_MODE_RESERVE ? WHEN_BEFORE : WHEN_AFTER;
 		result = false;
 		unij_fatal_error(
 			UNIJ_ERROR_OPERATION,
-			L"Calls to %s can only be made %s the operation mode is changed with a call to unij_packer_commit!",
+			L"Calls to %hs can only be made %ls the operation mode is changed with a call to unij_packer_commit!",
 			caller, when
 		);
 	}
@@ -76,13 +111,16 @@ static UNIJ_INLINE bool packer_ensure_mode(unij_packer_t* P, uint8_t mode, const
 static void packer_clear(unij_packer_t* P)
 {
 	// If the packer has already transitioned to packing mode, wee need to do some additional cleanup.
-	if(P->mode == PACKER_MODE_PACK && P->buffer != NULL) {
+	if(P->mode != PACKER_MODE_RESERVE && P->buffer != NULL) {
 		unij_memprocs_t* memprocs = P->mem;
 		// Free packer buffer
 		ASSERT_NOT_NULL(memprocs->free_fn);
 		memprocs->free_fn(memprocs->parameter, (void*)P->buffer);
 	}
 	
+	if(P->fields != NULL)
+		unij_free((void*)P->fields);
+	
 	// Revert the fields back to the starting state
 	RtlZeroMemory((void*)P, sizeof(*P));
 }
@@ -95,7 +133,7 @@ static void packer_clear(unij_packer_t* P)
 static UNIJ_INLINE void packer_initialize(unij_packer_t* P, unij_memprocs_t* memprocs)
 {
 	P->mem = memprocs;
-	P->size = sizeof(size_t);
+	P->size = PACKER_HEADER_SIZE;
 	P->mode = PACKER_MODE_RESERVE; // To make it more explicit
 }
 
@@ -104,6 +142,16 @@ static UNIJ_INLINE size_t packer_used_bytes(unij_packer_t* P)
 	return TOPTR(P->position) - TOPTR(P->buffer);
 }
 
+static UNIJ_INLINE size_t packer_header_size(uint8_t layout)
+{
+	return layout == UNIJ_LAYOUT_INDEXED ? PACKER_INDEX_HEADER_SIZE : PACKER_HEADER_SIZE;
+}
+
+static UNIJ_INLINE size_t packer_align(size_t offset)
+{
+	return (offset + (PACKER_FIELD_ALIGN - 1)) & ~((size_t)(PACKER_FIELD_ALIGN - 1));
+}
+
 static UNIJ_INLINE size_t unij_packer_bytes_remaining(unij_packer_t* P)
 {
 	size_t used = packer_used_bytes(P);
@@ -123,6 +171,223 @@ static UNIJ_INLINE size_t unij_unpacker_bytes_remaining(unij_unpacker_t* U)
 	return U->size - szUsed;
 }
 
+/**
+ * @brief Ensures a growable packer's buffer can hold \a required bytes in total, doubling its capacity as needed.
+ * @param P packer
+ * @param required Total byte count the buffer needs to hold. Without a buffer there's no header yet either, so it
+ * isn't counted.
+ */
+static bool packer_grow(unij_packer_t* P, size_t required)
+{
+	void* buffer;
+	size_t used, capacity = P->size;
+	unij_memprocs_t* memprocs = P->mem;
+	if(P->buffer == NULL)
+		required += packer_header_size(P->layout);
+	else if(required <= capacity)
+		return true;
+	
+	if(capacity < PACKER_MIN_CAPACITY)
+		capacity = PACKER_MIN_CAPACITY;
+	while(capacity < required) {
+		if(capacity > (SIZE_MAX >> 1)) {
+			capacity = required;
+			break;
+		}
+		capacity <<= 1;
+	}
+	
+	if(P->buffer == NULL) {
+		used = packer_header_size(P->layout);
+		buffer = memprocs->alloc_fn(memprocs->parameter, capacity);
+	} else if(memprocs->realloc_fn != NULL) {
+		used = packer_used_bytes(P);
+		buffer = memprocs->realloc_fn(memprocs->parameter, (void*)P->buffer, capacity);
+	} else {
+		used = packer_used_bytes(P);
+		buffer = memprocs->alloc_fn(memprocs->parameter, capacity);
+		if(buffer != NULL) {
+			RtlCopyMemory(buffer, P->buffer, used);
+			memprocs->free_fn(memprocs->parameter, (void*)P->buffer);
+		}
+	}
+	
+	if(buffer == NULL) {
+		unij_fatal_error(
+			UNIJ_ERROR_OUTOFMEMORY,
+			L"Specified unij_memprocs_t failed to grow packer buffer to %zu bytes",
+			capacity
+		);
+		return false;
+	}
+	
+	// Neither handler is required to hand back zeroed memory.
+	RtlZeroMemory((void*)(TOPTR(buffer) + used), capacity - used);
+	P->buffer = (const void*)buffer;
+	P->position = (void*)(TOPTR(buffer) + used);
+	P->size = capacity;
+	return true;
+}
+
+/**
+ * @brief Claims the next \a size bytes of the packer's buffer for the caller to fill in. Mode checks are left up to
+ * the caller.
+ * @return Start of the claimed span or NULL on failure.
+ */
+static void* packer_span(unij_packer_t* P, size_t size)
+{
+	void* span;
+	size_t remaining;
+	
+	// Growable packers make room instead of failing.
+	if(P->mode == PACKER_MODE_GROW && !packer_grow(P, packer_used_bytes(P) + size))
+		return NULL;
+	
+	remaining = unij_packer_bytes_remaining(P);
+	if(size > remaining) {
+		unij_fatal_error(
+			UNIJ_ERROR_OPERATION,
+			L"Attempted to pack %zu bytes with only %zu bytes of space left in the packer's buffer. "
+			L"Verify that all data packing calls has a matching reserve.",
+			size, remaining
+		);
+		return NULL;
+	}
+	
+	span = P->position;
+	P->position = (void*)(TOPTR(P->position) + size);
+	return span;
+}
+
+/**
+ * @brief Copies \a size bytes into the packer's buffer. Mode checks are left up to the caller.
+ */
+static bool packer_write(unij_packer_t* P, const void* data, size_t size)
+{
+	void* span = packer_span(P, size);
+	if(span == NULL)
+		return false;
+	
+	RtlCopyMemory(span, data, size);
+	return true;
+}
+
+/**
+ * @brief Reads the length prefix of a string, then borrows its characters (\a width bytes each) along with their
+ * terminator.
+ */
+static bool unpacker_borrow_string(unij_unpacker_t* U, uint16_t* plength, const void** pvalue, size_t width)
+{
+	const uint8_t* value;
+	size_t byte_count, index;
+	*pvalue = NULL;
+	if(!unij_unpack_val(U, plength))
+		return false;
+	
+	if(*plength == 0)
+		return true;
+	
+	byte_count = ((size_t)*plength + 1) * width;
+	value = (const uint8_t*)unij_unpacker_peek(U);
+	if(!unij_unpacker_seek(U, (int64_t)byte_count)) {
+		unij_show_error_message(
+			L"Failed to seek to the end of a packed string. Verify that the data layout for your packer "
+			L"and unpacker match. (if so, please report this issue)"
+		);
+		return false;
+	}
+	
+	// Borrowed strings get handed to APIs expecting a terminator, so don't trust a buffer without one.
+	for(index = byte_count - width; index < byte_count; index++) {
+		if(value[index] != 0) {
+			unij_fatal_error(UNIJ_ERROR_OPERATION, L"Packed string of length %hu is missing its terminator!", *plength);
+			return false;
+		}
+	}
+	
+	*pvalue = (const void*)value;
+	return true;
+}
+
+/**
+ * @brief Aligns the packer's position to the next field boundary. The padding is already zeroed by packer_grow.
+ */
+static bool packer_align_position(unij_packer_t* P)
+{
+	size_t used = packer_used_bytes(P);
+	size_t aligned = packer_align(used);
+	if(aligned != used) {
+		if(!packer_grow(P, aligned))
+			return false;
+		P->position = (void*)(TOPTR(P->buffer) + aligned);
+	}
+	return true;
+}
+
+/**
+ * @brief Starts a new field. Sequential layouts have nothing to do, while indexed layouts align the position and
+ * record its offset.
+ */
+static bool packer_begin_field(unij_packer_t* P)
+{
+	if(P->layout != UNIJ_LAYOUT_INDEXED)
+		return true;
+	
+	// Only growable packers can be indexed. Once reset, they get their buffer and header back with the first write.
+	if(P->buffer == NULL && !packer_grow(P, 0))
+		return false;
+	
+	if(!packer_align_position(P))
+		return false;
+	
+	if(P->field_count == P->field_capacity) {
+		uint32_t capacity = P->field_capacity == 0 ? PACKER_MIN_FIELDS : P->field_capacity << 1;
+		uint32_t* fields = (uint32_t*)unij_alloc(capacity * sizeof(uint32_t));
+		if(fields == NULL) {
+			unij_fatal_alloc();
+			return false;
+		}
+		if(P->fields != NULL) {
+			RtlCopyMemory((void*)fields, (const void*)P->fields, P->field_count * sizeof(uint32_t));
+			unij_free((void*)P->fields);
+		}
+		P->fields = fields;
+		P->field_capacity = capacity;
+	}
+	
+	P->fields[P->field_count++] = (uint32_t)packer_used_bytes(P);
+	return true;
+}
+
+/**
+ * @brief Appends the offset table and fills in the extended header of an indexed layout.
+ */
+static bool packer_write_index(unij_packer_t* P)
+{
+	uint32_t index_header[2];
+	if(!packer_align_position(P))
+		return false;
+	
+	index_header[0] = (uint32_t)packer_used_bytes(P);
+	index_header[1] = P->field_count;
+	if(P->field_count > 0 && !packer_write(P, (const void*)P->fields, P->field_count * sizeof(uint32_t)))
+		return false;
+	
+	RtlCopyMemory((void*)(TOPTR(P->buffer) + PACKER_HEADER_SIZE), (const void*)index_header, sizeof(index_header));
+	return true;
+}
+
+static UNIJ_INLINE void unpacker_align_position(unij_unpacker_t* U)
+{
+	if(U->layout == UNIJ_LAYOUT_INDEXED) {
+		size_t aligned = packer_align(unij_unpacker_bytes_used(U));
+		
+		// Out of bounds positions are left for the read that follows to report.
+		if(aligned <= U->size)
+			U->position = (void*)(TOPTR(U->buffer) + aligned);
+	}
+}
+
 /**
  * @endinternal
  */
@@ -146,19 +411,43 @@ unij_packer_t* unij_packer_create(unij_memprocs_t* memprocs)
 	return P;
 }
 
+unij_packer_t* unij_packer_create_growable(unij_memprocs_t* memprocs, size_t hint)
+{
+	unij_packer_t* P = unij_packer_create(memprocs);
+	if(P != NULL) {
+		P->growable = true;
+		P->mode = PACKER_MODE_GROW;
+		if(!packer_grow(P, hint)) {
+			unij_packer_destroy(P);
+			P = NULL;
+		}
+	}
+	return P;
+}
+
 void unij_packer_reset(unij_packer_t* P)
 {
 	// Only the memory routines are preserved. 
+	bool growable;
+	uint8_t layout;
 	unij_memprocs_t* memprocs;
 	if(!ENSURE_PACKER(P)) return;
 	
 	memprocs = P->mem;
+	layout = P->layout;
+	growable = P->growable;
 	
 	// Use internal reset handler to zero everything out.
 	packer_clear(P);
 	
-	// Then revert the fields to the initial state at the time of construction.
+	// Then revert the fields to the initial state at the time of construction. Growable packers reallocate lazily.
 	packer_initialize(P, memprocs);
+	if(growable) {
+		P->size = 0;
+		P->layout = layout;
+		P->growable = true;
+		P->mode = PACKER_MODE_GROW;
+	}
 }
 
 void unij_packer_destroy(unij_packer_t* P)
@@ -169,9 +458,40 @@ void unij_packer_destroy(unij_packer_t* P)
 	}
 }
 
+bool unij_packer_set_layout(unij_packer_t* P, unij_layout_t layout)
+{
+	size_t header_size;
+	if(!ENSURE_PACKER(P))
+		return false;
+	
+	if(layout != UNIJ_LAYOUT_SEQUENTIAL && layout != UNIJ_LAYOUT_INDEXED) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"Unknown packer layout: %u", (unsigned int)layout);
+		return false;
+	} else if(P->mode != PACKER_MODE_GROW) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"Only growable packers support changing their layout!");
+		return false;
+	} else if(P->buffer != NULL && packer_used_bytes(P) != packer_header_size(P->layout)) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"The layout of a packer must be set before any data is packed!");
+		return false;
+	}
+	
+	// Make room for (or reclaim) the extended header.
+	header_size = packer_header_size((uint8_t)layout);
+	P->layout = (uint8_t)layout;
+	if(P->buffer != NULL) {
+		if(!packer_grow(P, header_size))
+			return false;
+		RtlZeroMemory((void*)(TOPTR(P->buffer) + PACKER_HEADER_SIZE), PACKER_INDEX_HEADER_SIZE - PACKER_HEADER_SIZE);
+		P->position = (void*)(TOPTR(P->buffer) + header_size);
+	}
+	return true;
+}
+
 size_t unij_packer_get_size(unij_packer_t* P)
 {
-	return ENSURE_PACKER(P) ? P->size : 0;
+	if(!ENSURE_PACKER(P))
+		return 0;
+	return P->mode == PACKER_MODE_GROW ? packer_used_bytes(P) : P->size;
 }
 
 const void* unij_packer_get_buffer(unij_packer_t* P)
@@ -179,6 +499,50 @@ const void* unij_packer_get_buffer(unij_packer_t* P)
 	return ENSURE_PACKER(P) ? P->buffer : NULL;
 }
 
+bool unij_packer_finish(unij_packer_t* P)
+{
+	uint64_t llsize;
+	if(!ENSURE_PACKER(P))
+		return false;
+	
+	if(P->mode != PACKER_MODE_GROW) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"unij_packer_finish can only be called on a growable packer!");
+		return false;
+	} else if(!packer_grow(P, packer_header_size(P->layout))) {
+		return false;
+	} else if(P->layout == UNIJ_LAYOUT_INDEXED && !packer_write_index(P)) {
+		return false;
+	}
+	
+	// Shrink the logical size to what was actually packed, then fill in the header.
+	P->size = packer_used_bytes(P);
+	llsize = (uint64_t)P->size | ((uint64_t)P->layout << PACKER_LAYOUT_SHIFT);
+	RtlCopyMemory((void*)P->buffer, (const void*)&llsize, sizeof(llsize));
+	P->mode = PACKER_MODE_PACK;
+	return true;
+}
+
+void* unij_packer_release(unij_packer_t* P, size_t* psize)
+{
+	void* buffer;
+	if(!ENSURE_PACK_MODE(P)) {
+		return NULL;
+	} else if(P->mode == PACKER_MODE_GROW) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"Growable packers must be finished before their buffer is released!");
+		return NULL;
+	}
+	
+	buffer = (void*)P->buffer;
+	if(psize != NULL)
+		*psize = P->size;
+	
+	// Detach the buffer so packer_clear leaves it alone.
+	P->buffer = NULL;
+	P->position = NULL;
+	P->size = 0;
+	return buffer;
+}
+
 void unij_reserve(unij_packer_t* P, size_t size)
 {
 	if(ENSURE_RESERVE_MODE(P)) {
@@ -189,13 +553,43 @@ void unij_reserve(unij_packer_t* P, size_t size)
 void unij_reserve_wstr(unij_packer_t* P, const unij_wstr_t* data)
 {
 	// Mode/NULL checks are done in unij_reserve call
-	size_t size = data == NULL ? sizeof(uint16_t) : sizeof(data->length) + WSIZE(data->length);
+	size_t size = sizeof(uint16_t);
+	if(data != NULL && data->length > 0)
+		size += WSIZE((size_t)data->length + 1);
+	unij_reserve(P, size);
+}
+
+void unij_reserve_cstr(unij_packer_t* P, const unij_cstr_t* data)
+{
+	size_t size = sizeof(uint16_t);
+	if(data != NULL && data->length > 0)
+		size += (size_t)data->length + 1;
 	unij_reserve(P, size);
 }
 
+void unij_reserve_wstr_utf8(unij_packer_t* P, const unij_wstr_t* data)
+{
+	unij_reserve(P, sizeof(uint16_t) + unij_wstr_utf8_size(data));
+}
+
+size_t unij_wstr_utf8_size(const unij_wstr_t* data)
+{
+	size_t bytes;
+	if(data == NULL || data->length == 0)
+		return 0;
+	
+	bytes = unij_wcstoutf8(NULL, 0, data->value, (size_t)data->length);
+	if(bytes == 0) {
+		unij_fatal_call(unij_wcstoutf8);
+		return 0;
+	}
+	return bytes + 1;
+}
+
 bool unij_packer_commit(unij_packer_t* P)
 {
 	bool status;
+	uint64_t llsize;
 	void*  buffer = NULL;
 	unij_memprocs_t* memprocs;
 	if(!ENSURE_RESERVE_MODE(P))
@@ -216,53 +610,109 @@ bool unij_packer_commit(unij_packer_t* P)
 		P->position = buffer;
 		P->buffer = (const void*)buffer;
 		P->mode = PACKER_MODE_PACK;
-		uint64_t llsize = (uint64_t)P->size;
-		status = unij_pack(P, (const void*)&llsize, sizeof(uint64_t));
+		llsize = (uint64_t)P->size;
+		status = packer_write(P, (const void*)&llsize, sizeof(uint64_t));
 	}
 	return status;
 }
 
 bool unij_pack(unij_packer_t* P, const void* data, size_t size)
 {
-	bool status = true;
-	size_t remaining;
-	
-	if(!ENSURE_PACK_MODE(P))
+	if(!ENSURE_PACK_MODE(P) || !packer_begin_field(P))
 		return false;
 	
-	// Empty data is silently ignored.
+	// Empty data is silently ignored. (though it still gets an entry in an indexed layout)
 	if(data == NULL || size == 0) 
 		return true;
 	
-	remaining = unij_packer_bytes_remaining(P);
-	if(size > remaining) {
-		status = false;
-		unij_fatal_error(
-			UNIJ_ERROR_OPERATION,
-			L"Attempted to pack %zu bytes with only %zu bytes of space left in the packer's buffer. "
-			L"Verify that all data packing calls has a matching reserve.",
-			size, remaining
-		);
-	} else {
-		void* dest = P->position;
-		RtlCopyMemory(dest, data, size);
-		P->position = (void*)(TOPTR(P->position) + size);
+	return packer_write(P, data, size);
+}
+
+bool unij_pack_wstr(unij_packer_t* P, const unij_wstr_t* data)
+{
+	const wchar_t terminator = L'\0';
+	uint16_t length = data == NULL ? 0 : data->length;
+	if(!ENSURE_PACK_MODE(P) || !packer_begin_field(P))
+		return false;
+	
+	if(!packer_write(P, (const void*)&length, sizeof(length)))
+		return false;
+	
+	// Terminated, so unpacked strings can be used in place.
+	return length == 0 || (
+		packer_write(P, (const void*)data->value, WSIZE(length)) &&
+		packer_write(P, (const void*)&terminator, sizeof(terminator))
+	);
+}
+
+bool unij_pack_cstr(unij_packer_t* P, const unij_cstr_t* data)
+{
+	const char terminator = '\0';
+	uint16_t length = data == NULL ? 0 : data->length;
+	if(!ENSURE_PACK_MODE(P) || !packer_begin_field(P))
+		return false;
+	
+	if(!packer_write(P, (const void*)&length, sizeof(length)))
+		return false;
+	
+	return length == 0 || (
+		packer_write(P, (const void*)data->value, (size_t)length) &&
+		packer_write(P, (const void*)&terminator, sizeof(terminator))
+	);
+}
+
+bool unij_pack_wstr_utf8(unij_packer_t* P, const unij_wstr_t* data)
+{
+	char* span;
+	size_t size;
+	uint16_t length = 0;
+	if(!ENSURE_PACK_MODE(P) || !packer_begin_field(P))
+		return false;
+	
+	size = unij_wstr_utf8_size(data);
+	if(size > (size_t)UINT16_MAX) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"UTF-8 encoding of a %hu character wstr is too long to pack!", data->length);
+		return false;
+	} else if(size == 0) {
+		// Either an empty string or a failed conversion. (already reported)
+		if(data != NULL && data->length > 0)
+			return false;
+		return packer_write(P, (const void*)&length, sizeof(length));
 	}
 	
-	return status;
+	// The terminator is already zeroed, so only the characters need encoding.
+	length = (uint16_t)(size - 1);
+	if(!packer_write(P, (const void*)&length, sizeof(length)))
+		return false;
+	
+	span = (char*)packer_span(P, size);
+	if(span == NULL)
+		return false;
+	
+	if(!unij_wcstoutf8(span, (size_t)length, data->value, (size_t)data->length)) {
+		unij_fatal_call(unij_wcstoutf8);
+		return false;
+	}
+	return true;
 }
 
-bool unij_pack_wstr(unij_packer_t* P, const unij_wstr_t* data)
+size_t unij_packed_size(const void* buffer)
 {
-	uint16_t default_length = 0;
-	if(data == NULL) return unij_pack_val(P, default_length);
-	return unij_pack_val(P, data->length) && data->length > 0 ?
-	       unij_pack(P, (const void*)data->value, data->length * sizeof(wchar_t)) : true;
+	uint64_t llsize;
+	if(unij_fatal_null(buffer))
+		return 0;
+	
+	RtlCopyMemory((void*)&llsize, buffer, sizeof(llsize));
+	return (size_t)(llsize & PACKER_SIZE_MASK);
 }
 
 unij_unpacker_t* unij_unpacker_create(const void* buffer)
 {
 	unij_unpacker_t* U;
+	uint64_t llsize;
+	uint8_t layout;
+	size_t size, start = PACKER_HEADER_SIZE;
+	uint32_t index_header[2] = { 0, 0 };
 	
 	// Should never be NULL
 	if(buffer == NULL) {
@@ -273,12 +723,38 @@ unij_unpacker_t* unij_unpacker_create(const void* buffer)
 		return NULL;
 	}
 	
+	RtlCopyMemory((void*)&llsize, buffer, sizeof(llsize));
+	layout = (uint8_t)(llsize >> PACKER_LAYOUT_SHIFT);
+	size = (size_t)(llsize & PACKER_SIZE_MASK);
+	
+	if(layout == UNIJ_LAYOUT_INDEXED) {
+		// Readable data ends where the offset table starts.
+		RtlCopyMemory((void*)index_header, (const void*)(TOPTR(buffer) + PACKER_HEADER_SIZE), sizeof(index_header));
+		start = PACKER_INDEX_HEADER_SIZE;
+		if(index_header[0] < start || (size_t)index_header[0] > size ||
+		   (size - (size_t)index_header[0]) / sizeof(uint32_t) < (size_t)index_header[1]) {
+			unij_fatal_error(
+				UNIJ_ERROR_OPERATION,
+				L"Packed buffer has a corrupt offset table: %u fields at offset %u of a %zu byte buffer",
+				index_header[1], index_header[0], size
+			);
+			return NULL;
+		}
+		size = (size_t)index_header[0];
+	} else if(layout != UNIJ_LAYOUT_SEQUENTIAL) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"Packed buffer uses an unknown layout: %u", (unsigned int)layout);
+		return NULL;
+	}
+	
 	// Allocate unpacker struct
 	U = (unij_unpacker_t*)unij_alloc(sizeof(*U));
 	if(U != NULL) {
 		U->buffer = buffer;
-		U->size = (size_t)*((uint64_t*)buffer);
-		U->position = (void*)(TOPTR(buffer) + sizeof(uint64_t));
+		U->size = size;
+		U->layout = layout;
+		U->position = (void*)(TOPTR(buffer) + start);
+		U->field_count = index_header[1];
+		U->fields = layout == UNIJ_LAYOUT_INDEXED ? (const uint32_t*)(TOPTR(buffer) + index_header[0]) : NULL;
 	} else {
 		unij_fatal_alloc();
 	}
@@ -293,6 +769,43 @@ void unij_unpacker_destroy(unij_unpacker_t* U)
 	}
 }
 
+size_t unij_unpacker_field_count(unij_unpacker_t* U)
+{
+	return ENSURE_UNPACKER(U) ? (size_t)U->field_count : 0;
+}
+
+bool unij_unpacker_field(unij_unpacker_t* U, size_t index)
+{
+	size_t offset;
+	if(!ENSURE_UNPACKER(U))
+		return false;
+	
+	if(U->layout != UNIJ_LAYOUT_INDEXED) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"unij_unpacker_field requires a buffer packed with UNIJ_LAYOUT_INDEXED!");
+		return false;
+	} else if(index >= (size_t)U->field_count) {
+		unij_fatal_error(
+			UNIJ_ERROR_PARAM,
+			L"Field index %zu is out of range. The packed buffer only has %u fields.",
+			index, U->field_count
+		);
+		return false;
+	}
+	
+	offset = (size_t)U->fields[index];
+	if(offset < PACKER_INDEX_HEADER_SIZE || offset > U->size) {
+		unij_fatal_error(
+			UNIJ_ERROR_OPERATION,
+			L"Field %zu has an offset of %zu, which falls outside the packed data. (%zu bytes)",
+			index, offset, U->size
+		);
+		return false;
+	}
+	
+	U->position = (void*)(TOPTR(U->buffer) + offset);
+	return true;
+}
+
 void* unij_unpacker_peek(unij_unpacker_t* U)
 {
 	return ENSURE_UNPACKER(U) ? U->position : NULL;
@@ -319,7 +832,7 @@ bool unij_unpacker_seek(unij_unpacker_t* U, int64_t offset)
 			
 			// Subtract the offset from our position
 			if(result) U->position = (void*)(TOPTR(U->position) - szOffset);
-			
+		
 		} else {
 			// Compare offset against the remaining bytes in our buffer
 			szBoundOffset = unij_unpacker_bytes_remaining(U);
@@ -335,7 +848,7 @@ bool unij_unpacker_seek(unij_unpacker_t* U, int64_t offset)
 		if(!result) {
 			unij_fatal_error(
 				UNIJ_ERROR_OPERATION,
-				L"Attempted to reposition the unpacker outside of the buffer's %s bounds. Seek "
+				L"Attempted to reposition the unpacker outside of the buffer's %ls bounds. Seek "
 				L"offset %zu > bounds offset %zu",
 				bounds_text, szOffset, szBoundOffset
 			);
@@ -359,6 +872,8 @@ bool unij_unpack(unij_unpacker_t* U, void* pDest, size_t size)
 		return FALSE;
 	}
 	
+	// Indexed layouts pad every field out to its alignment.
+	unpacker_align_position(U);
 	szRemaining = unij_unpacker_bytes_remaining(U);
 	if(size > szRemaining) {
 		status = false;
@@ -388,24 +903,51 @@ bool unij_unpack_wstr(unij_unpacker_t* U, unij_wstr_t* dest)
 	
 	// Zero out the destination. unpacker NULL checking done by unij_unpack.
 	RtlZeroMemory((void*)dest, sizeof(*dest));
-	if(unij_unpack_val(U, &dest->length)) {
-		if(dest->length > 0) {
-			size_t byte_count = WSIZE(dest->length);
-			dest->value = (const wchar_t*)unij_unpacker_peek(U);
-			success = unij_unpacker_seek(U, byte_count);
-			if(!success) {
-				unij_show_error_message(
-					L"Failed to seek to the end of a packed wstr. Verify that the data layout for your packer "
-					L"and unpacker match. (if so, please report this issue)"
-				);
-			}
-		} else {
-			success = true;
-		}
+	success = unpacker_borrow_string(U, &dest->length, (const void**)&dest->value, sizeof(wchar_t));
+	if(!success)
+		RtlZeroMemory((void*)dest, sizeof(*dest));
+	return success;
+}
+
+bool unij_unpack_cstr(unij_unpacker_t* U, unij_cstr_t* dest)
+{
+	bool success;
+	
+	// Verify our destination
+	if(dest == NULL) {
+		unij_fatal_error(UNIJ_ERROR_ADDRESS, L"Fatal call made to unij_unpack_cstr: NULL destination");
+		return FALSE;
 	}
+	
+	RtlZeroMemory((void*)dest, sizeof(*dest));
+	success = unpacker_borrow_string(U, &dest->length, (const void**)&dest->value, sizeof(char));
+	if(!success)
+		RtlZeroMemory((void*)dest, sizeof(*dest));
 	return success;
 }
 
+bool unij_unpack_cstrdup(unij_unpacker_t* U, unij_cstr_t* dest)
+{
+	char* value;
+	unij_cstr_t in_place = { 0, NULL };
+	if(!unij_unpack_cstr(U, &in_place))
+		return false;
+	
+	dest->length = in_place.length;
+	dest->value = NULL;
+	if(in_place.length > 0) {
+		// unij_alloc hands back zeroed memory, which takes care of the terminator.
+		value = (char*)unij_alloc((size_t)in_place.length + 1);
+		if(value == NULL) {
+			unij_fatal_alloc();
+			return false;
+		}
+		RtlCopyMemory((void*)value, (const void*)in_place.value, (size_t)in_place.length);
+		dest->value = (const char*)value;
+	}
+	return true;
+}
+
 bool unij_unpack_wstrdup(unij_unpacker_t* U, unij_wstr_t* dest)
 {
 	bool result;
@@ -1,76 +1,120 @@
 /**
  * @file params.c
  * 
+ * The reserve/pack/unpack code for our params is generated from the field list in params.inl.
+ * 
  * TODO: Probably just be easier to delimit the string fields with null bytes instead of packing/unpacking based on lengths.
  * TODO: Default value fallback should probably be handled somewhere else.
  */
 #include "pch.h"
 #include <uniject/packing.h>
 #include <uniject/params.h>
+#include <uniject/utility.h>
 
 // Potential bitset values for our "flags"
 #define FLAGS_NONE      (0)
 #define FLAGS_DEBUGGING (1<<0)
 #define FLAGS_NEWTHREAD (1<<1)
+#define FLAGS_RESIDENT  (1<<2)
 
-void unij_reserve_params(unij_packer_t* P, const unij_params_t* data)
-{
-	unij_reserve_type(P, uint32_t); // pid
-	unij_reserve_type(P, uint32_t); // tid
-	unij_reserve_type(P, uint32_t); // flags
-	unij_reserve_wstr(P, &data->mono_path);
-	unij_reserve_wstr(P, &data->assembly_path);
-	unij_reserve_wstr(P, &data->class_name);
-	unij_reserve_wstr(P, &data->method_name);
-	unij_reserve_wstr(P, &data->log_path);
-}
+static const wchar_t default_class[] = UNIJ_DEFAULT_CLASSW;
+static const wchar_t default_method[] = UNIJ_DEFAULT_METHODW;
 
-/**
- * @brief Packs bools into a bitset
- */
-static UNIJ_INLINE bool unij_pack_flags(unij_packer_t* P, const unij_params_t* data)
+static UNIJ_INLINE void params_method_parts(const unij_params_t* data, unij_wstr_t* cls, unij_wstr_t* method)
 {
-	uint32_t flags = FLAGS_NONE;
-	if(data->debugging)  flags |= FLAGS_DEBUGGING;
-	return unij_pack_val(P, flags);
+	if(unij_is_empty(&data->class_name)) {
+		cls->length = (uint16_t)STRINGLEN(default_class);
+		cls->value = default_class;
+	} else {
+		*cls = data->class_name;
+	}
+	
+	if(unij_is_empty(&data->method_name)) {
+		method->length = (uint16_t)STRINGLEN(default_method);
+		method->value = default_method;
+	} else {
+		*method = data->method_name;
+	}
 }
 
-bool unij_pack_params(unij_packer_t* P, const unij_params_t* data)
+// The method descriptor is resolved on the injector side, so the loader can hand it to mono_method_desc_new as-is.
+static size_t params_method_desc_measure(const unij_params_t* data)
 {
-	if(!unij_pack_val(P, data->pid)) return false;
-	if(!unij_pack_val(P, data->tid)) return false;
-	if(!unij_pack_flags(P, data)) return false;
-	if(!unij_pack_wstr(P, &data->mono_path)) return false;
-	if(!unij_pack_wstr(P, &data->assembly_path)) return false;
-	if(!unij_pack_wstr(P, &data->class_name)) return false;
-	if(!unij_pack_wstr(P, &data->method_name)) return false;
-	if(!unij_pack_wstr(P, &data->log_path)) return false;
-	return true;
+	unij_wstr_t cls, method;
+	params_method_parts(data, &cls, &method);
+	
+	// Both parts are measured with a terminator. The class name's becomes the ':' separator.
+	return sizeof(uint16_t) + unij_wstr_utf8_size(&cls) + unij_wstr_utf8_size(&method);
 }
 
-/**
- * @brief Packs all the ``bool`` fields from \a ::unij_params_t into a bitset (for \a unij_params_packed::Flags)
- * @param[in] pSrc Pointer to input params
- */
-static UNIJ_INLINE bool unij_unpack_flags(unij_unpacker_t* U, unij_params_t* dest)
+static bool params_method_desc_pack(unij_packer_t* P, const unij_params_t* data)
 {
-	uint32_t flags = 0;
-	bool result = unij_unpack_val(U, &flags);
-	if(result) {
-		dest->debugging = (bool)(flags & FLAGS_DEBUGGING ? 1 : 0);
+	bool result;
+	wchar_t* buffer;
+	size_t length;
+	unij_wstr_t cls, method, desc;
+	params_method_parts(data, &cls, &method);
+	
+	length = (size_t)cls.length + 1 + (size_t)method.length;
+	if(length > (size_t)UINT16_MAX) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"Method descriptor of %zu characters is too long to pack!", length);
+		return false;
+	}
+	
+	buffer = unij_wcsalloc(length + 1);
+	if(buffer == NULL) {
+		unij_fatal_alloc();
+		return false;
 	}
+	
+	RtlCopyMemory((void*)buffer, (const void*)cls.value, WSIZE(cls.length));
+	buffer[cls.length] = L':';
+	RtlCopyMemory((void*)&(buffer[cls.length + 1]), (const void*)method.value, WSIZE(method.length));
+	
+	desc.length = (uint16_t)length;
+	desc.value = (const wchar_t*)buffer;
+	result = unij_pack_wstr_utf8(P, &desc);
+	unij_free((void*)buffer);
 	return result;
 }
 
-bool unij_unpack_params(unij_unpacker_t* U, unij_params_t* dest)
+static bool params_method_desc_unpack(unij_unpacker_t* U, unij_params_t* dest, bool view)
+{
+	return view ? unij_unpack_cstr(U, &dest->utf8.method_desc) : unij_unpack_cstrdup(U, &dest->utf8.method_desc);
+}
+
+// unij_unpack_params allocates copies, so the shared memory can be released right after unpacking.
+// unij_unpack_params_view borrows the strings from the shared memory instead.
+#define UNIJ_SCHEMA_NAME        params
+#define UNIJ_SCHEMA_TYPE        unij_params_t
+#define UNIJ_SCHEMA_FIELDS      "params.inl"
+#define UNIJ_SCHEMA_UNPACK_WSTR unij_unpack_wstrdup
+#define UNIJ_SCHEMA_UNPACK_CSTR unij_unpack_cstrdup
+#define UNIJ_SCHEMA_VIEW
+#define UNIJ_SCHEMA_REVISION    5
+#include <uniject/schema.h>
+
+void unij_free_params(unij_params_t* params)
+{
+	if(params == NULL)
+		return;
+	
+	unij_wstrfree(&params->mono_path);
+	unij_wstrfree(&params->assembly_path);
+	unij_wstrfree(&params->class_name);
+	unij_wstrfree(&params->method_name);
+	unij_wstrfree(&params->log_path);
+	unij_cstrfree(&params->utf8.assembly_path);
+	unij_cstrfree(&params->utf8.method_desc);
+	RtlZeroMemory((void*)params, sizeof(*params));
+}
+
+bool unij_pack_status(unij_packer_t* P, const unij_status_t* status)
+{
+	return unij_pack_val(P, status->request) && unij_pack_val(P, status->status);
+}
+
+bool unij_unpack_status(unij_unpacker_t* U, unij_status_t* dest)
 {
-	if(!unij_unpack_val(U, &(dest->pid))) return false;
-	if(!unij_unpack_val(U, &(dest->tid))) return false;
-	if(!unij_unpack_flags(U, dest)) return false;
-	if(!unij_unpack_wstrdup(U, &(dest->mono_path))) return false;
-	if(!unij_unpack_wstrdup(U, &(dest->assembly_path))) return false;
-	if(!unij_unpack_wstrdup(U, &(dest->class_name))) return false;
-	if(!unij_unpack_wstrdup(U, &(dest->method_name))) return false;
-	if(!unij_unpack_wstrdup(U, &(dest->log_path))) return false;
-	return true;
+	return unij_unpack_val(U, &dest->request) && unij_unpack_val(U, &dest->status);
 }
@@ -0,0 +1,28 @@
+/**
+ * Wire layout of \a unij_params_t. Included multiple times by uniject/schema.h with different implementations
+ * of UNIJ_FIELD.
+ */
+
+#ifndef UNIJ_FIELD
+#error UNIJ_FIELD must be defined prior to including params.inl!
+#endif
+
+UNIJ_FIELD(VAL, uint32_t, pid)
+UNIJ_FIELD(VAL, uint32_t, tid)
+UNIJ_FIELD(VAL, uint32_t, request)
+
+UNIJ_FIELD(FLAGS, uint32_t, flags)
+UNIJ_FIELD(FLAG, FLAGS_DEBUGGING, debugging)
+UNIJ_FIELD(FLAG, FLAGS_RESIDENT, resident)
+
+// Passed to Win32 APIs on the loader side.
+UNIJ_FIELD(WSTR, unij_wstr_t, mono_path)
+
+// Passed to mono, which only takes UTF-8. The method descriptor is built from class_name and method_name.
+UNIJ_FIELD(UTF8, utf8.assembly_path, assembly_path)
+UNIJ_FIELD(CUSTOM, params_method_desc, method_desc)
+
+UNIJ_FIELD(WSTR, unij_wstr_t, log_path)
+
+/** Save us some lines in the including file */
+#undef UNIJ_FIELD
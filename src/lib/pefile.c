@@ -0,0 +1,495 @@
+/**
+ * @file pefile.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Fields are read a byte at a time at their documented offsets instead of through the IMAGE_* structures, which keeps
+ * this independent of windows.h, alignment and host byte order. Offsets below are relative to the start of the
+ * structure they belong to.
+ */
+#include "pch.h"
+#include "filemap.h"
+#include <uniject/pefile.h>
+#include <uniject/utility.h>
+
+#define PE_DOS_MAGIC 0x5A4D /* MZ */
+#define PE_DOS_LFANEW 0x3C
+#define PE_DOS_SIZE 0x40
+
+#define PE_NT_SIGNATURE 0x00004550 /* PE\0\0 */
+#define PE_FILE_HEADER 4
+#define PE_FILE_MACHINE 0
+#define PE_FILE_SECTIONS 2
+#define PE_FILE_OPTIONAL_SIZE 16
+#define PE_OPTIONAL_HEADER 24
+
+#define PE_OPTIONAL_MAGIC 0
+#define PE_OPTIONAL_HEADERS_SIZE 60
+#define PE32_MAGIC 0x10B
+#define PE32_DIRECTORY_COUNT 92
+#define PE32_DIRECTORIES 96
+#define PE32PLUS_MAGIC 0x20B
+#define PE32PLUS_DIRECTORY_COUNT 108
+#define PE32PLUS_DIRECTORIES 112
+
+// The export directory is the first data directory.
+#define PE_DIRECTORY_SIZE 8
+
+#define PE_SECTION_SIZE 40
+#define PE_SECTION_VIRTUAL_SIZE 8
+#define PE_SECTION_VIRTUAL_ADDRESS 12
+#define PE_SECTION_RAW_SIZE 16
+#define PE_SECTION_RAW_POINTER 20
+
+#define PE_EXPORT_SIZE 40
+#define PE_EXPORT_FUNCTION_COUNT 20
+#define PE_EXPORT_NAME_COUNT 24
+#define PE_EXPORT_FUNCTIONS 28
+#define PE_EXPORT_NAMES 32
+#define PE_EXPORT_ORDINALS 36
+
+#define EXPORT_INDEX_MIN_CAPACITY 16
+
+// Far more names than any real image exports, and small enough that the slot count and size can't overflow.
+#define EXPORT_INDEX_MAX_NAMES 0x00FFFFFF
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+typedef struct pe_exports pe_exports_t;
+typedef struct export_slot export_slot_t;
+
+struct pe_exports
+{
+	const uint8_t* functions;
+	const uint8_t* names;
+	const uint8_t* ordinals;
+	uint32_t function_count;
+	uint32_t name_count;
+};
+
+// Empty while name is NULL.
+struct export_slot
+{
+	uint64_t hash;
+	const char* name;
+	uint32_t rva;
+};
+
+struct unij_export_index
+{
+	export_slot_t* slots;
+	uint32_t mask;
+	uint32_t count;
+};
+
+struct unij_pefile
+{
+	const uint8_t* data;
+	size_t size;
+	bool mapped;
+	
+	int bits;
+	uint16_t machine;
+	uint32_t headers_size;
+	const uint8_t* sections;
+	uint32_t section_count;
+	uint32_t export_rva;
+	uint32_t export_size;
+};
+
+static UNIJ_INLINE uint16_t read_u16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static UNIJ_INLINE uint32_t read_u32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static UNIJ_INLINE bool in_file(const unij_pefile_t* pe, uint64_t offset, uint64_t size)
+{
+	return offset <= (uint64_t)pe->size && size <= (uint64_t)pe->size - offset;
+}
+
+/**
+ * @internal
+ * Header parsing
+ */
+
+static bool parse_headers(unij_pefile_t* pe)
+{
+	uint32_t lfanew, optional, optional_size, count_offset, directories;
+	uint16_t magic;
+	const uint8_t* nt;
+	if(pe->size < PE_DOS_SIZE || read_u16(pe->data) != PE_DOS_MAGIC)
+		return false;
+	
+	lfanew = read_u32(pe->data + PE_DOS_LFANEW);
+	if(!in_file(pe, lfanew, PE_OPTIONAL_HEADER + sizeof(uint16_t)))
+		return false;
+	
+	nt = pe->data + lfanew;
+	if(read_u32(nt) != PE_NT_SIGNATURE)
+		return false;
+	
+	pe->machine = read_u16(nt + PE_FILE_HEADER + PE_FILE_MACHINE);
+	pe->section_count = read_u16(nt + PE_FILE_HEADER + PE_FILE_SECTIONS);
+	optional_size = read_u16(nt + PE_FILE_HEADER + PE_FILE_OPTIONAL_SIZE);
+	optional = lfanew + PE_OPTIONAL_HEADER;
+	if(!in_file(pe, optional, optional_size) ||
+	   !in_file(pe, (uint64_t)optional + optional_size, (uint64_t)pe->section_count * PE_SECTION_SIZE))
+		return false;
+	
+	magic = optional_size >= sizeof(uint16_t) ? read_u16(pe->data + optional + PE_OPTIONAL_MAGIC) : 0;
+	if(magic == PE32_MAGIC) {
+		pe->bits = 32;
+		count_offset = PE32_DIRECTORY_COUNT;
+		directories = PE32_DIRECTORIES;
+	} else if(magic == PE32PLUS_MAGIC) {
+		pe->bits = 64;
+		count_offset = PE32PLUS_DIRECTORY_COUNT;
+		directories = PE32PLUS_DIRECTORIES;
+	} else {
+		return false;
+	}
+	
+	if(optional_size < directories)
+		return false;
+	
+	pe->headers_size = read_u32(pe->data + optional + PE_OPTIONAL_HEADERS_SIZE);
+	pe->sections = pe->data + optional + optional_size;
+	
+	// An image without an export directory is still an image, it just won't have anything to find.
+	if(read_u32(pe->data + optional + count_offset) > 0 && optional_size >= directories + PE_DIRECTORY_SIZE) {
+		pe->export_rva = read_u32(pe->data + optional + directories);
+		pe->export_size = read_u32(pe->data + optional + directories + sizeof(uint32_t));
+	}
+	return true;
+}
+
+// Like unij_pefile_rva_to_data, but also says how much raw data follows, so strings can be read without knowing their
+// length up front.
+static const uint8_t* rva_to_span(const unij_pefile_t* pe, uint32_t rva, size_t* pavailable)
+{
+	uint32_t i;
+	uint64_t offset = 0, available = 0;
+	for(i = 0; i < pe->section_count; i++) {
+		const uint8_t* section = pe->sections + (size_t)i * PE_SECTION_SIZE;
+		uint32_t address = read_u32(section + PE_SECTION_VIRTUAL_ADDRESS);
+		uint32_t virtual_size = read_u32(section + PE_SECTION_VIRTUAL_SIZE);
+		uint32_t raw_size = read_u32(section + PE_SECTION_RAW_SIZE);
+		uint32_t extent = virtual_size > raw_size ? virtual_size : raw_size;
+		if(rva < address || rva - address >= extent)
+			continue;
+		
+		// Past the raw data is zero fill, which isn't in the file.
+		if(rva - address >= raw_size)
+			return NULL;
+		offset = (uint64_t)read_u32(section + PE_SECTION_RAW_POINTER) + (rva - address);
+		available = raw_size - (rva - address);
+		break;
+	}
+	
+	// Anything before the first section is the headers, which are laid out the same in the file.
+	if(i == pe->section_count) {
+		if(rva >= pe->headers_size)
+			return NULL;
+		offset = rva;
+		available = pe->headers_size - rva;
+	}
+	
+	if(offset >= (uint64_t)pe->size)
+		return NULL;
+	if(available > (uint64_t)pe->size - offset)
+		available = (uint64_t)pe->size - offset;
+	*pavailable = (size_t)available;
+	return pe->data + offset;
+}
+
+// strcmp against a name in the file, without running off the end of its section.
+static int compare_name(const char* name, const uint8_t* candidate, size_t available)
+{
+	size_t i;
+	for(i = 0; i < available; i++) {
+		uint8_t c = (uint8_t)name[i];
+		if(c != candidate[i])
+			return c < candidate[i] ? -1 : 1;
+		if(c == 0)
+			return 0;
+	}
+	
+	// Unterminated, so it can't be equal. Sorting it after everything keeps the search moving.
+	return -1;
+}
+
+// The export directory's tables, once they've been checked against the file.
+static bool load_exports(const unij_pefile_t* pe, pe_exports_t* exports)
+{
+	const uint8_t* directory;
+	if(pe->export_rva == 0)
+		return false;
+	
+	directory = (const uint8_t*)unij_pefile_rva_to_data(pe, pe->export_rva, PE_EXPORT_SIZE);
+	if(directory == NULL)
+		return false;
+	
+	// Counts are bounded by the file size before they get multiplied, so none of the sizes below can overflow.
+	exports->function_count = read_u32(directory + PE_EXPORT_FUNCTION_COUNT);
+	exports->name_count = read_u32(directory + PE_EXPORT_NAME_COUNT);
+	if((uint64_t)exports->function_count * sizeof(uint32_t) > (uint64_t)pe->size ||
+	   (uint64_t)exports->name_count * sizeof(uint32_t) > (uint64_t)pe->size)
+		return false;
+	
+	exports->functions = (const uint8_t*)unij_pefile_rva_to_data(pe, read_u32(directory + PE_EXPORT_FUNCTIONS),
+	                                                             (size_t)exports->function_count * sizeof(uint32_t));
+	exports->names = (const uint8_t*)unij_pefile_rva_to_data(pe, read_u32(directory + PE_EXPORT_NAMES),
+	                                                         (size_t)exports->name_count * sizeof(uint32_t));
+	exports->ordinals = (const uint8_t*)unij_pefile_rva_to_data(pe, read_u32(directory + PE_EXPORT_ORDINALS),
+	                                                            (size_t)exports->name_count * sizeof(uint16_t));
+	return exports->functions != NULL && exports->names != NULL && exports->ordinals != NULL;
+}
+
+// RVA of the function behind the \a name'th name.
+static uint32_t export_function(const unij_pefile_t* pe, const pe_exports_t* exports, uint32_t name)
+{
+	uint32_t rva;
+	uint16_t ordinal = read_u16(exports->ordinals + (size_t)name * sizeof(uint16_t));
+	if(ordinal >= exports->function_count)
+		return 0;
+	
+	// A forwarder's RVA points at a "module.export" string inside the export directory, not at code.
+	rva = read_u32(exports->functions + (size_t)ordinal * sizeof(uint32_t));
+	if(rva >= pe->export_rva && rva - pe->export_rva < pe->export_size)
+		return 0;
+	return rva;
+}
+
+// FNV-1a
+static UNIJ_INLINE uint64_t hash_name(const char* name)
+{
+	uint64_t hash = FNV_OFFSET;
+	for(; *name != '\0'; name++)
+		hash = (hash ^ (uint8_t)*name) * FNV_PRIME;
+	return hash;
+}
+
+// hash_name for a name in the file, which also makes sure it ends before its section does.
+static bool hash_file_name(const uint8_t* name, size_t available, uint64_t* phash)
+{
+	size_t i;
+	uint64_t hash = FNV_OFFSET;
+	for(i = 0; i < available; i++) {
+		if(name[i] == 0) {
+			*phash = hash;
+			return true;
+		}
+		hash = (hash ^ name[i]) * FNV_PRIME;
+	}
+	return false;
+}
+
+/**
+ * @internal
+ * Public API
+ */
+
+unij_pefile_t* unij_pefile_open_memory(const void* data, size_t size)
+{
+	unij_pefile_t* pe;
+	if(unij_fatal_null(data))
+		return NULL;
+	
+	pe = (unij_pefile_t*)unij_alloc(sizeof(*pe));
+	if(pe == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	pe->data = (const uint8_t*)data;
+	pe->size = size;
+	if(!parse_headers(pe)) {
+		unij_free((void*)pe);
+		return NULL;
+	}
+	return pe;
+}
+
+unij_pefile_t* unij_pefile_open(const wchar_t* path)
+{
+	size_t size = 0;
+	const uint8_t* data;
+	unij_pefile_t* pe;
+	if(unij_fatal_null(path))
+		return NULL;
+	
+	data = filemap_open(path, &size);
+	if(data == NULL)
+		return NULL;
+	
+	pe = unij_pefile_open_memory((const void*)data, size);
+	if(pe == NULL) {
+		filemap_close(data, size);
+		return NULL;
+	}
+	
+	pe->mapped = true;
+	return pe;
+}
+
+void unij_pefile_close(unij_pefile_t* pe)
+{
+	if(pe == NULL)
+		return;
+	if(pe->mapped)
+		filemap_close(pe->data, pe->size);
+	unij_free((void*)pe);
+}
+
+int unij_pefile_bits(const unij_pefile_t* pe)
+{
+	return pe->bits;
+}
+
+uint16_t unij_pefile_machine(const unij_pefile_t* pe)
+{
+	return pe->machine;
+}
+
+const void* unij_pefile_rva_to_data(const unij_pefile_t* pe, uint32_t rva, size_t size)
+{
+	size_t available = 0;
+	const uint8_t* data = rva_to_span(pe, rva, &available);
+	return data != NULL && size <= available ? (const void*)data : NULL;
+}
+
+uint32_t unij_pefile_export_rva(const unij_pefile_t* pe, const char* name)
+{
+	pe_exports_t exports;
+	uint32_t low, high;
+	if(unij_fatal_null(pe) || unij_fatal_null(name) || !load_exports(pe, &exports))
+		return 0;
+	
+	// Names are sorted, so the same binary search the loader does.
+	low = 0;
+	high = exports.name_count;
+	while(low < high) {
+		int cmp;
+		size_t available = 0;
+		uint32_t mid = low + (high - low) / 2;
+		const uint8_t* candidate = rva_to_span(pe, read_u32(exports.names + (size_t)mid * sizeof(uint32_t)), &available);
+		cmp = candidate == NULL ? -1 : compare_name(name, candidate, available);
+		if(cmp == 0)
+			return export_function(pe, &exports, mid);
+		
+		if(cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	return 0;
+}
+
+/**
+ * @internal
+ * Export index
+ */
+
+unij_export_index_t* unij_export_index_build(const unij_pefile_t* pe)
+{
+	uint32_t i, capacity = EXPORT_INDEX_MIN_CAPACITY;
+	pe_exports_t exports;
+	unij_export_index_t* index = NULL;
+	if(unij_fatal_null(pe))
+		return NULL;
+	
+	if(!load_exports(pe, &exports)) {
+		exports.name_count = 0;
+	} else if(exports.name_count > EXPORT_INDEX_MAX_NAMES) {
+		unij_fatal_error(UNIJ_ERROR_PROCESS, L"Export directory lists %u names, which is too many to index!",
+		                 (unsigned int)exports.name_count);
+		return NULL;
+	}
+	
+	// At most half full, so probe sequences stay short and there's always an empty slot to stop at.
+	while(capacity < exports.name_count * 2)
+		capacity *= 2;
+	
+	index = (unij_export_index_t*)unij_alloc(sizeof(*index) + (size_t)capacity * sizeof(export_slot_t));
+	if(index == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	index->slots = (export_slot_t*)(index + 1);
+	index->mask = capacity - 1;
+	for(i = 0; i < exports.name_count; i++) {
+		uint32_t rva;
+		uint64_t hash;
+		size_t available = 0;
+		export_slot_t* slot;
+		const char* name = (const char*)rva_to_span(pe, read_u32(exports.names + (size_t)i * sizeof(uint32_t)),
+		                                            &available);
+		if(name == NULL || !hash_file_name((const uint8_t*)name, available, &hash))
+			continue;
+		
+		rva = export_function(pe, &exports, i);
+		if(rva == 0)
+			continue;
+		
+		for(slot = &index->slots[hash & index->mask]; slot->name != NULL;
+		    slot = &index->slots[(size_t)(slot - index->slots + 1) & index->mask]) {
+			if(slot->hash == hash && strcmp(slot->name, name) == 0)
+				break;
+		}
+		
+		// A name that shows up twice keeps its first entry, like the binary search would more or less do.
+		if(slot->name != NULL)
+			continue;
+		slot->hash = hash;
+		slot->name = name;
+		slot->rva = rva;
+		index->count++;
+	}
+	return index;
+}
+
+void unij_export_index_free(unij_export_index_t* index)
+{
+	unij_free((void*)index);
+}
+
+uint32_t unij_export_index_count(const unij_export_index_t* index)
+{
+	return index->count;
+}
+
+uint32_t unij_export_index_find(const unij_export_index_t* index, const char* name)
+{
+	uint64_t hash;
+	const export_slot_t* slot;
+	if(unij_fatal_null(index) || unij_fatal_null(name))
+		return 0;
+	
+	hash = hash_name(name);
+	for(slot = &index->slots[hash & index->mask]; slot->name != NULL;
+	    slot = &index->slots[(size_t)(slot - index->slots + 1) & index->mask]) {
+		if(slot->hash == hash && strcmp(slot->name, name) == 0)
+			return slot->rva;
+	}
+	return 0;
+}
+
+size_t unij_export_index_bind(const unij_export_index_t* index, unij_export_binding_t* bindings, size_t count)
+{
+	size_t i, found = 0;
+	if(unij_fatal_null(index) || (count > 0 && unij_fatal_null(bindings)))
+		return 0;
+	
+	for(i = 0; i < count; i++) {
+		bindings[i].rva = bindings[i].name == NULL ? 0 : unij_export_index_find(index, bindings[i].name);
+		if(bindings[i].rva != 0)
+			found++;
+	}
+	return found;
+}
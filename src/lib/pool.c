@@ -0,0 +1,185 @@
+/**
+ * @file pool.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Since the work is just a range of indexes, a worker's queue is a pair of counters and claiming an item is a single
+ * fetch-and-add. Owner and thieves claim the same way, so there's no separate steal path to get wrong, and an index
+ * past the end of a range just means the range is empty. Each queue gets a cache line to itself, so workers busy with
+ * their own share don't slow each other down.
+ */
+#include "pch.h"
+#include "pool.h"
+#include <uniject/utility.h>
+
+#ifndef _WIN32
+#	include <pthread.h>
+#	include <unistd.h>
+#endif
+
+typedef struct pool_queue
+{
+	unij_atomic_u32 next;
+	uint32_t end;
+	uint8_t padding[56];
+} pool_queue_t;
+
+STATIC_ASSERT(sizeof(pool_queue_t) == 64);
+
+typedef struct pool
+{
+	pool_queue_t queues[POOL_MAX_THREADS];
+	uint32_t threads;
+	pool_task_fn fn;
+	void* context;
+	unij_atomic_u32* stop;
+} pool_t;
+
+typedef struct pool_worker
+{
+	pool_t* pool;
+	uint32_t index;
+} pool_worker_t;
+
+static UNIJ_INLINE bool pool_stopped(pool_t* pool)
+{
+	return pool->stop != NULL && unij_atomic_load_relaxed(pool->stop) != 0;
+}
+
+// Runs items from one queue until it's empty. Returns false if the pool was stopped.
+static bool drain_queue(pool_t* pool, pool_queue_t* queue, uint32_t worker)
+{
+	uint32_t index;
+	while(unij_atomic_load_relaxed(&queue->next) < queue->end) {
+		if(pool_stopped(pool))
+			return false;
+		
+		index = unij_atomic_fetch_add(&queue->next, 1);
+		if(index >= queue->end)
+			break;
+		pool->fn(pool->context, (size_t)index, worker);
+	}
+	return true;
+}
+
+static void run_worker(pool_t* pool, uint32_t worker)
+{
+	uint32_t i;
+	if(!drain_queue(pool, &pool->queues[worker], worker))
+		return;
+	
+	// Our own share is done, so go help whoever's next. Nothing ever gets added to a queue, so one pass is enough.
+	for(i = 1; i < pool->threads; i++) {
+		if(!drain_queue(pool, &pool->queues[(worker + i) % pool->threads], worker))
+			return;
+	}
+}
+
+#ifdef _WIN32
+
+typedef HANDLE pool_thread_t;
+
+static DWORD WINAPI pool_thread_main(LPVOID parameter)
+{
+	pool_worker_t* worker = (pool_worker_t*)parameter;
+	run_worker(worker->pool, worker->index);
+	return 0;
+}
+
+static bool pool_thread_start(pool_thread_t* thread, pool_worker_t* worker)
+{
+	*thread = CreateThread(NULL, 0, pool_thread_main, (LPVOID)worker, 0, NULL);
+	return *thread != NULL;
+}
+
+static void pool_thread_join(pool_thread_t thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+uint32_t pool_default_threads(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (uint32_t)info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+typedef pthread_t pool_thread_t;
+
+static void* pool_thread_main(void* parameter)
+{
+	pool_worker_t* worker = (pool_worker_t*)parameter;
+	run_worker(worker->pool, worker->index);
+	return NULL;
+}
+
+static bool pool_thread_start(pool_thread_t* thread, pool_worker_t* worker)
+{
+	return pthread_create(thread, NULL, pool_thread_main, (void*)worker) == 0;
+}
+
+static void pool_thread_join(pool_thread_t thread)
+{
+	pthread_join(thread, NULL);
+}
+
+uint32_t pool_default_threads(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32_t)count : 1;
+}
+
+#endif
+
+bool pool_run(size_t count, uint32_t threads, pool_task_fn fn, void* context, unij_atomic_u32* stop)
+{
+	uint32_t i, started;
+	pool_t* pool;
+	pool_worker_t workers[POOL_MAX_THREADS];
+	pool_thread_t handles[POOL_MAX_THREADS];
+	if(unij_fatal_null(fn)) {
+		return false;
+	} else if(count > (size_t)UINT32_MAX) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"Too many items for a pool: %zu", count);
+		return false;
+	}
+	
+	if(threads == 0)
+		threads = pool_default_threads();
+	if(threads > POOL_MAX_THREADS)
+		threads = POOL_MAX_THREADS;
+	if((size_t)threads > count)
+		threads = count > 0 ? (uint32_t)count : 1;
+	
+	pool = (pool_t*)unij_alloc(sizeof(*pool));
+	if(pool == NULL) {
+		unij_fatal_alloc();
+		return false;
+	}
+	
+	pool->fn = fn;
+	pool->context = context;
+	pool->stop = stop;
+	pool->threads = threads;
+	for(i = 0; i < threads; i++) {
+		unij_atomic_store_relaxed(&pool->queues[i].next, (uint32_t)((count * i) / threads));
+		pool->queues[i].end = (uint32_t)((count * (i + 1)) / threads);
+	}
+	
+	// Threads that fail to start just leave their share to be stolen.
+	for(started = 1; started < threads; started++) {
+		workers[started].pool = pool;
+		workers[started].index = started;
+		if(!pool_thread_start(&handles[started], &workers[started]))
+			break;
+	}
+	
+	run_worker(pool, 0);
+	for(i = 1; i < started; i++)
+		pool_thread_join(handles[i]);
+	
+	unij_free((void*)pool);
+	return threads == 1 || started > 1;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file pool.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief Work-stealing thread pool for index-based work
+ */
+#ifndef _POOL_H_
+#define _POOL_H_
+#pragma once
+
+#include <uniject.h>
+#include "atomics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POOL_MAX_THREADS 64
+
+/**
+ * @brief Runs item \a index on worker \a worker. (0 being the calling thread)
+ */
+typedef void(*pool_task_fn)(void* context, size_t index, uint32_t worker);
+
+/**
+ * @brief Number of threads a pool sized to the machine would use.
+ * @return
+ */
+uint32_t pool_default_threads(void);
+
+/**
+ * @brief Runs \a fn for every index below \a count, and returns once all of them are done.
+ *
+ * Each worker starts out with an equal share of the indexes and takes them in order. Once its share is gone, it
+ * steals from whichever workers still have some left. Item costs can vary wildly, (a process without a maps file to
+ * speak of next to one with thousands of mappings) so the workers left with the slow items get help instead of
+ * holding everybody up.
+ * @param count
+ * @param threads Capped to \a POOL_MAX_THREADS and \a count.
+ * @param fn
+ * @param context
+ * @param stop Optional. Items not started by the time it's non-zero are skipped.
+ * @return false if not a single thread could be started, in which case everything ran on the calling thread.
+ */
+bool pool_run(size_t count, uint32_t threads, pool_task_fn fn, void* context, unij_atomic_u32* stop);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _POOL_H_ */
@@ -0,0 +1,606 @@
+/**
+ * @file posix.c
+ * POSIX implementation of uniject/platform.h.
+ *
+ * Named mappings and events are both POSIX shared memory objects. Unlike Win32 objects, those outlive every handle
+ * until somebody unlinks them, so each object ends in a trailer page that counts the handles open on it, and closing
+ * the last one unlinks the name. Events are a word in that trailer, waited on with a futex.
+ *
+ * Unnamed mappings are sealed memfds instead, which the kernel already cleans up after. Nothing else can find them,
+ * so an importer pulls the descriptor straight out of the owner with pidfd_getfd, or through the owner's /proc/pid/fd
+ * when it isn't allowed to ptrace the owner. Only the mapping's size comes with the descriptor, which fstat reads.
+ */
+#include "pch.h"
+
+#ifndef _WIN32
+
+#include "atomics.h"
+#include "base_private.h"
+#include <uniject/platform.h>
+#include <uniject/utility.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#	include <linux/futex.h>
+#	include <sys/syscall.h>
+#endif
+
+// "UOBJ", written last when setting up a new object.
+#define OBJECT_MAGIC 0x4A424F55
+
+// How many times to yield waiting on an object whose creator hasn't finished setting it up.
+#define OBJECT_SETUP_ATTEMPTS 0x1000
+
+// How many times to go between creating and opening an object that keeps disappearing in between.
+#define OBJECT_OPEN_ATTEMPTS 8
+
+// What an imported memfd has to be sealed with before its size can be trusted.
+#define UNNAMED_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+// Largest string unij_vscwprintf will measure.
+#define FORMAT_MAX_LENGTH 0x100000
+
+// Last page of every object.
+struct posix_trailer
+{
+	unij_atomic_u32 magic;
+	unij_atomic_u32 handles;
+	unij_atomic_u32 event;
+	uint32_t reserved;
+	uint64_t size;
+};
+
+typedef struct posix_trailer posix_trailer_t;
+
+// What a HANDLE points to. Unnamed objects have neither a name nor a trailer.
+struct posix_object
+{
+	int fd;
+	size_t size;
+	posix_trailer_t* trailer;
+	char name[NAME_MAX + 1];
+};
+
+typedef struct posix_object posix_object_t;
+
+static size_t page_size(void)
+{
+	static size_t size = 0;
+	if(size == 0)
+		size = (size_t)sysconf(_SC_PAGESIZE);
+	return size;
+}
+
+static UNIJ_INLINE size_t page_align(size_t size)
+{
+	return (size + page_size() - 1) & ~(page_size() - 1);
+}
+
+void unij_wait_on_address(const volatile void* address, uint32_t expected)
+{
+#ifdef __linux__
+	// Private, since these words never leave the process.
+	syscall(SYS_futex, (void*)address, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+#else
+	UNIJ_SUPPRESS_UNUSED(address);
+	UNIJ_SUPPRESS_UNUSED(expected);
+	sched_yield();
+#endif
+}
+
+void unij_wake_by_address(const volatile void* address)
+{
+#ifdef __linux__
+	syscall(SYS_futex, (void*)address, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	UNIJ_SUPPRESS_UNUSED(address);
+#endif
+}
+
+bool unij_memory_init(void)
+{
+	return true;
+}
+
+void* unij_heap_alloc(size_t size)
+{
+	return calloc(1, size);
+}
+
+void unij_heap_free(void* ptr)
+{
+	free(ptr);
+}
+
+const wchar_t* unij_system_error_text(uint32_t error)
+{
+	size_t i, length;
+	wchar_t* result;
+	const char* text = strerror((int)error);
+	if(text == NULL)
+		return NULL;
+	
+	length = strlen(text);
+	result = (wchar_t*)unij_heap_alloc(WSIZE(length + 1));
+	if(result == NULL)
+		return NULL;
+	
+	// Only localized messages are anything other than ASCII, so widening byte by byte is the fallback.
+	if(mbstowcs(result, text, length + 1) == (size_t)-1) {
+		for(i = 0; i < length; i++)
+			result[i] = (wchar_t)(unsigned char)text[i];
+		result[length] = L'\0';
+	}
+	return result;
+}
+
+void unij_system_error_free(const wchar_t* text)
+{
+	unij_heap_free((void*)text);
+}
+
+int unij_vscwprintf(const wchar_t* format, va_list args)
+{
+	int result;
+	va_list copy;
+	wchar_t stack[0x100];
+	wchar_t* buffer = stack;
+	size_t length = ARRAYLEN(stack);
+	
+	// vswprintf can't just measure, and a short buffer only gets -1, so keep growing it until the result fits.
+	for(;;) {
+		va_copy(copy, args);
+		result = vswprintf(buffer, length, format, copy);
+		va_end(copy);
+		if(buffer != stack)
+			unij_heap_free(buffer);
+		if(result >= 0 || length >= FORMAT_MAX_LENGTH)
+			return result;
+		
+		length *= 4;
+		buffer = (wchar_t*)unij_heap_alloc(WSIZE(length));
+		if(buffer == NULL)
+			return -1;
+	}
+}
+
+bool unij_process_exists(uint32_t pid)
+{
+	// EPERM still means something is running under that pid.
+	return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+}
+
+size_t unij_wcstoutf8(char* buffer, size_t size, const wchar_t* str, size_t length)
+{
+	size_t i, used = 0;
+	for(i = 0; i < length; i++) {
+		uint32_t c = (uint32_t)str[i];
+		size_t count = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+		if(c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+			errno = EILSEQ;
+			return 0;
+		}
+		
+		if(buffer != NULL) {
+			if(used + count > size) {
+				errno = ENAMETOOLONG;
+				return 0;
+			}
+			
+			switch(count)
+			{
+				case 1:
+					buffer[used] = (char)c;
+					break;
+				case 2:
+					buffer[used] = (char)(0xC0 | (c >> 6));
+					buffer[used + 1] = (char)(0x80 | (c & 0x3F));
+					break;
+				case 3:
+					buffer[used] = (char)(0xE0 | (c >> 12));
+					buffer[used + 1] = (char)(0x80 | ((c >> 6) & 0x3F));
+					buffer[used + 2] = (char)(0x80 | (c & 0x3F));
+					break;
+				default:
+					buffer[used] = (char)(0xF0 | (c >> 18));
+					buffer[used + 1] = (char)(0x80 | ((c >> 12) & 0x3F));
+					buffer[used + 2] = (char)(0x80 | ((c >> 6) & 0x3F));
+					buffer[used + 3] = (char)(0x80 | (c & 0x3F));
+					break;
+			}
+		}
+		used += count;
+	}
+	return used;
+}
+
+static posix_object_t* object_alloc(const wchar_t* name)
+{
+	size_t length;
+	posix_object_t* object = (posix_object_t*)unij_heap_alloc(sizeof(posix_object_t));
+	if(object == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	
+	// The struct was zeroed, so the name's already terminated.
+	object->fd = -1;
+	length = unij_wcstoutf8(object->name, sizeof(object->name) - 1, name, unij_wcslen(name));
+	if(length == 0) {
+		unij_heap_free(object);
+		return NULL;
+	}
+	return object;
+}
+
+static void object_free(posix_object_t* object)
+{
+	int error = errno;
+	if(object->trailer != NULL)
+		munmap(object->trailer, page_size());
+	if(object->fd >= 0)
+		close(object->fd);
+	unij_heap_free(object);
+	errno = error;
+}
+
+static posix_trailer_t* object_map_trailer(posix_object_t* object, size_t offset)
+{
+	void* trailer = mmap(NULL, page_size(), PROT_READ | PROT_WRITE, MAP_SHARED, object->fd, (off_t)offset);
+	return trailer == MAP_FAILED ? NULL : (posix_trailer_t*)trailer;
+}
+
+// Sizes a freshly created object and sets up its trailer. The magic goes in last, since that's what openers wait on.
+static bool object_init(posix_object_t* object, size_t size)
+{
+	size_t offset = page_align(size);
+	if(ftruncate(object->fd, (off_t)(offset + page_size())) != 0)
+		return false;
+	
+	object->trailer = object_map_trailer(object, offset);
+	if(object->trailer == NULL)
+		return false;
+	
+	object->size = size;
+	object->trailer->size = (uint64_t)size;
+	unij_atomic_store_relaxed(&object->trailer->handles, 1);
+	unij_atomic_store_release(&object->trailer->magic, OBJECT_MAGIC);
+	return true;
+}
+
+// Waits for an existing object's creator to finish setting it up, then adds our handle to its count.
+static bool object_attach(posix_object_t* object)
+{
+	int attempt;
+	struct stat st;
+	uint32_t handles;
+	
+	for(attempt = 0; ; attempt++) {
+		if(fstat(object->fd, &st) != 0)
+			return false;
+		if((size_t)st.st_size >= page_size())
+			break;
+		if(attempt == OBJECT_SETUP_ATTEMPTS) {
+			errno = EAGAIN;
+			return false;
+		}
+		sched_yield();
+	}
+	
+	object->trailer = object_map_trailer(object, (size_t)st.st_size - page_size());
+	if(object->trailer == NULL)
+		return false;
+	
+	for(attempt = 0; unij_atomic_load_acquire(&object->trailer->magic) != OBJECT_MAGIC; attempt++) {
+		if(attempt == OBJECT_SETUP_ATTEMPTS) {
+			errno = EAGAIN;
+			return false;
+		}
+		sched_yield();
+	}
+	object->size = (size_t)object->trailer->size;
+	
+	// A count that already hit zero belongs to an object that's about to be unlinked.
+	handles = unij_atomic_load_relaxed(&object->trailer->handles);
+	do {
+		if(handles == 0) {
+			errno = ENOENT;
+			return false;
+		}
+	} while(!unij_atomic_compare_exchange(&object->trailer->handles, &handles, handles + 1));
+	return true;
+}
+
+static bool object_open(posix_object_t* object)
+{
+	object->fd = shm_open(object->name, O_RDWR | O_CLOEXEC, 0);
+	return object->fd >= 0 && object_attach(object);
+}
+
+// Creates or opens an object, leaving errno as EEXIST in the latter case, like CreateFileMapping would.
+static posix_object_t* object_create(const wchar_t* name, size_t size)
+{
+	int attempt;
+	posix_object_t* object = object_alloc(name);
+	if(object == NULL)
+		return NULL;
+	
+	for(attempt = 0; attempt < OBJECT_OPEN_ATTEMPTS; attempt++) {
+		object->fd = shm_open(object->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+		if(object->fd >= 0) {
+			if(!object_init(object, size)) {
+				shm_unlink(object->name);
+				break;
+			}
+			errno = 0;
+			return object;
+		} else if(errno != EEXIST) {
+			break;
+		}
+		
+		if(object_open(object)) {
+			errno = EEXIST;
+			return object;
+		} else if(errno != ENOENT) {
+			break;
+		}
+		
+		// Lost a race with the last handle being closed, so start over.
+		if(object->trailer != NULL) {
+			munmap(object->trailer, page_size());
+			object->trailer = NULL;
+		}
+		if(object->fd >= 0) {
+			close(object->fd);
+			object->fd = -1;
+		}
+	}
+	
+	object_free(object);
+	return NULL;
+}
+
+HANDLE unij_create_mmap(const wchar_t* name, size_t size)
+{
+	posix_object_t* object;
+	ASSERT_NOT_ZERO(size);
+	ASSERT_VALID_STRING(name);
+	
+	object = object_create(name, size);
+	if(object == NULL) {
+		unij_fatal_call(shm_open);
+	}
+	return (HANDLE)object;
+}
+
+HANDLE unij_reserve_mmap(const wchar_t* name, size_t max_size)
+{
+	// Pages of a shared memory object aren't backed until they're touched, so reserving is just creating.
+	return unij_create_mmap(name, max_size);
+}
+
+bool unij_commit_mmap(void* view, size_t size)
+{
+	ASSERT_NOT_NULL(view);
+	ASSERT_NOT_ZERO(size);
+	return true;
+}
+
+HANDLE unij_open_mmap(const wchar_t* name, bool readonly)
+{
+	posix_object_t* object;
+	ASSERT_VALID_STRING(name);
+	UNIJ_SUPPRESS_UNUSED(readonly);
+	
+	// Always opened for writing, since the handle count needs updating either way. Views still honor readonly.
+	object = object_alloc(name);
+	if(object != NULL && !object_open(object)) {
+		object_free(object);
+		object = NULL;
+	}
+	
+	if(object == NULL) {
+		unij_fatal_error(UNIJ_ERROR_LASTERROR, L"Failed call to shm_open(\"%ls\")", name);
+	}
+	return (HANDLE)object;
+}
+
+HANDLE unij_reserve_unnamed_mmap(size_t max_size, uint32_t* pexported)
+{
+#ifdef MFD_ALLOW_SEALING
+	posix_object_t* object;
+	ASSERT_NOT_ZERO(max_size);
+	ASSERT_NOT_NULL(pexported);
+	
+	object = (posix_object_t*)unij_heap_alloc(sizeof(posix_object_t));
+	if(object == NULL)
+		return NULL;
+	
+	// Sparse, same as the named ones, so reserving is still just sizing it.
+	object->fd = memfd_create("uniject", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(object->fd < 0 || ftruncate(object->fd, (off_t)max_size) != 0 ||
+	   fcntl(object->fd, F_ADD_SEALS, UNNAMED_SEALS) != 0) {
+		object_free(object);
+		return NULL;
+	}
+	
+	object->size = max_size;
+	*pexported = (uint32_t)object->fd;
+	return (HANDLE)object;
+#else
+	UNIJ_SUPPRESS_UNUSED(max_size);
+	UNIJ_SUPPRESS_UNUSED(pexported);
+	return NULL;
+#endif
+}
+
+// pidfd_getfd needs to be allowed to ptrace the owner, which Yama doesn't allow a loader in its default mode. Opening
+// the owner's descriptor through procfs only needs to be allowed to read its state.
+static int import_fd(uint32_t owner, uint32_t exported, bool readonly)
+{
+	int fd = -1;
+	char path[64];
+#if defined(SYS_pidfd_open) && defined(SYS_pidfd_getfd)
+	int pidfd = (int)syscall(SYS_pidfd_open, (pid_t)owner, 0);
+	if(pidfd >= 0) {
+		fd = (int)syscall(SYS_pidfd_getfd, pidfd, (int)exported, 0);
+		close(pidfd);
+	}
+	if(fd >= 0)
+		return fd;
+#endif
+
+	snprintf(path, sizeof(path), "/proc/%u/fd/%u", (unsigned int)owner, (unsigned int)exported);
+	return open(path, (readonly ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+}
+
+HANDLE unij_import_mmap(uint32_t owner, uint32_t exported, bool readonly)
+{
+#ifdef MFD_ALLOW_SEALING
+	struct stat st;
+	posix_object_t* object = (posix_object_t*)unij_heap_alloc(sizeof(posix_object_t));
+	if(object != NULL) {
+		object->fd = import_fd(owner, exported, readonly);
+		
+		// Anything unsealed could still shrink under our view, and touching the missing part would be a SIGBUS.
+		if(object->fd >= 0 && fstat(object->fd, &st) == 0 && st.st_size > 0 &&
+		   (fcntl(object->fd, F_GET_SEALS) & UNNAMED_SEALS) == UNNAMED_SEALS) {
+			object->size = (size_t)st.st_size;
+			return (HANDLE)object;
+		} else if(object->fd >= 0) {
+			errno = EPERM;
+		}
+		object_free(object);
+	}
+#else
+	UNIJ_SUPPRESS_UNUSED(readonly);
+	errno = ENOSYS;
+#endif
+
+	unij_fatal_error(UNIJ_ERROR_LASTERROR, L"Couldn't import mapping %u from process %u", exported, owner);
+	return NULL;
+}
+
+HANDLE unij_create_event(const wchar_t* name)
+{
+	posix_object_t* object;
+	ASSERT_VALID_STRING(name);
+	
+	object = object_create(name, 0);
+	if(object == NULL) {
+		unij_fatal_call(shm_open);
+	}
+	return (HANDLE)object;
+}
+
+void* unij_map_view(HANDLE mapping, size_t* psize, bool readonly)
+{
+	void* view;
+	size_t size;
+	posix_object_t* object = (posix_object_t*)mapping;
+	ASSERT_NOT_NULL(object);
+	ASSERT_NOT_NULL(psize);
+	
+	size = *psize == 0 ? object->size : *psize;
+	if(size == 0 || size > object->size) {
+		errno = EINVAL;
+		unij_fatal_call(mmap);
+		return NULL;
+	}
+	
+	view = mmap(NULL, size, PROT_READ | (readonly ? 0 : PROT_WRITE), MAP_SHARED, object->fd, 0);
+	if(view == MAP_FAILED) {
+		unij_fatal_call(mmap);
+		return NULL;
+	}
+	
+	*psize = size;
+	return view;
+}
+
+void unij_unmap_view(const void* view, size_t size)
+{
+	if(view != NULL && size != 0)
+		munmap((void*)view, size);
+}
+
+void unij_flush_view(const void* view, size_t size)
+{
+	uintptr_t start = (uintptr_t)view & ~(uintptr_t)(page_size() - 1);
+	msync((void*)start, size + ((uintptr_t)view - start), MS_ASYNC);
+}
+
+void unij_set_event(HANDLE event)
+{
+	posix_object_t* object = (posix_object_t*)event;
+	unij_atomic_store_release(&object->trailer->event, 1);
+#ifdef __linux__
+	syscall(SYS_futex, (void*)&object->trailer->event, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+void unij_reset_event(HANDLE event)
+{
+	posix_object_t* object = (posix_object_t*)event;
+	unij_atomic_store_release(&object->trailer->event, 0);
+}
+
+// Sleeps for up to timeout milliseconds, or until the event word changes.
+static bool event_sleep(unij_atomic_u32* word, uint32_t timeout)
+{
+	struct timespec ts;
+#ifdef __linux__
+	struct timespec* pts = NULL;
+	if(timeout != INFINITE) {
+		ts.tv_sec = (time_t)(timeout / 1000);
+		ts.tv_nsec = (long)(timeout % 1000) * 1000000;
+		pts = &ts;
+	}
+	
+	// Only sleeps while the word is still 0, so a set landing in between isn't missed.
+	if(syscall(SYS_futex, (void*)word, FUTEX_WAIT, 0, pts, NULL, 0) != 0)
+		return errno == EAGAIN || errno == EINTR || errno == ETIMEDOUT;
+	return true;
+#else
+	UNIJ_SUPPRESS_UNUSED(word);
+	ts.tv_sec = 0;
+	ts.tv_nsec = (long)(timeout < 1 ? timeout : 1) * 1000000;
+	return nanosleep(&ts, NULL) == 0 || errno == EINTR;
+#endif
+}
+
+unij_wait_t unij_wait_event(HANDLE event, uint32_t timeout)
+{
+	uint32_t elapsed, start = unij_tick_count();
+	posix_object_t* object = (posix_object_t*)event;
+	
+	for(;;) {
+		if(unij_atomic_load_acquire(&object->trailer->event) != 0)
+			return UNIJ_WAIT_SIGNALED;
+		
+		elapsed = unij_tick_count() - start;
+		if(timeout != INFINITE && elapsed >= timeout)
+			return UNIJ_WAIT_TIMEOUT;
+		if(!event_sleep(&object->trailer->event, timeout == INFINITE ? INFINITE : timeout - elapsed))
+			return UNIJ_WAIT_FAILED;
+	}
+}
+
+void unij_close_handle(HANDLE object)
+{
+	posix_object_t* handle = (posix_object_t*)object;
+	if(!IS_VALID_HANDLE(object))
+		return;
+	
+	if(handle->trailer != NULL && unij_atomic_fetch_add(&handle->trailer->handles, (uint32_t)-1) == 1)
+		shm_unlink(handle->name);
+	object_free(handle);
+}
+
+#endif /* _WIN32 */
@@ -7,6 +7,7 @@
  */
 #include "pch.h"
 #include "process_private.h"
+#include "monoenum.h"
 
 #include <uniject/module.h>
 #include <uniject/logger.h>
@@ -85,43 +86,118 @@ static unij_procflags_t get_process_flags(HANDLE process)
 	return UNIJ_PROCESS_INVALID;
 }
 
-// TODO: Cache previously checked modules
-static bool enum_process_modules(unij_monoinfo_t* info, HANDLE snapshot, unij_monoinfo_fn fn, void* parameter)
+// Finds the first module in \a snapshot that exports mono_init.
+static bool find_mono_module(HANDLE snapshot, MODULEENTRY32W* pme)
 {
 	BOOL ok;
-	bool handled = false;
-	MODULEENTRY32W me = { sizeof(me)} ;
-	for(ok = Module32FirstW(snapshot, &me); ok; ok = Module32NextW(snapshot, &me)) {
-		uint32_t rva = unij_get_proc_rva(me.szExePath, "mono_init");
-		if(rva > 0) {
-			info->mono_name = (const wchar_t*)me.szModule;
-			info->mono_path = (const wchar_t*)me.szExePath;
-			handled = fn(info, parameter);
-			break;
-		}
+	pme->dwSize = sizeof(*pme);
+	for(ok = Module32FirstW(snapshot, pme); ok; ok = Module32NextW(snapshot, pme)) {
+		if(unij_get_proc_rva_cached(pme->szExePath, "mono_init") > 0)
+			return true;
 	}
-	return handled;
+	return false;
 }
 
-void unij_enum_mono_processes(unij_monoinfo_fn fn, void* parameter)
+static bool enum_process_modules(unij_monoinfo_t* info, HANDLE snapshot, unij_monoinfo_fn fn, void* parameter)
+{
+	MODULEENTRY32W me;
+	if(!find_mono_module(snapshot, &me))
+		return false;
+	
+	info->mono_name = (const wchar_t*)me.szModule;
+	info->mono_path = (const wchar_t*)me.szExePath;
+	return fn(info, parameter);
+}
+
+static void process_inspect(mono_enum_t* E, void* context, void* state, size_t index)
+{
+	HANDLE snapshot;
+	MODULEENTRY32W me;
+	unij_monoinfo_t info;
+	const PROCESSENTRY32W* pe = &((const PROCESSENTRY32W*)context)[index];
+	UNIJ_SUPPRESS_UNUSED(state);
+	
+	snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPMODULES, pe->th32ProcessID);
+	if(snapshot == INVALID_HANDLE_VALUE)
+		return;
+	
+	if(find_mono_module(snapshot, &me)) {
+		info.pid = pe->th32ProcessID;
+		info.exe_path = (const wchar_t*)pe->szExeFile;
+		info.mono_name = (const wchar_t*)me.szModule;
+		info.mono_path = (const wchar_t*)me.szExePath;
+		mono_enum_found(E, index, &info);
+	}
+	CloseHandle(snapshot);
+}
+
+static int compare_processes(const void* a, const void* b)
+{
+	DWORD left = ((const PROCESSENTRY32W*)a)->th32ProcessID, right = ((const PROCESSENTRY32W*)b)->th32ProcessID;
+	return left < right ? -1 : left > right;
+}
+
+// Snapshots the process list in ascending pid order.
+static PROCESSENTRY32W* list_processes(size_t* pcount)
 {
 	BOOL ok;
 	HANDLE snapshot;
-	bool handled = false;
 	PROCESSENTRY32W pe = { sizeof(pe) };
-	uint32_t pid = GetCurrentProcessId();
-	snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPALLMODULES, pid);
-	for(ok = Process32First( snapshot, &pe ); ok && !handled; ok = Process32Next( snapshot, &pe )) {
-		unij_monoinfo_t info = { pe.th32ProcessID, (const wchar_t*)pe.szExeFile };
-		if(pe.th32ProcessID == pid) {
-			handled = enum_process_modules(&info, snapshot, fn, parameter);
-		} else {
-			HANDLE snapshot2 = CreateToolhelp32Snapshot(TH32CS_SNAPMODULES, pe.th32ProcessID);
-			handled = enum_process_modules(&info, snapshot2, fn, parameter);
-			CloseHandle(snapshot2);
+	PROCESSENTRY32W* processes = NULL;
+	size_t count = 0, capacity = 0;
+	snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+	if(snapshot == INVALID_HANDLE_VALUE) {
+		unij_fatal_call(CreateToolhelp32Snapshot);
+		return NULL;
+	}
+	
+	for(ok = Process32FirstW(snapshot, &pe); ok; ok = Process32NextW(snapshot, &pe)) {
+		if(count == capacity) {
+			PROCESSENTRY32W* grown;
+			capacity = capacity == 0 ? 256 : capacity * 2;
+			grown = (PROCESSENTRY32W*)unij_alloc(capacity * sizeof(PROCESSENTRY32W));
+			if(grown == NULL) {
+				unij_fatal_alloc();
+				unij_free((void*)processes);
+				CloseHandle(snapshot);
+				return NULL;
+			}
+			if(count > 0)
+				RtlCopyMemory((void*)grown, (const void*)processes, count * sizeof(PROCESSENTRY32W));
+			unij_free((void*)processes);
+			processes = grown;
 		}
+		processes[count++] = pe;
 	}
+	
 	CloseHandle(snapshot);
+	if(count > 1)
+		qsort((void*)processes, count, sizeof(PROCESSENTRY32W), compare_processes);
+	*pcount = count;
+	return processes;
+}
+
+void unij_enum_mono_processes(unij_monoinfo_fn fn, void* parameter)
+{
+	unij_enum_mono_processes_ex(fn, parameter, NULL);
+}
+
+void unij_enum_mono_processes_ex(unij_monoinfo_fn fn, void* parameter, const unij_enum_options_t* options)
+{
+	size_t count = 0;
+	PROCESSENTRY32W* processes;
+	mono_enum_platform_t platform = { 0 };
+	if(unij_fatal_null(fn))
+		return;
+	
+	processes = list_processes(&count);
+	if(processes == NULL)
+		return;
+	
+	platform.inspect = process_inspect;
+	platform.context = (void*)processes;
+	mono_enum_run(&platform, count, options, fn, parameter);
+	unij_free((void*)processes);
 }
 
 static UNIJ_NOINLINE bool CDECL mono_path_resolver(unij_monoinfo_t* info, unij_wstr_t* dest)
@@ -7,9 +7,12 @@
 #define _PROCESS_PRIVATE_H_
 #pragma once
 
-#include "peutil.h"
 #include <uniject/process.h>
 
+#ifdef _WIN32
+#	include "peutil.h"
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
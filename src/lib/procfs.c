@@ -0,0 +1,573 @@
+/**
+ * @file procfs.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Linux implementation of \a unij_enum_mono_processes. Each process's maps file is read in large chunks and its lines
+ * are parsed in place, and a line only gets looked at past its path when the file name looks like a Mono runtime.
+ * Libraries are identified by device and inode, so a runtime shared by any number of processes only has its symbols
+ * checked once per scan, and the module cache carries the result over to later scans.
+ *
+ * Each worker of a parallel enumeration gets a scan of its own, so none of the above needs a lock. Workers that see
+ * the same runtime each check it once, which the module cache mostly turns into a lookup.
+ *
+ * The \a unij_process_* functions live here too, since finding a process's runtime is the same scan on one process.
+ */
+#include "pch.h"
+
+#ifdef __linux__
+
+#include "monoenum.h"
+#include "process_private.h"
+#include <uniject/elffile.h>
+#include <uniject/modcache.h>
+#include <uniject/process.h>
+#include <uniject/utility.h>
+
+#include <dirent.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#define MAPS_BUFFER_SIZE 0x10000
+
+// Matches libmono.so, libmonobdwgc-2.0.so and libmonosgen-2.0.so.
+#define MONO_PREFIX "libmono"
+#define MONO_SUFFIX ".so"
+#define MONO_EXPORT "mono_init"
+
+#define DELETED_SUFFIX " (deleted)"
+
+typedef struct procfs_library procfs_library_t;
+typedef struct procfs_mapping procfs_mapping_t;
+typedef struct procfs_scan procfs_scan_t;
+
+// A library that has already been checked during this scan.
+struct procfs_library
+{
+	dev_t dev;
+	ino_t ino;
+	bool mono;
+};
+
+// Points into the maps buffer, so it's only good until the next read.
+struct procfs_mapping
+{
+	const char* path;
+	size_t path_length;
+	const char* name;
+	dev_t dev;
+	ino_t ino;
+};
+
+struct procfs_scan
+{
+	procfs_library_t* libraries;
+	size_t count;
+	size_t capacity;
+	char buffer[MAPS_BUFFER_SIZE];
+	
+	// Handed to the callback.
+	char exe[PATH_MAX];
+	wchar_t exe_path[PATH_MAX];
+	wchar_t mono_path[PATH_MAX];
+};
+
+/**
+ * @internal
+ * Symbol check
+ */
+
+// Looks \a MONO_EXPORT up the same way the dynamic linker would.
+static bool elf_exports_mono(const void* image, size_t size)
+{
+	uint64_t offset;
+	bool result;
+	unij_elffile_t* elf = unij_elffile_open_memory(image, size);
+	if(elf == NULL)
+		return false;
+	
+	result = unij_elffile_symbol(elf, MONO_EXPORT, &offset, NULL);
+	unij_elffile_close(elf);
+	return result;
+}
+
+// Opens the library that a mapping refers to, going through the target's root when the path alone leads to a
+// different file. (containers, mostly)
+static int open_mapped_file(pid_t pid, const procfs_mapping_t* mapping, struct stat* pst)
+{
+	int fd;
+	char path[PATH_MAX];
+	if(mapping->path_length >= sizeof(path) - 32)
+		return -1;
+	
+	RtlCopyMemory((void*)path, (const void*)mapping->path, mapping->path_length);
+	path[mapping->path_length] = '\0';
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd >= 0 && fstat(fd, pst) == 0 && pst->st_dev == mapping->dev && pst->st_ino == mapping->ino)
+		return fd;
+	if(fd >= 0)
+		close(fd);
+	
+	snprintf(path, sizeof(path), "/proc/%d/root%.*s", (int)pid, (int)mapping->path_length, mapping->path);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd >= 0 && fstat(fd, pst) == 0)
+		return fd;
+	if(fd >= 0)
+		close(fd);
+	return -1;
+}
+
+static bool check_library(pid_t pid, const procfs_mapping_t* mapping)
+{
+	int fd;
+	bool identified, result = false;
+	void* image;
+	uint64_t key, value;
+	struct stat st;
+	unij_file_identity_t identity;
+	fd = open_mapped_file(pid, mapping, &st);
+	if(fd < 0)
+		return false;
+	
+	key = unij_modcache_key((const void*)mapping->path, mapping->path_length, MONO_EXPORT);
+	identified = unij_file_identity_fd(fd, &identity);
+	if(identified && unij_modcache_get(key, &identity, &value)) {
+		close(fd);
+		return value != 0;
+	}
+	
+	if(st.st_size > 0) {
+		image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(image != MAP_FAILED) {
+			result = elf_exports_mono(image, (size_t)st.st_size);
+			munmap(image, (size_t)st.st_size);
+		}
+	}
+	
+	if(identified)
+		unij_modcache_put(key, &identity, result ? 1 : 0);
+	close(fd);
+	return result;
+}
+
+static bool scan_is_mono(procfs_scan_t* scan, pid_t pid, const procfs_mapping_t* mapping)
+{
+	size_t i;
+	procfs_library_t* library;
+	for(i = 0; i < scan->count; i++) {
+		if(scan->libraries[i].ino == mapping->ino && scan->libraries[i].dev == mapping->dev)
+			return scan->libraries[i].mono;
+	}
+	
+	if(scan->count == scan->capacity) {
+		size_t capacity = scan->capacity == 0 ? 16 : scan->capacity * 2;
+		library = (procfs_library_t*)unij_alloc(capacity * sizeof(*library));
+		if(library == NULL)
+			return check_library(pid, mapping);
+		if(scan->count > 0)
+			RtlCopyMemory((void*)library, (const void*)scan->libraries, scan->count * sizeof(*library));
+		unij_free((void*)scan->libraries);
+		scan->libraries = library;
+		scan->capacity = capacity;
+	}
+	
+	library = &scan->libraries[scan->count++];
+	library->dev = mapping->dev;
+	library->ino = mapping->ino;
+	library->mono = check_library(pid, mapping);
+	return library->mono;
+}
+
+/**
+ * @internal
+ * Maps parsing
+ */
+
+static UNIJ_INLINE const char* skip_field(const char* p, const char* end)
+{
+	while(p < end && *p != ' ')
+		p++;
+	while(p < end && *p == ' ')
+		p++;
+	return p;
+}
+
+static const char* parse_number(const char* p, const char* end, unsigned int base, unsigned long long* pvalue)
+{
+	unsigned long long value = 0;
+	const char* start = p;
+	for(; p < end; p++) {
+		unsigned int digit;
+		if(*p >= '0' && *p <= '9')
+			digit = (unsigned int)(*p - '0');
+		else if(base == 16 && *p >= 'a' && *p <= 'f')
+			digit = (unsigned int)(*p - 'a' + 10);
+		else
+			break;
+		value = value * base + digit;
+	}
+	
+	*pvalue = value;
+	return p == start ? NULL : p;
+}
+
+// start-end perms offset major:minor inode path
+static bool parse_mapping(const char* line, const char* end, procfs_mapping_t* mapping)
+{
+	const char* p;
+	unsigned long long major_id, minor_id, inode;
+	
+	// None of the fields before the path can hold a slash, so the first one starts it.
+	mapping->path = (const char*)memchr((const void*)line, '/', (size_t)(end - line));
+	if(mapping->path == NULL)
+		return false;
+	
+	mapping->name = (const char*)memrchr((const void*)mapping->path, '/', (size_t)(end - mapping->path)) + 1;
+	if((size_t)(end - mapping->name) < sizeof(MONO_PREFIX) - 1 + sizeof(MONO_SUFFIX) - 1 ||
+	   memcmp((const void*)mapping->name, (const void*)MONO_PREFIX, sizeof(MONO_PREFIX) - 1) != 0 ||
+	   memmem((const void*)mapping->name, (size_t)(end - mapping->name), MONO_SUFFIX, sizeof(MONO_SUFFIX) - 1) == NULL)
+		return false;
+	
+	// Nothing left on disk to check.
+	mapping->path_length = (size_t)(end - mapping->path);
+	if(mapping->path_length >= sizeof(DELETED_SUFFIX) &&
+	   memcmp((const void*)(end - (sizeof(DELETED_SUFFIX) - 1)), DELETED_SUFFIX, sizeof(DELETED_SUFFIX) - 1) == 0)
+		return false;
+	
+	p = skip_field(skip_field(skip_field(line, end), end), end);
+	if((p = parse_number(p, end, 16, &major_id)) == NULL || p == end || *p++ != ':' ||
+	   (p = parse_number(p, end, 16, &minor_id)) == NULL ||
+	   (p = parse_number(skip_field(p, end), end, 10, &inode)) == NULL)
+		return false;
+	
+	mapping->dev = makedev((unsigned int)major_id, (unsigned int)minor_id);
+	mapping->ino = (ino_t)inode;
+	return true;
+}
+
+/**
+ * @internal
+ * Enumeration
+ */
+
+// Mapped paths are UTF-8, where the callback gets wide strings like everywhere else.
+static const wchar_t* widen_path(wchar_t* buffer, size_t size, const char* path, size_t length)
+{
+	size_t used = 0;
+	const uint8_t* p = (const uint8_t*)path;
+	const uint8_t* end = p + length;
+	while(p < end && used + 1 < size) {
+		uint32_t c = *p++;
+		size_t extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+		if(extra > 0) {
+			c &= 0x3F >> extra;
+			for(; extra > 0 && p < end; extra--)
+				c = (c << 6) | (*p++ & 0x3F);
+		}
+		buffer[used++] = (wchar_t)c;
+	}
+	
+	buffer[used] = L'\0';
+	return buffer;
+}
+
+static bool find_mono_mapping(procfs_scan_t* scan, pid_t pid, int fd, procfs_mapping_t* mapping)
+{
+	size_t used = 0;
+	for(;;) {
+		const char* line = scan->buffer;
+		const char* eol;
+		ssize_t count = read(fd, (void*)(scan->buffer + used), sizeof(scan->buffer) - used);
+		if(count <= 0)
+			return false;
+		
+		used += (size_t)count;
+		while((eol = (const char*)memchr((const void*)line, '\n', (size_t)(scan->buffer + used - line))) != NULL) {
+			if(parse_mapping(line, eol, mapping) && scan_is_mono(scan, pid, mapping))
+				return true;
+			line = eol + 1;
+		}
+		
+		// Carry the partial line over to the next read. One that fills the whole buffer can't be a library we want.
+		used = (size_t)(scan->buffer + used - line);
+		if(used == sizeof(scan->buffer))
+			used = 0;
+		else if(used > 0)
+			memmove((void*)scan->buffer, (const void*)line, used);
+	}
+}
+
+static void scan_process(mono_enum_t* E, procfs_scan_t* scan, size_t index, pid_t pid)
+{
+	int fd;
+	bool found;
+	ssize_t length;
+	char path[64];
+	procfs_mapping_t mapping;
+	unij_monoinfo_t info;
+	
+	snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return;
+	
+	found = find_mono_mapping(scan, pid, fd, &mapping);
+	close(fd);
+	if(!found)
+		return;
+	
+	// The mapping still points into the buffer, which stays untouched from here on.
+	snprintf(path, sizeof(path), "/proc/%d/exe", (int)pid);
+	length = readlink(path, scan->exe, sizeof(scan->exe));
+	if(length <= 0)
+		return;
+	
+	info.pid = (uint32_t)pid;
+	info.exe_path = widen_path(scan->exe_path, ARRAYLEN(scan->exe_path), scan->exe, (size_t)length);
+	info.mono_path = widen_path(scan->mono_path, ARRAYLEN(scan->mono_path), mapping.path, mapping.path_length);
+	info.mono_name = info.mono_path + (mapping.name - mapping.path);
+	mono_enum_found(E, index, &info);
+}
+
+/**
+ * @internal
+ * Enumeration
+ */
+
+static void procfs_inspect(mono_enum_t* E, void* context, void* state, size_t index)
+{
+	const pid_t* pids = (const pid_t*)context;
+	scan_process(E, (procfs_scan_t*)state, index, pids[index]);
+}
+
+static void procfs_cleanup(void* state)
+{
+	procfs_scan_t* scan = (procfs_scan_t*)state;
+	unij_free((void*)scan->libraries);
+}
+
+static int compare_pids(const void* a, const void* b)
+{
+	pid_t left = *(const pid_t*)a, right = *(const pid_t*)b;
+	return left < right ? -1 : left > right;
+}
+
+// Lists the numeric entries of /proc in ascending order.
+static pid_t* list_pids(size_t* pcount)
+{
+	DIR* proc;
+	struct dirent* entry;
+	pid_t* pids = NULL;
+	size_t count = 0, capacity = 0;
+	proc = opendir("/proc");
+	if(proc == NULL) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"Couldn't open /proc: %hs", strerror(errno));
+		return NULL;
+	}
+	
+	while((entry = readdir(proc)) != NULL) {
+		char* end;
+		unsigned long pid;
+		if(entry->d_name[0] < '1' || entry->d_name[0] > '9')
+			continue;
+		
+		pid = strtoul(entry->d_name, &end, 10);
+		if(*end != '\0')
+			continue;
+		
+		if(count == capacity) {
+			pid_t* grown;
+			capacity = capacity == 0 ? 512 : capacity * 2;
+			grown = (pid_t*)unij_alloc(capacity * sizeof(pid_t));
+			if(grown == NULL) {
+				unij_fatal_alloc();
+				unij_free((void*)pids);
+				closedir(proc);
+				return NULL;
+			}
+			if(count > 0)
+				RtlCopyMemory((void*)grown, (const void*)pids, count * sizeof(pid_t));
+			unij_free((void*)pids);
+			pids = grown;
+		}
+		pids[count++] = (pid_t)pid;
+	}
+	
+	closedir(proc);
+	if(count > 1)
+		qsort((void*)pids, count, sizeof(pid_t), compare_pids);
+	*pcount = count;
+	return pids;
+}
+
+void unij_enum_mono_processes(unij_monoinfo_fn fn, void* parameter)
+{
+	unij_enum_mono_processes_ex(fn, parameter, NULL);
+}
+
+void unij_enum_mono_processes_ex(unij_monoinfo_fn fn, void* parameter, const unij_enum_options_t* options)
+{
+	size_t count = 0;
+	pid_t* pids;
+	mono_enum_platform_t platform;
+	if(unij_fatal_null(fn))
+		return;
+	
+	pids = list_pids(&count);
+	if(pids == NULL)
+		return;
+	
+	platform.inspect = procfs_inspect;
+	platform.cleanup = procfs_cleanup;
+	platform.state_size = sizeof(procfs_scan_t);
+	platform.context = (void*)pids;
+	mono_enum_run(&platform, count, options, fn, parameter);
+	unij_free((void*)pids);
+}
+
+/**
+ * @internal
+ * Processes
+ */
+
+// Bitness of the process's executable, in the Windows flags the rest of the library speaks.
+static unij_procflags_t get_process_flags(pid_t pid)
+{
+	int fd;
+	ssize_t count;
+	char path[64];
+	unsigned char ident[EI_NIDENT];
+	
+	snprintf(path, sizeof(path), "/proc/%d/exe", (int)pid);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return UNIJ_PROCESS_INVALID;
+	
+	count = read(fd, (void*)ident, sizeof(ident));
+	close(fd);
+	if(count != (ssize_t)sizeof(ident) || memcmp((const void*)ident, ELFMAG, SELFMAG) != 0)
+		return UNIJ_PROCESS_INVALID;
+	
+	switch(ident[EI_CLASS])
+	{
+		case ELFCLASS32:
+			return UNIJ_PROCESS_WIN32;
+		case ELFCLASS64:
+			return UNIJ_PROCESS_WIN64;
+		default:
+			return UNIJ_PROCESS_INVALID;
+	}
+}
+
+static bool resolve_mono_name(unij_wstr_t* dest, pid_t pid)
+{
+	int fd;
+	char path[64];
+	bool found = false;
+	procfs_mapping_t mapping;
+	procfs_scan_t* scan = (procfs_scan_t*)unij_alloc(sizeof(procfs_scan_t));
+	if(scan == NULL) {
+		unij_fatal_alloc();
+		return false;
+	}
+	
+	snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd >= 0) {
+		found = find_mono_mapping(scan, pid, fd, &mapping);
+		close(fd);
+	}
+	
+	if(found) {
+		widen_path(scan->mono_path, ARRAYLEN(scan->mono_path), mapping.path, mapping.path_length);
+		dest->length = (uint16_t)unij_wcslen(scan->mono_path);
+		dest->value = (const wchar_t*)unij_wcsndup(scan->mono_path, (size_t)dest->length);
+		found = dest->value != NULL;
+	}
+	
+	procfs_cleanup((void*)scan);
+	unij_free((void*)scan);
+	return found;
+}
+
+unij_process_t* unij_process_open(uint32_t pid)
+{
+	pid_t target;
+	unij_procflags_t flags;
+	unij_process_t* result = NULL;
+	unij_wstr_t mono_path = { 0, NULL };
+	
+	target = pid == 0 ? getpid() : (pid_t)pid;
+	if(kill(target, 0) != 0 && errno == ESRCH) {
+		unij_fatal_error(UNIJ_ERROR_PID, L"No process with the pid %u exists", (uint32_t)target);
+		return result;
+	}
+	
+	flags = get_process_flags(target);
+	if((flags & UNIJ_PROCESS_BITS_MASK) == UNIJ_PROCESS_INVALID) {
+		unij_fatal_error(UNIJ_ERROR_PROCESS, L"Invalid process type passed to unij_process_open");
+		return result;
+	}
+	
+	if(!resolve_mono_name(&mono_path, target)) {
+		unij_fatal_error(UNIJ_ERROR_PROCESS, L"No mono library detected in process passed to unij_process_open");
+		return result;
+	}
+	
+	result = (unij_process_t*)unij_alloc(sizeof(*result));
+	if(result == NULL) {
+		unij_wstrfree(&mono_path);
+		unij_fatal_alloc();
+		return result;
+	}
+	
+	result->pid = (uint32_t)target;
+	result->flags = flags;
+	result->process = NULL;
+	result->mono_path = mono_path;
+	return result;
+}
+
+void unij_process_close(unij_process_t* process)
+{
+	if(process == NULL) return;
+	unij_wstrfree(&process->mono_path);
+	unij_free(process);
+}
+
+unij_procflags_t unij_process_flags(unij_process_t* process, unij_procflags_t mask)
+{
+	if(unij_fatal_null(process))
+		return UNIJ_PROCESS_INVALID;
+	if(mask == UNIJ_PROCESS_INVALID)
+		mask = UNIJ_PROCESS_MASK;
+	return process->flags & mask;
+}
+
+uint32_t unij_process_get_pid(unij_process_t* process)
+{
+	return unij_fatal_null(process) ? 0 : process->pid;
+}
+
+unij_wstr_t* unij_process_get_mono_path(unij_process_t* process)
+{
+	unij_wstr_t* mono_path;
+	if(unij_fatal_null(process))
+		return NULL;
+	
+	mono_path = &process->mono_path;
+	if(unij_is_empty(mono_path)) {
+		if(!resolve_mono_name(mono_path, (pid_t)process->pid)) {
+			unij_fatal_error(UNIJ_ERROR_PROCESS, L"No mono library detected in currently selected process!");
+			return NULL;
+		}
+	}
+	
+	return mono_path;
+}
+
+#endif /* __linux__ */
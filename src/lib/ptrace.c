@@ -0,0 +1,749 @@
+/**
+ * @file ptrace.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Everything that can be worked out without stopping the target is done before attaching: the addresses of dlopen,
+ * dlsym and a syscall instruction are found by locating the same libraries in our own process, and the stub gets
+ * assembled locally. After that, the target's thread is only stopped for two single-stepped syscalls (mmap and
+ * munmap) and the register juggling around the stub.
+ *
+ * Injected memory is laid out the same way as on Windows: handoff block, stub, then the strings the stub needs. The
+ * stub runs on the interrupted thread's stack, below its red zone, and traps back to us when it's done.
+ */
+#include "pch.h"
+
+// Registers and stub are x86-64 only for now.
+#if defined(__linux__) && defined(UNIJ_ARCH_X64)
+
+#include <uniject/elffile.h>
+#include <uniject/handoff.h>
+#include <uniject/injector.h>
+#include <uniject/modcache.h>
+#include <uniject/process.h>
+#include <uniject/ptrace.h>
+#include <uniject/remote.h>
+#include <uniject/utility.h>
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+#define PTRACE_PAGE_SIZE 0x1000
+
+// Stack space left alone below the interrupted thread's stack pointer. (x86-64 red zone plus some slack)
+#define PTRACE_STACK_SKIP 0x100
+
+// How far into syscall() to look for the instruction itself.
+#define SYSCALL_SEARCH_SIZE 0x80
+
+#define STUB_OFFSET      sizeof(unij_handoff_t)
+#define STUB_SIZE        0x30
+#define STRINGS_OFFSET   (STUB_OFFSET + STUB_SIZE)
+
+#define TIMESPEC_NS(TS) \
+	( (uint64_t)(TS).tv_sec * 1000000000ULL + (uint64_t)(TS).tv_nsec )
+
+typedef struct ptrace_target ptrace_target_t;
+typedef struct ptrace_symbols ptrace_symbols_t;
+
+struct ptrace_symbols
+{
+	uintptr_t dlopen;
+	uintptr_t dlsym;
+	uintptr_t dlerror;
+	uintptr_t syscall;
+};
+
+struct ptrace_target
+{
+	pid_t pid;
+	bool attached;
+	bool exited;
+	
+	// Signal that arrived while we had the thread, redelivered when detaching.
+	int pending_signal;
+	
+	// Time the thread has spent stopped, for reporting.
+	uint64_t stopped_since;
+	uint64_t stopped_ns;
+	
+	struct user_regs_struct saved;
+	
+	// Remote memory access, which can also fall back on ptrace since the thread is stopped whenever we use it.
+	unij_remote_t* memory;
+};
+
+// Block handed to the loader's entrypoint, kept for unij_loader_handoff.
+static unij_handoff_t entry_handoff;
+
+// rbx = handoff, r12 = loader path, r13 = entrypoint name, r14 = dlopen, r15 = dlsym
+//
+// Leaves the dlopen handle in rbp, and clears r13 once the entrypoint has been found, so a failure can be told apart
+// from an entrypoint returning 0.
+static const uint8_t PTRACE_STUB[] = {
+	0x4C, 0x89, 0xE7,             //   mov rdi, r12
+	0xBE, 0x02, 0x00, 0x00, 0x00, //   mov esi, RTLD_NOW
+	0x41, 0xFF, 0xD6,             //   call r14
+	0x48, 0x89, 0xC5,             //   mov rbp, rax
+	0x48, 0x85, 0xC0,             //   test rax, rax
+	0x74, 0x16,                   //   jz done
+	0x48, 0x89, 0xC7,             //   mov rdi, rax
+	0x4C, 0x89, 0xEE,             //   mov rsi, r13
+	0x41, 0xFF, 0xD7,             //   call r15
+	0x48, 0x85, 0xC0,             //   test rax, rax
+	0x74, 0x08,                   //   jz done
+	0x45, 0x31, 0xED,             //   xor r13d, r13d
+	0x48, 0x89, 0xDF,             //   mov rdi, rbx
+	0xFF, 0xD0,                   //   call rax
+	                              // done:
+	0xCC,                         //   int3
+};
+
+#define STUB_TRAP_OFFSET (sizeof(PTRACE_STUB) - 1)
+
+STATIC_ASSERT(sizeof(PTRACE_STUB) <= STUB_SIZE);
+
+static UNIJ_INLINE uint64_t ptrace_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return TIMESPEC_NS(ts);
+}
+
+static void ptrace_fatal_errno(const wchar_t* call)
+{
+	int error = errno;
+	unij_fatal_error(UNIJ_ERROR_LASTERROR, L"Call to %ls failed: %hs", call, strerror(error));
+}
+
+/**
+ * @internal
+ * Address resolution
+ */
+
+// Identifies a library by its file rather than its path, since the target may have loaded it through a symlink.
+static bool local_library(const void* symbol, struct stat* st, uintptr_t* pbase, const char** pname)
+{
+	Dl_info info;
+	const char* slash;
+	if(dladdr(symbol, &info) == 0 || info.dli_fname == NULL || stat(info.dli_fname, st) != 0) {
+		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"Couldn't locate the library holding one of our own symbols!");
+		return false;
+	}
+	
+	slash = strrchr(info.dli_fname, '/');
+	*pname = slash == NULL ? info.dli_fname : slash + 1;
+	*pbase = (uintptr_t)info.dli_fbase;
+	return true;
+}
+
+/**
+ * Finds the start of the target's mapping of the same file as \a st. Failing that, a library with the same file name
+ * will do, like the target's own libc in a container, and its path in the target ends up in \a path. \a path is left
+ * empty when the file is the same as ours.
+ */
+static uintptr_t remote_library(pid_t pid, const struct stat* st, const char* name, char* path, size_t size)
+{
+	FILE* maps;
+	char maps_path[64], line[512];
+	uintptr_t result = 0, other = 0;
+	snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", (int)pid);
+	maps = fopen(maps_path, "r");
+	if(maps == NULL) {
+		ptrace_fatal_errno(L"fopen");
+		return 0;
+	}
+	
+	// start-end perms offset major:minor inode path
+	path[0] = '\0';
+	while(result == 0 && fgets(line, sizeof(line), maps) != NULL) {
+		unsigned long long start, offset, inode;
+		unsigned int major_id, minor_id;
+		char* file, *slash;
+		if(sscanf(line, "%llx-%*[0-9a-f] %*s %llx %x:%x %llu", &start, &offset, &major_id, &minor_id, &inode) != 5 ||
+		   offset != 0) {
+			continue;
+		} else if((ino_t)inode == st->st_ino && makedev(major_id, minor_id) == st->st_dev) {
+			result = (uintptr_t)start;
+			continue;
+		}
+		
+		file = strchr(line, '/');
+		if(other != 0 || file == NULL)
+			continue;
+		
+		file[strcspn(file, "\n")] = '\0';
+		slash = strrchr(file, '/');
+		if(strcmp(slash + 1, name) == 0 && strlen(file) < size) {
+			strcpy(path, file);
+			other = (uintptr_t)start;
+		}
+	}
+	
+	fclose(maps);
+	if(result != 0)
+		path[0] = '\0';
+	return result != 0 ? result : other;
+}
+
+// Any syscall instruction in libc will do, and the syscall() wrapper is bound to have one near the top.
+static const uint8_t* find_syscall_instruction(const uint8_t* code, size_t size)
+{
+	size_t i;
+	for(i = 0; i + 1 < size; i++) {
+		if(code[i] == 0x0F && code[i + 1] == 0x05)
+			return code + i;
+	}
+	return NULL;
+}
+
+/**
+ * Works out the offset of \a name in a library the target loaded from a different file than ours, straight from that
+ * file. The lookup goes through the module cache, so it's only parsed once per build of the library. With
+ * \a instruction set, the result is the syscall instruction near the top of \a name rather than \a name itself.
+ */
+static uint64_t library_offset(pid_t pid, const char* path, const char* name, bool instruction)
+{
+	int fd;
+	bool identified;
+	char root[PATH_MAX + 32];
+	wchar_t wroot[PATH_MAX + 32];
+	char label[64];
+	uint64_t key, offset = 0, vaddr;
+	unij_file_identity_t identity;
+	unij_elffile_t* elf;
+	const uint8_t* start, *code;
+	
+	// Through the target's root, in case it lives in a different mount namespace.
+	snprintf(root, sizeof(root), "/proc/%d/root%s", (int)pid, path);
+	fd = open(root, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return 0;
+	identified = unij_file_identity_fd(fd, &identity);
+	close(fd);
+	
+	snprintf(label, sizeof(label), instruction ? "%s+syscall" : "%s", name);
+	key = unij_modcache_key_bits(UNIJ_BITS, (const void*)path, strlen(path), label);
+	if(identified && unij_modcache_get(key, &identity, &offset) && offset != 0)
+		return offset;
+	
+	if(mbstowcs(wroot, root, ARRAYLEN(wroot)) >= ARRAYLEN(wroot))
+		return 0;
+	elf = unij_elffile_open(wroot);
+	if(elf == NULL)
+		return 0;
+	
+	if(unij_elffile_bits(elf) != UNIJ_BITS || !unij_elffile_symbol(elf, name, &offset, &vaddr)) {
+		offset = 0;
+	} else if(instruction) {
+		start = (const uint8_t*)unij_elffile_vaddr_to_data(elf, vaddr, SYSCALL_SEARCH_SIZE);
+		code = start == NULL ? NULL : find_syscall_instruction(start, SYSCALL_SEARCH_SIZE);
+		offset = code == NULL ? 0 : offset + (uint64_t)(code - start);
+	}
+	unij_elffile_close(elf);
+	
+	if(identified && offset != 0)
+		unij_modcache_put(key, &identity, offset);
+	return offset;
+}
+
+// Translates one of our own symbols to where it lives in the target.
+static uintptr_t remote_symbol(pid_t pid, const void* symbol, const char* name, bool instruction)
+{
+	struct stat st;
+	char path[PATH_MAX];
+	const char* library;
+	uint64_t offset;
+	uintptr_t local_base, remote_base;
+	if(!local_library(symbol, &st, &local_base, &library))
+		return 0;
+	
+	remote_base = remote_library(pid, &st, library, path, sizeof(path));
+	if(remote_base == 0) {
+		unij_fatal_error(UNIJ_ERROR_PROCESS, L"Process %d hasn't loaded %hs, which provides %hs!", (int)pid, library,
+		                 name);
+		return 0;
+	} else if(path[0] == '\0') {
+		return remote_base + ((uintptr_t)symbol - local_base);
+	}
+	
+	offset = library_offset(pid, path, name, instruction);
+	if(offset == 0) {
+		unij_fatal_error(UNIJ_ERROR_PROCESS, L"Couldn't find %hs in %hs, as loaded by process %d!", name, path,
+		                 (int)pid);
+		return 0;
+	}
+	return remote_base + (uintptr_t)offset;
+}
+
+static bool resolve_symbols(pid_t pid, ptrace_symbols_t* symbols)
+{
+	const uint8_t* code = (const uint8_t*)(uintptr_t)&syscall;
+	const void* instruction = (const void*)find_syscall_instruction(code, SYSCALL_SEARCH_SIZE);
+	if(instruction == NULL) {
+		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"Couldn't find a syscall instruction in libc!");
+		return false;
+	}
+	
+	symbols->dlopen = remote_symbol(pid, (const void*)(uintptr_t)&dlopen, "dlopen", false);
+	symbols->dlsym = remote_symbol(pid, (const void*)(uintptr_t)&dlsym, "dlsym", false);
+	symbols->dlerror = remote_symbol(pid, (const void*)(uintptr_t)&dlerror, "dlerror", false);
+	symbols->syscall = remote_symbol(pid, instruction, "syscall", true);
+	return symbols->dlopen != 0 && symbols->dlsym != 0 && symbols->dlerror != 0 && symbols->syscall != 0;
+}
+
+static bool check_target_class(pid_t pid)
+{
+	int fd;
+	char path[64];
+	unsigned char ident[EI_NIDENT];
+	snprintf(path, sizeof(path), "/proc/%d/exe", (int)pid);
+	fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		ptrace_fatal_errno(L"open");
+		return false;
+	}
+	
+	if(read(fd, ident, sizeof(ident)) != (ssize_t)sizeof(ident) || memcmp(ident, ELFMAG, SELFMAG) != 0) {
+		close(fd);
+		unij_fatal_error(UNIJ_ERROR_PROCESS, L"Process %d isn't running an ELF executable!", (int)pid);
+		return false;
+	}
+	close(fd);
+	
+	if(ident[EI_CLASS] != (UNIJ_BITS == 64 ? ELFCLASS64 : ELFCLASS32)) {
+		unij_fatal_error(UNIJ_ERROR_PROCESS, L"Process %d doesn't match the injector's architecture!", (int)pid);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @internal
+ * Tracing
+ */
+
+static UNIJ_INLINE void target_stopped(ptrace_target_t* T)
+{
+	T->stopped_since = ptrace_now();
+}
+
+static UNIJ_INLINE void target_resumed(ptrace_target_t* T)
+{
+	T->stopped_ns += ptrace_now() - T->stopped_since;
+}
+
+// Resumes the thread with \a request and waits for it to trap back to us. Signals that show up in the meantime are
+// held onto until we detach, except while the stub is running, where the target's own handlers may be needed.
+static bool target_run(ptrace_target_t* T, int request)
+{
+	pid_t result;
+	int status, signal_number = 0;
+	target_resumed(T);
+	for(;;) {
+		if(ptrace((enum __ptrace_request)request, T->pid, NULL, (void*)(uintptr_t)signal_number) != 0) {
+			ptrace_fatal_errno(L"ptrace");
+			return false;
+		}
+		
+		// Only the wait gets retried. The thread is already running, so resuming it again would fail with ESRCH.
+		signal_number = 0;
+		do {
+			result = waitpid(T->pid, &status, __WALL);
+		} while(result < 0 && errno == EINTR);
+		if(result < 0) {
+			ptrace_fatal_errno(L"waitpid");
+			return false;
+		} else if(WIFEXITED(status) || WIFSIGNALED(status)) {
+			T->exited = true;
+			T->attached = false;
+			unij_fatal_error(UNIJ_ERROR_PROCESS, L"Process %d exited during injection!", (int)T->pid);
+			return false;
+		} else if(!WIFSTOPPED(status)) {
+			continue;
+		}
+		
+		// Single-step and int3 traps. (the only SIGTRAP stops without an event attached)
+		if(WSTOPSIG(status) == SIGTRAP && (status >> 16) == 0)
+			break;
+		
+		// Group-stops and PTRACE_INTERRUPT leftovers just get resumed. Real signals get delivered or held onto.
+		if((status >> 16) == 0) {
+			if(request == PTRACE_CONT)
+				signal_number = WSTOPSIG(status);
+			else
+				T->pending_signal = WSTOPSIG(status);
+		}
+	}
+	
+	target_stopped(T);
+	return true;
+}
+
+static bool target_attach(ptrace_target_t* T)
+{
+	int status;
+	if(ptrace(PTRACE_SEIZE, T->pid, NULL, NULL) != 0) {
+		ptrace_fatal_errno(L"ptrace(PTRACE_SEIZE)");
+		return false;
+	}
+	T->attached = true;
+	
+	if(ptrace(PTRACE_INTERRUPT, T->pid, NULL, NULL) != 0) {
+		ptrace_fatal_errno(L"ptrace(PTRACE_INTERRUPT)");
+		return false;
+	}
+	
+	// Whatever stop comes first will do. A signal that beat the interrupt gets delivered when we detach.
+	while(waitpid(T->pid, &status, __WALL) < 0) {
+		if(errno != EINTR) {
+			ptrace_fatal_errno(L"waitpid");
+			return false;
+		}
+	}
+	
+	if(!WIFSTOPPED(status)) {
+		T->exited = true;
+		T->attached = false;
+		unij_fatal_error(UNIJ_ERROR_PROCESS, L"Process %d exited before it could be stopped!", (int)T->pid);
+		return false;
+	} else if((status >> 16) == 0 && WSTOPSIG(status) != SIGTRAP) {
+		T->pending_signal = WSTOPSIG(status);
+	}
+	
+	target_stopped(T);
+	if(ptrace(PTRACE_GETREGS, T->pid, NULL, &T->saved) != 0) {
+		ptrace_fatal_errno(L"ptrace(PTRACE_GETREGS)");
+		return false;
+	}
+	return true;
+}
+
+static void target_detach(ptrace_target_t* T)
+{
+	if(!T->attached)
+		return;
+	
+	// An interrupted syscall gets restarted from the saved registers, same as if we'd never been here.
+	if(ptrace(PTRACE_SETREGS, T->pid, NULL, &T->saved) != 0)
+		ptrace_fatal_errno(L"ptrace(PTRACE_SETREGS)");
+	
+	target_resumed(T);
+	ptrace(PTRACE_DETACH, T->pid, NULL, (void*)(uintptr_t)T->pending_signal);
+	T->attached = false;
+}
+
+// Single-steps a syscall instruction in libc with our own registers.
+static bool target_syscall(ptrace_target_t* T, const ptrace_symbols_t* symbols, long number, uintptr_t* presult,
+                           uintptr_t arg0, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t arg4,
+                           uintptr_t arg5)
+{
+	struct user_regs_struct regs = T->saved;
+	
+	// orig_rax of -1 keeps the kernel from treating this as a restart of whatever syscall was interrupted.
+	regs.orig_rax = (unsigned long long)-1;
+	regs.rax = (unsigned long long)number;
+	regs.rdi = arg0;
+	regs.rsi = arg1;
+	regs.rdx = arg2;
+	regs.r10 = arg3;
+	regs.r8 = arg4;
+	regs.r9 = arg5;
+	regs.rip = symbols->syscall;
+	if(ptrace(PTRACE_SETREGS, T->pid, NULL, &regs) != 0) {
+		ptrace_fatal_errno(L"ptrace(PTRACE_SETREGS)");
+		return false;
+	} else if(!target_run(T, PTRACE_SINGLESTEP)) {
+		return false;
+	} else if(ptrace(PTRACE_GETREGS, T->pid, NULL, &regs) != 0) {
+		ptrace_fatal_errno(L"ptrace(PTRACE_GETREGS)");
+		return false;
+	}
+	
+	*presult = (uintptr_t)regs.rax;
+	return true;
+}
+
+static UNIJ_INLINE bool target_write(ptrace_target_t* T, uintptr_t address, const void* data, size_t size)
+{
+	return unij_remote_write(T->memory, address, data, size);
+}
+
+// Pulls dlerror's message out of the target after a failed dlopen, while we still have the thread.
+static void target_report_dlerror(ptrace_target_t* T, const ptrace_symbols_t* symbols, uintptr_t trap,
+                                  const char* loader)
+{
+	char message[256] = "unknown error";
+	size_t size = sizeof(message) - 1;
+	struct user_regs_struct regs = T->saved;
+	
+	// Return straight into the stub's trap.
+	regs.rsp = ((T->saved.rsp - PTRACE_STACK_SKIP) & ~(unsigned long long)0xF) - sizeof(uint64_t);
+	regs.orig_rax = (unsigned long long)-1;
+	regs.rip = symbols->dlerror;
+	if(target_write(T, (uintptr_t)regs.rsp, (const void*)&trap, sizeof(uint64_t)) &&
+	   ptrace(PTRACE_SETREGS, T->pid, NULL, &regs) == 0 && target_run(T, PTRACE_CONT) &&
+	   ptrace(PTRACE_GETREGS, T->pid, NULL, &regs) == 0 && regs.rax != 0) {
+		// Don't read past the page the message starts on, since the next one may not be mapped.
+		if(size > PTRACE_PAGE_SIZE - (regs.rax & (PTRACE_PAGE_SIZE - 1)))
+			size = PTRACE_PAGE_SIZE - (regs.rax & (PTRACE_PAGE_SIZE - 1));
+		if(unij_remote_read(T->memory, (uintptr_t)regs.rax, (void*)message, size))
+			message[size] = '\0';
+		else
+			strcpy(message, "unknown error");
+	}
+	
+	unij_fatal_error(UNIJ_ERROR_LOADERS, L"Process %d failed to load %hs: %hs", (int)T->pid, loader, message);
+}
+
+/**
+ * @internal
+ * Injection
+ */
+
+// The stub's memory, assembled locally so it can be written with a single call.
+static uint8_t* render_stub(const unij_handoff_t* handoff, const char* loader, size_t* psize)
+{
+	uint8_t* buffer;
+	size_t loader_size = strlen(loader) + 1;
+	size_t size = STRINGS_OFFSET + loader_size + sizeof(UNIJ_LOADER_ENTRY);
+	
+	size = (size + PTRACE_PAGE_SIZE - 1) & ~((size_t)PTRACE_PAGE_SIZE - 1);
+	buffer = (uint8_t*)unij_alloc(size);
+	if(buffer == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	// Handoff block first. (left zeroed without one, which the loader won't mistake for a valid block)
+	if(handoff != NULL)
+		RtlCopyMemory((void*)buffer, (const void*)handoff, sizeof(*handoff));
+	
+	RtlCopyMemory((void*)(buffer + STUB_OFFSET), (const void*)PTRACE_STUB, sizeof(PTRACE_STUB));
+	RtlCopyMemory((void*)(buffer + STRINGS_OFFSET), (const void*)loader, loader_size);
+	RtlCopyMemory((void*)(buffer + STRINGS_OFFSET + loader_size), (const void*)UNIJ_LOADER_ENTRY,
+	              sizeof(UNIJ_LOADER_ENTRY));
+	
+	*psize = size;
+	return buffer;
+}
+
+static bool execute_stub(ptrace_target_t* T, const ptrace_symbols_t* symbols, uintptr_t memory, const char* loader)
+{
+	struct user_regs_struct regs = T->saved;
+	uintptr_t trap = memory + STUB_OFFSET + STUB_TRAP_OFFSET;
+	
+	regs.rsp = (T->saved.rsp - PTRACE_STACK_SKIP) & ~(unsigned long long)0xF;
+	regs.orig_rax = (unsigned long long)-1;
+	regs.rip = memory + STUB_OFFSET;
+	regs.rbx = memory;
+	regs.r12 = memory + STRINGS_OFFSET;
+	regs.r13 = memory + STRINGS_OFFSET + strlen(loader) + 1;
+	regs.r14 = symbols->dlopen;
+	regs.r15 = symbols->dlsym;
+	if(ptrace(PTRACE_SETREGS, T->pid, NULL, &regs) != 0) {
+		ptrace_fatal_errno(L"ptrace(PTRACE_SETREGS)");
+		return false;
+	} else if(!target_run(T, PTRACE_CONT)) {
+		return false;
+	} else if(ptrace(PTRACE_GETREGS, T->pid, NULL, &regs) != 0) {
+		ptrace_fatal_errno(L"ptrace(PTRACE_GETREGS)");
+		return false;
+	}
+	
+	if(regs.rip != trap + 1) {
+		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"Process %d trapped somewhere other than the stub!", (int)T->pid);
+		return false;
+	} else if(regs.rbp == 0) {
+		target_report_dlerror(T, symbols, trap, loader);
+		return false;
+	} else if(regs.r13 != 0) {
+		unij_fatal_error(UNIJ_ERROR_LOADERS, L"%hs doesn't export " UNIJ_WIDEN(UNIJ_LOADER_ENTRY) L"!", loader);
+		return false;
+	} else if((int)regs.rax == 0) {
+		unij_fatal_error(UNIJ_ERROR_LOADERS, L"The loader's entrypoint failed in process %d!", (int)T->pid);
+		return false;
+	}
+	return true;
+}
+
+bool unij_ptrace_inject(uint32_t pid, const char* loader, const unij_handoff_t* handoff)
+{
+	bool result = false;
+	size_t size = 0;
+	uint8_t* stub;
+	uintptr_t memory = 0, status;
+	ptrace_symbols_t symbols;
+	ptrace_target_t target;
+	if(unij_fatal_null(loader)) {
+		return false;
+	} else if(loader[0] != '/') {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"Loader path must be absolute: %hs", loader);
+		return false;
+	} else if(access(loader, R_OK) != 0) {
+		unij_fatal_error(UNIJ_ERROR_LOADERS, L"%hs does not point to a readable file!", loader);
+		return false;
+	}
+	
+	// Everything up to here runs before the target is touched.
+	if(!check_target_class((pid_t)pid) || !resolve_symbols((pid_t)pid, &symbols))
+		return false;
+	
+	stub = render_stub(handoff, loader, &size);
+	if(stub == NULL)
+		return false;
+	
+	RtlZeroMemory((void*)&target, sizeof(target));
+	target.pid = (pid_t)pid;
+	target.memory = unij_remote_open(pid);
+	if(target.memory == NULL || !target_attach(&target))
+		goto cleanup;
+	
+	if(!target_syscall(&target, &symbols, SYS_mmap, &memory, 0, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+	                   MAP_PRIVATE | MAP_ANONYMOUS, (uintptr_t)-1, 0)) {
+		goto cleanup;
+	} else if(memory > (uintptr_t)-4096) {
+		errno = -(int)memory;
+		memory = 0;
+		ptrace_fatal_errno(L"mmap (in the target)");
+		goto cleanup;
+	}
+	
+	if(target_write(&target, memory, (const void*)stub, size))
+		result = execute_stub(&target, &symbols, memory, loader);
+	
+	target_syscall(&target, &symbols, SYS_munmap, &status, memory, size, 0, 0, 0, 0);
+
+cleanup:
+	if(!target.exited)
+		target_detach(&target);
+	unij_remote_close(target.memory);
+	unij_free((void*)stub);
+	
+	unij_show_message(
+		UNIJ_LEVEL_INFO, L"Process %u was stopped for %.3fms during injection.",
+		pid, (double)target.stopped_ns / 1e6
+	);
+	return result;
+}
+
+// wchar_t paths are what the rest of the library deals in.
+static bool path_from_wstr(char* buffer, size_t size, const unij_wstr_t* path)
+{
+	size_t used = unij_wcstoutf8(buffer, size - 1, path->value, (size_t)path->length);
+	if(used == 0)
+		return false;
+	
+	buffer[used] = '\0';
+	return true;
+}
+
+// Next to our own executable, same as the Windows loaders.
+static bool get_loader_path(char* buffer, size_t size)
+{
+	char* slash;
+	ssize_t length = readlink("/proc/self/exe", buffer, size - 1);
+	if(length <= 0) {
+		ptrace_fatal_errno(L"readlink");
+		return false;
+	}
+	
+	buffer[length] = '\0';
+	slash = strrchr(buffer, '/');
+	if(slash == NULL || (size_t)(slash - buffer) + sizeof(UNIJ_LOADER_SO_NAME) + 1 > size) {
+		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"Failure while trying to auto-resolve loader path");
+		return false;
+	}
+	
+	strcpy(slash + 1, UNIJ_LOADER_SO_NAME);
+	return true;
+}
+
+bool unij_inject_loader_ex(unij_process_t* process, unij_wstr_t* loader, const unij_handoff_t* handoff)
+{
+	char path[PATH_MAX];
+	if(unij_fatal_null(process))
+		return false;
+	
+	if(!unij_wstring(loader)) {
+		if(!get_loader_path(path, sizeof(path)))
+			return false;
+	} else if(!path_from_wstr(path, sizeof(path), loader)) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"Loader path is too long!");
+		return false;
+	}
+	
+	unij_show_message(UNIJ_LEVEL_INFO, L"Attempting to inject loader: %hs", path);
+	return unij_ptrace_inject(unij_process_get_pid(process), path, handoff);
+}
+
+// The stub has already returned by the time unij_ptrace_inject does, so there's never anything left to wait on.
+struct unij_injection
+{
+	bool result;
+};
+
+unij_injection_t* unij_inject_loader_start(unij_process_t* process, unij_wstr_t* loader, const unij_handoff_t* handoff)
+{
+	unij_injection_t* injection;
+	if(!unij_inject_loader_ex(process, loader, handoff))
+		return NULL;
+	
+	injection = (unij_injection_t*)unij_alloc(sizeof(unij_injection_t));
+	if(injection == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	injection->result = true;
+	return injection;
+}
+
+unij_wait_t unij_injection_wait(unij_injection_t* injection, uint32_t timeout, bool* presult)
+{
+	UNIJ_SUPPRESS_UNUSED(timeout);
+	if(unij_fatal_null(injection))
+		return UNIJ_WAIT_FAILED;
+	
+	if(presult != NULL)
+		*presult = injection->result;
+	return UNIJ_WAIT_SIGNALED;
+}
+
+void unij_injection_close(unij_injection_t* injection)
+{
+	if(injection != NULL)
+		unij_free((void*)injection);
+}
+
+void unij_loader_set_handoff(const unij_handoff_t* handoff)
+{
+	if(handoff != NULL && handoff->magic == UNIJ_HANDOFF_MAGIC) {
+		RtlCopyMemory((void*)&entry_handoff, (const void*)handoff, sizeof(entry_handoff));
+	} else {
+		RtlZeroMemory((void*)&entry_handoff, sizeof(entry_handoff));
+	}
+}
+
+bool unij_loader_handoff(unij_handoff_t* handoff)
+{
+	if(unij_fatal_null(handoff))
+		return false;
+	
+	// Nothing to look for here: the stub passes the block to the loader's entry point, which leaves us a copy.
+	if(entry_handoff.magic != UNIJ_HANDOFF_MAGIC)
+		return false;
+	RtlCopyMemory((void*)handoff, (const void*)&entry_handoff, sizeof(*handoff));
+	return true;
+}
+
+#endif /* __linux__ && UNIJ_ARCH_X64 */
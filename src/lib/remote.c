@@ -0,0 +1,330 @@
+/**
+ * @file remote.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Every method works through the whole list of spans, so a method that fails partway through just hands the same
+ * list to the next one. Rewriting or rereading what was already transferred is harmless, and much simpler than
+ * keeping track of where each method left off.
+ *
+ * process_vm_writev refuses to write to read-only pages, where /proc/pid/mem doesn't, so an EFAULT only moves the
+ * current transfer on to the next method. ENOSYS and EPERM (seccomp, or a kernel without the syscalls) rule a method
+ * out for the life of the handle.
+ */
+#include "pch.h"
+
+#ifdef __linux__
+
+#include <uniject/remote.h>
+#include <uniject/utility.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Spans handed to a single process_vm_readv/writev call. (well under IOV_MAX)
+#define REMOTE_BATCH 128
+
+#define REMOTE_WORD sizeof(long)
+
+struct unij_remote
+{
+	pid_t pid;
+	unij_remote_method_t method;
+	bool disabled[UNIJ_REMOTE_METHODS];
+	
+	// /proc/pid/mem, opened on first use.
+	int mem_fd;
+	
+	// Last failure, reported once every method has had its turn.
+	int error;
+	unij_remote_method_t failed;
+};
+
+typedef bool(*remote_transfer_fn)(unij_remote_t* R, const unij_remote_span_t* spans, size_t count, bool write);
+
+static const wchar_t* const METHOD_NAMES[UNIJ_REMOTE_METHODS] = {
+	L"auto",
+	L"process_vm_readv/writev",
+	L"/proc/pid/mem",
+	L"ptrace",
+};
+
+static UNIJ_INLINE bool remote_failed(unij_remote_t* R, unij_remote_method_t method)
+{
+	R->error = errno;
+	R->failed = method;
+	if(R->error == ENOSYS || R->error == EPERM)
+		R->disabled[method] = true;
+	return false;
+}
+
+/**
+ * @internal
+ * process_vm_readv/writev
+ */
+
+static bool transfer_vm(unij_remote_t* R, const unij_remote_span_t* spans, size_t count, bool write)
+{
+	size_t i = 0, offset = 0;
+	struct iovec local[REMOTE_BATCH], remote[REMOTE_BATCH];
+	for(;;) {
+		ssize_t transferred;
+		size_t batch = 0;
+		
+		// Empty spans would make a batch of nothing look like a failed transfer.
+		while(i < count && spans[i].size == 0)
+			i++;
+		if(i == count)
+			break;
+		
+		// The first span may have been partially transferred by the last call.
+		while(batch < REMOTE_BATCH && i + batch < count) {
+			const unij_remote_span_t* span = &spans[i + batch];
+			size_t skip = batch == 0 ? offset : 0;
+			local[batch].iov_base = (void*)((uint8_t*)span->data + skip);
+			local[batch].iov_len = span->size - skip;
+			remote[batch].iov_base = (void*)(span->address + skip);
+			remote[batch].iov_len = span->size - skip;
+			batch++;
+		}
+		
+		transferred = write ?
+			process_vm_writev(R->pid, local, batch, remote, batch, 0) :
+			process_vm_readv(R->pid, local, batch, remote, batch, 0);
+		if(transferred <= 0) {
+			if(transferred == 0)
+				errno = EFAULT;
+			return remote_failed(R, UNIJ_REMOTE_VM);
+		}
+		
+		// Short transfers stop at a span boundary or a bad page, so pick up from wherever it stopped.
+		while((size_t)transferred > 0 && i < count) {
+			size_t left = spans[i].size - offset;
+			if((size_t)transferred < left) {
+				offset += (size_t)transferred;
+				break;
+			}
+			transferred -= (ssize_t)left;
+			offset = 0;
+			i++;
+		}
+	}
+	return true;
+}
+
+/**
+ * @internal
+ * /proc/pid/mem
+ */
+
+static bool open_mem(unij_remote_t* R)
+{
+	char path[64];
+	if(R->mem_fd >= 0)
+		return true;
+	
+	snprintf(path, sizeof(path), "/proc/%d/mem", (int)R->pid);
+	R->mem_fd = open(path, O_RDWR | O_CLOEXEC);
+	if(R->mem_fd < 0) {
+		// Nothing about this is going to change while the handle is open.
+		remote_failed(R, UNIJ_REMOTE_PROCMEM);
+		R->disabled[UNIJ_REMOTE_PROCMEM] = true;
+		return false;
+	}
+	return true;
+}
+
+static bool transfer_procmem(unij_remote_t* R, const unij_remote_span_t* spans, size_t count, bool write)
+{
+	size_t i;
+	if(!open_mem(R))
+		return false;
+	
+	for(i = 0; i < count; i++) {
+		size_t done = 0;
+		while(done < spans[i].size) {
+			uint8_t* data = (uint8_t*)spans[i].data + done;
+			off_t address = (off_t)(spans[i].address + done);
+			ssize_t transferred = write ?
+				pwrite(R->mem_fd, (const void*)data, spans[i].size - done, address) :
+				pread(R->mem_fd, (void*)data, spans[i].size - done, address);
+			if(transferred <= 0) {
+				if(transferred == 0)
+					errno = EIO;
+				return remote_failed(R, UNIJ_REMOTE_PROCMEM);
+			}
+			done += (size_t)transferred;
+		}
+	}
+	return true;
+}
+
+/**
+ * @internal
+ * PTRACE_PEEKDATA/POKEDATA
+ */
+
+static bool peek_word(unij_remote_t* R, uintptr_t address, long* pword)
+{
+	errno = 0;
+	*pword = ptrace(PTRACE_PEEKDATA, R->pid, (void*)address, NULL);
+	return errno == 0 ? true : remote_failed(R, UNIJ_REMOTE_PTRACE);
+}
+
+static bool poke_word(unij_remote_t* R, uintptr_t address, long word)
+{
+	return ptrace(PTRACE_POKEDATA, R->pid, (void*)address, (void*)word) == 0 ?
+		true : remote_failed(R, UNIJ_REMOTE_PTRACE);
+}
+
+// A word at a time, with the words at either end of a span read first so the bytes around it survive a write.
+static bool transfer_ptrace(unij_remote_t* R, const unij_remote_span_t* spans, size_t count, bool write)
+{
+	size_t i;
+	for(i = 0; i < count; i++) {
+		uint8_t* data = (uint8_t*)spans[i].data;
+		uintptr_t address = spans[i].address;
+		uintptr_t end = address + spans[i].size;
+		while(address < end) {
+			long word;
+			uintptr_t aligned = address & ~(uintptr_t)(REMOTE_WORD - 1);
+			size_t skip = (size_t)(address - aligned);
+			size_t length = REMOTE_WORD - skip;
+			if(length > (size_t)(end - address))
+				length = (size_t)(end - address);
+			
+			if(!write || length != REMOTE_WORD) {
+				if(!peek_word(R, aligned, &word))
+					return false;
+			}
+			
+			if(write) {
+				RtlCopyMemory((void*)((uint8_t*)&word + skip), (const void*)data, length);
+				if(!poke_word(R, aligned, word))
+					return false;
+			} else {
+				RtlCopyMemory((void*)data, (const void*)((uint8_t*)&word + skip), length);
+			}
+			
+			data += length;
+			address += length;
+		}
+	}
+	return true;
+}
+
+/**
+ * @internal
+ * Public API
+ */
+
+static const remote_transfer_fn TRANSFERS[UNIJ_REMOTE_METHODS] = {
+	NULL,
+	transfer_vm,
+	transfer_procmem,
+	transfer_ptrace,
+};
+
+#define ENSURE_REMOTE(R) \
+	( !unij_fatal_null3(R, UNIJ_FUNCTION, L"remote") )
+
+static bool remote_transfer(unij_remote_t* R, const unij_remote_span_t* spans, size_t count, bool write)
+{
+	int method;
+	if(!ENSURE_REMOTE(R) || (count > 0 && unij_fatal_null(spans)))
+		return false;
+	
+	R->error = 0;
+	R->failed = UNIJ_REMOTE_AUTO;
+	for(method = UNIJ_REMOTE_VM; method < UNIJ_REMOTE_METHODS; method++) {
+		if(R->method != UNIJ_REMOTE_AUTO && R->method != (unij_remote_method_t)method)
+			continue;
+		else if(R->method == UNIJ_REMOTE_AUTO && R->disabled[method])
+			continue;
+		else if(TRANSFERS[method](R, spans, count, write))
+			return true;
+	}
+	
+	if(R->failed == UNIJ_REMOTE_AUTO) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"No way left to access the memory of process %d!", (int)R->pid);
+	} else {
+		unij_fatal_error(
+			UNIJ_ERROR_LASTERROR, L"Couldn't %ls the memory of process %d with %ls: %hs",
+			write ? L"write" : L"read", (int)R->pid, METHOD_NAMES[R->failed], strerror(R->error)
+		);
+	}
+	return false;
+}
+
+unij_remote_t* unij_remote_open(uint32_t pid)
+{
+	unij_remote_t* R = (unij_remote_t*)unij_alloc(sizeof(*R));
+	if(R == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	R->pid = (pid_t)pid;
+	R->method = UNIJ_REMOTE_AUTO;
+	R->mem_fd = -1;
+	return R;
+}
+
+void unij_remote_close(unij_remote_t* R)
+{
+	if(R == NULL)
+		return;
+	
+	if(R->mem_fd >= 0)
+		close(R->mem_fd);
+	unij_free((void*)R);
+}
+
+void unij_remote_set_method(unij_remote_t* R, unij_remote_method_t method)
+{
+	if(!ENSURE_REMOTE(R))
+		return;
+	
+	if((unsigned int)method >= UNIJ_REMOTE_METHODS) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"Unknown remote memory method: %d", (int)method);
+		return;
+	}
+	R->method = method;
+}
+
+const wchar_t* unij_remote_method_name(unij_remote_method_t method)
+{
+	return (unsigned int)method < UNIJ_REMOTE_METHODS ? METHOD_NAMES[method] : L"unknown";
+}
+
+bool unij_remote_readv(unij_remote_t* R, const unij_remote_span_t* spans, size_t count)
+{
+	return remote_transfer(R, spans, count, false);
+}
+
+bool unij_remote_writev(unij_remote_t* R, const unij_remote_span_t* spans, size_t count)
+{
+	return remote_transfer(R, spans, count, true);
+}
+
+bool unij_remote_read(unij_remote_t* R, uintptr_t address, void* buffer, size_t size)
+{
+	unij_remote_span_t span;
+	span.address = address;
+	span.data = buffer;
+	span.size = size;
+	return !unij_fatal_null(buffer) && remote_transfer(R, &span, 1, false);
+}
+
+bool unij_remote_write(unij_remote_t* R, uintptr_t address, const void* data, size_t size)
+{
+	unij_remote_span_t span;
+	span.address = address;
+	span.data = (void*)data;
+	span.size = size;
+	return !unij_fatal_null(data) && remote_transfer(R, &span, 1, true);
+}
+
+#endif /* __linux__ */
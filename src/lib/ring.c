@@ -0,0 +1,310 @@
+/**
+ * @file ring.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Head and tail are free-running byte counters, so the ring is empty when they're equal and an index into the data
+ * is just the counter masked by the capacity. Each side keeps a cached copy of the other side's counter and only goes
+ * back to the shared cache line when the cached copy says the ring is full/empty.
+ *
+ * Every message is preceded by a record header and padded to 8 bytes. A message that won't fit before the end of the
+ * data is written at the start instead, behind a wrap record that tells the consumer to skip the rest of the data.
+ */
+#include "pch.h"
+#include "atomics.h"
+#include <uniject/ring.h>
+#include <uniject/utility.h>
+
+#define TOPTR(X) ((size_t)(X))
+
+#define RING_MAGIC 0x474E4952 /* RING */
+#define RING_WRAP UINT32_MAX
+#define RING_MIN_CAPACITY 0x100
+#define RING_MAX_CAPACITY 0x80000000
+
+#define RING_ALIGN_UP(X) \
+	( ((X) + 7) & ~((size_t)7) )
+
+// Shared between both processes, so everything is a fixed size and the counters get a cache line to themselves.
+typedef struct ring_shared
+{
+	uint32_t magic;
+	uint32_t capacity;
+	uint8_t header_padding[56];
+	
+	// Written by the producer only
+	unij_atomic_u32 head;
+	uint8_t head_padding[60];
+	
+	// Written by the consumer only
+	unij_atomic_u32 tail;
+	uint8_t tail_padding[60];
+} ring_shared_t;
+
+STATIC_ASSERT(sizeof(ring_shared_t) == 192);
+
+typedef struct ring_record
+{
+	uint32_t size;
+	uint32_t reserved;
+} ring_record_t;
+
+#define RING_RECORD_SIZE sizeof(ring_record_t)
+
+#define RING_DATA(SHARED) \
+	( (uint8_t*)(TOPTR(SHARED) + sizeof(ring_shared_t)) )
+
+struct unij_ring
+{
+	ring_shared_t* shared;
+	uint8_t* data;
+	uint32_t capacity;
+	uint32_t mask;
+	
+	// Producer state: our own head, the last tail we saw and the bytes taken up by the reserved message.
+	bool reserved;
+	uint32_t head;
+	uint32_t cached_tail;
+	uint32_t reserved_skip;
+	uint32_t reserved_size;
+	
+	// Consumer state: our own tail, the last head we saw and the bytes taken up by the peeked message.
+	uint32_t tail;
+	uint32_t cached_head;
+	uint32_t peeked;
+};
+
+#define ENSURE_RING(R) \
+	( !unij_fatal_null3(R, UNIJ_FUNCTION, L"ring") )
+
+static UNIJ_INLINE size_t ring_record_total(size_t size)
+{
+	return RING_RECORD_SIZE + RING_ALIGN_UP(size);
+}
+
+static UNIJ_INLINE size_t ring_max_message(uint32_t capacity)
+{
+	// Keeps a wrapped message from ever needing more than the whole ring. (see unij_ring_reserve)
+	return (size_t)(capacity / 2) - RING_RECORD_SIZE;
+}
+
+static unij_ring_t* ring_open(ring_shared_t* shared)
+{
+	unij_ring_t* R = (unij_ring_t*)unij_alloc(sizeof(*R));
+	if(R == NULL) {
+		unij_fatal_alloc();
+		return NULL;
+	}
+	
+	R->shared = shared;
+	R->data = RING_DATA(shared);
+	R->capacity = shared->capacity;
+	R->mask = shared->capacity - 1;
+	R->head = R->cached_head = unij_atomic_load_acquire(&shared->head);
+	R->tail = R->cached_tail = unij_atomic_load_acquire(&shared->tail);
+	return R;
+}
+
+size_t unij_ring_footprint(size_t capacity)
+{
+	size_t rounded = RING_MIN_CAPACITY;
+	if(capacity > RING_MAX_CAPACITY)
+		return 0;
+	
+	while(rounded < capacity)
+		rounded <<= 1;
+	return sizeof(ring_shared_t) + rounded;
+}
+
+unij_ring_t* unij_ring_create(void* memory, size_t size)
+{
+	size_t capacity = RING_MIN_CAPACITY;
+	ring_shared_t* shared = (ring_shared_t*)memory;
+	if(unij_fatal_null(memory)) {
+		return NULL;
+	} else if((TOPTR(memory) & 7) != 0) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"Ring memory must be at least 8-byte aligned!");
+		return NULL;
+	} else if(size < unij_ring_footprint(RING_MIN_CAPACITY)) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"%zu bytes is too small to hold a ring!", size);
+		return NULL;
+	}
+	
+	size -= sizeof(ring_shared_t);
+	while(capacity < RING_MAX_CAPACITY && (capacity << 1) <= size)
+		capacity <<= 1;
+	
+	RtlZeroMemory((void*)shared, sizeof(*shared));
+	shared->capacity = (uint32_t)capacity;
+	unij_atomic_store_relaxed(&shared->head, 0);
+	unij_atomic_store_relaxed(&shared->tail, 0);
+	
+	// The magic is what attach checks for, so it goes last.
+	unij_atomic_store_release((unij_atomic_u32*)&shared->magic, RING_MAGIC);
+	return ring_open(shared);
+}
+
+unij_ring_t* unij_ring_attach(void* memory, size_t size)
+{
+	uint32_t capacity;
+	ring_shared_t* shared = (ring_shared_t*)memory;
+	if(unij_fatal_null(memory)) {
+		return NULL;
+	} else if(size < sizeof(ring_shared_t) ||
+	          unij_atomic_load_acquire((unij_atomic_u32*)&shared->magic) != RING_MAGIC) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"No ring has been created in the specified memory!");
+		return NULL;
+	}
+	
+	capacity = shared->capacity;
+	if(capacity < RING_MIN_CAPACITY || (capacity & (capacity - 1)) != 0 ||
+	   (size_t)capacity > size - sizeof(ring_shared_t)) {
+		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"Ring header is corrupt: capacity=%u", (unsigned int)capacity);
+		return NULL;
+	}
+	
+	return ring_open(shared);
+}
+
+void unij_ring_destroy(unij_ring_t* R)
+{
+	if(R != NULL)
+		unij_free((void*)R);
+}
+
+size_t unij_ring_max_message(unij_ring_t* R)
+{
+	return ENSURE_RING(R) ? ring_max_message(R->capacity) : 0;
+}
+
+void* unij_ring_reserve(unij_ring_t* R, size_t size)
+{
+	ring_record_t* record;
+	uint32_t position, to_end, total, needed;
+	if(!ENSURE_RING(R)) {
+		return NULL;
+	} else if(size > ring_max_message(R->capacity)) {
+		unij_fatal_error(
+			UNIJ_ERROR_PARAM,
+			L"Message of %zu bytes is larger than the ring allows: %zu bytes",
+			size, ring_max_message(R->capacity)
+		);
+		return NULL;
+	}
+	
+	// A message that doesn't fit before the end of the data also costs the space it skips over. Since no message
+	// takes up more than half the ring, the skipped space plus the message never exceeds the capacity.
+	total = (uint32_t)ring_record_total(size);
+	position = R->head & R->mask;
+	to_end = R->capacity - position;
+	needed = to_end < total ? to_end + total : total;
+	
+	if(R->capacity - (R->head - R->cached_tail) < needed) {
+		R->cached_tail = unij_atomic_load_acquire(&R->shared->tail);
+		if(R->capacity - (R->head - R->cached_tail) < needed)
+			return NULL;
+	}
+	
+	if(to_end < total) {
+		record = (ring_record_t*)(R->data + position);
+		record->size = RING_WRAP;
+		position = 0;
+	}
+	
+	R->reserved = true;
+	R->reserved_skip = needed - total;
+	R->reserved_size = (uint32_t)size;
+	record = (ring_record_t*)(R->data + position);
+	record->size = (uint32_t)size;
+	record->reserved = 0;
+	return (void*)(record + 1);
+}
+
+bool unij_ring_publish(unij_ring_t* R, size_t size)
+{
+	ring_record_t* record;
+	if(!ENSURE_RING(R)) {
+		return false;
+	} else if(!R->reserved) {
+		unij_fatal_error(UNIJ_ERROR_OPERATION, L"unij_ring_publish called without a reserved message!");
+		return false;
+	} else if(size > R->reserved_size) {
+		unij_fatal_error(
+			UNIJ_ERROR_OPERATION,
+			L"Can't publish %zu bytes when only %u bytes were reserved!",
+			size, (unsigned int)R->reserved_size
+		);
+		return false;
+	}
+	
+	// The record header was written for the reserved size, so it gets the real one now.
+	record = (ring_record_t*)(R->data + ((R->head + R->reserved_skip) & R->mask));
+	record->size = (uint32_t)size;
+	
+	R->head += R->reserved_skip + (uint32_t)ring_record_total(size);
+	R->reserved = false;
+	R->reserved_skip = 0;
+	R->reserved_size = 0;
+	unij_atomic_store_release(&R->shared->head, R->head);
+	return true;
+}
+
+bool unij_ring_push(unij_ring_t* R, const void* data, size_t size)
+{
+	void* dest;
+	if(unij_fatal_null(data) || (dest = unij_ring_reserve(R, size)) == NULL)
+		return false;
+	
+	RtlCopyMemory(dest, data, size);
+	return unij_ring_publish(R, size);
+}
+
+const void* unij_ring_peek(unij_ring_t* R, size_t* psize)
+{
+	uint32_t position, skip = 0;
+	ring_record_t* record;
+	if(!ENSURE_RING(R) || unij_fatal_null(psize))
+		return NULL;
+	
+	if(R->tail == R->cached_head) {
+		R->cached_head = unij_atomic_load_acquire(&R->shared->head);
+		if(R->tail == R->cached_head)
+			return NULL;
+	}
+	
+	position = R->tail & R->mask;
+	record = (ring_record_t*)(R->data + position);
+	if(record->size == RING_WRAP) {
+		skip = R->capacity - position;
+		record = (ring_record_t*)R->data;
+		position = 0;
+	}
+	
+	// The producer lives in another process, so don't trust the record any further than the data it's in.
+	if(record->size > ring_max_message(R->capacity) ||
+	   skip + ring_record_total(record->size) > R->cached_head - R->tail) {
+		unij_fatal_error(UNIJ_ERROR_INTERNAL, L"Ring record is corrupt: size=%u", (unsigned int)record->size);
+		return NULL;
+	}
+	
+	R->peeked = skip + (uint32_t)ring_record_total(record->size);
+	*psize = (size_t)record->size;
+	return (const void*)(record + 1);
+}
+
+void unij_ring_release(unij_ring_t* R)
+{
+	if(!ENSURE_RING(R) || R->peeked == 0)
+		return;
+	
+	R->tail += R->peeked;
+	R->peeked = 0;
+	unij_atomic_store_release(&R->shared->tail, R->tail);
+}
+
+bool unij_ring_empty(unij_ring_t* R)
+{
+	if(!ENSURE_RING(R))
+		return true;
+	
+	return unij_atomic_load_acquire(&R->shared->head) == unij_atomic_load_acquire(&R->shared->tail);
+}
@@ -3,58 +3,53 @@
  * Misc shared functionality used by both the injector and loader dlls.
  */
 #include "pch.h"
+#include <uniject/base.h>
 #include <uniject/utility.h>
-#include <uniject/win32.h>
+#include <uniject/platform.h>
 
-#include <intrin.h>
-#pragma intrinsic(_InterlockedCompareExchangePointer)
+// Application overrides installed with unij_set_handlers
+static unij_handlers_t active_handlers = { NULL, NULL, NULL, NULL };
 
-#ifdef _DEBUG
-#define UNIJ_HEAP_OPTS HEAP_GENERATE_EXCEPTIONS
-#else
-#define UNIJ_HEAP_OPTS 0
-#endif
-
-// Heap used for this library's allocations
-static HANDLE uniject_heap_handle = NULL;
-
-// One-time execution data for unij_acquire_default_privileges
-static unij_once_t memory_initialized = UNIJ_ONCE_INIT;
-
-static UNIJ_NOINLINE
-BOOL CDECL unij_memory_init_once(void* pData)
+void* unij_alloc(size_t size)
 {
-	HANDLE heap = GetProcessHeap();
-	if(IS_INVALID_HANDLE(heap)) {
-		heap = HeapCreate(UNIJ_HEAP_OPTS, 0, 0);
-		if(IS_INVALID_HANDLE(heap)) {
-			unij_fatal_call(HeapCreate);
-			return FALSE;
-		}
-	}
-	
-	// Set the global and return
-	uniject_heap_handle = heap;
-	return TRUE;
+	void* ptr;
+	if(active_handlers.alloc_fn == NULL)
+		return unij_heap_alloc(size);
+	
+	// Everything in here relies on zeroed allocations, which application allocators don't promise.
+	ptr = active_handlers.alloc_fn(active_handlers.context, size);
+	if(ptr != NULL)
+		RtlZeroMemory(ptr, size);
+	return ptr;
 }
 
-bool unij_memory_init(void)
+void unij_free(void* ptr)
 {
-	return unij_once(&memory_initialized, unij_memory_init_once, NULL) && uniject_heap_handle != NULL;
+	if(ptr == NULL) return;
+	if(active_handlers.free_fn == NULL) {
+		unij_heap_free(ptr);
+	} else {
+		active_handlers.free_fn(active_handlers.context, ptr);
+	}
 }
 
-void* unij_alloc(size_t size)
+bool unij_set_handlers(const unij_handlers_t* handlers)
 {
-	return unij_memory_init() ? (void*)HeapAlloc(uniject_heap_handle, HEAP_ZERO_MEMORY, (SIZE_T)size) : NULL;
+	if(handlers == NULL) {
+		RtlZeroMemory((void*)&active_handlers, sizeof(active_handlers));
+		return true;
+	} else if((handlers->alloc_fn == NULL) != (handlers->free_fn == NULL)) {
+		unij_fatal_error(UNIJ_ERROR_PARAM, L"unij_handlers_t::alloc_fn and unij_handlers_t::free_fn must be set together!");
+		return false;
+	}
+	
+	active_handlers = *handlers;
+	return true;
 }
 
-void unij_free(void* ptr)
+const unij_handlers_t* unij_get_handlers(void)
 {
-	BOOL free_result;
-	if(ptr == NULL) return;
-	if(!unij_memory_init()) return;
-	free_result = HeapFree(uniject_heap_handle, 0, ptr); 
-	assert(free_result);
+	return &active_handlers;
 }
 
 wchar_t* unij_wcsndup(const wchar_t* src, size_t count)
@@ -64,12 +59,12 @@ wchar_t* unij_wcsndup(const wchar_t* src, size_t count)
 	if(IS_INVALID_STRING(src)) {
 		return NULL;
 	}
-
-	szDest = (size_t)lstrlenW(src);
+	
+	szDest = unij_wcslen(src);
 	if(szDest < count) {
 		count = szDest;
 	}
-
+	
 	pResult = unij_wcsalloc(count + 1);
 	if(pResult == NULL) unij_fatal_alloc();
 	RtlCopyMemory((void*)pResult, (const void*)src, count * sizeof(wchar_t));
@@ -83,7 +78,7 @@ wchar_t* unij_wcsdup(const wchar_t* src)
 		return NULL;
 	}
 	
-	length = (size_t)lstrlenW(src);
+	length = unij_wcslen(src);
 	return unij_wcsndup(src, length);
 }
 
@@ -107,12 +102,12 @@ const wchar_t* unij_prefix_vsawprintf(const wchar_t* prefix, const wchar_t* form
 	
 	// Check the resulting size of the buffer.
 	va_copy(argscopy, args);
-	szFormatted = (size_t)_vscwprintf(format, argscopy) + 1;
+	szFormatted = (size_t)unij_vscwprintf(format, argscopy) + 1;
 	va_end(argscopy);
 	
 	// Add additional space for the prefix
 	if(prefix != NULL) {
-		szPrefix = (size_t)lstrlenW(prefix);
+		szPrefix = unij_wcslen(prefix);
 	}
 	
 	// Allocate our buffer.
@@ -120,13 +115,13 @@ const wchar_t* unij_prefix_vsawprintf(const wchar_t* prefix, const wchar_t* form
 	if(pResult == NULL) {
 		return NULL;
 	}
-
+	
 	// Finally, fill in the message.
 	if(IS_VALID_STRING(prefix))
-		lstrcpynW(pResult, prefix, (int)szPrefix + 1);
+		RtlCopyMemory((void*)pResult, (const void*)prefix, WSIZE(szPrefix));
 	
 	pWorking = &(pResult[szPrefix]);
-	_vsnwprintf(pWorking, szFormatted, format, args);
+	unij_vsnwprintf(pWorking, szFormatted, format, args);
 	return (const wchar_t*)pResult;
 }
 
@@ -148,12 +143,12 @@ const char* unij_prefix_vsacprintf(const char* prefix, const char* format, va_li
 	
 	// Check the resulting size of the buffer.
 	va_copy(argscopy, args);
-	szFormatted = (size_t)_vscprintf(format, argscopy) + 1;
+	szFormatted = (size_t)unij_vscprintf(format, argscopy) + 1;
 	va_end(argscopy);
 	
 	// Add additional space for the prefix
 	if(prefix != NULL) {
-		szPrefix = (size_t)lstrlenA(prefix);
+		szPrefix = strlen(prefix);
 	}
 	
 	// Allocate our buffer.
@@ -161,13 +156,13 @@ const char* unij_prefix_vsacprintf(const char* prefix, const char* format, va_li
 	if(pResult == NULL) {
 		return NULL;
 	}
-
+	
 	// Finally, fill in the message.
 	if(IS_VALID_STRING(prefix))
-		lstrcpynA(pResult, prefix, (int)szPrefix + 1);
+		RtlCopyMemory((void*)pResult, (const void*)prefix, szPrefix);
 	
 	pWorking = &(pResult[szPrefix]);
-	_vsnprintf(pWorking, szFormatted, format, args);
+	unij_vsnprintf(pWorking, szFormatted, format, args);
 	return (const char*)pResult;
 }
 
@@ -183,27 +178,27 @@ const char* unij_prefix_sacprintf(const char* prefix, const char* format, ...)
 
 unij_cstr_t unij_wstrtocstr(const unij_wstr_t* str)
 {
-	int bufsize;
+	size_t bufsize;
 	unij_cstr_t result = { 0, NULL };
-	int length = (int)unij_wstrlen(str);
+	size_t length = (size_t)unij_wstrlen(str);
 	if(length == 0) return result;
 	
-	bufsize = WideCharToMultiByte(CP_UTF8, 0, str->value, length, NULL, 0, NULL, NULL);
+	bufsize = unij_wcstoutf8(NULL, 0, str->value, length);
 	if(!bufsize) {
-		unij_fatal_call(WideCharToMultiByte);
+		unij_fatal_call(unij_wcstoutf8);
 		return result;
 	}
 	
 	result.length = (uint16_t)length;
-	result.value = (const char*)unij_alloc((size_t)bufsize + sizeof(char));
+	result.value = (const char*)unij_alloc(bufsize + sizeof(char));
 	if(result.value == NULL) {
 		unij_fatal_alloc();
 		return result;
 	}
 	
-	if(!WideCharToMultiByte(CP_UTF8, 0, str->value, length, (char*)result.value, bufsize, NULL, NULL)) {
+	if(!unij_wcstoutf8((char*)result.value, bufsize, str->value, length)) {
 		unij_cstrfree(&result);
-		unij_fatal_call(WideCharToMultiByte);
+		unij_fatal_call(unij_wcstoutf8);
 	}
 	
 	return result;
@@ -215,6 +210,15 @@ unij_cstr_t unij_wstrtocstr(const unij_wstr_t* str)
 #define APPLY_OFFSET(PTR,OFF) \
 	(TOPTR(PTR) + TOPTR(OFF))
 
+// 0x20 in every character, whichever width wchar_t has.
+#if WCHAR_MAX > 0xFFFF
+#	define LOWER_BITS64 ((uint64_t)0x0000002000000020)
+#	define LOWER_BITS32 ((uint32_t)0x00000020)
+#else
+#	define LOWER_BITS64 ((uint64_t)0x0020002000200020)
+#	define LOWER_BITS32 ((uint32_t)0x00200020)
+#endif
+
 wchar_t* unij_strtolower(wchar_t* buffer, size_t length)
 {
 	union
@@ -227,12 +231,12 @@ wchar_t* unij_strtolower(wchar_t* buffer, size_t length)
 	uintptr_t pend = APPLY_OFFSET(buffer, WSIZE(length));
 	
 	while(TOPTR(idata.p64) + sizeof(uint64_t) <= pend)
-		*idata.p64++ |= (uint64_t)0x0020002000200020;
+		*idata.p64++ |= LOWER_BITS64;
 	
 	
 	while(TOPTR(idata.p32) + sizeof(uint32_t) <= pend)
-		*idata.p32++ |= (uint32_t)0x00200020;
-	 
+		*idata.p32++ |= LOWER_BITS32;
+	
 	while(TOPTR(idata.p16) + sizeof(uint16_t) <= pend)
 		*idata.p16++ |= (uint16_t)0x0020;
 	
@@ -1,33 +1,43 @@
 /**
  * @file win32_api.c
- * TODO: description
+ * Win32 implementation of uniject/platform.h, plus the token helpers in uniject/win32.h.
  */
 #include "pch.h"
+#include "atomics.h"
+#include "base_private.h"
+#include <uniject/platform.h>
 #include <uniject/win32.h>
 #include <uniject/utility.h>
 
-#include <intrin.h>
-// TODO: Atomics compatibility macros
-#pragma intrinsic(_InterlockedCompareExchangePointer)
-
 // Privileges
 #define LUID_SIZE(COUNT)  ((uint32_t)(sizeof(LUID_AND_ATTRIBUTES) * (COUNT)))
 #define PRIVILEGES_OFFSET ((uint32_t)FIELD_OFFSET(TOKEN_PRIVILEGES, Privileges))
 
-// Private run once primitive declaration
-struct unij_once_internal
-{
-	UNIJ_CACHE_ALIGN
-	HANDLE event;
-	BOOL executed;
-	BOOL result;
-};
+#ifdef _DEBUG
+#define UNIJ_HEAP_OPTS HEAP_GENERATE_EXCEPTIONS
+#else
+#define UNIJ_HEAP_OPTS 0
+#endif
 
-typedef struct unij_once_internal unij_once_internal_t;
+// WaitOnAddress and WakeByAddressAll, which only exist from Windows 8 on.
+typedef BOOL(WINAPI *wait_on_address_fn)(volatile VOID* address, PVOID compare, SIZE_T size, DWORD timeout);
+typedef VOID(WINAPI *wake_by_address_fn)(PVOID address);
 
 // One-time execution data for unij_acquire_default_privileges
 static unij_once_t acquired_current_process_privileges = UNIJ_ONCE_INIT;
 
+// Heap used for this library's allocations. Only ever set once, so unij_heap_alloc reads it without going through
+// memory_initialized.
+static HANDLE volatile uniject_heap_handle = NULL;
+
+// One-time execution data for unij_memory_init
+static unij_once_t memory_initialized = UNIJ_ONCE_INIT;
+
+// Resolved by resolve_address_waits. Both stay NULL on older versions of Windows.
+static unij_atomic_u32 address_waits_resolved = 0;
+static wait_on_address_fn wait_on_address = NULL;
+static wake_by_address_fn wake_by_address_all = NULL;
+
 // Convert a size_t value to a ULARGE_INTEGER.
 static UNIJ_INLINE ULARGE_INTEGER make_ularge_integer(size_t szValue)
 {
@@ -35,41 +45,115 @@ static UNIJ_INLINE ULARGE_INTEGER make_ularge_integer(size_t szValue)
 	return *((PULARGE_INTEGER)(&ullTempStore));
 }
 
-static UNIJ_NOINLINE
-BOOL CDECL unij_once_inner(unij_once_internal_t* pOnce, unij_once_fn fnOnce, void* pData)
+// Can't use unij_once, which sits on top of these. Racing callers all resolve the same pointers, so that's harmless.
+static UNIJ_NOINLINE void resolve_address_waits(void)
+{
+	HMODULE kernelbase = GetModuleHandleW(L"kernelbase.dll");
+	if(kernelbase != NULL) {
+		wait_on_address = (wait_on_address_fn)GetProcAddress(kernelbase, "WaitOnAddress");
+		wake_by_address_all = (wake_by_address_fn)GetProcAddress(kernelbase, "WakeByAddressAll");
+		if(wait_on_address == NULL || wake_by_address_all == NULL)
+			wait_on_address = NULL;
+	}
+	unij_atomic_store_release(&address_waits_resolved, 1);
+}
+
+void unij_wait_on_address(const volatile void* address, uint32_t expected)
+{
+	if(unij_atomic_load_acquire(&address_waits_resolved) == 0)
+		resolve_address_waits();
+	if(wait_on_address != NULL) {
+		wait_on_address((volatile VOID*)address, (PVOID)&expected, sizeof(expected), INFINITE);
+	} else {
+		SwitchToThread();
+	}
+}
+
+void unij_wake_by_address(const volatile void* address)
 {
-	DWORD dwResult;
-	HANDLE hExisting, hCreated;
+	if(unij_atomic_load_acquire(&address_waits_resolved) == 0)
+		resolve_address_waits();
+	if(wait_on_address != NULL)
+		wake_by_address_all((PVOID)address);
+}
 
-	hCreated = CreateEvent(NULL, TRUE, FALSE, NULL);
-	if(IS_INVALID_HANDLE(hCreated)) {
-		unij_fatal_call(CreateEvent);
-		return FALSE;
+static UNIJ_NOINLINE
+BOOL CDECL unij_memory_init_once(void* pData)
+{
+	HANDLE heap = GetProcessHeap();
+	if(IS_INVALID_HANDLE(heap)) {
+		heap = HeapCreate(UNIJ_HEAP_OPTS, 0, 0);
+		if(IS_INVALID_HANDLE(heap)) {
+			unij_fatal_call(HeapCreate);
+			return FALSE;
+		}
 	}
 	
-	hExisting = _InterlockedCompareExchangePointer(&pOnce->event, hCreated, NULL);
-	if(IS_INVALID_HANDLE(hExisting)) {
-		pOnce->result = fnOnce(pData);
-		dwResult = SetEvent(hCreated) ? 1 : 0;
-		assert(dwResult > 0);
-		pOnce->executed = TRUE;
-	} else {
-		// Wait for event signal
-		CloseHandle(hCreated);
-		dwResult = WaitForSingleObject(hExisting, INFINITE);
-		assert(dwResult == WAIT_OBJECT_0);
+	// Set the global and return
+	uniject_heap_handle = heap;
+	return TRUE;
+}
+
+bool unij_memory_init(void)
+{
+	return unij_once(&memory_initialized, unij_memory_init_once, NULL) && uniject_heap_handle != NULL;
+}
+
+void* unij_heap_alloc(size_t size)
+{
+	HANDLE heap = uniject_heap_handle;
+	if(heap == NULL) {
+		if(!unij_memory_init()) return NULL;
+		heap = uniject_heap_handle;
 	}
+	return (void*)HeapAlloc(heap, HEAP_ZERO_MEMORY, (SIZE_T)size);
+}
 
-	return pOnce->result;
+void unij_heap_free(void* ptr)
+{
+	BOOL free_result;
+	if(ptr == NULL) return;
+	
+	// Anything being freed came from the heap, so it's already set.
+	free_result = HeapFree(uniject_heap_handle, 0, ptr); 
+	assert(free_result);
 }
 
-bool unij_once(unij_once_t* once, unij_once_fn oncefn, void* parameter)
+const wchar_t* unij_system_error_text(uint32_t error)
 {
-	BOOL bResult;
-	/* Fast case - avoid WaitForSingleObject. */
-	unij_once_internal_t* pOncePriv = (unij_once_internal_t*)once;
-	bResult = pOncePriv->executed ? pOncePriv->result : unij_once_inner(pOncePriv, oncefn, parameter);
-	return bResult ? true : false;
+	const wchar_t* message = NULL;
+	FormatMessageW(
+		FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM |FORMAT_MESSAGE_IGNORE_INSERTS,
+		NULL, error,
+		MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+		(wchar_t*)&message, 0, NULL
+	);
+	return message;
+}
+
+void unij_system_error_free(const wchar_t* text)
+{
+	if(text != NULL)
+		LocalFree((HLOCAL)text);
+}
+
+bool unij_process_exists(uint32_t pid)
+{
+	DWORD code;
+	bool result;
+	HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid);
+	if(process == NULL)
+		return GetLastError() == ERROR_ACCESS_DENIED;
+	
+	result = !GetExitCodeProcess(process, &code) || code == STILL_ACTIVE;
+	CloseHandle(process);
+	return result;
+}
+
+size_t unij_wcstoutf8(char* buffer, size_t size, const wchar_t* str, size_t length)
+{
+	int result = WideCharToMultiByte(CP_UTF8, 0, str, (int)length, buffer, buffer == NULL ? 0 : (int)size, NULL, NULL);
+	return result > 0 ? (size_t)result : 0;
 }
 
 static UNIJ_INLINE
@@ -77,7 +161,7 @@ PTOKEN_PRIVILEGES unij_alloc_token_privileges(const wchar_t** names, uint32_t co
 {
 	PTOKEN_PRIVILEGES privileges = NULL;
 	*pbuffer_size = PRIVILEGES_OFFSET + LUID_SIZE(count);
-
+	
 	privileges = (PTOKEN_PRIVILEGES)unij_alloc((size_t) *pbuffer_size);
 	if(privileges != NULL) {
 		uint32_t idx = 0;
@@ -88,7 +172,7 @@ PTOKEN_PRIVILEGES unij_alloc_token_privileges(const wchar_t** names, uint32_t co
 				privileges = NULL;
 				break;
 			}
-
+			
 			privileges->Privileges[idx].Attributes = SE_PRIVILEGE_ENABLED;
 		}
 	} else {
@@ -96,7 +180,7 @@ PTOKEN_PRIVILEGES unij_alloc_token_privileges(const wchar_t** names, uint32_t co
 		unij_fatal_alloc();
 		SetLastError(ERROR_OUTOFMEMORY);
 	}
-
+	
 	return privileges;
 }
 
@@ -104,11 +188,11 @@ bool unij_acquire_privileges(HANDLE process, const wchar_t** names, uint32_t cou
 {
 	HANDLE hToken = NULL;
 	BOOL bResult = FALSE;
-
+	
 	if(OpenProcessToken(process, TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken )) {
 		uint32_t buffer_size = 0, last_error = ERROR_SUCCESS, i = 0;
 		PTOKEN_PRIVILEGES lpPrivileges = unij_alloc_token_privileges(names, count, &buffer_size);
-
+		
 		// Mark the call as successful
 		if(lpPrivileges != NULL) {
 			bResult = AdjustTokenPrivileges(hToken, FALSE, lpPrivileges, buffer_size, NULL, NULL);
@@ -139,29 +223,6 @@ bool unij_acquire_default_privileges(void)
 	return unij_once(&acquired_current_process_privileges, unij_acquire_default_privileges_once, NULL);
 }
 
-static UNIJ_INLINE const wchar_t* unij_object_type_text(unij_object_t type)
-{
-	switch(type)
-	{
-		case UNIJ_OBJECT_MAPPING:
-			return L"mem";
-		case UNIJ_OBJECT_EVENT:
-			return L"ev";
-		default:
-			return L"unknown";
-	}
-}
-
-// TODO: pid is coming up as 0 in the loader dll call. Need to find out why
-const wchar_t* unij_object_name(const wchar_t* key, unij_object_t type, uint32_t pid)
-{
-	const wchar_t* stype = unij_object_type_text(type);
-	//ASSERT_NOT_ZERO(pid);
-	ASSERT_VALID_STRING(key);
-	return unij_sawprintf(UNIJ_OBJECT_FORMAT, key, stype);
-	//return unij_sawprintf(UNIJ_OBJECT_FORMAT, key, stype, pid);
-}
-
 HANDLE unij_create_mmap(const wchar_t* name, size_t size)
 {
 	HANDLE hResult = NULL;
@@ -178,6 +239,33 @@ HANDLE unij_create_mmap(const wchar_t* name, size_t size)
 	return hResult;
 }
 
+HANDLE unij_reserve_mmap(const wchar_t* name, size_t max_size)
+{
+	HANDLE hResult = NULL;
+	ULARGE_INTEGER ullSize = make_ularge_integer(max_size);
+	
+	ASSERT_NOT_ZERO(max_size);
+	ASSERT_VALID_STRING(name);
+	
+	hResult = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE | SEC_RESERVE,
+	                             ullSize.HighPart, ullSize.LowPart, name);
+	if(IS_INVALID_HANDLE(hResult)) {
+		unij_fatal_call(CreateFileMapping);
+	}
+	return hResult;
+}
+
+bool unij_commit_mmap(void* view, size_t size)
+{
+	ASSERT_NOT_NULL(view);
+	ASSERT_NOT_ZERO(size);
+	if(VirtualAlloc(view, (SIZE_T)size, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+		unij_fatal_call(VirtualAlloc);
+		return false;
+	}
+	return true;
+}
+
 HANDLE unij_open_mmap(const wchar_t* name, bool readonly)
 {
 	HANDLE result = NULL;
@@ -185,19 +273,95 @@ HANDLE unij_open_mmap(const wchar_t* name, bool readonly)
 	ASSERT_VALID_STRING(name);
 	result = OpenFileMappingW(access, FALSE, name);
 	if(IS_INVALID_HANDLE(result)) {
-		unij_fatal_error(UNIJ_ERROR_LASTERROR, L"Failed call to OpenFileMapping(%lu, FALSE, \"%s\")", access, name);
+		unij_fatal_error(UNIJ_ERROR_LASTERROR, L"Failed call to OpenFileMapping(%lu, FALSE, \"%ls\")", access, name);
 	}
 	return result;
 }
 
+HANDLE unij_reserve_unnamed_mmap(size_t max_size, uint32_t* pexported)
+{
+	// Handing over a section means duplicating it into the loader, which needs a process handle on one side or the
+	// other that an elevated injector won't reliably give. Named sections it is.
+	UNIJ_SUPPRESS_UNUSED(max_size);
+	UNIJ_SUPPRESS_UNUSED(pexported);
+	return NULL;
+}
+
+HANDLE unij_import_mmap(uint32_t owner, uint32_t exported, bool readonly)
+{
+	UNIJ_SUPPRESS_UNUSED(exported);
+	UNIJ_SUPPRESS_UNUSED(readonly);
+	unij_fatal_error(UNIJ_ERROR_OPERATION, L"Can't import a mapping from process %u: not supported on Windows", owner);
+	return NULL;
+}
+
 HANDLE unij_create_event(const wchar_t* name)
 {
 	HANDLE result = NULL;
 	ASSERT_VALID_STRING(name);
 	result = CreateEventW(NULL, TRUE, FALSE, name);
-
+	
 	if(IS_INVALID_HANDLE(result)) {
 		unij_fatal_call(CreateEventW);
 	}
 	return result;
 }
+
+void* unij_map_view(HANDLE mapping, size_t* psize, bool readonly)
+{
+	void* view;
+	MEMORY_BASIC_INFORMATION info;
+	DWORD access = readonly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS;
+	ASSERT_NOT_NULL(psize);
+	view = MapViewOfFile(mapping, access, 0, 0, (SIZE_T)*psize);
+	if(view == NULL) {
+		unij_fatal_call(MapViewOfFile);
+		return NULL;
+	}
+	
+	// Only informational here, since UnmapViewOfFile doesn't need it.
+	if(*psize == 0 && VirtualQuery(view, &info, sizeof(info)) != 0)
+		*psize = (size_t)info.RegionSize;
+	return view;
+}
+
+void unij_unmap_view(const void* view, size_t size)
+{
+	UNIJ_SUPPRESS_UNUSED(size);
+	if(view != NULL)
+		UnmapViewOfFile(view);
+}
+
+void unij_flush_view(const void* view, size_t size)
+{
+	FlushViewOfFile(view, (SIZE_T)size);
+}
+
+void unij_set_event(HANDLE event)
+{
+	SetEvent(event);
+}
+
+void unij_reset_event(HANDLE event)
+{
+	ResetEvent(event);
+}
+
+unij_wait_t unij_wait_event(HANDLE event, uint32_t timeout)
+{
+	switch(WaitForSingleObject(event, (DWORD)timeout))
+	{
+		case WAIT_OBJECT_0:
+			return UNIJ_WAIT_SIGNALED;
+		case WAIT_TIMEOUT:
+			return UNIJ_WAIT_TIMEOUT;
+		default:
+			return UNIJ_WAIT_FAILED;
+	}
+}
+
+void unij_close_handle(HANDLE object)
+{
+	if(IS_VALID_HANDLE(object))
+		CloseHandle(object);
+}
@@ -0,0 +1,359 @@
+/**
+ * @file async-test.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Drives injections through unij_inject_async from a single thread, against a handful of mono-hosts running the
+ * stand-in runtime. All of them get injected before any gets checked on, so they're in flight together, and the only
+ * thing moving them along is this thread polling. Every operation has to call back exactly once, with the state it
+ * ends up in. A host that takes its time loading the assembly covers the other two ways out: running out of time,
+ * and being cancelled. Another one keeps the loader resident, so later requests share its channel, and each of them
+ * has to get its own reply.
+ *
+ * Usage: async-test <path to uniject-loader .so>
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "fake-mono.h"
+
+#define HOSTS 4
+
+#define TEST_ASSEMBLY L"/opt/game/Managed/FakeAssembly.dll"
+#define TEST_CLASS L"Fake.Entry"
+#define TEST_METHOD L"Start"
+
+// How long the hosts that answer right away get, in milliseconds.
+#define INJECT_TIMEOUT 10000
+
+// How long the slow host takes to load the assembly, and how long it gets to do that.
+#define SLOW_LOAD_US 2000000
+#define SLOW_TIMEOUT 100
+
+// How long the resident host takes per request.
+#define RESIDENT_LOAD_US 200000
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	if(level != UNIJ_LEVEL_INFO)
+		wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Fatal error 0x%08X (system error 0x%08X)\n", (unsigned int)code, (unsigned int)win32_error);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %ls\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+typedef struct
+{
+	pid_t pid;
+	fake_mono_shared_t* shared;
+} host_t;
+
+// What each callback saw.
+typedef struct
+{
+	int calls;
+	unij_operation_t* op;
+	unij_operation_state_t state;
+	unij_error_t status;
+} outcome_t;
+
+static bool sibling_path(char* buffer, size_t size, const char* name)
+{
+	char* slash;
+	ssize_t length = readlink("/proc/self/exe", buffer, size - 1);
+	if(length <= 0)
+		return false;
+	
+	buffer[length] = '\0';
+	slash = strrchr(buffer, '/');
+	if(slash == NULL || (size_t)(slash - buffer) + strlen(name) + 2 > size)
+		return false;
+	
+	strcpy(slash + 1, name);
+	return true;
+}
+
+static bool start_host(host_t* host, uint32_t load_us)
+{
+	int shared_fd;
+	char path[PATH_MAX], fd[16];
+	CHECK(sibling_path(path, sizeof(path), "mono-host"));
+	CHECK((shared_fd = memfd_create("async-test", 0)) >= 0);
+	CHECK(ftruncate(shared_fd, (off_t)sizeof(fake_mono_shared_t)) == 0);
+	host->shared = (fake_mono_shared_t*)mmap(NULL, sizeof(fake_mono_shared_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+	                                          shared_fd, 0);
+	CHECK(host->shared != MAP_FAILED);
+	host->shared->load_us = load_us;
+	
+	host->pid = fork();
+	if(host->pid == 0) {
+		snprintf(fd, sizeof(fd), "%d", shared_fd);
+		execl(path, "mono-host", fd, (char*)NULL);
+		_exit(127);
+	}
+	close(shared_fd);
+	CHECK(host->pid > 0);
+	
+	while(__atomic_load_n(&host->shared->ready, __ATOMIC_ACQUIRE) == 0) {
+		CHECK(waitpid(host->pid, NULL, WNOHANG) == 0);
+		usleep(1000);
+	}
+	return true;
+}
+
+static void stop_host(host_t* host)
+{
+	if(host->pid > 0) {
+		kill(host->pid, SIGKILL);
+		waitpid(host->pid, NULL, 0);
+	}
+	if(host->shared != NULL && host->shared != MAP_FAILED)
+		munmap((void*)host->shared, sizeof(fake_mono_shared_t));
+}
+
+static void CDECL record_outcome(unij_operation_t* op, unij_operation_state_t state, unij_error_t status, void* user)
+{
+	outcome_t* outcome = (outcome_t*)user;
+	outcome->calls++;
+	outcome->op = op;
+	outcome->state = state;
+	outcome->status = status;
+}
+
+static uniject_t* open_context(const host_t* host, unij_wstr_t* loader)
+{
+	uniject_t* ctx;
+	unij_wstr_t assembly = { ARRAYLEN(TEST_ASSEMBLY) - 1, TEST_ASSEMBLY };
+	unij_wstr_t cls = { ARRAYLEN(TEST_CLASS) - 1, TEST_CLASS };
+	unij_wstr_t method = { ARRAYLEN(TEST_METHOD) - 1, TEST_METHOD };
+	
+	ctx = unij_injector_open((uint32_t)host->pid);
+	if(ctx != NULL) {
+		unij_set_loader_path(ctx, loader);
+		unij_set_assembly_path(ctx, &assembly);
+		unij_set_class_name(ctx, &cls);
+		unij_set_method_name(ctx, &method);
+	}
+	return ctx;
+}
+
+static bool test_in_flight(host_t* hosts, unij_wstr_t* loader)
+{
+	int i, pending;
+	bool result = true;
+	uint32_t start;
+	uniject_t* ctxs[HOSTS] = { NULL };
+	unij_operation_t* ops[HOSTS] = { NULL };
+	outcome_t outcomes[HOSTS];
+	RtlZeroMemory((void*)outcomes, sizeof(outcomes));
+	
+	for(i = 0; result && i < HOSTS; i++) {
+		ctxs[i] = open_context(&hosts[i], loader);
+		ops[i] = ctxs[i] != NULL ? unij_inject_async(ctxs[i], record_outcome, &outcomes[i], INJECT_TIMEOUT) : NULL;
+		result = ops[i] != NULL;
+	}
+	
+	// One thread, polling until nothing's left pending.
+	start = unij_tick_count();
+	do {
+		for(i = pending = 0; result && i < HOSTS; i++) {
+			if(unij_operation_poll(ops[i]) == UNIJ_OPERATION_PENDING)
+				pending++;
+		}
+		if(pending != 0)
+			usleep(1000);
+	} while(result && pending != 0 && unij_tick_count() - start < 2 * INJECT_TIMEOUT);
+	
+	for(i = 0; result && i < HOSTS; i++) {
+		if(outcomes[i].calls != 1 || outcomes[i].op != ops[i] || outcomes[i].state != UNIJ_OPERATION_SUCCEEDED ||
+		   outcomes[i].status != UNIJ_ERROR_SUCCESS || unij_operation_status(ops[i]) != UNIJ_ERROR_SUCCESS) {
+			wprintf(L"Injection %d: %d calls, state %d, status 0x%08X\n", i, outcomes[i].calls,
+			        (int)outcomes[i].state, (unsigned int)outcomes[i].status);
+			result = false;
+		} else if(hosts[i].shared->calls[FAKE_CALL_mono_runtime_invoke] != 1) {
+			wprintf(L"Injection %d reported back before invoking anything.\n", i);
+			result = false;
+		}
+	}
+	
+	// Finished operations are left alone by cancelling and closing.
+	for(i = 0; i < HOSTS; i++) {
+		if(ops[i] != NULL) {
+			if(result && unij_operation_cancel(ops[i])) {
+				wprintf(L"Cancelled injection %d after it finished.\n", i);
+				result = false;
+			}
+			unij_operation_close(ops[i]);
+		}
+		unij_close(ctxs[i]);
+		if(result && outcomes[i].calls != 1) {
+			wprintf(L"Injection %d called back again after finishing.\n", i);
+			result = false;
+		}
+	}
+	return result;
+}
+
+static bool test_timeout(host_t* host, unij_wstr_t* loader)
+{
+	uniject_t* ctx;
+	unij_operation_t* op;
+	outcome_t outcome = { 0 };
+	unij_operation_state_t state;
+	
+	CHECK((ctx = open_context(host, loader)) != NULL);
+	op = unij_inject_async(ctx, record_outcome, &outcome, SLOW_TIMEOUT);
+	if(op == NULL) {
+		unij_close(ctx);
+		CHECK(!"unij_inject_async failed");
+	}
+	
+	state = unij_operation_wait(op, INFINITE);
+	unij_operation_close(op);
+	unij_close(ctx);
+	CHECK(state == UNIJ_OPERATION_TIMED_OUT);
+	CHECK(outcome.calls == 1 && outcome.state == UNIJ_OPERATION_TIMED_OUT);
+	return true;
+}
+
+static bool test_cancel(host_t* host, unij_wstr_t* loader)
+{
+	uniject_t* ctx;
+	unij_operation_t* op;
+	outcome_t outcome = { 0 };
+	bool cancelled, again;
+	unij_operation_state_t waited, polled;
+	
+	CHECK((ctx = open_context(host, loader)) != NULL);
+	op = unij_inject_async(ctx, record_outcome, &outcome, INFINITE);
+	if(op == NULL) {
+		unij_close(ctx);
+		CHECK(!"unij_inject_async failed");
+	}
+	
+	// Waiting on it for a bit leaves it pending, since neither timeout is up.
+	waited = unij_operation_wait(op, SLOW_TIMEOUT);
+	cancelled = unij_operation_cancel(op);
+	again = unij_operation_cancel(op);
+	polled = unij_operation_poll(op);
+	unij_operation_close(op);
+	unij_close(ctx);
+	CHECK(waited == UNIJ_OPERATION_PENDING);
+	CHECK(cancelled && !again && polled == UNIJ_OPERATION_CANCELLED);
+	CHECK(outcome.calls == 1 && outcome.state == UNIJ_OPERATION_CANCELLED);
+	return true;
+}
+
+static unij_operation_t* resident_inject(uniject_t* ctx, outcome_t* outcome)
+{
+	RtlZeroMemory((void*)outcome, sizeof(*outcome));
+	return unij_inject_async(ctx, record_outcome, outcome, INJECT_TIMEOUT);
+}
+
+static uint32_t invoke_count(const host_t* host)
+{
+	return __atomic_load_n(&host->shared->calls[FAKE_CALL_mono_runtime_invoke], __ATOMIC_ACQUIRE);
+}
+
+static bool test_resident(host_t* host, unij_wstr_t* loader)
+{
+	uniject_t* ctx, *other;
+	unij_operation_t* ops[3] = { NULL };
+	outcome_t outcomes[3];
+	unij_operation_state_t state;
+	uint32_t invoked;
+	bool second;
+	
+	// The first one injects the loader, which then stays behind listening on the channel.
+	CHECK((ctx = open_context(host, loader)) != NULL);
+	unij_set_resident(ctx, true);
+	ops[0] = resident_inject(ctx, &outcomes[0]);
+	state = ops[0] != NULL ? unij_operation_wait(ops[0], INFINITE) : UNIJ_OPERATION_FAILED;
+	unij_operation_close(ops[0]);
+	if(state != UNIJ_OPERATION_SUCCEEDED) {
+		unij_close(ctx);
+		CHECK(!"Resident injection failed");
+	}
+	
+	// The command ring only takes one producer, so a second context can't write to it too.
+	other = open_context(host, loader);
+	if(other != NULL)
+		unij_set_resident(other, true);
+	second = other != NULL && (ops[0] = resident_inject(other, &outcomes[0])) != NULL;
+	unij_operation_close(ops[0]);
+	unij_close(other);
+	
+	// The reply to a request that got cancelled still comes in first, and mustn't finish the next one.
+	invoked = invoke_count(host);
+	ops[0] = resident_inject(ctx, &outcomes[0]);
+	if(ops[0] != NULL)
+		unij_operation_cancel(ops[0]);
+	ops[1] = resident_inject(ctx, &outcomes[1]);
+	state = ops[1] != NULL ? unij_operation_wait(ops[1], INFINITE) : UNIJ_OPERATION_FAILED;
+	CHECK(!second);
+	CHECK(ops[0] != NULL && outcomes[0].calls == 1 && outcomes[0].state == UNIJ_OPERATION_CANCELLED);
+	CHECK(state == UNIJ_OPERATION_SUCCEEDED && outcomes[1].calls == 1 && invoke_count(host) == invoked + 2);
+	unij_operation_close(ops[0]);
+	unij_operation_close(ops[1]);
+	
+	// Two in flight at once: waiting on the later one also picks up the reply to the earlier one.
+	ops[1] = resident_inject(ctx, &outcomes[1]);
+	ops[2] = resident_inject(ctx, &outcomes[2]);
+	state = ops[1] != NULL && ops[2] != NULL ? unij_operation_wait(ops[2], INFINITE) : UNIJ_OPERATION_FAILED;
+	CHECK(state == UNIJ_OPERATION_SUCCEEDED && outcomes[2].calls == 1);
+	CHECK(unij_operation_poll(ops[1]) == UNIJ_OPERATION_SUCCEEDED && outcomes[1].calls == 1);
+	unij_operation_close(ops[1]);
+	unij_operation_close(ops[2]);
+	unij_close(ctx);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	int i;
+	bool result = true;
+	host_t hosts[HOSTS + 2];
+	wchar_t wloader[PATH_MAX];
+	unij_wstr_t loader = { 0, wloader };
+	if(argc < 2 || argv[1][0] != '/' || mbstowcs(wloader, argv[1], ARRAYLEN(wloader)) >= ARRAYLEN(wloader)) {
+		wprintf(L"Usage: async-test <absolute path to the loader>\n");
+		return 1;
+	}
+	loader.length = (uint16_t)wcslen(wloader);
+	
+	// Nothing reads the stand-in's reports here. It counts its calls in the shared block instead.
+	unsetenv("UNIJ_TEST_FD");
+	RtlZeroMemory((void*)hosts, sizeof(hosts));
+	for(i = 0; result && i < HOSTS + 2; i++)
+		result = start_host(&hosts[i], i < HOSTS ? 0 : i == HOSTS ? SLOW_LOAD_US : RESIDENT_LOAD_US);
+	if(!unij_init() || !result) {
+		wprintf(L"Couldn't start the hosts!\n");
+		result = false;
+	}
+	
+	if(result && (result = test_in_flight(hosts, &loader)))
+		wprintf(L"%d injections in flight at once all called back.\n", HOSTS);
+	if(result && (result = test_timeout(&hosts[HOSTS], &loader)))
+		wprintf(L"A slow injection timed out.\n");
+	if(result && (result = test_cancel(&hosts[HOSTS], &loader)))
+		wprintf(L"A slow injection got cancelled.\n");
+	if(result && (result = test_resident(&hosts[HOSTS + 1], &loader)))
+		wprintf(L"Requests to a resident loader each got their own reply.\n");
+	
+	for(i = 0; i < HOSTS + 2; i++)
+		stop_host(&hosts[i]);
+	return result ? 0 : 1;
+}
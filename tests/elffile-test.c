@@ -0,0 +1,273 @@
+/**
+ * @file elffile-test.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Resolves symbols in libc and in the stand-in runtime (fake-mono.c) straight from their files, and checks the
+ * offsets against where the dynamic linker actually put them in this process. The decoy build of the stand-in only has
+ * a .hash table, so both lookup paths get covered. Then a child loads the stand-in, and the address worked out from
+ * its maps file alone has to hold the same code. Every truncation of the stand-in is opened too, which should only
+ * ever fail or miss.
+ *
+ * Usage: elffile-test
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/elffile.h>
+#include <uniject/remote.h>
+
+#include <dlfcn.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/wait.h>
+
+#define MONO_NAME "libmonobdwgc-2.0.so"
+#define DECOY_NAME "libmono-decoy.so"
+#define LOOKUP_ROUNDS 10000
+#define CODE_SIZE 16
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Exiting process with code: 0x%08X\n", (unsigned int)win32_error);
+	exit((int)code);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %s\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+// Not indirect functions, so dlsym hands back the same address the symbol table has.
+static const char* libc_symbols[] = { "dlopen", "dlsym", "dlerror", "malloc", "free", "fopen" };
+
+static const char* missing[] = { "", "mono", "mono_init2", "dlopen_", "not_a_symbol_anywhere" };
+
+static bool library_path(char* buffer, size_t size, const char* name)
+{
+	char* slash;
+	ssize_t length = readlink("/proc/self/exe", buffer, size - 1);
+	CHECK(length > 0);
+	buffer[length] = '\0';
+	slash = strrchr(buffer, '/');
+	CHECK(slash != NULL && (size_t)(slash - buffer) + strlen(name) + 2 < size);
+	strcpy(slash + 1, name);
+	return true;
+}
+
+static unij_elffile_t* open_path(const char* path)
+{
+	wchar_t wpath[PATH_MAX];
+	if(mbstowcs(wpath, path, ARRAYLEN(wpath)) >= ARRAYLEN(wpath))
+		return NULL;
+	return unij_elffile_open(wpath);
+}
+
+// Every name in \a names should land where the dynamic linker put it, given the library's base in this process.
+static bool check_loaded(unij_elffile_t* elf, void* handle, const char** names, size_t count)
+{
+	size_t i;
+	Dl_info info;
+	uint64_t offset;
+	for(i = 0; i < count; i++) {
+		void* symbol = dlsym(handle, names[i]);
+		CHECK(symbol != NULL && dladdr(symbol, &info) != 0);
+		CHECK(unij_elffile_symbol(elf, names[i], &offset, NULL));
+		if((uintptr_t)info.dli_fbase + (uintptr_t)offset != (uintptr_t)symbol) {
+			wprintf(L"%hs resolved to +0x%llx, but it's at +0x%llx!\n", names[i], (unsigned long long)offset,
+			        (unsigned long long)((uintptr_t)symbol - (uintptr_t)info.dli_fbase));
+			return false;
+		}
+	}
+	
+	for(i = 0; i < ARRAYLEN(missing); i++)
+		CHECK(!unij_elffile_symbol(elf, missing[i], &offset, NULL));
+	return true;
+}
+
+static bool test_libc(void)
+{
+	size_t i;
+	Dl_info info;
+	clock_t start;
+	double elapsed;
+	uint64_t offset;
+	unij_elffile_t* elf;
+	CHECK(dladdr(dlsym(RTLD_DEFAULT, "dlopen"), &info) != 0 && info.dli_fname != NULL);
+	
+	elf = open_path(info.dli_fname);
+	CHECK(elf != NULL);
+	CHECK(unij_elffile_bits(elf) == UNIJ_BITS);
+	CHECK(unij_elffile_hash(elf) != UNIJ_ELF_HASH_NONE);
+	if(!check_loaded(elf, RTLD_DEFAULT, libc_symbols, ARRAYLEN(libc_symbols))) {
+		unij_elffile_close(elf);
+		return false;
+	}
+	
+	start = clock();
+	for(i = 0; i < LOOKUP_ROUNDS; i++)
+		CHECK(unij_elffile_symbol(elf, libc_symbols[i % ARRAYLEN(libc_symbols)], &offset, NULL));
+	elapsed = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / LOOKUP_ROUNDS;
+	wprintf(L"%hs (%ls hash): %.0fns per lookup.\n", info.dli_fname,
+	        unij_elffile_hash(elf) == UNIJ_ELF_HASH_GNU ? L"GNU" : L"SysV", elapsed);
+	unij_elffile_close(elf);
+	return true;
+}
+
+static bool test_library(const char* path, const char* symbol, unij_elfhash_t hash)
+{
+	void* handle;
+	unij_elffile_t* elf;
+	const char* names[1];
+	handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	CHECK(handle != NULL);
+	
+	elf = open_path(path);
+	CHECK(elf != NULL);
+	CHECK(unij_elffile_hash(elf) == hash);
+	names[0] = symbol;
+	if(!check_loaded(elf, handle, names, 1)) {
+		unij_elffile_close(elf);
+		return false;
+	}
+	
+	unij_elffile_close(elf);
+	wprintf(L"%hs: %hs resolved through its %ls hash.\n", path, symbol, hash == UNIJ_ELF_HASH_GNU ? L"GNU" : L"SysV");
+	return true;
+}
+
+// Cut short, the stand-in either fails to open or comes up empty unless the lookup had everything it needed.
+static bool test_truncated(const char* path)
+{
+	FILE* file;
+	size_t size, i;
+	uint8_t* image;
+	uint64_t expected, offset;
+	unij_elffile_t* elf;
+	struct stat st;
+	CHECK(stat(path, &st) == 0 && st.st_size > 0);
+	
+	size = (size_t)st.st_size;
+	image = (uint8_t*)malloc(size);
+	CHECK(image != NULL);
+	file = fopen(path, "rb");
+	CHECK(file != NULL && fread((void*)image, 1, size, file) == size);
+	fclose(file);
+	
+	elf = unij_elffile_open_memory((const void*)image, size);
+	CHECK(elf != NULL && unij_elffile_symbol(elf, "mono_init", &expected, NULL));
+	unij_elffile_close(elf);
+	
+	for(i = 0; i < size; i++) {
+		bool found;
+		elf = unij_elffile_open_memory((const void*)image, i);
+		if(elf == NULL)
+			continue;
+		found = unij_elffile_symbol(elf, "mono_init", &offset, NULL);
+		unij_elffile_close(elf);
+		CHECK(!found || offset == expected);
+	}
+	
+	free((void*)image);
+	return true;
+}
+
+// Start of the mapping of \a path's first byte in \a pid, found the same way an injector would.
+static uintptr_t remote_base(pid_t pid, const char* path)
+{
+	FILE* maps;
+	struct stat st;
+	char maps_path[64], line[1024];
+	uintptr_t result = 0;
+	if(stat(path, &st) != 0)
+		return 0;
+	
+	snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", (int)pid);
+	maps = fopen(maps_path, "r");
+	if(maps == NULL)
+		return 0;
+	
+	while(result == 0 && fgets(line, sizeof(line), maps) != NULL) {
+		unsigned long long start, offset, inode;
+		unsigned int major_id, minor_id;
+		if(sscanf(line, "%llx-%*[0-9a-f] %*s %llx %x:%x %llu", &start, &offset, &major_id, &minor_id, &inode) != 5)
+			continue;
+		if(offset == 0 && (ino_t)inode == st.st_ino && makedev(major_id, minor_id) == st.st_dev)
+			result = (uintptr_t)start;
+	}
+	fclose(maps);
+	return result;
+}
+
+static bool test_remote(const char* path)
+{
+	int ready[2];
+	char byte;
+	pid_t child;
+	bool result = false;
+	uint64_t offset;
+	uintptr_t base;
+	void* handle;
+	unij_elffile_t* elf;
+	unij_remote_t* remote;
+	uint8_t local[CODE_SIZE], code[CODE_SIZE];
+	
+	// Our own copy is only there to compare the code against.
+	handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	CHECK(handle != NULL && dlsym(handle, "mono_init") != NULL);
+	memcpy((void*)local, dlsym(handle, "mono_init"), sizeof(local));
+	
+	CHECK(pipe(ready) == 0);
+	child = fork();
+	CHECK(child >= 0);
+	if(child == 0) {
+		// Loaded after the fork, so it's somewhere else in the child.
+		dlclose(handle);
+		if(dlopen(path, RTLD_NOW) == NULL || write(ready[1], "r", 1) != 1)
+			_exit(1);
+		for(;;)
+			pause();
+	}
+	
+	close(ready[1]);
+	if(read(ready[0], &byte, 1) == 1) {
+		elf = open_path(path);
+		base = remote_base(child, path);
+		remote = unij_remote_open((uint32_t)child);
+		result = elf != NULL && base != 0 && remote != NULL && unij_elffile_symbol(elf, "mono_init", &offset, NULL) &&
+		         unij_remote_read(remote, base + (uintptr_t)offset, (void*)code, sizeof(code)) &&
+		         memcmp((const void*)code, (const void*)local, sizeof(code)) == 0;
+		if(result)
+			wprintf(L"mono_init found at 0x%llx in child %d without touching it.\n",
+			        (unsigned long long)(base + offset), (int)child);
+		unij_remote_close(remote);
+		unij_elffile_close(elf);
+	}
+	
+	close(ready[0]);
+	kill(child, SIGKILL);
+	waitpid(child, NULL, 0);
+	CHECK(result);
+	return true;
+}
+
+int main(void)
+{
+	char mono[PATH_MAX], decoy[PATH_MAX];
+	if(!unij_init()) return 1;
+	
+	if(!library_path(mono, sizeof(mono), MONO_NAME) || !library_path(decoy, sizeof(decoy), DECOY_NAME)) {
+		wprintf(L"Couldn't set up the test!\n");
+		return 1;
+	}
+	
+	return test_libc() && test_library(mono, "mono_init", UNIJ_ELF_HASH_GNU) &&
+	       test_library(decoy, "mono_decoy", UNIJ_ELF_HASH_SYSV) && test_truncated(mono) && test_remote(mono) ? 0 : 1;
+}
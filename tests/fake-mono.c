@@ -0,0 +1,302 @@
+/**
+ * @file fake-mono.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Stand-in for a Mono runtime. Built twice: once as libmonobdwgc-2.0.so, exporting mono_init and everything the
+ * loader binds from mono_api.inl, and once as libmono-decoy.so without any of it, which has the right name but isn't
+ * a runtime.
+ *
+ * The runtime half tracks just enough state to tell a loader that got the calls in the right order apart from one
+ * that didn't. Whatever gets invoked is reported over the file descriptor named by UNIJ_TEST_FD, as
+ * "invoke <assembly> <method descriptor> <attached>\n". Once a host hands it a shared block (see fake-mono.h), every
+ * call gets counted there, opening an assembly sleeps for load_us like reading it from disk would, and invoking
+ * spins for invoke_us like JIT compiling and running it would.
+ */
+#include <stddef.h>
+
+#ifndef FAKE_MONO_DECOY
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake-mono.h"
+
+#define FAKE_EXPORT __attribute__((visibility("default")))
+
+#define FAKE_NAME_MAX 256
+
+typedef void(*vprintf_func)(const char* msg, va_list args);
+
+typedef struct
+{
+	int root;
+} fake_domain_t;
+
+typedef struct
+{
+	fake_domain_t* domain;
+} fake_thread_t;
+
+typedef struct
+{
+	char path[FAKE_NAME_MAX];
+} fake_assembly_t;
+
+typedef struct
+{
+	fake_assembly_t* assembly;
+} fake_image_t;
+
+typedef struct
+{
+	char name[FAKE_NAME_MAX];
+} fake_desc_t;
+
+typedef struct
+{
+	fake_image_t* image;
+	char name[FAKE_NAME_MAX];
+} fake_method_t;
+
+static fake_domain_t root_domain = { 1 };
+
+// Threads attached through mono_thread_attach. The host's own thread never is, same as a real embedder's.
+static __thread fake_thread_t* current_thread = NULL;
+
+static vprintf_func printer = NULL;
+
+// Calls get counted here until fake_mono_setup.
+static fake_mono_shared_t local_shared;
+static fake_mono_shared_t* shared = &local_shared;
+
+#define FAKE_CALL(NAME) \
+	__atomic_fetch_add(&shared->calls[FAKE_CALL_##NAME], 1, __ATOMIC_RELAXED)
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void spin_us(uint32_t us)
+{
+	uint64_t until = now_ns() + (uint64_t)us * 1000;
+	while(now_ns() < until)
+		;
+}
+
+static void sleep_us(uint32_t us)
+{
+	struct timespec ts;
+	ts.tv_sec = (time_t)(us / 1000000);
+	ts.tv_nsec = (long)(us % 1000000) * 1000;
+	while(us != 0 && nanosleep(&ts, &ts) != 0)
+		;
+}
+
+static void report(const char* format, ...)
+{
+	int length;
+	char line[FAKE_NAME_MAX * 3];
+	va_list args;
+	const char* fd = getenv("UNIJ_TEST_FD");
+	if(fd == NULL)
+		return;
+	
+	va_start(args, format);
+	length = vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	if(length <= 0 || (size_t)length >= sizeof(line))
+		return;
+	if(write(atoi(fd), line, (size_t)length) != (ssize_t)length)
+		perror("fake-mono: write");
+}
+
+FAKE_EXPORT void* mono_init(const char* domain_name)
+{
+	FAKE_CALL(mono_init);
+	(void)domain_name;
+	return (void*)&root_domain;
+}
+
+FAKE_EXPORT void mono_unity_set_vprintf_func(vprintf_func func)
+{
+	FAKE_CALL(mono_unity_set_vprintf_func);
+	printer = func;
+}
+
+// What older runtimes call it.
+FAKE_EXPORT void set_vprintf_func(vprintf_func func)
+{
+	FAKE_CALL(set_vprintf_func);
+	printer = func;
+}
+
+FAKE_EXPORT void mono_trace_set_level_string(const char* level)
+{
+	FAKE_CALL(mono_trace_set_level_string);
+	(void)level;
+}
+
+FAKE_EXPORT void mono_trace_set_mask_string(const char* mask)
+{
+	FAKE_CALL(mono_trace_set_mask_string);
+	(void)mask;
+}
+
+FAKE_EXPORT void mono_set_commandline_arguments(int argc, const char* argv[], const char* baseline)
+{
+	FAKE_CALL(mono_set_commandline_arguments);
+	(void)argc;
+	(void)argv;
+	(void)baseline;
+}
+
+FAKE_EXPORT void mono_jit_parse_options(int argc, char* argv[])
+{
+	FAKE_CALL(mono_jit_parse_options);
+	(void)argc;
+	(void)argv;
+}
+
+FAKE_EXPORT void mono_debug_init(int format)
+{
+	FAKE_CALL(mono_debug_init);
+	(void)format;
+}
+
+FAKE_EXPORT void* mono_get_root_domain(void)
+{
+	FAKE_CALL(mono_get_root_domain);
+	return (void*)&root_domain;
+}
+
+FAKE_EXPORT void* mono_thread_attach(void* domain)
+{
+	FAKE_CALL(mono_thread_attach);
+	if(domain != (void*)&root_domain)
+		return NULL;
+	if(current_thread == NULL) {
+		current_thread = (fake_thread_t*)calloc(1, sizeof(fake_thread_t));
+		if(current_thread != NULL)
+			current_thread->domain = &root_domain;
+	}
+	return (void*)current_thread;
+}
+
+FAKE_EXPORT void* mono_thread_current(void)
+{
+	FAKE_CALL(mono_thread_current);
+	return (void*)current_thread;
+}
+
+FAKE_EXPORT void mono_thread_detach(void* thread)
+{
+	FAKE_CALL(mono_thread_detach);
+	if(thread != NULL && thread == (void*)current_thread) {
+		free(current_thread);
+		current_thread = NULL;
+	}
+}
+
+FAKE_EXPORT void* mono_domain_assembly_open(void* domain, const char* path)
+{
+	fake_assembly_t* assembly;
+	FAKE_CALL(mono_domain_assembly_open);
+	if(domain != (void*)&root_domain || path == NULL || strlen(path) >= FAKE_NAME_MAX)
+		return NULL;
+	
+	// Never freed, like a real runtime's assemblies.
+	sleep_us(shared->load_us);
+	assembly = (fake_assembly_t*)calloc(1, sizeof(fake_assembly_t));
+	if(assembly != NULL)
+		strcpy(assembly->path, path);
+	return (void*)assembly;
+}
+
+FAKE_EXPORT void* mono_assembly_get_image(void* assembly)
+{
+	fake_image_t* image;
+	FAKE_CALL(mono_assembly_get_image);
+	if(assembly == NULL)
+		return NULL;
+	
+	image = (fake_image_t*)calloc(1, sizeof(fake_image_t));
+	if(image != NULL)
+		image->assembly = (fake_assembly_t*)assembly;
+	return (void*)image;
+}
+
+FAKE_EXPORT void* mono_method_desc_new(const char* name, int include_namespace)
+{
+	fake_desc_t* desc;
+	FAKE_CALL(mono_method_desc_new);
+	(void)include_namespace;
+	if(name == NULL || strlen(name) >= FAKE_NAME_MAX || strchr(name, ':') == NULL)
+		return NULL;
+	
+	desc = (fake_desc_t*)calloc(1, sizeof(fake_desc_t));
+	if(desc != NULL)
+		strcpy(desc->name, name);
+	return (void*)desc;
+}
+
+FAKE_EXPORT void* mono_method_desc_search_in_image(void* desc, void* image)
+{
+	fake_method_t* method;
+	FAKE_CALL(mono_method_desc_search_in_image);
+	if(desc == NULL || image == NULL)
+		return NULL;
+	
+	method = (fake_method_t*)calloc(1, sizeof(fake_method_t));
+	if(method != NULL) {
+		method->image = (fake_image_t*)image;
+		strcpy(method->name, ((fake_desc_t*)desc)->name);
+	}
+	return (void*)method;
+}
+
+FAKE_EXPORT void mono_method_desc_free(void* desc)
+{
+	FAKE_CALL(mono_method_desc_free);
+	free(desc);
+}
+
+FAKE_EXPORT void* mono_runtime_invoke(void* method, void* obj, void** params, void** exc)
+{
+	FAKE_CALL(mono_runtime_invoke);
+	fake_method_t* invoked = (fake_method_t*)method;
+	(void)obj;
+	(void)params;
+	if(exc != NULL)
+		*exc = NULL;
+	if(invoked == NULL)
+		return NULL;
+	
+	spin_us(shared->invoke_us);
+	report("invoke %s %s %d\n", invoked->image->assembly->path, invoked->name, current_thread != NULL ? 1 : 0);
+	return NULL;
+}
+
+FAKE_EXPORT void fake_mono_setup(fake_mono_shared_t* setup)
+{
+	size_t i;
+	for(i = 0; i < FAKE_CALLS; i++)
+		setup->calls[i] += local_shared.calls[i];
+	shared = setup;
+}
+
+#else
+
+__attribute__((visibility("default")))
+int mono_decoy(void)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * @file fake-mono.h
+ * @author Charles Grunwald <ch@rles.rocks>
+ * @brief What the stand-in runtime (fake-mono.c), its host (mono-host.c) and inject-bench share.
+ *
+ * The bench creates the shared block and hands it to the host, which hands it to the runtime. From then on, the
+ * runtime counts every call into it and takes its simulated costs from it, and the host stamps the end of every frame
+ * into it, so the bench can tell how long a frame was held up while it was injecting.
+ */
+#ifndef _FAKE_MONO_H_
+#define _FAKE_MONO_H_
+#pragma once
+
+#include <stdint.h>
+
+// Only for the runtime's own control export. Everything else comes from mono_api.inl.
+#define FAKE_MONO_SETUP "fake_mono_setup"
+
+// Frames kept in the ring. At 1ms frames, that's about 4 seconds.
+#define FAKE_MONO_FRAMES 4096
+
+// Every export of the stand-in: everything the loader binds, plus the two it only looks for.
+enum fake_mono_call
+{
+	FAKE_CALL_mono_init = 0,
+	FAKE_CALL_mono_unity_set_vprintf_func,
+	FAKE_CALL_set_vprintf_func,
+#	define MONO_API(RET, NAME, ...) \
+	FAKE_CALL_##NAME,
+#	include "../src/dll/mono_api.inl"
+	FAKE_CALLS
+};
+
+typedef enum fake_mono_call fake_mono_call_t;
+
+typedef struct fake_mono_shared fake_mono_shared_t;
+
+struct fake_mono_shared
+{
+	// Set by the bench before starting the host.
+	uint32_t frame_us;
+	uint32_t load_us;
+	uint32_t invoke_us;
+	
+	// Set by the host once its runtime is up and its frame loop is about to start.
+	uint32_t ready;
+	
+	uint32_t calls[FAKE_CALLS];
+	
+	// Frames finished so far. Frame N ended at frame_end_ns[N % FAKE_MONO_FRAMES]. (CLOCK_MONOTONIC)
+	uint64_t frames;
+	uint64_t frame_end_ns[FAKE_MONO_FRAMES];
+};
+
+/**
+ * @brief Points the runtime at the shared block. Until then, calls are counted locally and nothing costs anything.
+ */
+typedef void(*fake_mono_setup_fn)(fake_mono_shared_t* shared);
+
+// Names of every export, in fake_mono_call order.
+static const char* const fake_mono_names[FAKE_CALLS] = {
+	"mono_init",
+	"mono_unity_set_vprintf_func",
+	"set_vprintf_func",
+#	define MONO_API(RET, NAME, ...) \
+	#NAME,
+#	include "../src/dll/mono_api.inl"
+};
+
+#endif /* _FAKE_MONO_H_ */
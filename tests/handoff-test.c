@@ -0,0 +1,391 @@
+/**
+ * @file handoff-test.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Stress test for the per-injection object names. A bunch of injectors (threads on Windows, forked processes
+ * elsewhere) all target this process at the same time. Each one names its object after a fresh nonce, creates it
+ * exclusively, writes a payload into it and sends the handoff block back over a pipe. This process plays the loader:
+ * it only gets the handoff, derives the name from it and checks that the object holds the payload it expects.
+ *
+ * Usage: handoff-test [injector count] [injections per injector]
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/handoff.h>
+#include <uniject/platform.h>
+#include <uniject/utility.h>
+
+#ifdef _WIN32
+#	include <uniject/win32.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/wait.h>
+#endif
+
+#define DEFAULT_INJECTORS 8
+#define DEFAULT_INJECTIONS 2000
+#define MAX_INJECTORS 64
+#define MAX_ATTEMPTS 4
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%s] %s\n", unij_level_name(level)->value, message);
+}
+
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Exiting process with code: 0x%08X\n", (unsigned int)win32_error);
+	exit((int)code);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %s\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+// What each injection leaves in its object for the loader to find.
+typedef struct
+{
+	unij_handoff_t handoff;
+	uint32_t injector;
+	uint32_t sequence;
+} payload_t;
+
+// What goes over the pipe. The object handle only means something on Windows, where everything is one process.
+typedef struct
+{
+	unij_handoff_t handoff;
+	uint64_t object;
+} message_t;
+
+typedef struct
+{
+	uint32_t injector;
+	uint32_t count;
+	uint32_t target;
+	bool result;
+#ifdef _WIN32
+	HANDLE pipe;
+#else
+	int pipe;
+#endif
+} injector_args_t;
+
+static bool payload_matches(const payload_t* payload, const unij_handoff_t* handoff)
+{
+	return payload->handoff.nonce == handoff->nonce && payload->handoff.pid == handoff->pid &&
+	       payload->injector < MAX_INJECTORS;
+}
+
+#ifdef _WIN32
+
+static HANDLE create_object(const unij_handoff_t* handoff, const payload_t* payload, bool* ptaken)
+{
+	void* view;
+	HANDLE mapping;
+	const wchar_t* name = unij_object_name(L"params", UNIJ_OBJECT_MAPPING, handoff->pid, handoff->nonce);
+	if(name == NULL)
+		return NULL;
+	
+	mapping = unij_create_mmap(name, sizeof(*payload));
+	*ptaken = IS_VALID_HANDLE(mapping) && GetLastError() == ERROR_ALREADY_EXISTS;
+	unij_free((void*)name);
+	if(IS_INVALID_HANDLE(mapping) || *ptaken) {
+		if(IS_VALID_HANDLE(mapping))
+			CloseHandle(mapping);
+		return NULL;
+	}
+	
+	view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(*payload));
+	if(view == NULL) {
+		CloseHandle(mapping);
+		return NULL;
+	}
+	RtlCopyMemory(view, (const void*)payload, sizeof(*payload));
+	UnmapViewOfFile(view);
+	return mapping;
+}
+
+static bool open_object(const message_t* message, payload_t* payload)
+{
+	void* view;
+	HANDLE mapping;
+	const wchar_t* name = unij_object_name(L"params", UNIJ_OBJECT_MAPPING, message->handoff.pid, message->handoff.nonce);
+	if(name == NULL)
+		return false;
+	
+	mapping = unij_open_mmap(name, true);
+	unij_free((void*)name);
+	CloseHandle((HANDLE)(uintptr_t)message->object);
+	if(IS_INVALID_HANDLE(mapping))
+		return false;
+	
+	view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(*payload));
+	if(view != NULL) {
+		RtlCopyMemory((void*)payload, (const void*)view, sizeof(*payload));
+		UnmapViewOfFile(view);
+	}
+	CloseHandle(mapping);
+	return view != NULL;
+}
+
+static bool send_message(injector_args_t* args, const message_t* message)
+{
+	DWORD written = 0;
+	return WriteFile(args->pipe, (const void*)message, sizeof(*message), &written, NULL) && written == sizeof(*message);
+}
+
+#else
+
+// The same name unij_object_name gives the mapping, narrowed for shm_open the way the library does it.
+static bool object_name(char* buffer, size_t size, uint32_t pid, uint32_t nonce)
+{
+	size_t length;
+	const wchar_t* name = unij_object_name(L"params", UNIJ_OBJECT_MAPPING, pid, nonce);
+	if(name == NULL)
+		return false;
+	
+	length = unij_wcstoutf8(buffer, size - 1, name, unij_wcslen(name));
+	unij_free((void*)name);
+	buffer[length] = '\0';
+	return length != 0;
+}
+
+static uint64_t create_object(const unij_handoff_t* handoff, const payload_t* payload, bool* ptaken)
+{
+	int fd;
+	ssize_t written;
+	char name[64];
+	if(!object_name(name, sizeof(name), handoff->pid, handoff->nonce))
+		return 0;
+	
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	*ptaken = fd < 0 && errno == EEXIST;
+	if(fd < 0)
+		return 0;
+	
+	written = write(fd, (const void*)payload, sizeof(*payload));
+	close(fd);
+	return written == (ssize_t)sizeof(*payload) ? 1 : 0;
+}
+
+static bool open_object(const message_t* message, payload_t* payload)
+{
+	int fd;
+	ssize_t count;
+	char name[64];
+	if(!object_name(name, sizeof(name), message->handoff.pid, message->handoff.nonce))
+		return false;
+	
+	fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0)
+		return false;
+	
+	count = read(fd, (void*)payload, sizeof(*payload));
+	close(fd);
+	shm_unlink(name);
+	return count == (ssize_t)sizeof(*payload);
+}
+
+static bool send_message(injector_args_t* args, const message_t* message)
+{
+	// Messages are well under PIPE_BUF, so writes from different injectors never interleave.
+	return write(args->pipe, (const void*)message, sizeof(*message)) == (ssize_t)sizeof(*message);
+}
+
+#endif
+
+static bool run_injector(injector_args_t* args)
+{
+	uint32_t sequence;
+	int attempt;
+	bool taken;
+	payload_t payload;
+	message_t message;
+	
+	for(sequence = 0; sequence < args->count; sequence++) {
+		RtlZeroMemory((void*)&message, sizeof(message));
+		unij_handoff_init(&message.handoff, args->target);
+		
+		// Same as the IPC writer: a taken name just means another injector rolled the same nonce.
+		for(attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+			payload.handoff = message.handoff;
+			payload.injector = args->injector;
+			payload.sequence = sequence;
+			taken = false;
+			message.object = (uint64_t)(uintptr_t)create_object(&message.handoff, &payload, &taken);
+			if(message.object != 0 || !taken)
+				break;
+			message.handoff.nonce = unij_object_nonce();
+		}
+		
+		if(message.object == 0) {
+			wprintf(L"Injector %u couldn't create an object for injection %u!\n", args->injector, sequence);
+			return false;
+		} else if(!send_message(args, &message)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The loader's side: everything it knows about an injection comes from the handoff.
+static bool receive_injection(const message_t* message, uint32_t* sequences)
+{
+	payload_t payload;
+	CHECK(unij_handoff_valid(&message->handoff));
+	CHECK(open_object(message, &payload));
+	CHECK(payload_matches(&payload, &message->handoff));
+	
+	// Injections from the same injector have to show up in order, once each.
+	CHECK(payload.sequence == sequences[payload.injector]);
+	sequences[payload.injector]++;
+	return true;
+}
+
+static bool test_nonces(void)
+{
+	uint32_t i, j, nonces[0x1000];
+	unij_handoff_t handoff;
+	for(i = 0; i < ARRAYLEN(nonces); i++) {
+		nonces[i] = unij_object_nonce();
+		CHECK(nonces[i] != 0);
+		for(j = 0; j < i; j++)
+			CHECK(nonces[i] != nonces[j]);
+	}
+	
+	unij_handoff_init(&handoff, 1234);
+	CHECK(unij_handoff_valid(&handoff) && handoff.pid == 1234 && handoff.nonce != 0);
+	handoff.magic = 0;
+	CHECK(!unij_handoff_valid(&handoff));
+	return true;
+}
+
+#ifdef _WIN32
+
+static DWORD WINAPI injector_thread(LPVOID parameter)
+{
+	injector_args_t* args = (injector_args_t*)parameter;
+	args->result = run_injector(args);
+	return 0;
+}
+
+static bool test_injections(injector_args_t* injectors, uint32_t count, uint32_t* sequences)
+{
+	uint32_t i, received = 0, total = 0;
+	bool result = true;
+	HANDLE read_pipe, write_pipe, threads[MAX_INJECTORS];
+	message_t message;
+	DWORD bytes;
+	CHECK(CreatePipe(&read_pipe, &write_pipe, NULL, 0));
+	
+	for(i = 0; i < count; i++) {
+		injectors[i].pipe = write_pipe;
+		total += injectors[i].count;
+		threads[i] = CreateThread(NULL, 0, injector_thread, (LPVOID)&injectors[i], 0, NULL);
+		CHECK(threads[i] != NULL);
+	}
+	
+	while(result && received < total && ReadFile(read_pipe, (void*)&message, sizeof(message), &bytes, NULL)) {
+		result = bytes == sizeof(message) && receive_injection(&message, sequences);
+		received++;
+	}
+	
+	WaitForMultipleObjects((DWORD)count, threads, TRUE, INFINITE);
+	for(i = 0; i < count; i++) {
+		CloseHandle(threads[i]);
+		result = result && injectors[i].result;
+	}
+	CloseHandle(read_pipe);
+	CloseHandle(write_pipe);
+	return result && received == total;
+}
+
+#else
+
+static bool test_injections(injector_args_t* injectors, uint32_t count, uint32_t* sequences)
+{
+	int fds[2], status;
+	uint32_t i, received = 0, total = 0;
+	bool result = true;
+	pid_t children[MAX_INJECTORS];
+	message_t message;
+	CHECK(pipe(fds) == 0);
+	
+	for(i = 0; i < count; i++) {
+		injectors[i].pipe = fds[1];
+		total += injectors[i].count;
+		children[i] = fork();
+		CHECK(children[i] >= 0);
+		if(children[i] == 0) {
+			close(fds[0]);
+			_exit(run_injector(&injectors[i]) ? 0 : 1);
+		}
+	}
+	close(fds[1]);
+	
+	while(result && read(fds[0], (void*)&message, sizeof(message)) == (ssize_t)sizeof(message)) {
+		result = receive_injection(&message, sequences);
+		received++;
+	}
+	close(fds[0]);
+	
+	for(i = 0; i < count; i++) {
+		CHECK(waitpid(children[i], &status, 0) == children[i]);
+		result = result && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+	return result && received == total;
+}
+
+#endif
+
+int main(int argc, char* argv[])
+{
+	uint32_t i, count = DEFAULT_INJECTORS, injections = DEFAULT_INJECTIONS;
+	static injector_args_t injectors[MAX_INJECTORS];
+	static uint32_t sequences[MAX_INJECTORS];
+	
+	if(argc > 1)
+		count = (uint32_t)strtoul(argv[1], NULL, 10);
+	if(argc > 2)
+		injections = (uint32_t)strtoul(argv[2], NULL, 10);
+	if(count == 0 || count > MAX_INJECTORS)
+		count = DEFAULT_INJECTORS;
+	
+	if(!unij_init()) return 1;
+	
+	if(!test_nonces()) {
+		wprintf(L"Nonce checks failed!\n");
+		return 1;
+	}
+	wprintf(L"Nonce checks passed.\n");
+	
+	for(i = 0; i < count; i++) {
+		injectors[i].injector = i;
+		injectors[i].count = injections;
+#ifdef _WIN32
+		injectors[i].target = (uint32_t)GetCurrentProcessId();
+#else
+		injectors[i].target = (uint32_t)getpid();
+#endif
+	}
+	
+	if(!test_injections(injectors, count, sequences)) {
+		wprintf(L"Concurrent injections failed!\n");
+		return 1;
+	}
+	
+	for(i = 0; i < count; i++) {
+		if(sequences[i] != injections) {
+			wprintf(L"Injector %u only delivered %u of %u injections!\n", i, sequences[i], injections);
+			return 1;
+		}
+	}
+	
+	wprintf(L"%u injectors handed off %u injections each.\n", count, injections);
+	return 0;
+}
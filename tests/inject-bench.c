@@ -0,0 +1,285 @@
+/**
+ * @file inject-bench.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * End-to-end injection latency, against mono-host and the stand-in runtime instead of a game. Every injection goes
+ * through the public API the way a tool would use it, and is timed in three steps: opening the process (which finds
+ * the runtime), unij_inject returning (the loader is loaded and has read its params) and the stand-in reporting the
+ * invoke (the loader has done everything). The host's frame stamps from the same window give the longest frame the
+ * injection caused, against the frame time it's supposed to keep.
+ *
+ * Usage: inject-bench <loader .so> [injections] [frame us] [load us] [invoke us]
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "fake-mono.h"
+
+#define DEFAULT_INJECTIONS 20
+#define DEFAULT_FRAME_US 1000
+#define DEFAULT_LOAD_US 2000
+#define DEFAULT_INVOKE_US 1000
+
+#define TEST_ASSEMBLY L"/opt/game/Managed/FakeAssembly.dll"
+#define TEST_CLASS L"Fake.Entry"
+#define TEST_METHOD L"Start"
+
+// How long the loader gets to report back, in milliseconds.
+#define REPORT_TIMEOUT 5000
+
+// Frames to let pass after each injection, so the one it held up has certainly ended.
+#define SETTLE_FRAMES 4
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	// Only errors, so the injector's info messages don't end up in the timings.
+	if(level != UNIJ_LEVEL_INFO)
+		wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Fatal error 0x%08X (system error 0x%08X)\n", (unsigned int)code, (unsigned int)win32_error);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %ls\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+typedef struct
+{
+	pid_t pid;
+	int reports;
+	fake_mono_shared_t* shared;
+} host_t;
+
+// Min/avg/max of one step, in microseconds.
+typedef struct
+{
+	double min;
+	double max;
+	double total;
+} stat_t;
+
+typedef struct
+{
+	stat_t open;
+	stat_t inject;
+	stat_t complete;
+	stat_t frame;
+	size_t count;
+} results_t;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void stat_add(stat_t* stat, size_t count, double value)
+{
+	if(count == 0 || value < stat->min)
+		stat->min = value;
+	if(count == 0 || value > stat->max)
+		stat->max = value;
+	stat->total += value;
+}
+
+static void stat_print(const wchar_t* name, const stat_t* stat, size_t count)
+{
+	wprintf(L"  %-10ls %10.1f %10.1f %10.1f\n", name, stat->min, stat->total / (double)count, stat->max);
+}
+
+static bool sibling_path(char* buffer, size_t size, const char* name)
+{
+	char* slash;
+	ssize_t length = readlink("/proc/self/exe", buffer, size - 1);
+	if(length <= 0)
+		return false;
+	
+	buffer[length] = '\0';
+	slash = strrchr(buffer, '/');
+	if(slash == NULL || (size_t)(slash - buffer) + strlen(name) + 2 > size)
+		return false;
+	
+	strcpy(slash + 1, name);
+	return true;
+}
+
+static bool start_host(host_t* host, uint32_t frame_us, uint32_t load_us, uint32_t invoke_us)
+{
+	int shared_fd, reports[2];
+	char path[PATH_MAX], fd[16];
+	CHECK(sibling_path(path, sizeof(path), "mono-host"));
+	CHECK((shared_fd = memfd_create("inject-bench", 0)) >= 0);
+	CHECK(ftruncate(shared_fd, (off_t)sizeof(fake_mono_shared_t)) == 0);
+	host->shared = (fake_mono_shared_t*)mmap(NULL, sizeof(fake_mono_shared_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+	                                          shared_fd, 0);
+	CHECK(host->shared != MAP_FAILED);
+	host->shared->frame_us = frame_us;
+	host->shared->load_us = load_us;
+	host->shared->invoke_us = invoke_us;
+	
+	// The stand-in finds its end of the pipe through the environment, which the host inherits.
+	CHECK(pipe(reports) == 0);
+	snprintf(fd, sizeof(fd), "%d", reports[1]);
+	setenv("UNIJ_TEST_FD", fd, 1);
+	
+	host->pid = fork();
+	if(host->pid == 0) {
+		close(reports[0]);
+		snprintf(fd, sizeof(fd), "%d", shared_fd);
+		execl(path, "mono-host", fd, (char*)NULL);
+		_exit(127);
+	}
+	close(reports[1]);
+	close(shared_fd);
+	host->reports = reports[0];
+	CHECK(host->pid > 0);
+	
+	while(__atomic_load_n(&host->shared->ready, __ATOMIC_ACQUIRE) == 0) {
+		CHECK(waitpid(host->pid, NULL, WNOHANG) == 0);
+		usleep(1000);
+	}
+	return true;
+}
+
+static void stop_host(host_t* host)
+{
+	kill(host->pid, SIGKILL);
+	waitpid(host->pid, NULL, 0);
+	close(host->reports);
+}
+
+static bool wait_report(host_t* host)
+{
+	char c;
+	struct pollfd pfd = { host->reports, POLLIN, 0 };
+	do {
+		CHECK(poll(&pfd, 1, REPORT_TIMEOUT) == 1);
+		CHECK(read(host->reports, (void*)&c, 1) == 1);
+	} while(c != '\n');
+	return true;
+}
+
+// Longest frame that ended after \a start, up to the last one finished.
+static uint64_t longest_frame(const fake_mono_shared_t* shared, uint64_t start)
+{
+	uint64_t frame, end, interval, longest = 0;
+	uint64_t frames = __atomic_load_n(&shared->frames, __ATOMIC_ACQUIRE);
+	uint64_t first = frames > FAKE_MONO_FRAMES ? frames - FAKE_MONO_FRAMES + 1 : 1;
+	for(frame = first; frame < frames; frame++) {
+		end = shared->frame_end_ns[frame % FAKE_MONO_FRAMES];
+		if(end < start)
+			continue;
+		interval = end - shared->frame_end_ns[(frame - 1) % FAKE_MONO_FRAMES];
+		if(interval > longest)
+			longest = interval;
+	}
+	return longest;
+}
+
+static bool inject_once(host_t* host, unij_wstr_t* loader, results_t* results)
+{
+	uniject_t* ctx;
+	uint64_t start, opened, injected, completed, frames;
+	unij_wstr_t assembly = { ARRAYLEN(TEST_ASSEMBLY) - 1, TEST_ASSEMBLY };
+	unij_wstr_t cls = { ARRAYLEN(TEST_CLASS) - 1, TEST_CLASS };
+	unij_wstr_t method = { ARRAYLEN(TEST_METHOD) - 1, TEST_METHOD };
+	
+	start = now_ns();
+	ctx = unij_injector_open((uint32_t)host->pid);
+	CHECK(ctx != NULL);
+	opened = now_ns();
+	
+	unij_set_loader_path(ctx, loader);
+	unij_set_assembly_path(ctx, &assembly);
+	unij_set_class_name(ctx, &cls);
+	unij_set_method_name(ctx, &method);
+	if(!unij_inject(ctx)) {
+		unij_close(ctx);
+		CHECK(!"unij_inject failed");
+	}
+	injected = now_ns();
+	unij_close(ctx);
+	
+	CHECK(wait_report(host));
+	completed = now_ns();
+	
+	frames = __atomic_load_n(&host->shared->frames, __ATOMIC_ACQUIRE);
+	while(__atomic_load_n(&host->shared->frames, __ATOMIC_ACQUIRE) < frames + SETTLE_FRAMES)
+		usleep(host->shared->frame_us);
+	
+	stat_add(&results->open, results->count, (double)(opened - start) / 1e3);
+	stat_add(&results->inject, results->count, (double)(injected - opened) / 1e3);
+	stat_add(&results->complete, results->count, (double)(completed - start) / 1e3);
+	stat_add(&results->frame, results->count, (double)longest_frame(host->shared, start) / 1e3);
+	results->count++;
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t i, injections = DEFAULT_INJECTIONS;
+	uint32_t frame_us = DEFAULT_FRAME_US, load_us = DEFAULT_LOAD_US, invoke_us = DEFAULT_INVOKE_US;
+	bool result = true;
+	host_t host;
+	results_t results;
+	wchar_t wloader[PATH_MAX];
+	unij_wstr_t loader = { 0, wloader };
+	if(argc < 2 || argv[1][0] != '/' || mbstowcs(wloader, argv[1], ARRAYLEN(wloader)) >= ARRAYLEN(wloader)) {
+		wprintf(L"Usage: inject-bench <absolute path to the loader> [injections] [frame us] [load us] [invoke us]\n");
+		return 1;
+	}
+	loader.length = (uint16_t)wcslen(wloader);
+	if(argc > 2)
+		injections = (size_t)strtoull(argv[2], NULL, 10);
+	if(argc > 3)
+		frame_us = (uint32_t)strtoul(argv[3], NULL, 10);
+	if(argc > 4)
+		load_us = (uint32_t)strtoul(argv[4], NULL, 10);
+	if(argc > 5)
+		invoke_us = (uint32_t)strtoul(argv[5], NULL, 10);
+	if(injections == 0)
+		injections = 1;
+	if(frame_us == 0)
+		frame_us = DEFAULT_FRAME_US;
+	
+	if(!unij_init() || !start_host(&host, frame_us, load_us, invoke_us)) {
+		wprintf(L"Couldn't start mono-host!\n");
+		return 1;
+	}
+	
+	RtlZeroMemory((void*)&results, sizeof(results));
+	for(i = 0; result && i < injections; i++)
+		result = inject_once(&host, &loader, &results);
+	
+	if(results.count != 0) {
+		wprintf(L"%zu injections, %uus frames, %uus load, %uus invoke (all in us):\n", results.count, frame_us,
+		        load_us, invoke_us);
+		wprintf(L"  %-10ls %10ls %10ls %10ls\n", L"", L"min", L"avg", L"max");
+		stat_print(L"open", &results.open, results.count);
+		stat_print(L"inject", &results.inject, results.count);
+		stat_print(L"complete", &results.complete, results.count);
+		stat_print(L"frame", &results.frame, results.count);
+		
+		wprintf(L"Calls into the runtime:\n");
+		for(i = 0; i < FAKE_CALLS; i++) {
+			if(host.shared->calls[i] != 0)
+				wprintf(L"  %-36hs %u\n", fake_mono_names[i], host.shared->calls[i]);
+		}
+	}
+	
+	stop_host(&host);
+	return result ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+/**
+ * @file ipc-test.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Packing round trips over real shared memory. This process plays the injector: it forks a child to play the loader,
+ * packs a payload for it and sends over nothing but the handoff block. The child opens the mapping from the block and
+ * checks what it unpacks, in both layouts, through an unnamed mapping it has to pull out of this process, and through a
+ * named one. Named mappings have to be gone once both sides close them.
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/handoff.h>
+#include <uniject/ipc.h>
+#include <uniject/packing.h>
+#include <uniject/platform.h>
+#include <uniject/utility.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define TEST_KEY L"ipc-test"
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+// Some of the checks below fail on purpose, so fatal errors only get reported and the failing call returns.
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Fatal error 0x%08X (system error 0x%08X)\n", (unsigned int)code, (unsigned int)win32_error);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %ls\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+typedef struct
+{
+	bool bool_field;
+	uint16_t u16_field;
+	uint32_t u32_field;
+	uint64_t u64_field;
+	unij_wstr_t mono;
+	unij_wstr_t assembly;
+	unij_wstr_t method;
+} payload_t;
+
+// What goes over the pipe to the child. The handoff is all it gets to find the mapping with.
+typedef struct
+{
+	unij_handoff_t handoff;
+	bool named;
+} request_t;
+
+#define TEST_WSTR(TEXT) { ARRAYLEN(TEXT) - 1, TEXT }
+
+static const payload_t expected = {
+	true,
+	300,
+	0xDEADBEEF,
+	343597383680ULL,
+	TEST_WSTR(L"libmonobdwgc-2.0.so"),
+	TEST_WSTR(L"FakeAssembly.dll"),
+	TEST_WSTR(L"LetsGetItStarted")
+};
+
+static UNIJ_NOINLINE bool CDECL pack_payload(unij_packer_t* P, const payload_t* data)
+{
+	return unij_pack_val(P, data->bool_field) && unij_pack_val(P, data->u16_field) &&
+	       unij_pack_val(P, data->u32_field) && unij_pack_val(P, data->u64_field) &&
+	       unij_pack_wstr(P, &data->mono) && unij_pack_wstr(P, &data->assembly) && unij_pack_wstr(P, &data->method);
+}
+
+static UNIJ_NOINLINE bool CDECL unpack_payload(unij_unpacker_t* U, payload_t* dest)
+{
+	return unij_unpack_val(U, &dest->bool_field) && unij_unpack_val(U, &dest->u16_field) &&
+	       unij_unpack_val(U, &dest->u32_field) && unij_unpack_val(U, &dest->u64_field) &&
+	       unij_unpack_wstr(U, &dest->mono) && unij_unpack_wstr(U, &dest->assembly) &&
+	       unij_unpack_wstr(U, &dest->method);
+}
+
+static bool wstr_matches(const unij_wstr_t* a, const unij_wstr_t* b)
+{
+	return a->length == b->length && memcmp(a->value, b->value, WSIZE(a->length)) == 0;
+}
+
+static bool payload_matches(const payload_t* payload)
+{
+	CHECK(payload->bool_field == expected.bool_field);
+	CHECK(payload->u16_field == expected.u16_field);
+	CHECK(payload->u32_field == expected.u32_field);
+	CHECK(payload->u64_field == expected.u64_field);
+	CHECK(wstr_matches(&payload->mono, &expected.mono));
+	CHECK(wstr_matches(&payload->assembly, &expected.assembly));
+	CHECK(wstr_matches(&payload->method, &expected.method));
+	return true;
+}
+
+/**
+ * @internal
+ * Loader side
+ */
+
+static bool receive_payload(const request_t* request)
+{
+	bool result;
+	payload_t payload;
+	unij_ipc_t* ipc;
+	
+	RtlZeroMemory((void*)&payload, sizeof(payload));
+	ipc = request->named ? unij_ipc_reader_open(TEST_KEY) : unij_ipc_handoff_reader_open(&request->handoff, TEST_KEY);
+	CHECK(ipc != NULL);
+	
+	// Indexed buffers read front to back all the same, so the layout only matters to the writer.
+	unij_ipc_set_unpack_fn(ipc, (unij_unpack_fn)unpack_payload);
+	result = unij_ipc_unpack(ipc, (void*)&payload) && payload_matches(&payload);
+	unij_ipc_close(ipc);
+	return result;
+}
+
+static int run_loader(int requests, int results)
+{
+	request_t request;
+	uint8_t result;
+	while(read(requests, (void*)&request, sizeof(request)) == (ssize_t)sizeof(request)) {
+		result = receive_payload(&request) ? 1 : 0;
+		if(write(results, (const void*)&result, sizeof(result)) != (ssize_t)sizeof(result))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @internal
+ * Injector side
+ */
+
+typedef struct
+{
+	pid_t pid;
+	int requests;
+	int results;
+} loader_t;
+
+static bool start_loader(loader_t* loader)
+{
+	int requests[2], results[2];
+	if(pipe(requests) != 0 || pipe(results) != 0)
+		return false;
+	
+	loader->pid = fork();
+	if(loader->pid == 0) {
+		close(requests[1]);
+		close(results[0]);
+		_exit(run_loader(requests[0], results[1]));
+	}
+	
+	close(requests[0]);
+	close(results[1]);
+	loader->requests = requests[1];
+	loader->results = results[0];
+	return loader->pid > 0;
+}
+
+static bool stop_loader(loader_t* loader)
+{
+	int status = 0;
+	close(loader->requests);
+	close(loader->results);
+	return waitpid(loader->pid, &status, 0) == loader->pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool shm_exists(uint32_t pid)
+{
+	char path[96];
+	int length;
+	const wchar_t* name = unij_object_name(TEST_KEY, UNIJ_OBJECT_MAPPING, pid, 0);
+	if(name == NULL)
+		return false;
+	
+	// POSIX shared memory objects live under /dev/shm.
+	length = snprintf(path, sizeof(path), "/dev/shm%ls", name);
+	unij_free((void*)name);
+	return length > 0 && (size_t)length < sizeof(path) && access(path, F_OK) == 0;
+}
+
+static bool test_round_trip(loader_t* loader, unij_layout_t layout, bool named)
+{
+	uint8_t result = 0;
+	request_t request;
+	unij_ipc_t* ipc;
+	
+	RtlZeroMemory((void*)&request, sizeof(request));
+	request.named = named;
+	unij_handoff_init(&request.handoff, (uint32_t)loader->pid);
+	
+	ipc = named ? unij_ipc_writer_open((uint32_t)loader->pid, TEST_KEY) :
+	              unij_ipc_handoff_writer_open(&request.handoff, TEST_KEY);
+	CHECK(ipc != NULL);
+	unij_ipc_set_pack_fn(ipc, (unij_pack_fn)pack_payload);
+	unij_ipc_set_layout(ipc, layout);
+	CHECK(unij_ipc_pack(ipc, (const void*)&expected));
+	
+	// Nothing named gets left behind when the mapping can be handed over.
+	if(named) {
+		CHECK(request.handoff.owner == 0);
+		CHECK(shm_exists((uint32_t)loader->pid));
+	} else {
+		CHECK(request.handoff.owner == (uint32_t)getpid());
+		CHECK(!shm_exists((uint32_t)loader->pid));
+	}
+	
+	// The writer has to keep its side open until the loader is done with it.
+	CHECK(write(loader->requests, (const void*)&request, sizeof(request)) == (ssize_t)sizeof(request));
+	CHECK(read(loader->results, (void*)&result, sizeof(result)) == (ssize_t)sizeof(result));
+	unij_ipc_close(ipc);
+	CHECK(result == 1);
+	CHECK(!shm_exists((uint32_t)loader->pid));
+	
+	wprintf(L"%ls round trip (%ls layout) passed.\n", named ? L"Named" : L"Handed over",
+	        layout == UNIJ_LAYOUT_INDEXED ? L"indexed" : L"sequential");
+	return true;
+}
+
+// A descriptor that could still change size out from under the importer has to be refused.
+static bool test_import_unsealed(void)
+{
+	int fds[2];
+	HANDLE mapping;
+	CHECK(pipe(fds) == 0);
+	mapping = unij_import_mmap((uint32_t)getpid(), (uint32_t)fds[0], true);
+	close(fds[0]);
+	close(fds[1]);
+	CHECK(mapping == NULL);
+	wprintf(L"Unsealed import was refused.\n");
+	return true;
+}
+
+int main(void)
+{
+	bool result;
+	loader_t loader;
+	if(!unij_init()) return 1;
+	
+	if(!start_loader(&loader)) {
+		wprintf(L"Couldn't start the loader!\n");
+		return 1;
+	}
+	
+	result = test_round_trip(&loader, UNIJ_LAYOUT_SEQUENTIAL, false) &&
+	         test_round_trip(&loader, UNIJ_LAYOUT_INDEXED, false) &&
+	         test_round_trip(&loader, UNIJ_LAYOUT_SEQUENTIAL, true) &&
+	         test_round_trip(&loader, UNIJ_LAYOUT_INDEXED, true) &&
+	         test_import_unsealed();
+	if(!result)
+		kill(loader.pid, SIGKILL);
+	return stop_loader(&loader) && result ? 0 : 1;
+}
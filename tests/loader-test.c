@@ -0,0 +1,184 @@
+/**
+ * @file loader-test.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Injects the real loader into a forked child running the stand-in runtime (fake-mono.c), the same way a game would
+ * get injected: through unij_inject, with nothing but the pid to start from. The stand-in reports what gets invoked
+ * back over a pipe, which has to be the assembly and method we asked for, on a thread the loader attached to the root
+ * domain. The second injection finds the loader already loaded, so only its entrypoint runs again.
+ *
+ * Usage: loader-test <path to uniject-loader .so>
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define MONO_NAME "libmonobdwgc-2.0.so"
+
+#define TEST_ASSEMBLY L"/opt/game/Managed/FakeAssembly.dll"
+#define TEST_CLASS L"Fake.Entry"
+#define TEST_METHOD L"Start"
+
+// How long the loader gets to report back, in milliseconds.
+#define REPORT_TIMEOUT 5000
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Fatal error 0x%08X (system error 0x%08X)\n", (unsigned int)code, (unsigned int)win32_error);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %ls\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+typedef struct
+{
+	pid_t pid;
+	int reports;
+} target_t;
+
+// The stand-in runtime gets built next to this executable.
+static bool library_path(char* buffer, size_t size, const char* name)
+{
+	char* slash;
+	ssize_t length = readlink("/proc/self/exe", buffer, size - 1);
+	if(length <= 0)
+		return false;
+	
+	buffer[length] = '\0';
+	slash = strrchr(buffer, '/');
+	if(slash == NULL || (size_t)(slash - buffer) + strlen(name) + 2 > size)
+		return false;
+	
+	strcpy(slash + 1, name);
+	return true;
+}
+
+static bool start_target(target_t* target, const char* mono)
+{
+	char fd[16];
+	int reports[2], ready[2];
+	if(pipe(reports) != 0 || pipe(ready) != 0)
+		return false;
+	
+	// The stand-in finds its end of the pipe through the environment, which the child inherits.
+	snprintf(fd, sizeof(fd), "%d", reports[1]);
+	setenv("UNIJ_TEST_FD", fd, 1);
+	
+	target->pid = fork();
+	if(target->pid == 0) {
+		close(reports[0]);
+		close(ready[0]);
+		if(dlopen(mono, RTLD_NOW) == NULL || write(ready[1], "r", 1) != 1)
+			_exit(1);
+		for(;;)
+			pause();
+	}
+	
+	close(reports[1]);
+	close(ready[1]);
+	target->reports = reports[0];
+	if(target->pid < 0 || read(ready[0], (void*)fd, 1) != 1) {
+		close(ready[0]);
+		return false;
+	}
+	close(ready[0]);
+	return true;
+}
+
+static void stop_target(target_t* target)
+{
+	kill(target->pid, SIGKILL);
+	waitpid(target->pid, NULL, 0);
+	close(target->reports);
+}
+
+static bool read_report(target_t* target, char* line, size_t size)
+{
+	size_t used = 0;
+	struct pollfd pfd = { target->reports, POLLIN, 0 };
+	while(used + 1 < size) {
+		CHECK(poll(&pfd, 1, REPORT_TIMEOUT) == 1);
+		CHECK(read(target->reports, (void*)&line[used], 1) == 1);
+		if(line[used++] == '\n')
+			break;
+	}
+	line[used] = '\0';
+	return true;
+}
+
+static bool test_inject(target_t* target, const char* loader)
+{
+	uniject_t* ctx;
+	wchar_t wloader[PATH_MAX];
+	char line[1024], expected[1024];
+	unij_wstr_t assembly = { ARRAYLEN(TEST_ASSEMBLY) - 1, TEST_ASSEMBLY };
+	unij_wstr_t cls = { ARRAYLEN(TEST_CLASS) - 1, TEST_CLASS };
+	unij_wstr_t method = { ARRAYLEN(TEST_METHOD) - 1, TEST_METHOD };
+	unij_wstr_t wpath = { 0, wloader };
+	
+	CHECK(mbstowcs(wloader, loader, ARRAYLEN(wloader)) < ARRAYLEN(wloader));
+	wpath.length = (uint16_t)wcslen(wloader);
+	
+	ctx = unij_injector_open((uint32_t)target->pid);
+	CHECK(ctx != NULL);
+	unij_set_loader_path(ctx, &wpath);
+	unij_set_assembly_path(ctx, &assembly);
+	unij_set_class_name(ctx, &cls);
+	unij_set_method_name(ctx, &method);
+	
+	// The loader reads its params before its entrypoint returns, so the context can go right after.
+	if(!unij_inject(ctx)) {
+		unij_close(ctx);
+		CHECK(!"unij_inject failed");
+	}
+	unij_close(ctx);
+	
+	snprintf(expected, sizeof(expected), "invoke %ls %ls:%ls 1\n", TEST_ASSEMBLY, TEST_CLASS, TEST_METHOD);
+	CHECK(read_report(target, line, sizeof(line)));
+	if(strcmp(line, expected) != 0) {
+		wprintf(L"Got \"%hs\", expected \"%hs\"\n", line, expected);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	int i;
+	bool result = true;
+	char mono[PATH_MAX];
+	target_t target;
+	if(argc < 2 || argv[1][0] != '/') {
+		wprintf(L"Usage: loader-test <absolute path to the loader>\n");
+		return 1;
+	}
+	
+	if(!unij_init() || !library_path(mono, sizeof(mono), MONO_NAME) || !start_target(&target, mono)) {
+		wprintf(L"Couldn't start the target!\n");
+		return 1;
+	}
+	
+	for(i = 0; result && i < 2; i++) {
+		result = test_inject(&target, argv[1]);
+		if(result)
+			wprintf(L"Injection %d was invoked on an attached thread.\n", i + 1);
+	}
+	
+	stop_target(&target);
+	return result ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file modcache-test.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Checks hits, misses on a changed file and eviction in the in-memory cache, then moves the cache into a file and
+ * re-executes itself to check that a second process starts out with the same entries.
+ *
+ * Usage: modcache-test
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/modcache.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define CHILD_ARG "--child"
+#define ENTRY_COUNT 64
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+// Some of the checks below fail on purpose, so fatal errors only get reported and the failing call returns.
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Fatal error 0x%08X (system error 0x%08X)\n", (unsigned int)code, (unsigned int)win32_error);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %s\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+static uint64_t entry_key(size_t index)
+{
+	char path[64];
+	int length = snprintf(path, sizeof(path), "/usr/lib/module-%zu.so", index);
+	return unij_modcache_key((const void*)path, (size_t)length, "mono_init");
+}
+
+static void entry_identity(size_t index, unij_file_identity_t* identity)
+{
+	identity->size = 0x10000 + index;
+	identity->mtime = 1700000000000000000ULL + index;
+	identity->file_id = 1000 + index;
+}
+
+static bool test_memory(void)
+{
+	size_t i;
+	uint64_t value = 0;
+	uint32_t hits, misses;
+	unij_file_identity_t identity;
+	
+	// Different symbols in the same module get different keys.
+	CHECK(unij_modcache_key("/a", 2, "mono_init") != unij_modcache_key("/a", 2, "mono_jit_init"));
+	CHECK(unij_modcache_key("/ab", 3, "c") != unij_modcache_key("/a", 2, "bc"));
+	
+	// And the same lookup for targets of different bitness doesn't share an entry, or one with plain keys.
+	CHECK(unij_modcache_key_bits(32, "/a", 2, "dlopen") != unij_modcache_key_bits(64, "/a", 2, "dlopen"));
+	CHECK(unij_modcache_key_bits(64, "/a", 2, "dlopen") != unij_modcache_key("/a", 2, "dlopen"));
+	CHECK(unij_modcache_key_bits(64, "/a", 2, "dlopen") != unij_modcache_key("@/a", 3, "dlopen"));
+	
+	for(i = 0; i < ENTRY_COUNT; i++) {
+		entry_identity(i, &identity);
+		CHECK(!unij_modcache_get(entry_key(i), &identity, &value));
+		unij_modcache_put(entry_key(i), &identity, i * 3);
+	}
+	
+	for(i = 0; i < ENTRY_COUNT; i++) {
+		entry_identity(i, &identity);
+		CHECK(unij_modcache_get(entry_key(i), &identity, &value) && value == i * 3);
+	}
+	
+	// A rebuilt module misses, and replaces its old entry when it's put back.
+	entry_identity(0, &identity);
+	identity.mtime++;
+	CHECK(!unij_modcache_get(entry_key(0), &identity, &value));
+	unij_modcache_put(entry_key(0), &identity, 42);
+	CHECK(unij_modcache_get(entry_key(0), &identity, &value) && value == 42);
+	identity.mtime--;
+	CHECK(!unij_modcache_get(entry_key(0), &identity, &value));
+	unij_modcache_put(entry_key(0), &identity, 0);
+	
+	unij_modcache_stats(&hits, &misses);
+	CHECK(hits == ENTRY_COUNT + 1 && misses == ENTRY_COUNT + 2);
+	
+	// Way more entries than fit: still only ever a miss, never a wrong value.
+	for(i = ENTRY_COUNT; i < ENTRY_COUNT * 64; i++) {
+		entry_identity(i, &identity);
+		unij_modcache_put(entry_key(i), &identity, i * 3);
+	}
+	for(i = 0; i < ENTRY_COUNT * 64; i++) {
+		entry_identity(i, &identity);
+		value = 1;
+		CHECK(!unij_modcache_get(entry_key(i), &identity, &value) || value == i * 3);
+	}
+	return true;
+}
+
+// Runs in the re-executed copy, which should find everything the parent put in the file.
+static bool test_child(const char* path)
+{
+	size_t i;
+	uint64_t value;
+	uint32_t hits, misses;
+	wchar_t wpath[PATH_MAX];
+	unij_file_identity_t identity;
+	
+	swprintf(wpath, PATH_MAX, L"%hs", path);
+	CHECK(unij_modcache_persist(wpath));
+	for(i = 0; i < ENTRY_COUNT; i++) {
+		entry_identity(i, &identity);
+		CHECK(unij_modcache_get(entry_key(i), &identity, &value) && value == i * 3);
+	}
+	
+	unij_modcache_stats(&hits, &misses);
+	CHECK(hits == ENTRY_COUNT && misses == 0);
+	return true;
+}
+
+static bool test_persist(const char* self)
+{
+	int fd, status = 0;
+	size_t i;
+	pid_t child;
+	char path[] = "/tmp/uniject-modcache-XXXXXX";
+	wchar_t wpath[sizeof(path)];
+	unij_file_identity_t identity;
+	
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+	
+	// An empty file gets initialized, and what's in memory is carried over into it.
+	swprintf(wpath, ARRAYLEN(wpath), L"%hs", path);
+	CHECK(unij_modcache_persist(wpath));
+	CHECK(!unij_modcache_persist(wpath));
+	for(i = 0; i < ENTRY_COUNT; i++) {
+		entry_identity(i, &identity);
+		unij_modcache_put(entry_key(i), &identity, i * 3);
+	}
+	
+	child = fork();
+	CHECK(child >= 0);
+	if(child == 0) {
+		execl(self, self, CHILD_ARG, path, (char*)NULL);
+		_exit(127);
+	}
+	
+	CHECK(waitpid(child, &status, 0) == child);
+	unlink(path);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	char self[PATH_MAX];
+	ssize_t length;
+	
+	if(!unij_init()) return 1;
+	
+	if(argc == 3 && strcmp(argv[1], CHILD_ARG) == 0)
+		return test_child(argv[2]) ? 0 : 1;
+	
+	if(!test_memory()) {
+		wprintf(L"In-memory cache checks failed!\n");
+		return 1;
+	}
+	wprintf(L"In-memory cache checks passed.\n");
+	
+	length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+	if(length <= 0)
+		return 1;
+	self[length] = '\0';
+	
+	if(!test_persist(self)) {
+		wprintf(L"Cache file checks failed!\n");
+		return 1;
+	}
+	wprintf(L"Cache file checks passed.\n");
+	return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file mono-host.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Plays the game for inject-bench: loads the stand-in runtime from next to itself, the way a Unity player loads
+ * libmonobdwgc, checks that it exports everything the loader binds, and then idles in a fixed-rate frame loop on its
+ * main thread, which is the thread ptrace takes over during an injection. The end of every frame gets stamped into the
+ * shared block, so a frame that ran long is visible to the bench.
+ *
+ * Usage: mono-host <shared block fd>
+ */
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "fake-mono.h"
+
+#define MONO_NAME "libmonobdwgc-2.0.so"
+
+typedef void*(*mono_init_fn)(const char* domain_name);
+
+static bool library_path(char* buffer, size_t size, const char* name)
+{
+	char* slash;
+	ssize_t length = readlink("/proc/self/exe", buffer, size - 1);
+	if(length <= 0)
+		return false;
+	
+	buffer[length] = '\0';
+	slash = strrchr(buffer, '/');
+	if(slash == NULL || (size_t)(slash - buffer) + strlen(name) + 2 > size)
+		return false;
+	
+	strcpy(slash + 1, name);
+	return true;
+}
+
+static void* load_runtime(fake_mono_shared_t* shared)
+{
+	size_t i;
+	void* mono;
+	char path[PATH_MAX];
+	fake_mono_setup_fn setup;
+	if(!library_path(path, sizeof(path), MONO_NAME) || (mono = dlopen(path, RTLD_NOW)) == NULL) {
+		fprintf(stderr, "mono-host: couldn't load %s: %s\n", MONO_NAME, dlerror());
+		return NULL;
+	}
+	
+	for(i = 0; i < FAKE_CALLS; i++) {
+		if(dlsym(mono, fake_mono_names[i]) == NULL) {
+			fprintf(stderr, "mono-host: %s doesn't export %s\n", MONO_NAME, fake_mono_names[i]);
+			return NULL;
+		}
+	}
+	
+	*((void**)&setup) = dlsym(mono, FAKE_MONO_SETUP);
+	if(setup == NULL) {
+		fprintf(stderr, "mono-host: %s doesn't export " FAKE_MONO_SETUP "\n", MONO_NAME);
+		return NULL;
+	}
+	setup(shared);
+	return mono;
+}
+
+static void frame_loop(fake_mono_shared_t* shared)
+{
+	uint64_t frame = 0;
+	struct timespec next, now;
+	long period_ns = (long)shared->frame_us * 1000;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for(;;) {
+		next.tv_nsec += period_ns;
+		while(next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		
+		// A frame that overran starts the next one right away, without trying to catch up.
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+			;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if(now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+			next = now;
+		
+		shared->frame_end_ns[frame % FAKE_MONO_FRAMES] = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+		__atomic_store_n(&shared->frames, ++frame, __ATOMIC_RELEASE);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	void* mono;
+	mono_init_fn init;
+	fake_mono_shared_t* shared;
+	if(argc < 2) {
+		fprintf(stderr, "Usage: mono-host <shared block fd>\n");
+		return 1;
+	}
+	
+	shared = (fake_mono_shared_t*)mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED, atoi(argv[1]), 0);
+	if(shared == MAP_FAILED) {
+		perror("mono-host: mmap");
+		return 1;
+	}
+	close(atoi(argv[1]));
+	if(shared->frame_us == 0)
+		shared->frame_us = 1000;
+	
+	mono = load_runtime(shared);
+	if(mono == NULL)
+		return 1;
+	
+	*((void**)&init) = dlsym(mono, "mono_init");
+	if(init("mono-host") == NULL) {
+		fprintf(stderr, "mono-host: mono_init failed\n");
+		return 1;
+	}
+	
+	__atomic_store_n(&shared->ready, 1, __ATOMIC_RELEASE);
+	frame_loop(shared);
+	return 0;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file once-bench.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Lines up a number of threads behind a barrier and lets them all hit the same fresh unij_once at once, round after
+ * round, with a callback slow enough that the losers have to sleep. Every round has to run its callback exactly once
+ * and hand every caller the same result, including rounds whose callback fails. After that, it times the fast path
+ * of a finished once and of unij_alloc/unij_free from every thread at the same time.
+ *
+ * Usage: once-bench [threads] [rounds]
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/platform.h>
+#include <uniject/utility.h>
+
+#include <pthread.h>
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_ROUNDS 2000
+#define MAX_THREADS 256
+
+// Calls each thread makes on the fast paths.
+#define FAST_CALLS 0x400000
+
+// Every FAILED_EVERY-th round's callback fails.
+#define FAILED_EVERY 7
+
+// How long a callback keeps the others waiting, in microseconds.
+#define CALLBACK_US 20
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Exiting process with code: 0x%08X\n", (unsigned int)win32_error);
+	exit((int)code);
+}
+
+typedef struct
+{
+	unij_once_t once;
+	uint32_t calls;
+	bool succeeds;
+} round_t;
+
+typedef struct
+{
+	round_t* rounds;
+	size_t count;
+	size_t threads;
+	pthread_barrier_t barrier;
+	unij_once_t finished;
+} bench_t;
+
+typedef struct
+{
+	pthread_t thread;
+	bench_t* bench;
+	size_t wrong;
+	double once_seconds;
+	double alloc_seconds;
+} worker_t;
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static BOOL CDECL round_callback(void* parameter)
+{
+	round_t* round = (round_t*)parameter;
+	double until = now_seconds() + CALLBACK_US / 1e6;
+	__atomic_fetch_add(&round->calls, 1, __ATOMIC_RELAXED);
+	while(now_seconds() < until)
+		unij_yield_processor();
+	return round->succeeds ? TRUE : FALSE;
+}
+
+static BOOL CDECL finished_callback(void* parameter)
+{
+	UNIJ_SUPPRESS_UNUSED(parameter);
+	return TRUE;
+}
+
+static void* run_worker(void* parameter)
+{
+	size_t index;
+	double start;
+	worker_t* worker = (worker_t*)parameter;
+	bench_t* bench = worker->bench;
+	
+	for(index = 0; index < bench->count; index++) {
+		round_t* round = &bench->rounds[index];
+		pthread_barrier_wait(&bench->barrier);
+		if(unij_once(&round->once, round_callback, (void*)round) != round->succeeds)
+			worker->wrong++;
+	}
+	
+	// Everybody starts the fast paths together, so they're timed under contention as well.
+	pthread_barrier_wait(&bench->barrier);
+	start = now_seconds();
+	for(index = 0; index < FAST_CALLS; index++) {
+		if(!unij_once(&bench->finished, finished_callback, NULL))
+			worker->wrong++;
+	}
+	worker->once_seconds = now_seconds() - start;
+	
+	pthread_barrier_wait(&bench->barrier);
+	start = now_seconds();
+	for(index = 0; index < FAST_CALLS; index++)
+		unij_free(unij_alloc(32));
+	worker->alloc_seconds = now_seconds() - start;
+	return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t index, wrong = 0, repeated = 0;
+	double start, elapsed, once_seconds = 0, alloc_seconds = 0;
+	worker_t* workers;
+	bench_t bench;
+	
+	RtlZeroMemory((void*)&bench, sizeof(bench));
+	bench.threads = DEFAULT_THREADS;
+	bench.count = DEFAULT_ROUNDS;
+	if(argc > 1)
+		bench.threads = (size_t)strtoull(argv[1], NULL, 10);
+	if(argc > 2)
+		bench.count = (size_t)strtoull(argv[2], NULL, 10);
+	if(bench.threads < 2)
+		bench.threads = 2;
+	if(bench.threads > MAX_THREADS)
+		bench.threads = MAX_THREADS;
+	
+	if(!unij_init()) return 1;
+	
+	bench.rounds = (round_t*)calloc(bench.count, sizeof(round_t));
+	workers = (worker_t*)calloc(bench.threads, sizeof(worker_t));
+	if(bench.rounds == NULL || workers == NULL) {
+		wprintf(L"Couldn't allocate %zu rounds!\n", bench.count);
+		return 1;
+	}
+	for(index = 0; index < bench.count; index++)
+		bench.rounds[index].succeeds = (index % FAILED_EVERY) != 0;
+	
+	pthread_barrier_init(&bench.barrier, NULL, (unsigned)bench.threads);
+	start = now_seconds();
+	for(index = 0; index < bench.threads; index++) {
+		workers[index].bench = &bench;
+		if(pthread_create(&workers[index].thread, NULL, run_worker, (void*)&workers[index]) != 0) {
+			wprintf(L"Couldn't start thread %zu!\n", index);
+			return 1;
+		}
+	}
+	for(index = 0; index < bench.threads; index++) {
+		pthread_join(workers[index].thread, NULL);
+		wrong += workers[index].wrong;
+		once_seconds += workers[index].once_seconds;
+		alloc_seconds += workers[index].alloc_seconds;
+	}
+	elapsed = now_seconds() - start - once_seconds / bench.threads - alloc_seconds / bench.threads;
+	
+	for(index = 0; index < bench.count; index++) {
+		if(bench.rounds[index].calls != 1)
+			repeated++;
+	}
+	
+	wprintf(L"%zu threads, %zu rounds:\n", bench.threads, bench.count);
+	wprintf(L"  contended: %8.2f us/round (callback takes %d us)\n", elapsed * 1e6 / bench.count, CALLBACK_US);
+	wprintf(L"  finished:  %8.2f ns/call\n", once_seconds * 1e9 / ((double)bench.threads * FAST_CALLS));
+	wprintf(L"  alloc:     %8.2f ns/alloc+free\n", alloc_seconds * 1e9 / ((double)bench.threads * FAST_CALLS));
+	
+	pthread_barrier_destroy(&bench.barrier);
+	free(bench.rounds);
+	free(workers);
+	if(repeated != 0 || wrong != 0) {
+		wprintf(L"%zu rounds didn't run their callback exactly once, and %zu calls got the wrong result!\n",
+		        repeated, wrong);
+		return 1;
+	}
+	return 0;
+}
@@ -1,55 +1,56 @@
 /**
- * @file data_test.c
+ * @file packing-test.c
  * @author Charles Grunwald <ch@rles.rocks>
  */
 #include "pch.h"
 #include <uniject.h>
+#include <uniject/arena.h>
 #include <uniject/base.h>
+#include <uniject/ipc.h>
 #include <uniject/packing.h>
-#include <uniject/module.h>
-#include <uniject/process.h>
 #include <uniject/utility.h>
 
+#define SHARED_KEY L"packing-test"
+
 /**
  * @brief Application-specific display of messages to user.
  * In order to give the application/DLL full control over the display of messages and critical failure process, we leave
- * this and ::UNIJ_AbortProcessImpl as undefined external symbols.
+ * this and ::unij_abort_impl as undefined external symbols.
  * @param[in] level Message urgency level
  * @param[in] message The error message to show.
  */
 void unij_show_message_impl(unij_level_t level, const wchar_t* message)
 {
-	wchar_t* pScratch = (wchar_t*)message;
-	wchar_t* pLevel = (wchar_t*)unij_level_name(level);
-	wprintf(L"[%s] %s\n", pLevel, pScratch);
+	wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
 }
 
 /**
  * @brief Application-specific termination of our logic.
  * In order to give the application/DLL full control over the display of messages and critical failure process, we leave
- * this and ::UNIJ_ShowUserMessageImpl as undefined external symbols.
+ * this and ::unij_show_message_impl as undefined external symbols.
  * NOTE: In the case of the loader DLLs, this shouldn't actually terminate the process. Instead, it should abort the
  * loader logic, then cleanup and unload the loader DLL.
- * @param[in] last_error System error code 
+ * @param[in] code Error code
+ * @param[in] win32_error System error code
  */
-void unij_abort_impl(uint32_t last_error)
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
 {
-	wprintf(L"Exiting process with code: 0x%08X", (unsigned int)last_error);
-	ExitProcess(last_error);
+	wprintf(L"Exiting process with code: 0x%08X\n", (unsigned int)win32_error);
+	exit((int)code);
 }
 
-static VOID DumpBuffer(LPCWSTR pName, PBYTE pBuffer, SIZE_T szBuffer)
+static void DumpBuffer(const char* name, const void* buffer, size_t size)
 {
-	FILE* fOuput = _wfopen(pName, L"wb");
+	FILE* fOuput = fopen(name, "wb");
 	assert(fOuput != NULL);
-	fwrite((const void*)pBuffer, 1, szBuffer, fOuput);
+	fwrite(buffer, 1, size, fOuput);
 	fflush(fOuput);
 	fclose(fOuput);
 }
 
 UNIJ_NOINLINE void* CDECL alloc_handler(void* unused, size_t szBytes)
 {
-	PVOID pResult = malloc(szBytes);
+	void* pResult = malloc(szBytes);
 	assert(pResult != NULL);
 	memset(pResult, 0, szBytes);
 	return pResult;
@@ -75,25 +76,25 @@ typedef struct
 	unij_wstr_t MethodName;
 } TestStruct;
 
-static LPCWSTR bool_to_string(bool bValue)
+static const wchar_t* bool_to_string(bool bValue)
 {
-	static CONST WCHAR sTRUE[] = L"TRUE";
-	static CONST WCHAR sFALSE[] = L"FALSE";
+	static const wchar_t sTRUE[] = L"TRUE";
+	static const wchar_t sFALSE[] = L"FALSE";
 	return bValue ? sTRUE : sFALSE;
 }
 
 static void print_wstr(const wchar_t* name, unij_wstr_t* value)
 {
-	wprintf(L"  %s = L\"%.*s\" [%hu bytes]\n", name, (int)value->length, value->value, value->length);
+	wprintf(L"  %ls = L\"%.*ls\" [%hu bytes]\n", name, (int)value->length, value->value, value->length);
 }
 
-static void dump_params(LPCWSTR pLabel, TestStruct* pParams)
+static void dump_params(const wchar_t* pLabel, TestStruct* pParams)
 {
-	wprintf(L"Params: %s\n", pLabel);
-	wprintf(L"  bool_field = %s\n", bool_to_string(pParams->bool_field));
+	wprintf(L"Params: %ls\n", pLabel);
+	wprintf(L"  bool_field = %ls\n", bool_to_string(pParams->bool_field));
 	wprintf(L"  u16_field = %hu\n", pParams->u16_field);
-	wprintf(L"  u32_field = 0x%08X\n", pParams->u32_field);
-	wprintf(L"  u64_field = %llu\n", pParams->u64_field);
+	wprintf(L"  u32_field = 0x%08X\n", (unsigned int)pParams->u32_field);
+	wprintf(L"  u64_field = %llu\n", (unsigned long long)pParams->u64_field);
 	wprintf(L"  size_field = %zu\n", pParams->size_field);
 	print_wstr(L"Mono", &(pParams->Mono));
 	print_wstr(L"Assembly", &(pParams->Assembly));
@@ -127,6 +128,121 @@ static unij_wstr_t wsMethodName = {
 	L"LetsGetItStarted"
 };
 
+static UNIJ_NOINLINE void CDECL reserve_params(unij_packer_t* P, const TestStruct* data)
+{
+	unij_reserve_type(P, bool);
+	unij_reserve_type(P, uint16_t);
+	unij_reserve_type(P, uint32_t);
+	unij_reserve_type(P, uint64_t);
+	unij_reserve_type(P, size_t);
+	unij_reserve_wstr(P, &data->Mono);
+	unij_reserve_wstr(P, &data->Assembly);
+	unij_reserve_wstr(P, &data->ClassName);
+	unij_reserve_wstr(P, &data->MethodName);
+}
+
+static UNIJ_NOINLINE bool CDECL pack_params(unij_packer_t* P, const TestStruct* data)
+{
+	return unij_pack_val(P, data->bool_field) && unij_pack_val(P, data->u16_field) &&
+	       unij_pack_val(P, data->u32_field) && unij_pack_val(P, data->u64_field) &&
+	       unij_pack_val(P, data->size_field) && unij_pack_wstr(P, &data->Mono) &&
+	       unij_pack_wstr(P, &data->Assembly) && unij_pack_wstr(P, &data->ClassName) &&
+	       unij_pack_wstr(P, &data->MethodName);
+}
+
+static UNIJ_NOINLINE bool CDECL unpack_params(unij_unpacker_t* U, TestStruct* dest)
+{
+	return unij_unpack_val(U, &dest->bool_field) && unij_unpack_val(U, &dest->u16_field) &&
+	       unij_unpack_val(U, &dest->u32_field) && unij_unpack_val(U, &dest->u64_field) &&
+	       unij_unpack_val(U, &dest->size_field) && unij_unpack_wstr(U, &dest->Mono) &&
+	       unij_unpack_wstr(U, &dest->Assembly) && unij_unpack_wstr(U, &dest->ClassName) &&
+	       unij_unpack_wstr(U, &dest->MethodName);
+}
+
+static bool wstr_equal(const unij_wstr_t* a, const unij_wstr_t* b)
+{
+	return a->length == b->length && memcmp(a->value, b->value, WSIZE(a->length)) == 0;
+}
+
+static bool params_equal(const TestStruct* a, const TestStruct* b)
+{
+	return a->bool_field == b->bool_field && a->u16_field == b->u16_field && a->u32_field == b->u32_field &&
+	       a->u64_field == b->u64_field && a->size_field == b->size_field && wstr_equal(&a->Mono, &b->Mono) &&
+	       wstr_equal(&a->Assembly, &b->Assembly) && wstr_equal(&a->ClassName, &b->ClassName) &&
+	       wstr_equal(&a->MethodName, &b->MethodName);
+}
+
+/**
+ * @brief Packs something, resets the packer and packs a blob that only just fits the first buffer. The packer has to
+ * come out of the reset as if it were new, layout included.
+ */
+static bool reset_round_trip(unij_layout_t layout)
+{
+	bool result = false;
+	uint8_t first[0x10], blob[0xFC], check[0xFC];
+	unij_packer_t* R;
+	unij_unpacker_t* U = NULL;
+	size_t i;
+	
+	for(i = 0; i < sizeof(blob); i++)
+		blob[i] = (uint8_t)(i * 7 + 1);
+	RtlZeroMemory((void*)first, sizeof(first));
+	
+	R = unij_packer_create_growable(&test_procs, 0);
+	if(R == NULL)
+		return false;
+	if(unij_packer_set_layout(R, layout) && unij_pack(R, (const void*)first, sizeof(first))) {
+		unij_packer_reset(R);
+		if(unij_pack(R, (const void*)blob, sizeof(blob)) && unij_packer_finish(R))
+			U = unij_unpacker_create(unij_packer_get_buffer(R));
+	}
+	if(U != NULL) {
+		result = (layout != UNIJ_LAYOUT_INDEXED || (unij_unpacker_field_count(U) == 1 && unij_unpacker_field(U, 0))) &&
+		         unij_unpack(U, (void*)check, sizeof(check)) && memcmp(check, blob, sizeof(blob)) == 0;
+		unij_unpacker_destroy(U);
+	}
+	unij_packer_destroy(R);
+	
+	wprintf(L"Reset and repack (%ls layout) %ls.\n", layout == UNIJ_LAYOUT_INDEXED ? L"indexed" : L"sequential",
+	        result ? L"passed" : L"failed");
+	return result;
+}
+
+/**
+ * @brief Packs \a params into a real shared mapping and unpacks them from a second view of it. The named path goes
+ * through a named mapping, the other one through the handoff block, which outside of Windows is a sealed memfd.
+ */
+static bool shared_round_trip(const TestStruct* params, unij_layout_t layout, bool named)
+{
+	bool result = false;
+	unij_handoff_t handoff;
+	unij_ipc_t* writer, *reader = NULL;
+	TestStruct oShared = {0};
+	
+	unij_handoff_init(&handoff, unij_current_pid());
+	writer = named ? unij_ipc_writer_open(unij_current_pid(), SHARED_KEY) :
+	                 unij_ipc_handoff_writer_open(&handoff, SHARED_KEY);
+	if(writer == NULL)
+		return false;
+	
+	unij_ipc_set_reserve_fn(writer, (unij_reserve_fn)reserve_params);
+	unij_ipc_set_pack_fn(writer, (unij_pack_fn)pack_params);
+	unij_ipc_set_layout(writer, layout);
+	if(unij_ipc_pack(writer, (const void*)params)) {
+		reader = named ? unij_ipc_reader_open(SHARED_KEY) : unij_ipc_handoff_reader_open(&handoff, SHARED_KEY);
+	}
+	if(reader != NULL) {
+		unij_ipc_set_unpack_fn(reader, (unij_unpack_fn)unpack_params);
+		result = unij_ipc_unpack(reader, (void*)&oShared) && params_equal(&oShared, params);
+		unij_ipc_close(reader);
+	}
+	unij_ipc_close(writer);
+	
+	wprintf(L"%ls shared memory round trip (%ls layout) %ls.\n", named ? L"Named" : L"Handed over",
+	        layout == UNIJ_LAYOUT_INDEXED ? L"indexed" : L"sequential", result ? L"passed" : L"failed");
+	return result;
+}
+
 /*
 typedef struct
 {
@@ -142,15 +258,20 @@ typedef struct
 } TestStruct;
  */
 
-int wmain(int argc, wchar_t *argv[])
+int main(void)
 {
-	unij_packer_t* P;
-	unij_unpacker_t* U;
+	unij_packer_t* P, *G, *I, *C, *A;
+	unij_arena_t* pArena;
+	unij_memprocs_t arena_procs;
+	unij_unpacker_t* U, *V, *W;
+	unij_cstr_t csAssembly = { 0, NULL };
+	unij_cstr_t csMethod = { 0, NULL };
 	const void* pBuffer = NULL;
-	SIZE_T szBuffer = 0;
-	unij_wstr_t sysdir;
-	wchar_t lcbuffer[MAX_PATH+1] = L"";
+	void* pGrown = NULL;
+	size_t szBuffer = 0;
+	size_t szGrown = 0;
 	TestStruct oUnpacking = {0};
+	TestStruct oIndexed = {0};
 	TestStruct oPacking = {
 		true,
 		300,
@@ -175,20 +296,20 @@ int wmain(int argc, wchar_t *argv[])
 	unij_reserve_type(P, uint32_t);
 	unij_reserve_type(P, uint64_t);
 	unij_reserve_type(P, size_t);
-	unij_reserve_wstr(P, oPacking.Mono);
-	unij_reserve_wstr(P, oPacking.Assembly);
-	unij_reserve_wstr(P, oPacking.ClassName);
-	unij_reserve_wstr(P, oPacking.MethodName);
+	unij_reserve_wstr(P, &oPacking.Mono);
+	unij_reserve_wstr(P, &oPacking.Assembly);
+	unij_reserve_wstr(P, &oPacking.ClassName);
+	unij_reserve_wstr(P, &oPacking.MethodName);
 	unij_packer_commit(P);
-	
+
 #	define TRYPACK(P,FLD) \
-	wprintf(L"Packing %s..\n", UNIJ_WSTRINGIFY(FLD) ); \
+	wprintf(L"Packing %ls..\n", UNIJ_WSTRINGIFY(FLD) ); \
 	if( !unij_pack_val( (P), (FLD) ) ) \
 		return 1
-	
+
 #	define TRYPACKSTR(P,FLD) \
-	wprintf(L"Packing %s..\n", UNIJ_WSTRINGIFY(FLD) ); \
-	if( !unij_pack_wstr( (P), (FLD) ) ) \
+	wprintf(L"Packing %ls..\n", UNIJ_WSTRINGIFY(FLD) ); \
+	if( !unij_pack_wstr( (P), &(FLD) ) ) \
 		return 1
 	
 	TRYPACK(P,oPacking.bool_field);
@@ -201,20 +322,21 @@ int wmain(int argc, wchar_t *argv[])
 	TRYPACKSTR(P,oPacking.ClassName);
 	TRYPACKSTR(P,oPacking.MethodName);
 	
-	pBuffer = (PBYTE)unij_packer_get_buffer(P);
-	szBuffer = (SIZE_T)unij_packer_get_size(P);
-	DumpBuffer(L"packed.bin", (PBYTE)pBuffer, szBuffer);
+	pBuffer = unij_packer_get_buffer(P);
+	szBuffer = unij_packer_get_size(P);
+	DumpBuffer("packed.bin", pBuffer, szBuffer);
 	
-	wprintf(L"Successfully packed data structure into %zu bytes! sizeof(struct) = %zu.\n\n\n", szBuffer, sizeof(oPacking));
+	wprintf(L"Successfully packed data structure into %zu bytes! sizeof(struct) = %zu.\n\n\n", szBuffer,
+	        sizeof(oPacking));
 	
 	U = unij_unpacker_create(pBuffer);
 #	define TRYUNPACK(U,FLD) \
-	wprintf(L"Unpacking %s..\n", UNIJ_WSTRINGIFY(FLD) ); \
+	wprintf(L"Unpacking %ls..\n", UNIJ_WSTRINGIFY(FLD) ); \
 	if( !unij_unpack_val( (U), &(FLD) ) ) \
 		return 1
 
 #	define TRYUNPACKSTR(U,FLD) \
-	wprintf(L"Unpacking %s..\n", UNIJ_WSTRINGIFY(FLD) ); \
+	wprintf(L"Unpacking %ls..\n", UNIJ_WSTRINGIFY(FLD) ); \
 	if( !unij_unpack_wstr( (U), &(FLD) ) ) \
 		return 1
 	
@@ -230,10 +352,143 @@ int wmain(int argc, wchar_t *argv[])
 	
 	dump_params(L"<= Unpacking", &oUnpacking);
 	
+	// Single-pass packing should produce the exact same bytes as reserve/commit/pack.
+	G = unij_packer_create_growable(&test_procs, 0);
+	assert(G != NULL);
+	TRYPACK(G,oPacking.bool_field);
+	TRYPACK(G,oPacking.u16_field);
+	TRYPACK(G,oPacking.u32_field);
+	TRYPACK(G,oPacking.u64_field);
+	TRYPACK(G,oPacking.size_field);
+	TRYPACKSTR(G,oPacking.Mono);
+	TRYPACKSTR(G,oPacking.Assembly);
+	TRYPACKSTR(G,oPacking.ClassName);
+	TRYPACKSTR(G,oPacking.MethodName);
+	if(!unij_packer_finish(G))
+		return 1;
+	
+	pGrown = unij_packer_release(G, &szGrown);
+	if(szGrown != szBuffer || memcmp(pGrown, pBuffer, szBuffer) != 0) {
+		wprintf(L"Growable packer output (%zu bytes) doesn't match the reserved packer output!\n", szGrown);
+		return 1;
+	}
+	wprintf(L"Growable packer matched the reserved packer output.\n");
+	free_handler(NULL, pGrown);
+	
+	if(!reset_round_trip(UNIJ_LAYOUT_SEQUENTIAL) || !reset_round_trip(UNIJ_LAYOUT_INDEXED))
+		return 1;
 	
+	// Indexed layout: fields should be reachable out of order, and still readable in order.
+	I = unij_packer_create_growable(&test_procs, 0);
+	assert(I != NULL);
+	if(!unij_packer_set_layout(I, UNIJ_LAYOUT_INDEXED))
+		return 1;
+	TRYPACK(I,oPacking.bool_field);
+	TRYPACK(I,oPacking.u16_field);
+	TRYPACK(I,oPacking.u32_field);
+	TRYPACK(I,oPacking.u64_field);
+	TRYPACK(I,oPacking.size_field);
+	TRYPACKSTR(I,oPacking.Mono);
+	TRYPACKSTR(I,oPacking.Assembly);
+	TRYPACKSTR(I,oPacking.ClassName);
+	TRYPACKSTR(I,oPacking.MethodName);
+	if(!unij_packer_finish(I))
+		return 1;
+	
+	V = unij_unpacker_create(unij_packer_get_buffer(I));
+	assert(V != NULL);
+	if(unij_unpacker_field_count(V) != 9) {
+		wprintf(L"Indexed packer wrote %zu fields instead of 9!\n", unij_unpacker_field_count(V));
+		return 1;
+	}
+	
+	if(!unij_unpacker_field(V, 8) || !unij_unpack_wstr(V, &oIndexed.MethodName) ||
+	   !unij_unpacker_field(V, 1) || !unij_unpack_val(V, &oIndexed.u16_field)) {
+		return 1;
+	}
+	if(oIndexed.u16_field != oPacking.u16_field || oIndexed.MethodName.length != wsMethodName.length ||
+	   memcmp(oIndexed.MethodName.value, wsMethodName.value, wsMethodName.length * sizeof(wchar_t)) != 0) {
+		wprintf(L"Random access into the indexed buffer returned the wrong data!\n");
+		return 1;
+	}
+	
+	if(!unij_unpacker_field(V, 0))
+		return 1;
+	TRYUNPACK(V,oIndexed.bool_field);
+	TRYUNPACK(V,oIndexed.u16_field);
+	TRYUNPACK(V,oIndexed.u32_field);
+	TRYUNPACK(V,oIndexed.u64_field);
+	TRYUNPACK(V,oIndexed.size_field);
+	TRYUNPACKSTR(V,oIndexed.Mono);
+	TRYUNPACKSTR(V,oIndexed.Assembly);
+	TRYUNPACKSTR(V,oIndexed.ClassName);
+	TRYUNPACKSTR(V,oIndexed.MethodName);
+	if(oIndexed.u64_field != oPacking.u64_field || oIndexed.size_field != oPacking.size_field ||
+	   oIndexed.ClassName.length != wsClassName.length) {
+		wprintf(L"Sequential read of the indexed buffer returned the wrong data!\n");
+		return 1;
+	}
+	dump_params(L"<= Indexed", &oIndexed);
+	
+	// UTF-8: wide strings transcoded by the packer and plain cstrs should both come back as borrowed cstrs.
+	C = unij_packer_create_growable(&test_procs, 0);
+	assert(C != NULL);
+	csMethod.length = (uint16_t)strlen("LetsGetItStarted");
+	csMethod.value = "LetsGetItStarted";
+	if(!unij_pack_wstr_utf8(C, &wsAssemblyName) || !unij_pack_cstr(C, &csMethod) || !unij_packer_finish(C))
+		return 1;
+	
+	W = unij_unpacker_create(unij_packer_get_buffer(C));
+	assert(W != NULL);
+	RtlZeroMemory((void*)&csMethod, sizeof(csMethod));
+	if(!unij_unpack_cstr(W, &csAssembly) || !unij_unpack_cstr(W, &csMethod))
+		return 1;
+	if(csAssembly.length != wsAssemblyName.length || strcmp(csAssembly.value, "FakeAssembly.dll") != 0 ||
+	   strcmp(csMethod.value, "LetsGetItStarted") != 0) {
+		wprintf(L"UTF-8 strings didn't survive the round trip!\n");
+		return 1;
+	}
+	wprintf(L"UTF-8 round trip: %hs, %hs\n", csAssembly.value, csMethod.value);
+	
+	// Arena-backed growable packer: buffer growth should stay in place and match the reserved output.
+	pArena = unij_arena_create(0x40);
+	assert(pArena != NULL);
+	unij_arena_memprocs(pArena, &arena_procs);
+	A = unij_packer_create_growable(&arena_procs, 0);
+	assert(A != NULL);
+	TRYPACK(A,oPacking.bool_field);
+	TRYPACK(A,oPacking.u16_field);
+	TRYPACK(A,oPacking.u32_field);
+	TRYPACK(A,oPacking.u64_field);
+	TRYPACK(A,oPacking.size_field);
+	TRYPACKSTR(A,oPacking.Mono);
+	TRYPACKSTR(A,oPacking.Assembly);
+	TRYPACKSTR(A,oPacking.ClassName);
+	TRYPACKSTR(A,oPacking.MethodName);
+	if(!unij_packer_finish(A))
+		return 1;
+	if(unij_packer_get_size(A) != szBuffer || memcmp(unij_packer_get_buffer(A), pBuffer, szBuffer) != 0) {
+		wprintf(L"Arena-backed packer output doesn't match the reserved packer output!\n");
+		return 1;
+	}
+	wprintf(L"Arena-backed packer matched the reserved packer output. (%zu arena bytes)\n", unij_arena_used(pArena));
+	unij_packer_destroy(A);
+	unij_arena_destroy(pArena);
+	
+	// Same round trip, over real shared memory this time.
+	if(!shared_round_trip(&oPacking, UNIJ_LAYOUT_SEQUENTIAL, true) ||
+	   !shared_round_trip(&oPacking, UNIJ_LAYOUT_INDEXED, true) ||
+	   !shared_round_trip(&oPacking, UNIJ_LAYOUT_SEQUENTIAL, false) ||
+	   !shared_round_trip(&oPacking, UNIJ_LAYOUT_INDEXED, false)) {
+		return 1;
+	}
+	
+	unij_unpacker_destroy(W);
+	unij_unpacker_destroy(V);
 	unij_unpacker_destroy(U);
+	unij_packer_destroy(C);
+	unij_packer_destroy(I);
+	unij_packer_destroy(G);
 	unij_packer_destroy(P);
-	
-	unij_shutdown();
 	return 0;
 }
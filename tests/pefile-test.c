@@ -0,0 +1,396 @@
+/**
+ * @file pefile-test.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Builds small PE32 and PE32+ images with an export directory (including a forwarder and names whose ordinals are out
+ * of order) and checks lookups against them, from memory and from a file. Every truncation of the images is opened
+ * too, which should only ever fail or miss. The export index gets the same lookups, and is timed against the binary
+ * search on an image with a few thousand exports. Any files passed on the command line get their named exports
+ * looked up.
+ *
+ * Usage: pefile-test [file export]...
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/pefile.h>
+
+#define IMAGE_SIZE 0x400
+#define HEADERS_SIZE 0x200
+#define SECTION_RVA 0x1000
+#define SECTION_SIZE 0x200
+#define TEST_FILE "pefile-test.dll"
+#define OPEN_ROUNDS 1000
+
+#define LARGE_EXPORTS 4000
+#define LARGE_NAME_SIZE 24
+#define LARGE_CODE_RVA 0x1000000
+#define BATCH_SIZE 32
+#define BATCH_ROUNDS 10000
+
+#define FUNCTIONS_RVA (SECTION_RVA + 0x28)
+#define NAMES_RVA (SECTION_RVA + 0x40)
+#define ORDINALS_RVA (SECTION_RVA + 0x60)
+#define STRINGS_RVA (SECTION_RVA + 0x80)
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Exiting process with code: 0x%08X\n", (unsigned int)win32_error);
+	exit((int)code);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %s\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+typedef struct
+{
+	const char* name;
+	// Index into the function table.
+	uint16_t ordinal;
+	uint32_t rva;
+} test_export_t;
+
+// Sorted by name, like the loader expects. mono_forwarded's RVA gets pointed at its forwarder string.
+static const test_export_t exports[] = {
+	{ "mono_domain_get", 2, 0x2000 },
+	{ "mono_forwarded", 0, 0 },
+	{ "mono_init", 3, 0x2100 },
+	{ "mono_thread_attach", 1, 0x2200 },
+};
+
+static const char* missing[] = { "", "mono", "mono_init2", "mono_inis", "a", "zzz" };
+
+static void put_u16(uint8_t* p, uint32_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* p, uint32_t value)
+{
+	put_u16(p, value);
+	put_u16(p + 2, value >> 16);
+}
+
+#define AT_RVA(IMAGE, RVA) ((IMAGE) + HEADERS_SIZE + ((RVA) - SECTION_RVA))
+
+// Headers for an image with one section at SECTION_RVA holding nothing but the export directory.
+static void build_headers(uint8_t* image, int bits, uint32_t section_size)
+{
+	uint8_t *nt, *optional, *section;
+	uint32_t optional_size = bits == 64 ? 0xF0 : 0xE0;
+	uint32_t directories = bits == 64 ? 112 : 96;
+	
+	put_u16(image, 0x5A4D);
+	put_u32(image + 0x3C, 0x40);
+	
+	nt = image + 0x40;
+	put_u32(nt, 0x00004550);
+	put_u16(nt + 4, bits == 64 ? 0x8664 : 0x14C);
+	put_u16(nt + 6, 1);
+	put_u16(nt + 20, optional_size);
+	
+	optional = nt + 24;
+	put_u16(optional, bits == 64 ? 0x20B : 0x10B);
+	put_u32(optional + 60, HEADERS_SIZE);
+	put_u32(optional + directories - 4, 16);
+	put_u32(optional + directories, SECTION_RVA);
+	put_u32(optional + directories + 4, section_size);
+	
+	section = optional + optional_size;
+	memcpy((void*)section, ".edata", 6);
+	put_u32(section + 8, section_size);
+	put_u32(section + 12, SECTION_RVA);
+	put_u32(section + 16, section_size);
+	put_u32(section + 20, HEADERS_SIZE);
+}
+
+static void build_image(uint8_t* image, int bits)
+{
+	size_t i;
+	uint8_t* directory;
+	uint32_t strings = STRINGS_RVA, forwarder;
+	RtlZeroMemory((void*)image, IMAGE_SIZE);
+	build_headers(image, bits, SECTION_SIZE);
+	
+	directory = AT_RVA(image, SECTION_RVA);
+	put_u32(directory + 20, (uint32_t)ARRAYLEN(exports));
+	put_u32(directory + 24, (uint32_t)ARRAYLEN(exports));
+	put_u32(directory + 28, FUNCTIONS_RVA);
+	put_u32(directory + 32, NAMES_RVA);
+	put_u32(directory + 36, ORDINALS_RVA);
+	
+	for(i = 0; i < ARRAYLEN(exports); i++) {
+		size_t length = strlen(exports[i].name) + 1;
+		put_u32(AT_RVA(image, NAMES_RVA) + i * 4, strings);
+		put_u16(AT_RVA(image, ORDINALS_RVA) + i * 2, exports[i].ordinal);
+		put_u32(AT_RVA(image, FUNCTIONS_RVA) + exports[i].ordinal * 4, exports[i].rva);
+		memcpy((void*)AT_RVA(image, strings), (const void*)exports[i].name, length);
+		strings += (uint32_t)length;
+	}
+	
+	forwarder = strings;
+	memcpy((void*)AT_RVA(image, forwarder), "other.mono_init", sizeof("other.mono_init"));
+	put_u32(AT_RVA(image, FUNCTIONS_RVA), forwarder);
+}
+
+static bool check_exports(const unij_pefile_t* pe, int bits)
+{
+	size_t i;
+	const uint8_t* data;
+	CHECK(unij_pefile_bits(pe) == bits);
+	CHECK(unij_pefile_machine(pe) == (bits == 64 ? 0x8664 : 0x14C));
+	
+	for(i = 0; i < ARRAYLEN(exports); i++)
+		CHECK(unij_pefile_export_rva(pe, exports[i].name) == exports[i].rva);
+	for(i = 0; i < ARRAYLEN(missing); i++)
+		CHECK(unij_pefile_export_rva(pe, missing[i]) == 0);
+	
+	// Headers map straight through, sections through the table, and nothing past either.
+	data = (const uint8_t*)unij_pefile_rva_to_data(pe, 0, 2);
+	CHECK(data != NULL && data[0] == 'M' && data[1] == 'Z');
+	CHECK(unij_pefile_rva_to_data(pe, HEADERS_SIZE, 1) == NULL);
+	CHECK(unij_pefile_rva_to_data(pe, SECTION_RVA, SECTION_SIZE) != NULL);
+	CHECK(unij_pefile_rva_to_data(pe, SECTION_RVA, SECTION_SIZE + 1) == NULL);
+	CHECK(unij_pefile_rva_to_data(pe, SECTION_RVA + SECTION_SIZE, 1) == NULL);
+	return true;
+}
+
+static bool test_memory(int bits)
+{
+	size_t size;
+	unij_pefile_t* pe;
+	uint8_t image[IMAGE_SIZE];
+	build_image(image, bits);
+	
+	pe = unij_pefile_open_memory((const void*)image, sizeof(image));
+	CHECK(pe != NULL);
+	if(!check_exports(pe, bits)) {
+		unij_pefile_close(pe);
+		return false;
+	}
+	unij_pefile_close(pe);
+	
+	// Anything cut short either fails to open or comes up empty unless everything it needed made it in, and never
+	// reads past the end.
+	for(size = 0; size < sizeof(image); size++) {
+		uint32_t rva;
+		pe = unij_pefile_open_memory((const void*)image, size);
+		if(pe == NULL)
+			continue;
+		rva = unij_pefile_export_rva(pe, "mono_init");
+		unij_pefile_close(pe);
+		CHECK(rva == 0 || rva == 0x2100);
+	}
+	
+	// Counts that claim more than the file holds.
+	put_u32(AT_RVA(image, SECTION_RVA) + 24, 0x40000000);
+	pe = unij_pefile_open_memory((const void*)image, sizeof(image));
+	CHECK(pe != NULL);
+	CHECK(unij_pefile_export_rva(pe, "mono_init") == 0);
+	unij_pefile_close(pe);
+	
+	// Headers pointing nowhere.
+	put_u32(image + 0x3C, 0xFFFFFFF0);
+	CHECK(unij_pefile_open_memory((const void*)image, sizeof(image)) == NULL);
+	build_image(image, bits);
+	put_u16(image + 0x40 + 24, 0x107);
+	CHECK(unij_pefile_open_memory((const void*)image, sizeof(image)) == NULL);
+	
+	wprintf(L"PE%ls image checks passed.\n", bits == 64 ? L"32+" : L"32");
+	return true;
+}
+
+// An image exporting \a count names, mono_export_00000 and up, each at LARGE_CODE_RVA plus its index.
+static uint8_t* build_large_image(uint32_t count, size_t* psize)
+{
+	uint32_t i, functions, names, ordinals, strings, section_size;
+	uint8_t *image, *directory;
+	functions = SECTION_RVA + 0x28;
+	names = functions + count * 4;
+	ordinals = names + count * 4;
+	strings = ordinals + count * 2;
+	section_size = (strings - SECTION_RVA) + count * LARGE_NAME_SIZE;
+	*psize = HEADERS_SIZE + section_size;
+	
+	image = (uint8_t*)calloc(1, *psize);
+	if(image == NULL)
+		return NULL;
+	build_headers(image, UNIJ_BITS, section_size);
+	
+	directory = AT_RVA(image, SECTION_RVA);
+	put_u32(directory + 20, count);
+	put_u32(directory + 24, count);
+	put_u32(directory + 28, functions);
+	put_u32(directory + 32, names);
+	put_u32(directory + 36, ordinals);
+	for(i = 0; i < count; i++) {
+		put_u32(AT_RVA(image, functions) + i * 4, LARGE_CODE_RVA + i);
+		put_u32(AT_RVA(image, names) + i * 4, strings);
+		put_u16(AT_RVA(image, ordinals) + i * 2, i);
+		snprintf((char*)AT_RVA(image, strings), LARGE_NAME_SIZE, "mono_export_%05u", (unsigned int)i);
+		strings += LARGE_NAME_SIZE;
+	}
+	return image;
+}
+
+static bool test_index(int bits)
+{
+	size_t i;
+	unij_pefile_t* pe;
+	unij_export_index_t* index;
+	uint8_t image[IMAGE_SIZE];
+	unij_export_binding_t bindings[ARRAYLEN(exports) + 2];
+	build_image(image, bits);
+	
+	pe = unij_pefile_open_memory((const void*)image, sizeof(image));
+	CHECK(pe != NULL);
+	index = unij_export_index_build(pe);
+	CHECK(index != NULL);
+	
+	// Forwarders don't make it in.
+	CHECK(unij_export_index_count(index) == ARRAYLEN(exports) - 1);
+	for(i = 0; i < ARRAYLEN(exports); i++)
+		CHECK(unij_export_index_find(index, exports[i].name) == exports[i].rva);
+	for(i = 0; i < ARRAYLEN(missing); i++)
+		CHECK(unij_export_index_find(index, missing[i]) == 0);
+	
+	for(i = 0; i < ARRAYLEN(exports); i++)
+		bindings[i].name = exports[i].name;
+	bindings[i++].name = "mono_missing";
+	bindings[i].name = NULL;
+	CHECK(unij_export_index_bind(index, bindings, ARRAYLEN(bindings)) == ARRAYLEN(exports) - 1);
+	for(i = 0; i < ARRAYLEN(exports); i++)
+		CHECK(bindings[i].rva == exports[i].rva);
+	CHECK(bindings[i].rva == 0 && bindings[i + 1].rva == 0);
+	
+	unij_export_index_free(index);
+	unij_pefile_close(pe);
+	return true;
+}
+
+// A MONO_API-sized batch of lookups in a module with a runtime's worth of exports, both ways.
+static bool test_index_speed(void)
+{
+	uint32_t i, round, sum = 0;
+	size_t size;
+	clock_t start;
+	double search, indexed, build;
+	unij_pefile_t* pe;
+	unij_export_index_t* index;
+	char names[BATCH_SIZE][LARGE_NAME_SIZE];
+	unij_export_binding_t bindings[BATCH_SIZE];
+	uint8_t* image = build_large_image(LARGE_EXPORTS, &size);
+	CHECK(image != NULL);
+	
+	pe = unij_pefile_open_memory((const void*)image, size);
+	CHECK(pe != NULL);
+	for(i = 0; i < BATCH_SIZE; i++) {
+		uint32_t which = (i * 7919) % LARGE_EXPORTS;
+		snprintf(names[i], sizeof(names[i]), "mono_export_%05u", (unsigned int)which);
+		bindings[i].name = names[i];
+	}
+	
+	start = clock();
+	for(round = 0; round < BATCH_ROUNDS; round++) {
+		for(i = 0; i < BATCH_SIZE; i++)
+			sum += unij_pefile_export_rva(pe, names[i]);
+	}
+	search = (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC / BATCH_ROUNDS;
+	
+	start = clock();
+	index = unij_export_index_build(pe);
+	build = (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC;
+	CHECK(index != NULL && unij_export_index_count(index) == LARGE_EXPORTS);
+	
+	start = clock();
+	for(round = 0; round < BATCH_ROUNDS; round++)
+		CHECK(unij_export_index_bind(index, bindings, BATCH_SIZE) == BATCH_SIZE);
+	indexed = (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC / BATCH_ROUNDS;
+	
+	for(i = 0; i < BATCH_SIZE; i++)
+		CHECK(bindings[i].rva == unij_pefile_export_rva(pe, names[i]));
+	
+	wprintf(L"%u lookups among %u exports: %.2fus searching, %.2fus through an index that took %.2fus to build. (%u)\n",
+	        (unsigned int)BATCH_SIZE, (unsigned int)LARGE_EXPORTS, search, indexed, build, (unsigned int)(sum & 1));
+	unij_export_index_free(index);
+	unij_pefile_close(pe);
+	free((void*)image);
+	return true;
+}
+
+static bool test_file(void)
+{
+	size_t i;
+	FILE* file;
+	double elapsed;
+	clock_t start;
+	unij_pefile_t* pe;
+	uint8_t image[IMAGE_SIZE];
+	build_image(image, 64);
+	
+	file = fopen(TEST_FILE, "wb");
+	CHECK(file != NULL);
+	CHECK(fwrite((const void*)image, 1, sizeof(image), file) == sizeof(image));
+	fclose(file);
+	
+	pe = unij_pefile_open(UNIJ_WIDEN(TEST_FILE));
+	CHECK(pe != NULL);
+	if(!check_exports(pe, 64)) {
+		unij_pefile_close(pe);
+		return false;
+	}
+	unij_pefile_close(pe);
+	
+	// What probing a module costs from scratch.
+	start = clock();
+	for(i = 0; i < OPEN_ROUNDS; i++) {
+		pe = unij_pefile_open(UNIJ_WIDEN(TEST_FILE));
+		CHECK(pe != NULL && unij_pefile_export_rva(pe, "mono_init") == 0x2100);
+		unij_pefile_close(pe);
+	}
+	elapsed = (double)(clock() - start) * 1e6 / CLOCKS_PER_SEC / OPEN_ROUNDS;
+	wprintf(L"Opened %ls and looked up an export in %.2fus on average.\n", UNIJ_WIDEN(TEST_FILE), elapsed);
+	
+	CHECK(unij_pefile_open(L"pefile-test-missing.dll") == NULL);
+	remove(TEST_FILE);
+	return true;
+}
+
+static bool test_sample(const char* path, const char* name)
+{
+	wchar_t wpath[1024];
+	unij_pefile_t* pe;
+	CHECK(mbstowcs(wpath, path, ARRAYLEN(wpath)) < ARRAYLEN(wpath));
+	
+	pe = unij_pefile_open(wpath);
+	if(pe == NULL) {
+		wprintf(L"%hs: not a PE image\n", path);
+		return false;
+	}
+	wprintf(L"%hs (PE%ls, machine 0x%04X): %hs = 0x%08X\n", path, unij_pefile_bits(pe) == 64 ? L"32+" : L"32",
+	        (unsigned int)unij_pefile_machine(pe), name, (unsigned int)unij_pefile_export_rva(pe, name));
+	unij_pefile_close(pe);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	int i;
+	bool result;
+	if(!unij_init()) return 1;
+	
+	result = test_memory(32) && test_memory(64) && test_index(32) && test_index(64) && test_index_speed() &&
+	         test_file();
+	for(i = 1; result && i + 1 < argc; i += 2)
+		result = test_sample(argv[i], argv[i + 1]);
+	return result ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+/**
+ * @file procfs-test.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Forks a crowd of idle children, some of which load the stand-in runtime (fake-mono.c) and some a decoy with a
+ * runtime's name but no mono_init, then checks that \a unij_enum_mono_processes reports exactly the ones with the
+ * runtime and times the scan. The second scan should get all of its symbol checks from the module cache.
+ *
+ * The same checks then run against \a unij_enum_mono_processes_ex with a pool per core, both ordered and unordered,
+ * along with a callback that stops the enumeration at the first result.
+ *
+ * Usage: procfs-test [child count]
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/modcache.h>
+#include <uniject/process.h>
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define DEFAULT_CHILDREN 200
+#define MONO_NAME "libmonobdwgc-2.0.so"
+#define DECOY_NAME "libmono-decoy.so"
+
+// Every MONO_EVERY'th child loads the runtime, and the ones halfway in between load the decoy.
+#define MONO_EVERY 10
+
+#define MIN_WORKERS 4
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Exiting process with code: 0x%08X\n", (unsigned int)win32_error);
+	exit((int)code);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %s\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+typedef struct
+{
+	pid_t* children;
+	size_t count;
+	size_t* found;
+	size_t reported;
+	bool unexpected;
+	
+	// Unordered callbacks come in from every worker.
+	pthread_mutex_t lock;
+	uint32_t last_pid;
+	bool unordered;
+	bool stop;
+} scan_results_t;
+
+static bool library_path(char* buffer, size_t size, const char* name)
+{
+	char* slash;
+	ssize_t length = readlink("/proc/self/exe", buffer, size - 1);
+	CHECK(length > 0);
+	buffer[length] = '\0';
+	slash = strrchr(buffer, '/');
+	CHECK(slash != NULL && (size_t)(slash - buffer) + strlen(name) + 2 < size);
+	strcpy(slash + 1, name);
+	return true;
+}
+
+static void run_child(size_t index, int ready, const char* mono, const char* decoy)
+{
+	const char* library = NULL;
+	if(index % MONO_EVERY == 0)
+		library = mono;
+	else if(index % MONO_EVERY == MONO_EVERY / 2)
+		library = decoy;
+	
+	if(library != NULL && dlopen(library, RTLD_NOW) == NULL)
+		_exit(1);
+	if(write(ready, "r", 1) != 1)
+		_exit(2);
+	for(;;)
+		pause();
+}
+
+static bool CDECL collect_result(unij_monoinfo_t* info, void* parameter)
+{
+	size_t i;
+	scan_results_t* results = (scan_results_t*)parameter;
+	pthread_mutex_lock(&results->lock);
+	results->unordered |= info->pid < results->last_pid;
+	results->last_pid = info->pid;
+	for(i = 0; i < results->count; i++) {
+		if(results->children[i] != (pid_t)info->pid)
+			continue;
+		
+		results->found[i]++;
+		results->unexpected |= wcscmp(info->mono_name, UNIJ_WIDEN(MONO_NAME)) != 0 ||
+		                       wcsstr(info->mono_path, info->mono_name) == NULL ||
+		                       info->exe_path == NULL || info->exe_path[0] != L'/';
+		break;
+	}
+	
+	results->reported++;
+	pthread_mutex_unlock(&results->lock);
+	return results->stop;
+}
+
+static double scan(scan_results_t* results, const unij_enum_options_t* options, bool stop)
+{
+	struct timespec start, end;
+	results->reported = 0;
+	results->last_pid = 0;
+	results->unordered = false;
+	results->unexpected = false;
+	results->stop = stop;
+	RtlZeroMemory((void*)results->found, results->count * sizeof(size_t));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if(options == NULL)
+		unij_enum_mono_processes(collect_result, (void*)results);
+	else
+		unij_enum_mono_processes_ex(collect_result, (void*)results, options);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+static bool test_scan(scan_results_t* results, const unij_enum_options_t* options)
+{
+	size_t i, expected = 0;
+	double elapsed;
+	uint32_t hits, misses;
+	elapsed = scan(results, options, false);
+	
+	for(i = 0; i < results->count; i++) {
+		size_t want = i % MONO_EVERY == 0 ? 1 : 0;
+		if(results->found[i] != want) {
+			wprintf(L"Child %zu (pid %d) was reported %zu times instead of %zu!\n",
+			        i, (int)results->children[i], results->found[i], want);
+			return false;
+		}
+		expected += want;
+	}
+	
+	CHECK(!results->unexpected);
+	
+	// Serial scans come out in pid order too, since that's the order they inspect in.
+	if(options == NULL || (options->flags & UNIJ_ENUM_ORDERED)) {
+		CHECK(!results->unordered);
+	}
+	
+	unij_modcache_stats(&hits, &misses);
+	wprintf(L"Scanned /proc in %.3fms (%ls): %zu Mono processes, %zu of them ours. (module cache: %u hits, %u misses)\n",
+	        elapsed, options == NULL ? L"serial" : (options->flags & UNIJ_ENUM_ORDERED) ? L"ordered" : L"unordered",
+	        results->reported, expected, hits, misses);
+	return true;
+}
+
+// A callback that returns true should be the last one to run, give or take the ones already underway on other workers.
+static bool test_stop(scan_results_t* results, const unij_enum_options_t* options, uint32_t workers)
+{
+	scan(results, options, true);
+	CHECK(results->reported >= 1);
+	if(options->flags & UNIJ_ENUM_ORDERED) {
+		CHECK(results->reported == 1);
+	} else {
+		CHECK(results->reported <= (size_t)workers);
+	}
+	return true;
+}
+
+// At least a few workers, so the stealing gets exercised even on a single core.
+static bool test_parallel(scan_results_t* results)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t workers = cores < MIN_WORKERS ? MIN_WORKERS : (uint32_t)cores;
+	unij_enum_options_t ordered = { workers, UNIJ_ENUM_ORDERED };
+	unij_enum_options_t unordered = { workers, UNIJ_ENUM_DEFAULT };
+	return test_scan(results, &ordered) && test_scan(results, &unordered) &&
+	       test_stop(results, &ordered, workers) && test_stop(results, &unordered, workers);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t i, started = 0;
+	int ready[2];
+	bool result = false;
+	char mono[PATH_MAX], decoy[PATH_MAX], byte;
+	scan_results_t results = { NULL, DEFAULT_CHILDREN, NULL, 0, false, PTHREAD_MUTEX_INITIALIZER };
+	
+	if(argc > 1)
+		results.count = (size_t)strtoull(argv[1], NULL, 10);
+	if(results.count == 0)
+		results.count = 1;
+	
+	if(!unij_init()) return 1;
+	
+	if(!library_path(mono, sizeof(mono), MONO_NAME) || !library_path(decoy, sizeof(decoy), DECOY_NAME) ||
+	   pipe(ready) != 0) {
+		wprintf(L"Couldn't set up the test!\n");
+		return 1;
+	}
+	
+	results.children = (pid_t*)calloc(results.count, sizeof(pid_t));
+	results.found = (size_t*)calloc(results.count, sizeof(size_t));
+	if(results.children == NULL || results.found == NULL) {
+		wprintf(L"Out of memory!\n");
+		return 1;
+	}
+	
+	for(i = 0; i < results.count; i++) {
+		results.children[i] = fork();
+		if(results.children[i] < 0)
+			break;
+		else if(results.children[i] == 0)
+			run_child(i, ready[1], mono, decoy);
+	}
+	
+	close(ready[1]);
+	while(started < i && read(ready[0], &byte, 1) == 1)
+		started++;
+	
+	if(i < results.count || started < results.count)
+		wprintf(L"Only %zu of %zu children started!\n", started, results.count);
+	else
+		result = test_scan(&results, NULL) && test_scan(&results, NULL) && test_parallel(&results);
+	
+	for(i = 0; i < results.count; i++) {
+		if(results.children[i] > 0) {
+			kill(results.children[i], SIGKILL);
+			waitpid(results.children[i], NULL, 0);
+		}
+	}
+	return result ? 0 : 1;
+}
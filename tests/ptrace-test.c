@@ -0,0 +1,296 @@
+/**
+ * @file ptrace-test.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * End-to-end test for the ptrace injector. Re-executes itself as the target: a process with a busy worker thread
+ * whose main thread sits blocked in read(), which is where the injection catches it. The stand-in loader (test-so.c)
+ * reports the handoff it was given back over a pipe, and the target only exits cleanly if its read() came back with
+ * the byte that was actually written, so a botched syscall restart fails the test too. A second target runs on a copy
+ * of libc, so its dlopen has to be resolved from that file rather than from our own, and a second injection into it
+ * should find the result in the module cache.
+ *
+ * Usage: ptrace-test [loader path]
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/handoff.h>
+#include <uniject/modcache.h>
+#include <uniject/ptrace.h>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define TARGET_ARG "--target"
+#define TEST_SO_NAME "test-so.so"
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+// Some of the checks below fail on purpose, so fatal errors only get reported and the failing call returns.
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Fatal error 0x%08X (system error 0x%08X)\n", (unsigned int)code, (unsigned int)win32_error);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %s\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+typedef struct
+{
+	pid_t pid;
+	int control;
+	int report;
+} target_t;
+
+static volatile uint64_t worker_counter = 0;
+
+static void* worker_thread(void* parameter)
+{
+	UNIJ_SUPPRESS_UNUSED(parameter);
+	for(;;)
+		worker_counter++;
+	return NULL;
+}
+
+// The target: tells the test it's ready, then blocks until the test writes its quit byte.
+static int run_target(int control, int report)
+{
+	char byte = 0;
+	ssize_t count;
+	uint64_t before;
+	pthread_t worker;
+	if(pthread_create(&worker, NULL, worker_thread, NULL) != 0)
+		return 2;
+	
+	if(write(report, "ready\n", 6) != 6)
+		return 3;
+	
+	before = worker_counter;
+	count = read(control, &byte, 1);
+	if(count != 1 || byte != 'q')
+		return 4;
+	
+	// The worker kept running through the injection.
+	return worker_counter != before ? 0 : 5;
+}
+
+static bool read_line(int fd, char* buffer, size_t size)
+{
+	size_t used = 0;
+	while(used + 1 < size && read(fd, buffer + used, 1) == 1) {
+		if(buffer[used++] == '\n')
+			break;
+	}
+	buffer[used] = '\0';
+	return used > 0 && buffer[used - 1] == '\n';
+}
+
+static bool start_target(target_t* target, const char* libraries)
+{
+	int control[2], report[2];
+	char line[32], control_fd[16], report_fd[16];
+	CHECK(pipe(control) == 0 && pipe(report) == 0);
+	
+	snprintf(control_fd, sizeof(control_fd), "%d", control[0]);
+	snprintf(report_fd, sizeof(report_fd), "%d", report[1]);
+	setenv("UNIJ_TEST_FD", report_fd, 1);
+	
+	target->pid = fork();
+	CHECK(target->pid >= 0);
+	if(target->pid == 0) {
+		close(control[1]);
+		close(report[0]);
+		if(libraries != NULL)
+			setenv("LD_LIBRARY_PATH", libraries, 1);
+		execl("/proc/self/exe", "ptrace-test", TARGET_ARG, control_fd, report_fd, (char*)NULL);
+		_exit(127);
+	}
+	
+	close(control[0]);
+	close(report[1]);
+	target->control = control[1];
+	target->report = report[0];
+	CHECK(read_line(target->report, line, sizeof(line)) && strcmp(line, "ready\n") == 0);
+	
+	// Give the main thread time to actually block in read().
+	usleep(50000);
+	return true;
+}
+
+static bool stop_target(target_t* target)
+{
+	int status = 0;
+	CHECK(write(target->control, "q", 1) == 1);
+	CHECK(waitpid(target->pid, &status, 0) == target->pid);
+	close(target->control);
+	close(target->report);
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		wprintf(L"Target didn't exit cleanly: status=0x%X\n", (unsigned int)status);
+		return false;
+	}
+	return true;
+}
+
+static bool test_injection(target_t* target, const char* loader)
+{
+	char line[128];
+	unsigned int pid, nonce;
+	int reporter;
+	unij_handoff_t handoff;
+	unij_handoff_init(&handoff, (uint32_t)target->pid);
+	CHECK(unij_ptrace_inject((uint32_t)target->pid, loader, &handoff));
+	
+	CHECK(read_line(target->report, line, sizeof(line)));
+	CHECK(sscanf(line, "%u %u %d", &pid, &nonce, &reporter) == 3);
+	CHECK(pid == handoff.pid && nonce == handoff.nonce && reporter == target->pid);
+	return true;
+}
+
+// Failures inside the target have to come back as errors, and leave the target running.
+static bool test_failures(target_t* target)
+{
+	int fd;
+	char garbage[] = "/tmp/uniject-ptrace-test-XXXXXX";
+	CHECK(!unij_ptrace_inject((uint32_t)target->pid, "relative/loader.so", NULL));
+	CHECK(!unij_ptrace_inject((uint32_t)target->pid, "/nonexistent/loader.so", NULL));
+	
+	// Not an ELF file, so dlopen fails in the target.
+	fd = mkstemp(garbage);
+	CHECK(fd >= 0);
+	CHECK(write(fd, "not a shared object\n", 20) == 20);
+	close(fd);
+	CHECK(!unij_ptrace_inject((uint32_t)target->pid, garbage, NULL));
+	unlink(garbage);
+	return true;
+}
+
+// Copies the libc holding dlopen into a fresh directory, where a target can be pointed at it with LD_LIBRARY_PATH.
+static bool copy_libc(char* directory, char* copy, size_t size)
+{
+	Dl_info info;
+	FILE* in, *out;
+	size_t count;
+	char buffer[0x10000];
+	const char* name;
+	CHECK(dladdr((const void*)(uintptr_t)&dlopen, &info) != 0 && info.dli_fname != NULL);
+	CHECK(mkdtemp(directory) != NULL);
+	
+	name = strrchr(info.dli_fname, '/');
+	name = name == NULL ? info.dli_fname : name + 1;
+	CHECK((size_t)snprintf(copy, size, "%s/%s", directory, name) < size);
+	
+	in = fopen(info.dli_fname, "rb");
+	CHECK(in != NULL);
+	out = fopen(copy, "wb");
+	if(out == NULL) {
+		fclose(in);
+		return false;
+	}
+	
+	while((count = fread(buffer, 1, sizeof(buffer), in)) > 0 && fwrite(buffer, 1, count, out) == count)
+		continue;
+	fclose(in);
+	CHECK(fclose(out) == 0);
+	return true;
+}
+
+static bool test_other_libc(const char* loader)
+{
+	bool result;
+	target_t target;
+	uint32_t hits, misses, cached;
+	char directory[] = "/tmp/uniject-ptrace-libc-XXXXXX", copy[PATH_MAX];
+	CHECK(copy_libc(directory, copy, sizeof(copy)));
+	
+	result = start_target(&target, directory);
+	if(result) {
+		result = test_injection(&target, loader);
+		unij_modcache_stats(&cached, &misses);
+		result = result && test_injection(&target, loader);
+		unij_modcache_stats(&hits, &misses);
+		// dlopen, dlsym, dlerror and syscall all come out of the cache the second time.
+		result = result && hits - cached >= 4 && stop_target(&target);
+		if(!result)
+			kill(target.pid, SIGKILL);
+	}
+	
+	unlink(copy);
+	rmdir(directory);
+	return result;
+}
+
+static bool default_loader_path(char* buffer, size_t size)
+{
+	char* slash;
+	ssize_t length = readlink("/proc/self/exe", buffer, size - 1);
+	CHECK(length > 0);
+	buffer[length] = '\0';
+	slash = strrchr(buffer, '/');
+	CHECK(slash != NULL && (size_t)(slash - buffer) + sizeof(TEST_SO_NAME) + 1 < size);
+	strcpy(slash + 1, TEST_SO_NAME);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	target_t target;
+	char loader[PATH_MAX];
+	
+	if(argc == 4 && strcmp(argv[1], TARGET_ARG) == 0)
+		return run_target(atoi(argv[2]), atoi(argv[3]));
+	
+	if(argc > 1) {
+		if(realpath(argv[1], loader) == NULL) {
+			wprintf(L"Couldn't resolve the loader path: %hs\n", argv[1]);
+			return 1;
+		}
+	} else if(!default_loader_path(loader, sizeof(loader))) {
+		return 1;
+	}
+	
+	if(!unij_init()) return 1;
+	
+	if(!start_target(&target, NULL)) {
+		wprintf(L"Couldn't start the target!\n");
+		return 1;
+	}
+	
+	if(!test_injection(&target, loader)) {
+		wprintf(L"Injection failed!\n");
+		kill(target.pid, SIGKILL);
+		return 1;
+	}
+	wprintf(L"Injection checks passed.\n");
+	
+	if(!test_failures(&target)) {
+		wprintf(L"Failure checks failed!\n");
+		kill(target.pid, SIGKILL);
+		return 1;
+	}
+	wprintf(L"Failure checks passed.\n");
+	
+	// A second injection into the same process works the same as the first.
+	if(!test_injection(&target, loader) || !stop_target(&target)) {
+		wprintf(L"Target didn't survive being injected!\n");
+		return 1;
+	}
+	
+	wprintf(L"Target exited cleanly after injection.\n");
+	
+	if(!test_other_libc(loader)) {
+		wprintf(L"Injection into a target with its own libc failed!\n");
+		return 1;
+	}
+	wprintf(L"Injection into a target with its own libc passed.\n");
+	return 0;
+}
@@ -0,0 +1,215 @@
+/**
+ * @file remote-bench.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Pushes the same buffer through each remote memory method, into and back out of a forked child that's held in a
+ * ptrace stop (so pokes work too), and reports bytes/sec for each. Every round trip is checked byte for byte, and
+ * the automatic fallback gets checked against a read-only page, which process_vm_writev can't write to.
+ *
+ * Usage: remote-bench [total bytes] [span size]
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/remote.h>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+#define DEFAULT_TOTAL 0x1000000
+#define DEFAULT_SPAN 0x1000
+
+// Pokes move a word per syscall, so they get a smaller share of the buffer to keep the run short.
+#define PTRACE_DIVISOR 16
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%ls] %ls\n", unij_level_name(level)->value, message);
+}
+
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Exiting process with code: 0x%08X\n", (unsigned int)win32_error);
+	exit((int)code);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %s\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+typedef struct
+{
+	uint8_t* remote;
+	uint8_t* local;
+	uint8_t* check;
+	uint8_t* readonly;
+	size_t total;
+	size_t span;
+} bench_t;
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void fill_buffer(uint8_t* buffer, size_t size, uint32_t seed)
+{
+	size_t i;
+	for(i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		buffer[i] = (uint8_t)(seed >> 16);
+	}
+}
+
+// Spans deliberately start one byte in, so the unaligned edges of the word-sized methods get exercised.
+static unij_remote_span_t* make_spans(uint8_t* remote, uint8_t* local, size_t total, size_t span, size_t* pcount)
+{
+	size_t i, count = (total - 1 + span - 1) / span;
+	unij_remote_span_t* spans = (unij_remote_span_t*)calloc(count, sizeof(*spans));
+	if(spans == NULL)
+		return NULL;
+	
+	for(i = 0; i < count; i++) {
+		size_t offset = 1 + i * span;
+		spans[i].address = (uintptr_t)(remote + offset);
+		spans[i].data = (void*)(local + offset);
+		spans[i].size = total - offset < span ? total - offset : span;
+	}
+	
+	*pcount = count;
+	return spans;
+}
+
+static void report(const wchar_t* what, unij_remote_method_t method, size_t bytes, double elapsed)
+{
+	wprintf(L"  %-24ls %-6ls %10zu bytes in %8.4fs: %10.1f MB/s\n", unij_remote_method_name(method), what,
+	        bytes, elapsed, (double)bytes / elapsed / (1024.0 * 1024.0));
+}
+
+static bool bench_method(unij_remote_t* R, bench_t* bench, unij_remote_method_t method, uint32_t seed)
+{
+	double elapsed;
+	size_t count = 0;
+	size_t total = method == UNIJ_REMOTE_PTRACE ? bench->total / PTRACE_DIVISOR : bench->total;
+	unij_remote_span_t* spans = make_spans(bench->remote, bench->local, total, bench->span, &count);
+	unij_remote_span_t* reads = make_spans(bench->remote, bench->check, total, bench->span, &count);
+	CHECK(spans != NULL && reads != NULL);
+	
+	unij_remote_set_method(R, method);
+	fill_buffer(bench->local, total, seed);
+	RtlZeroMemory((void*)bench->check, total);
+	
+	elapsed = now_seconds();
+	CHECK(unij_remote_writev(R, spans, count));
+	report(L"write", method, total - 1, now_seconds() - elapsed);
+	
+	elapsed = now_seconds();
+	CHECK(unij_remote_readv(R, reads, count));
+	report(L"read", method, total - 1, now_seconds() - elapsed);
+	
+	CHECK(memcmp((const void*)(bench->local + 1), (const void*)(bench->check + 1), total - 1) == 0);
+	free((void*)spans);
+	free((void*)reads);
+	return true;
+}
+
+// process_vm_writev gets EFAULT on the read-only page, and the next method has to pick the write up.
+static bool test_fallback(unij_remote_t* R, bench_t* bench)
+{
+	uint8_t data[24], check[24];
+	unij_remote_span_t spans[3];
+	fill_buffer(data, sizeof(data), 7);
+	
+	spans[0].address = (uintptr_t)bench->remote;
+	spans[0].data = (void*)data;
+	spans[0].size = 8;
+	spans[1].address = (uintptr_t)(bench->readonly + 13);
+	spans[1].data = (void*)(data + 8);
+	spans[1].size = 0;
+	spans[2].address = (uintptr_t)(bench->readonly + 13);
+	spans[2].data = (void*)(data + 8);
+	spans[2].size = 16;
+	
+	unij_remote_set_method(R, UNIJ_REMOTE_AUTO);
+	CHECK(unij_remote_writev(R, spans, ARRAYLEN(spans)));
+	CHECK(unij_remote_read(R, (uintptr_t)bench->remote, (void*)check, 8));
+	CHECK(unij_remote_read(R, (uintptr_t)(bench->readonly + 13), (void*)(check + 8), 16));
+	CHECK(memcmp((const void*)data, (const void*)check, sizeof(data)) == 0);
+	return true;
+}
+
+static bool stop_child(pid_t child)
+{
+	int status;
+	CHECK(ptrace(PTRACE_SEIZE, child, NULL, NULL) == 0);
+	CHECK(ptrace(PTRACE_INTERRUPT, child, NULL, NULL) == 0);
+	CHECK(waitpid(child, &status, 0) == child && WIFSTOPPED(status));
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	int method;
+	bool result = true;
+	pid_t child;
+	unij_remote_t* R;
+	bench_t bench = { NULL, NULL, NULL, NULL, DEFAULT_TOTAL, DEFAULT_SPAN };
+	
+	if(argc > 1)
+		bench.total = (size_t)strtoull(argv[1], NULL, 10);
+	if(argc > 2)
+		bench.span = (size_t)strtoull(argv[2], NULL, 10);
+	if(bench.total < PTRACE_DIVISOR * 2)
+		bench.total = PTRACE_DIVISOR * 2;
+	if(bench.span == 0)
+		bench.span = 1;
+	
+	if(!unij_init()) return 1;
+	
+	// Mapped before forking, so the child has the same addresses.
+	bench.remote = (uint8_t*)mmap(NULL, bench.total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	bench.readonly = (uint8_t*)mmap(NULL, 0x1000, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	bench.local = (uint8_t*)malloc(bench.total);
+	bench.check = (uint8_t*)malloc(bench.total);
+	if(bench.remote == MAP_FAILED || bench.readonly == MAP_FAILED || bench.local == NULL || bench.check == NULL) {
+		wprintf(L"Couldn't allocate %zu bytes to benchmark with!\n", bench.total);
+		return 1;
+	}
+	
+	child = fork();
+	if(child < 0) {
+		wprintf(L"fork failed!\n");
+		return 1;
+	} else if(child == 0) {
+		for(;;)
+			pause();
+	}
+	
+	if(!stop_child(child) || (R = unij_remote_open((uint32_t)child)) == NULL) {
+		wprintf(L"Couldn't stop the child process!\n");
+		kill(child, SIGKILL);
+		return 1;
+	}
+	
+	wprintf(L"Transferring %zu bytes in spans of %zu bytes:\n", bench.total - 1, bench.span);
+	for(method = UNIJ_REMOTE_VM; result && method < UNIJ_REMOTE_METHODS; method++)
+		result = bench_method(R, &bench, (unij_remote_method_t)method, (uint32_t)method);
+	
+	if(result) {
+		result = test_fallback(R, &bench);
+		wprintf(result ? L"Read-only page was written through the fallback.\n" :
+		                 L"Fallback to a method that can write read-only pages failed!\n");
+	}
+	
+	unij_remote_close(R);
+	kill(child, SIGKILL);
+	waitpid(child, NULL, 0);
+	return result ? 0 : 1;
+}
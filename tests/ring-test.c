@@ -0,0 +1,300 @@
+/**
+ * @file ring-test.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Exercises the SPSC ring on its own first, then streams messages through it from a second consumer (a thread over
+ * a page-file mapping on Windows, a forked child over POSIX shared memory elsewhere) and reports the throughput.
+ *
+ * Usage: ring-test [message count] [message size]
+ */
+#include "pch.h"
+#include <uniject.h>
+#include <uniject/base.h>
+#include <uniject/ring.h>
+
+#ifdef _WIN32
+#	include <uniject/win32.h>
+#else
+#	include <fcntl.h>
+#	include <sched.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/wait.h>
+#endif
+
+#define RING_SIZE 0x10000
+#define DEFAULT_COUNT 1000000
+#define DEFAULT_MESSAGE_SIZE 64
+
+void unij_show_message_impl(unij_level_t level, const wchar_t* message)
+{
+	wprintf(L"[%s] %s\n", unij_level_name(level)->value, message);
+}
+
+void unij_abort_impl(unij_error_t code, uint32_t win32_error)
+{
+	wprintf(L"Exiting process with code: 0x%08X\n", (unsigned int)win32_error);
+	exit((int)code);
+}
+
+#define CHECK(COND) \
+	if(!(COND)) { \
+		wprintf(L"%d: check failed: %s\n", __LINE__, UNIJ_WSTRINGIFY(COND)); \
+		return false; \
+	}
+
+typedef struct
+{
+	void* memory;
+	size_t count;
+	size_t size;
+	bool result;
+} stream_args_t;
+
+static double now_seconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+// Full/empty rings are polled, so give the other side the CPU instead of burning the rest of our time slice.
+static void yield_cpu(void)
+{
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+static void fill_message(uint8_t* buffer, size_t size, uint64_t sequence)
+{
+	size_t i;
+	RtlCopyMemory((void*)buffer, (const void*)&sequence, sizeof(sequence));
+	for(i = sizeof(sequence); i < size; i++)
+		buffer[i] = (uint8_t)(sequence + i);
+}
+
+static bool check_message(const uint8_t* buffer, size_t size, uint64_t sequence)
+{
+	size_t i;
+	uint64_t actual;
+	RtlCopyMemory((void*)&actual, (const void*)buffer, sizeof(actual));
+	if(actual != sequence)
+		return false;
+	for(i = sizeof(sequence); i < size; i++)
+		if(buffer[i] != (uint8_t)(sequence + i))
+			return false;
+	return true;
+}
+
+// Push, peek, release, wrap-around and the full/empty edges, all from a single thread.
+static bool test_basics(void* memory)
+{
+	size_t i, size = 0;
+	size_t pushed = 0, max_message;
+	uint8_t message[200];
+	const uint8_t* peeked;
+	unij_ring_t* P = unij_ring_create(memory, unij_ring_footprint(0x100));
+	unij_ring_t* C = unij_ring_attach(memory, unij_ring_footprint(0x100));
+	CHECK(P != NULL && C != NULL);
+	CHECK(unij_ring_empty(C));
+	CHECK(unij_ring_peek(C, &size) == NULL);
+	
+	max_message = unij_ring_max_message(P);
+	CHECK(max_message == 0x80 - 8);
+	
+	// Fill it up until it refuses, then drain it.
+	while(unij_ring_push(P, (fill_message(message, 24, pushed), message), 24))
+		pushed++;
+	CHECK(pushed == 0x100 / 32);
+	for(i = 0; i < pushed; i++) {
+		peeked = (const uint8_t*)unij_ring_peek(C, &size);
+		CHECK(peeked != NULL && size == 24 && check_message(peeked, size, i));
+		unij_ring_release(C);
+	}
+	CHECK(unij_ring_peek(C, &size) == NULL);
+	CHECK(unij_ring_empty(P));
+	
+	// Odd sizes force the wrap record to show up at different offsets.
+	for(i = 0; i < 1000; i++) {
+		size_t length = 8 + (i * 7) % (max_message - 8);
+		fill_message(message, length, i);
+		CHECK(unij_ring_push(P, message, length));
+		peeked = (const uint8_t*)unij_ring_peek(C, &size);
+		CHECK(peeked != NULL && size == length && check_message(peeked, size, i));
+		unij_ring_release(C);
+	}
+	
+	// Publishing less than was reserved.
+	peeked = (const uint8_t*)unij_ring_reserve(P, max_message);
+	CHECK(peeked != NULL);
+	fill_message((uint8_t*)peeked, 16, 42);
+	CHECK(unij_ring_publish(P, 16));
+	peeked = (const uint8_t*)unij_ring_peek(C, &size);
+	CHECK(peeked != NULL && size == 16 && check_message(peeked, size, 42));
+	unij_ring_release(C);
+	CHECK(unij_ring_empty(C));
+	
+	unij_ring_destroy(C);
+	unij_ring_destroy(P);
+	return true;
+}
+
+static bool consume_stream(stream_args_t* args)
+{
+	size_t size;
+	uint64_t sequence = 0;
+	const uint8_t* message;
+	unij_ring_t* C = unij_ring_attach(args->memory, RING_SIZE);
+	if(C == NULL)
+		return false;
+	
+	while(sequence < args->count) {
+		message = (const uint8_t*)unij_ring_peek(C, &size);
+		if(message == NULL) {
+			yield_cpu();
+			continue;
+		}
+		if(size != args->size || !check_message(message, size, sequence)) {
+			wprintf(L"Message %llu came through corrupted!\n", (unsigned long long)sequence);
+			unij_ring_destroy(C);
+			return false;
+		}
+		unij_ring_release(C);
+		sequence++;
+	}
+	
+	unij_ring_destroy(C);
+	return true;
+}
+
+static bool produce_stream(stream_args_t* args, unij_ring_t* P)
+{
+	uint64_t sequence;
+	uint8_t* message;
+	for(sequence = 0; sequence < args->count; sequence++) {
+		while((message = (uint8_t*)unij_ring_reserve(P, args->size)) == NULL)
+			yield_cpu();
+		fill_message(message, args->size, sequence);
+		if(!unij_ring_publish(P, args->size))
+			return false;
+	}
+	
+	while(!unij_ring_empty(P))
+		yield_cpu();
+	return true;
+}
+
+#ifdef _WIN32
+
+static DWORD WINAPI consumer_thread(LPVOID parameter)
+{
+	stream_args_t* args = (stream_args_t*)parameter;
+	args->result = consume_stream(args);
+	return 0;
+}
+
+static bool test_stream(stream_args_t* args)
+{
+	bool result;
+	HANDLE thread;
+	unij_ring_t* P;
+	HANDLE mapping = unij_create_mmap(L"Local\\uniject-ring-test", RING_SIZE);
+	CHECK(IS_VALID_HANDLE(mapping));
+	args->memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, RING_SIZE);
+	CHECK(args->memory != NULL);
+	P = unij_ring_create(args->memory, RING_SIZE);
+	CHECK(P != NULL);
+	
+	thread = CreateThread(NULL, 0, consumer_thread, (LPVOID)args, 0, NULL);
+	CHECK(thread != NULL);
+	result = produce_stream(args, P);
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+	
+	unij_ring_destroy(P);
+	UnmapViewOfFile(args->memory);
+	CloseHandle(mapping);
+	return result && args->result;
+}
+
+#else
+
+static bool test_stream(stream_args_t* args)
+{
+	int fd, status = 0;
+	pid_t child;
+	bool result;
+	unij_ring_t* P;
+	char name[64];
+	
+	snprintf(name, sizeof(name), "/uniject-ring-test-%d", (int)getpid());
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	CHECK(fd >= 0);
+	shm_unlink(name);
+	CHECK(ftruncate(fd, RING_SIZE) == 0);
+	args->memory = mmap(NULL, RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	CHECK(args->memory != MAP_FAILED);
+	P = unij_ring_create(args->memory, RING_SIZE);
+	CHECK(P != NULL);
+	
+	child = fork();
+	CHECK(child >= 0);
+	if(child == 0)
+		_exit(consume_stream(args) ? 0 : 1);
+	
+	result = produce_stream(args, P);
+	CHECK(waitpid(child, &status, 0) == child);
+	
+	unij_ring_destroy(P);
+	munmap(args->memory, RING_SIZE);
+	return result && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+#endif
+
+int main(int argc, char* argv[])
+{
+	double elapsed;
+	stream_args_t args = { NULL, DEFAULT_COUNT, DEFAULT_MESSAGE_SIZE, false };
+	static uint64_t basics_memory[0x200 / sizeof(uint64_t)];
+	
+	if(argc > 1)
+		args.count = (size_t)strtoull(argv[1], NULL, 10);
+	if(argc > 2)
+		args.size = (size_t)strtoull(argv[2], NULL, 10);
+	if(args.size < sizeof(uint64_t))
+		args.size = sizeof(uint64_t);
+	
+	if(!unij_init()) return 1;
+	
+	if(!test_basics((void*)basics_memory)) {
+		wprintf(L"Single-threaded ring checks failed!\n");
+		return 1;
+	}
+	wprintf(L"Single-threaded ring checks passed.\n");
+	
+	elapsed = now_seconds();
+	if(!test_stream(&args)) {
+		wprintf(L"Streaming through the shared ring failed!\n");
+		return 1;
+	}
+	elapsed = now_seconds() - elapsed;
+	
+	wprintf(L"Streamed %zu messages of %zu bytes in %.3fs: %.2f M msg/s, %.1f MB/s\n",
+	        args.count, args.size, elapsed,
+	        (double)args.count / elapsed / 1e6,
+	        (double)(args.count * args.size) / elapsed / (1024.0 * 1024.0));
+	
+	return 0;
+}
@@ -0,0 +1,30 @@
+/**
+ * @file test-so.c
+ * @author Charles Grunwald <ch@rles.rocks>
+ *
+ * Stand-in for the Linux loader, injected by ptrace-test. Reports the handoff block it gets back to the test over the
+ * file descriptor named by UNIJ_TEST_FD.
+ */
+#include <uniject/ptrace.h>
+#include <unistd.h>
+
+static int constructed = 0;
+
+__attribute__((constructor))
+static void test_so_init(void)
+{
+	constructed = 1;
+}
+
+__attribute__((visibility("default")))
+int unij_loader_entry(const unij_handoff_t* handoff)
+{
+	int length;
+	char line[128];
+	const char* fd = getenv("UNIJ_TEST_FD");
+	if(!constructed || fd == NULL || handoff == NULL || handoff->magic != UNIJ_HANDOFF_MAGIC)
+		return 0;
+	
+	length = snprintf(line, sizeof(line), "%u %u %d\n", handoff->pid, handoff->nonce, (int)getpid());
+	return write(atoi(fd), line, (size_t)length) == (ssize_t)length;
+}